@@ -20,11 +20,15 @@
 #include "oc_blockwise.h"
 #include "oc_endpoint.h"
 #include "port/oc_log.h"
+#include "util/oc_hash.h"
 #include "util/oc_list.h"
 #include "util/oc_memb.h"
 #ifdef OC_DYNAMIC_ALLOCATION
 #include "util/oc_mem.h"
 #endif
+#ifdef OC_TCP
+#include "messaging/coap/coap_signal.h"
+#endif /* OC_TCP */
 
 OC_MEMB(oc_blockwise_request_states_s, oc_blockwise_request_state_t,
         OC_MAX_NUM_CONCURRENT_REQUESTS);
@@ -32,6 +36,11 @@ OC_MEMB(oc_blockwise_response_states_s, oc_blockwise_response_state_t,
         OC_MAX_NUM_CONCURRENT_REQUESTS);
 OC_LIST(oc_blockwise_requests);
 OC_LIST(oc_blockwise_responses);
+#ifdef OC_CLIENT
+/* Indexes of the client-role buffers by the MID of their last block */
+OC_HASH(oc_blockwise_requests_by_mid, 16);
+OC_HASH(oc_blockwise_responses_by_mid, 16);
+#endif /* OC_CLIENT */
 
 static oc_blockwise_state_t *
 oc_blockwise_init_buffer(struct oc_memb *pool, const char *href, int href_len,
@@ -70,6 +79,9 @@ oc_blockwise_init_buffer(struct oc_memb *pool, const char *href, int href_len,
 
 static void
 oc_blockwise_free_buffer(oc_list_t list, struct oc_memb *pool,
+#ifdef OC_CLIENT
+                         struct oc_hash *mids,
+#endif /* OC_CLIENT */
                          oc_blockwise_state_t *buffer)
 {
 
@@ -82,6 +94,9 @@ oc_blockwise_free_buffer(oc_list_t list, struct oc_memb *pool,
     oc_free_string(&buffer->uri_query);
   oc_free_string(&buffer->href);
   oc_list_remove(list, buffer);
+#ifdef OC_CLIENT
+  oc_hash_remove(mids, &buffer->mid_link);
+#endif /* OC_CLIENT */
 #ifdef OC_DYNAMIC_ALLOCATION
   oc_mem_free(buffer->buffer);
   buffer->buffer = NULL;
@@ -93,7 +108,11 @@ static oc_event_callback_retval_t
 oc_blockwise_request_timeout(void *data)
 {
   oc_blockwise_free_buffer(oc_blockwise_requests,
-                           &oc_blockwise_request_states_s, data);
+                           &oc_blockwise_request_states_s,
+#ifdef OC_CLIENT
+                           &oc_blockwise_requests_by_mid,
+#endif /* OC_CLIENT */
+                           data);
   return OC_EVENT_DONE;
 }
 
@@ -101,7 +120,11 @@ static oc_event_callback_retval_t
 oc_blockwise_response_timeout(void *data)
 {
   oc_blockwise_free_buffer(oc_blockwise_responses,
-                           &oc_blockwise_response_states_s, data);
+                           &oc_blockwise_response_states_s,
+#ifdef OC_CLIENT
+                           &oc_blockwise_responses_by_mid,
+#endif /* OC_CLIENT */
+                           data);
   return OC_EVENT_DONE;
 }
 
@@ -209,27 +232,44 @@ oc_blockwise_scrub_buffers()
 
 #ifdef OC_CLIENT
 static oc_blockwise_state_t *
-oc_blockwise_find_buffer_by_mid(oc_list_t list, uint16_t mid)
+oc_blockwise_find_buffer_by_mid(struct oc_hash *mids, uint16_t mid)
 {
-  oc_blockwise_state_t *buffer = oc_list_head(list);
-  while (buffer) {
-    if (buffer->mid == mid && buffer->role == OC_BLOCKWISE_CLIENT)
-      break;
-    buffer = buffer->next;
+  oc_hash_link_t *link = oc_hash_lookup(mids, mid);
+  while (link) {
+    oc_blockwise_state_t *buffer =
+      oc_hash_entry(link, oc_blockwise_state_t, mid_link);
+    if (buffer->role == OC_BLOCKWISE_CLIENT)
+      return buffer;
+    link = oc_hash_next(link);
   }
-  return buffer;
+  return NULL;
 }
 
 oc_blockwise_state_t *
 oc_blockwise_find_request_buffer_by_mid(uint16_t mid)
 {
-  return oc_blockwise_find_buffer_by_mid(oc_blockwise_requests, mid);
+  return oc_blockwise_find_buffer_by_mid(&oc_blockwise_requests_by_mid, mid);
 }
 
 oc_blockwise_state_t *
 oc_blockwise_find_response_buffer_by_mid(uint16_t mid)
 {
-  return oc_blockwise_find_buffer_by_mid(oc_blockwise_responses, mid);
+  return oc_blockwise_find_buffer_by_mid(&oc_blockwise_responses_by_mid, mid);
+}
+
+void
+oc_blockwise_set_request_buffer_mid(oc_blockwise_state_t *buffer, uint16_t mid)
+{
+  buffer->mid = mid;
+  oc_hash_rekey(&oc_blockwise_requests_by_mid, &buffer->mid_link, mid);
+}
+
+void
+oc_blockwise_set_response_buffer_mid(oc_blockwise_state_t *buffer,
+                                     uint16_t mid)
+{
+  buffer->mid = mid;
+  oc_hash_rekey(&oc_blockwise_responses_by_mid, &buffer->mid_link, mid);
 }
 
 static oc_blockwise_state_t *
@@ -310,18 +350,40 @@ oc_blockwise_dispatch_block(oc_blockwise_state_t *buffer, uint32_t block_offset,
                             uint32_t *payload_size)
 {
   if (block_offset < buffer->payload_size) {
-    if (buffer->payload_size < requested_block_size)
-      *payload_size = (uint32_t)buffer->payload_size;
-    else {
-      *payload_size = MIN(requested_block_size,
-                          (uint32_t)(buffer->payload_size - block_offset));
-    }
+    *payload_size = MIN(requested_block_size,
+                        (uint32_t)(buffer->payload_size - block_offset));
     buffer->next_block_offset = block_offset + *payload_size;
     return (const void *)&buffer->buffer[block_offset];
   }
   return NULL;
 }
 
+#ifdef OC_TCP
+uint32_t
+oc_blockwise_tcp_block_size(oc_blockwise_state_t *buffer, bool block,
+                            bool bert, uint16_t *block_size, uint8_t *use_bert)
+{
+  uint32_t max_payload_size = coap_signal_max_payload_size(&buffer->endpoint);
+
+  *use_bert = 0;
+  if (!block && buffer->payload_size <= max_payload_size) {
+    return buffer->payload_size;
+  }
+  if (!block || bert) {
+    uint32_t bert_size = coap_signal_bert_payload_size(&buffer->endpoint);
+    if (bert_size > 0) {
+      *use_bert = 1;
+      *block_size = COAP_BERT_BLOCK_SIZE;
+      return bert_size;
+    }
+  }
+  while (*block_size > 16 && *block_size > max_payload_size) {
+    *block_size >>= 1;
+  }
+  return *block_size;
+}
+#endif /* OC_TCP */
+
 bool
 oc_blockwise_handle_block(oc_blockwise_state_t *buffer,
                           uint32_t incoming_block_offset,
@@ -20,6 +20,7 @@
 #include "util/oc_memb.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #ifdef OC_DYNAMIC_ALLOCATION
 #include "util/oc_mem.h"
 #endif /* OC_DYNAMIC_ALLOCATION */
@@ -31,40 +32,220 @@
 #include "config.h"
 #include "oc_buffer.h"
 #include "oc_events.h"
+#if defined(OC_MESSAGE_CACHE_SIZE) || defined(OC_SEND_BATCH_SIZE)
+#include "util/oc_etimer.h"
+#endif /* OC_MESSAGE_CACHE_SIZE || OC_SEND_BATCH_SIZE */
 
 OC_PROCESS(message_buffer_handler, "OC Message Buffer Handler");
 OC_MEMB(oc_incoming_buffers, oc_message_t, OC_MAX_NUM_CONCURRENT_REQUESTS);
 OC_MEMB(oc_outgoing_buffers, oc_message_t, OC_MAX_NUM_CONCURRENT_REQUESTS);
 
+#ifdef OC_SEND_BATCH_SIZE
+/* Most messages the outbound queue may hold. Messages sent while it is full
+ * are dropped, as they are when the buffer handler's event queue is full.
+ */
+#ifndef OC_SEND_QUEUE_LEN
+#define OC_SEND_QUEUE_LEN (4 * OC_SEND_BATCH_SIZE)
+#endif /* !OC_SEND_QUEUE_LEN */
+
+/* Ticks to wait before offering messages the port deferred to it again */
+#define OC_SEND_RETRY_TICKS                                                    \
+  ((OC_CLOCK_SECOND / 100) > 0 ? (OC_CLOCK_SECOND / 100) : 1)
+
+/* Outbound messages queued since the buffer handler last ran. They are
+ * drained together so that unicast messages reach the port in batches.
+ */
+static oc_message_t *outgoing_head, *outgoing_tail;
+static int outgoing_len;
+static struct oc_etimer send_retry_timer;
+#endif /* OC_SEND_BATCH_SIZE */
+
+#ifdef OC_MESSAGE_CACHE_SIZE
+#ifndef OC_MESSAGE_CACHE_IDLE_TIMEOUT
+#define OC_MESSAGE_CACHE_IDLE_TIMEOUT (10)
+#endif /* !OC_MESSAGE_CACHE_IDLE_TIMEOUT */
+
+/* Released messages are kept here along with their PDU buffers, up to
+ * OC_MESSAGE_CACHE_SIZE of them, so that steady traffic reuses them instead
+ * of going to the heap. The cache is emptied when it stays unused for
+ * OC_MESSAGE_CACHE_IDLE_TIMEOUT seconds, and when the PDU size changes.
+ * It is protected by the network event handler mutex.
+ */
+static oc_message_t *message_cache;
+static int message_cache_len;
+static bool message_cache_used;
+/* Cleared while the stack shuts down so that released messages are freed */
+static bool message_cache_enabled;
+static struct oc_etimer message_cache_timer;
+
+static void
+free_message_memory(oc_message_t *message)
+{
+  oc_mem_free(message->data);
+  oc_memb_free(message->pool, message);
+}
+
+/* Must be called with the network event handler mutex held */
 static oc_message_t *
-allocate_message(struct oc_memb *pool)
+get_cached_message(struct oc_memb *pool)
+{
+  /* Only descriptors of unbounded pools are interchangeable */
+  if (pool->num > 0) {
+    return NULL;
+  }
+  while (message_cache) {
+    oc_message_t *message = message_cache;
+    message_cache = message->next;
+    message_cache_len--;
+    if (message->data_size == (size_t)OC_PDU_SIZE) {
+      message_cache_used = true;
+      message->pool = pool;
+      return message;
+    }
+    /* The MTU changed since this buffer was allocated */
+    free_message_memory(message);
+  }
+  return NULL;
+}
+
+/* Must be called with the network event handler mutex held */
+static bool
+cache_message(oc_message_t *message)
+{
+  if (!message_cache_enabled || message->pool->num > 0 ||
+      message_cache_len >= OC_MESSAGE_CACHE_SIZE ||
+      message->data_size != (size_t)OC_PDU_SIZE) {
+    return false;
+  }
+  message->next = message_cache;
+  message_cache = message;
+  message_cache_len++;
+  return true;
+}
+
+static void
+trim_message_cache(void)
 {
   oc_network_event_handler_mutex_lock();
-  oc_message_t *message = (oc_message_t *)oc_memb_alloc(pool);
+  oc_message_t *message = message_cache;
+  message_cache = NULL;
+  message_cache_len = 0;
   oc_network_event_handler_mutex_unlock();
-  if (message) {
+
+  while (message) {
+    oc_message_t *next = message->next;
+    free_message_memory(message);
+    message = next;
+  }
+  OC_DBG("buffer: trimmed message cache");
+}
+
+static void
+check_message_cache(void)
+{
+  if (!oc_etimer_expired(&message_cache_timer)) {
+    return;
+  }
+  /* Network threads fill and drain the cache concurrently */
+  oc_network_event_handler_mutex_lock();
+  bool cache_enabled = message_cache_enabled;
+  int cache_len = message_cache_len;
+  bool cache_used = message_cache_used;
+  message_cache_used = false;
+  oc_network_event_handler_mutex_unlock();
+
+  /* oc_buffer_shutdown() stopped the timer for good */
+  if (!cache_enabled) {
+    return;
+  }
+  /* Checked once per idle period, whatever the cache holds now */
+  oc_etimer_set(&message_cache_timer,
+                OC_MESSAGE_CACHE_IDLE_TIMEOUT * OC_CLOCK_SECOND);
+  if (cache_len > 0 && !cache_used) {
+    trim_message_cache();
+  }
+}
+#endif /* OC_MESSAGE_CACHE_SIZE */
+
+static bool
+init_message(struct oc_memb *pool, oc_message_t *message)
+{
 #ifdef OC_DYNAMIC_ALLOCATION
-    message->data = oc_mem_malloc(OC_PDU_SIZE);
+  /* Blocks fresh from the pool are zeroed; cached ones keep their buffer */
+  if (!message->data) {
+    message->data_size = (size_t)OC_PDU_SIZE;
+    message->data = oc_mem_malloc(message->data_size);
     if (!message->data) {
-      oc_memb_free(pool, message);
-      return NULL;
+      return false;
     }
+  }
 #endif /* OC_DYNAMIC_ALLOCATION */
-    message->pool = pool;
-    message->length = 0;
-    message->next = 0;
-    message->ref_count = 1;
-    message->endpoint.interface_index = -1;
-#ifndef OC_DYNAMIC_ALLOCATION
-    OC_DBG("buffer: Allocated TX/RX buffer; num free: %d",
-           oc_memb_numfree(pool));
-#endif /* !OC_DYNAMIC_ALLOCATION */
+  message->pool = pool;
+  message->length = 0;
+  message->next = 0;
+  message->ref_count = 1;
+  memset(&message->endpoint, 0, sizeof(oc_endpoint_t));
+  message->endpoint.interface_index = -1;
+#ifdef OC_TCP
+  message->read_offset = 0;
+  message->close_session = false;
+#endif /* OC_TCP */
+  return true;
+}
+
+/* Takes up to num_messages messages from pool while holding the network
+ * event handler mutex once, so that a network thread receiving a batch of
+ * packets does not contend for it once per packet. Returns the number of
+ * messages taken.
+ */
+static int
+allocate_messages(struct oc_memb *pool, oc_message_t **messages,
+                  int num_messages)
+{
+  int i, num_taken = 0, num_ready = 0;
+
+  oc_network_event_handler_mutex_lock();
+  while (num_taken < num_messages) {
+    oc_message_t *message = NULL;
+#ifdef OC_MESSAGE_CACHE_SIZE
+    message = get_cached_message(pool);
+#endif /* OC_MESSAGE_CACHE_SIZE */
+    if (!message) {
+      message = (oc_message_t *)oc_memb_alloc(pool);
+      if (!message) {
+        break;
+      }
+    }
+    messages[num_taken++] = message;
+  }
+  oc_network_event_handler_mutex_unlock();
+
+  for (i = 0; i < num_taken; i++) {
+    if (!init_message(pool, messages[i])) {
+      oc_network_event_handler_mutex_lock();
+      oc_memb_free(pool, messages[i]);
+      oc_network_event_handler_mutex_unlock();
+      continue;
+    }
+    messages[num_ready++] = messages[i];
   }
+
 #ifndef OC_DYNAMIC_ALLOCATION
-  else {
+  if (num_ready < num_messages) {
     OC_WRN("buffer: No free TX/RX buffers!");
+  } else {
+    OC_DBG("buffer: Allocated %d TX/RX buffers; num free: %d", num_ready,
+           oc_memb_numfree(pool));
   }
 #endif /* !OC_DYNAMIC_ALLOCATION */
+  return num_ready;
+}
+
+static oc_message_t *
+allocate_message(struct oc_memb *pool)
+{
+  oc_message_t *message = NULL;
+  allocate_messages(pool, &message, 1);
   return message;
 }
 
@@ -89,6 +270,12 @@ oc_allocate_message(void)
   return allocate_message(&oc_incoming_buffers);
 }
 
+int
+oc_allocate_messages(oc_message_t **messages, int num_messages)
+{
+  return allocate_messages(&oc_incoming_buffers, messages, num_messages);
+}
+
 oc_message_t *
 oc_internal_allocate_outgoing_message(void)
 {
@@ -106,13 +293,30 @@ void
 oc_message_unref(oc_message_t *message)
 {
   if (message) {
-    message->ref_count--;
-    if (message->ref_count <= 0) {
+    /* A message whose send already dropped the last reference is freed
+     * here rather than wrapping ref_count around */
+    if (message->ref_count > 0) {
+      message->ref_count--;
+    }
+    if (message->ref_count == 0) {
+      struct oc_memb *pool = message->pool;
+#ifdef OC_MESSAGE_CACHE_SIZE
+      oc_network_event_handler_mutex_lock();
+      bool cached = cache_message(message);
+      oc_network_event_handler_mutex_unlock();
+      if (cached) {
+        if (pool->buffers_avail_cb) {
+          pool->buffers_avail_cb(oc_memb_numfree(pool));
+        }
+        return;
+      }
+#endif /* OC_MESSAGE_CACHE_SIZE */
 #ifdef OC_DYNAMIC_ALLOCATION
       oc_mem_free(message->data);
 #endif /* OC_DYNAMIC_ALLOCATION */
-      struct oc_memb *pool = message->pool;
+      oc_network_event_handler_mutex_lock();
       oc_memb_free(pool, message);
+      oc_network_event_handler_mutex_unlock();
 #ifndef OC_DYNAMIC_ALLOCATION
       OC_DBG("buffer: freed TX/RX buffer; num free: %d", oc_memb_numfree(pool));
 #endif /* !OC_DYNAMIC_ALLOCATION */
@@ -128,23 +332,200 @@ oc_recv_message(oc_message_t *message)
     oc_message_unref(message);
 }
 
+void
+oc_buffer_shutdown(void)
+{
+#ifdef OC_MESSAGE_CACHE_SIZE
+  oc_network_event_handler_mutex_lock();
+  message_cache_enabled = false;
+  oc_network_event_handler_mutex_unlock();
+  oc_etimer_stop(&message_cache_timer);
+  trim_message_cache();
+#endif /* OC_MESSAGE_CACHE_SIZE */
+}
+
 void
 oc_send_message(oc_message_t *message)
 {
+#ifdef OC_SEND_BATCH_SIZE
+  if (outgoing_len >= OC_SEND_QUEUE_LEN) {
+    OC_WRN("outbound queue is full; dropping message");
+    message->ref_count--;
+    return;
+  }
+  message->next = NULL;
+  if (outgoing_tail) {
+    outgoing_tail->next = message;
+  } else {
+    outgoing_head = message;
+  }
+  outgoing_tail = message;
+  outgoing_len++;
+  oc_process_poll(&message_buffer_handler);
+#else  /* OC_SEND_BATCH_SIZE */
   if (oc_process_post(&message_buffer_handler,
                       oc_events[OUTBOUND_NETWORK_EVENT],
                       message) == OC_PROCESS_ERR_FULL)
     message->ref_count--;
+#endif /* !OC_SEND_BATCH_SIZE */
 
   _oc_signal_event_loop();
 }
 
+static void
+handle_outbound_message(oc_message_t *message)
+{
+#ifndef ST_APP_OPTIMIZATION
+#ifdef OC_CLIENT
+  if (message->endpoint.flags & DISCOVERY) {
+    OC_DBG("Outbound network event: multicast request");
+    oc_send_discovery_request(message);
+    oc_message_unref(message);
+  } else
+#endif /* OC_CLIENT */
+#endif/*.ST_APP_OPTIMIZATION */
+#ifdef OC_SECURITY
+      if (message->endpoint.flags & SECURED) {
+    OC_DBG("Outbound network event: forwarding to TLS");
+
+#ifdef OC_CLIENT
+    if (!oc_tls_connected(&message->endpoint)) {
+      OC_DBG("Posting INIT_TLS_CONN_EVENT");
+      oc_process_post(&oc_tls_handler, oc_events[INIT_TLS_CONN_EVENT],
+                      message);
+    } else
+#endif /* OC_CLIENT */
+    {
+      OC_DBG("Posting RI_TO_TLS_EVENT");
+      oc_process_post(&oc_tls_handler, oc_events[RI_TO_TLS_EVENT], message);
+    }
+  } else
+#endif /* OC_SECURITY */
+  {
+    OC_DBG("Outbound network event: unicast message");
+#ifdef OC_TCP
+    if (oc_send_buffer(message) < 0 && (message->endpoint.flags & TCP)) {
+      coap_tcp_send_failed(message);
+    }
+    if (message->close_session) {
+      oc_connectivity_end_session(&message->endpoint);
+    }
+#else  /* OC_TCP */
+    oc_send_buffer(message);
+#endif /* !OC_TCP */
+    oc_message_unref(message);
+  }
+}
+
+#ifdef OC_SEND_BATCH_SIZE
+static void
+requeue_message(oc_message_t *message)
+{
+  message->next = outgoing_head;
+  outgoing_head = message;
+  if (!outgoing_tail) {
+    outgoing_tail = message;
+  }
+  outgoing_len++;
+}
+
+/* Returns false if the port deferred part of the batch because the network
+ * would block. Those messages go back to the front of the outbound queue.
+ */
+static bool
+send_batch(oc_message_t **batch, int *num_messages)
+{
+  int i, num_done, num_sent = *num_messages;
+  if (num_sent == 0) {
+    return true;
+  }
+  OC_DBG("Outbound network event: batch of %d unicast messages", num_sent);
+  num_done = oc_send_buffers(batch, num_sent);
+  for (i = 0; i < num_done; i++) {
+    oc_message_unref(batch[i]);
+  }
+  for (i = num_sent - 1; i >= num_done; i--) {
+    requeue_message(batch[i]);
+  }
+  *num_messages = 0;
+  return (num_done == num_sent);
+}
+
+static void
+flush_outgoing_messages(void)
+{
+  oc_message_t *batch[OC_SEND_BATCH_SIZE];
+  int num_messages = 0;
+  bool blocked = false;
+
+  while (outgoing_head && !blocked) {
+    oc_message_t *message = outgoing_head;
+#ifdef OC_TCP
+    /* TCP messages are not batched so that a refused one can be reported */
+    bool unbatched =
+      (message->endpoint.flags & (DISCOVERY | SECURED | TCP)) != 0;
+#else  /* OC_TCP */
+    bool unbatched = (message->endpoint.flags & (DISCOVERY | SECURED)) != 0;
+#endif /* !OC_TCP */
+    if (unbatched && !send_batch(batch, &num_messages)) {
+      /* Keep the order of messages leaving the stack */
+      blocked = true;
+      break;
+    }
+
+    outgoing_head = message->next;
+    if (!outgoing_head) {
+      outgoing_tail = NULL;
+    }
+    outgoing_len--;
+    message->next = NULL;
+
+    if (unbatched) {
+      handle_outbound_message(message);
+      continue;
+    }
+
+    batch[num_messages++] = message;
+    if (num_messages == OC_SEND_BATCH_SIZE) {
+      blocked = !send_batch(batch, &num_messages);
+    }
+  }
+  if (!send_batch(batch, &num_messages)) {
+    blocked = true;
+  }
+
+  if (blocked) {
+    OC_DBG("Outbound network event: %d messages deferred", outgoing_len);
+    oc_etimer_set(&send_retry_timer, OC_SEND_RETRY_TICKS);
+  }
+}
+#endif /* OC_SEND_BATCH_SIZE */
+
 OC_PROCESS_THREAD(message_buffer_handler, ev, data)
 {
+#ifdef OC_SEND_BATCH_SIZE
+  OC_PROCESS_POLLHANDLER(flush_outgoing_messages());
+#endif /* OC_SEND_BATCH_SIZE */
+#ifdef OC_MESSAGE_CACHE_SIZE
+  OC_PROCESS_EXITHANDLER(trim_message_cache());
+#endif /* OC_MESSAGE_CACHE_SIZE */
   OC_PROCESS_BEGIN();
   OC_DBG("Started buffer handler process");
+#ifdef OC_MESSAGE_CACHE_SIZE
+  oc_network_event_handler_mutex_lock();
+  message_cache_enabled = true;
+  oc_network_event_handler_mutex_unlock();
+  oc_etimer_set(&message_cache_timer,
+                OC_MESSAGE_CACHE_IDLE_TIMEOUT * OC_CLOCK_SECOND);
+#endif /* OC_MESSAGE_CACHE_SIZE */
   while (1) {
     OC_PROCESS_YIELD();
+#ifdef OC_MESSAGE_CACHE_SIZE
+    /* An exiting handler must not re-arm the timer its exit released */
+    if (ev != OC_PROCESS_EVENT_EXIT) {
+      check_message_cache();
+    }
+#endif /* OC_MESSAGE_CACHE_SIZE */
 
     if (ev == oc_events[INBOUND_NETWORK_EVENT]) {
 #ifdef OC_SECURITY
@@ -161,39 +542,13 @@ OC_PROCESS_THREAD(message_buffer_handler, ev, data)
       oc_process_post(&coap_engine, oc_events[INBOUND_RI_EVENT], data);
 #endif /* !OC_SECURITY */
     } else if (ev == oc_events[OUTBOUND_NETWORK_EVENT]) {
-      oc_message_t *message = (oc_message_t *)data;
-#ifndef ST_APP_OPTIMIZATION
-#ifdef OC_CLIENT
-      if (message->endpoint.flags & DISCOVERY) {
-        OC_DBG("Outbound network event: multicast request");
-        oc_send_discovery_request(message);
-        oc_message_unref(message);
-      } else
-#endif /* OC_CLIENT */
-#endif/*.ST_APP_OPTIMIZATION */
-#ifdef OC_SECURITY
-          if (message->endpoint.flags & SECURED) {
-        OC_DBG("Outbound network event: forwarding to TLS");
-
-#ifdef OC_CLIENT
-        if (!oc_tls_connected(&message->endpoint)) {
-          OC_DBG("Posting INIT_TLS_CONN_EVENT");
-          oc_process_post(&oc_tls_handler, oc_events[INIT_TLS_CONN_EVENT],
-                          data);
-        } else
-#endif /* OC_CLIENT */
-        {
-          OC_DBG("Posting RI_TO_TLS_EVENT");
-          oc_process_post(&oc_tls_handler, oc_events[RI_TO_TLS_EVENT], data);
-        }
-      } else
-#endif /* OC_SECURITY */
-      {
-        OC_DBG("Outbound network event: unicast message");
-        oc_send_buffer(message);
-        oc_message_unref(message);
-      }
+      handle_outbound_message((oc_message_t *)data);
+    }
+#ifdef OC_SEND_BATCH_SIZE
+    else if (ev == OC_PROCESS_EVENT_TIMER && data == &send_retry_timer) {
+      flush_outgoing_messages();
     }
+#endif /* OC_SEND_BATCH_SIZE */
   }
   OC_PROCESS_END();
 }
@@ -15,52 +15,333 @@
 */
 
 #include "messaging/coap/coap.h"
+#ifdef OC_TCP
+#include "messaging/coap/coap_signal.h"
+#endif /* OC_TCP */
+#include "messaging/coap/rtt.h"
 #include "messaging/coap/transactions.h"
 #include "oc_api.h"
+#include "util/oc_hash.h"
+#include "util/oc_memb.h"
 #ifdef OC_SECURITY
 #include "security/oc_tls.h"
 #endif /* OC_SECURITY */
 #ifdef OC_CLIENT
 
-static coap_transaction_t *transaction;
-coap_packet_t request[1];
-oc_client_cb_t *client_cb;
-
+/* State of one outgoing request between prepare_coap_request() and
+ * dispatch_coap_request().
+ */
+typedef struct oc_client_request_s
+{
+  coap_packet_t packet[1];
+  coap_transaction_t *transaction;
+  oc_client_cb_t *client_cb;
 #ifdef OC_BLOCK_WISE
-static oc_blockwise_state_t *request_buffer = NULL;
+  oc_blockwise_state_t *request_buffer;
 #endif /* OC_BLOCK_WISE */
+} oc_client_request_t;
+
+/* Request opened by oc_init_put()/oc_init_post(); the payload is encoded by
+ * the application before oc_do_put()/oc_do_post() dispatches it.
+ */
+static oc_client_request_t pending_request;
 
 oc_event_callback_retval_t oc_ri_remove_client_cb(void *data);
 
+/* Requests in flight to one endpoint and those waiting there for a free
+ * NSTART slot, oldest first. A window exists while either is non-empty.
+ */
+typedef struct oc_request_window_s
+{
+  struct oc_request_window_s *next;
+  oc_endpoint_t endpoint;
+  int in_flight;
+  oc_client_cb_t *queue_head;
+  oc_client_cb_t *queue_tail;
+  oc_hash_link_t endpoint_link;
+} oc_request_window_t;
+
+OC_MEMB(request_windows_s, oc_request_window_t,
+        OC_MAX_NUM_CONCURRENT_REQUESTS + 1);
+OC_HASH(request_windows_by_endpoint, 16);
+
+/* Multicast and discovery requests are answered by any number of servers and
+ * are never held back.
+ */
+static bool
+counts_against_nstart(const oc_client_cb_t *cb)
+{
+  return !cb->discovery && !cb->multicast &&
+         !(cb->endpoint->flags & DISCOVERY);
+}
+
+static int
+request_window(const oc_endpoint_t *endpoint)
+{
+#ifdef OC_TCP
+  if (endpoint->flags & TCP) {
+    return COAP_TCP_NSTART;
+  }
+#else  /* OC_TCP */
+  (void)endpoint;
+#endif /* !OC_TCP */
+  return COAP_NSTART;
+}
+
+static oc_request_window_t *
+find_window(const oc_endpoint_t *endpoint)
+{
+  oc_hash_link_t *link =
+    oc_hash_lookup(&request_windows_by_endpoint, oc_endpoint_hash(endpoint));
+  while (link) {
+    oc_request_window_t *w =
+      oc_hash_entry(link, oc_request_window_t, endpoint_link);
+    if (oc_endpoint_compare(&w->endpoint, endpoint) == 0) {
+      return w;
+    }
+    link = oc_hash_next(link);
+  }
+  return NULL;
+}
+
+static oc_request_window_t *
+get_window(const oc_endpoint_t *endpoint)
+{
+  oc_request_window_t *w = find_window(endpoint);
+  if (!w) {
+    w = (oc_request_window_t *)oc_memb_alloc(&request_windows_s);
+    if (!w) {
+      OC_WRN("insufficient memory to track requests to endpoint");
+      return NULL;
+    }
+    memcpy(&w->endpoint, endpoint, sizeof(oc_endpoint_t));
+    oc_hash_add(&request_windows_by_endpoint, &w->endpoint_link,
+                oc_endpoint_hash(endpoint));
+  }
+  return w;
+}
+
+static oc_event_callback_retval_t send_queued_requests(void *data);
+
+static void
+free_window_if_idle(oc_request_window_t *w)
+{
+  if (w->in_flight == 0 && !w->queue_head) {
+    oc_ri_remove_timed_event_callback(w, &send_queued_requests);
+    oc_hash_remove(&request_windows_by_endpoint, &w->endpoint_link);
+    oc_memb_free(&request_windows_s, w);
+  }
+}
+
+int
+oc_client_num_requests_in_flight(const oc_endpoint_t *endpoint)
+{
+  oc_request_window_t *w = find_window(endpoint);
+  return w ? w->in_flight : 0;
+}
+
+static void
+queue_request(oc_request_window_t *w, oc_client_cb_t *cb,
+              coap_transaction_t *transaction)
+{
+  cb->queued = true;
+  cb->queue_next = NULL;
+  if (w->queue_tail) {
+    w->queue_tail->queue_next = cb;
+  } else {
+    w->queue_head = cb;
+  }
+  w->queue_tail = cb;
+  coap_queue_transaction(transaction);
+}
+
+static oc_client_cb_t *
+dequeue_request(oc_request_window_t *w)
+{
+  oc_client_cb_t *cb = w->queue_head;
+  if (cb) {
+    w->queue_head = cb->queue_next;
+    if (!w->queue_head) {
+      w->queue_tail = NULL;
+    }
+    cb->queue_next = NULL;
+    cb->queued = false;
+  }
+  return cb;
+}
+
+/* Drops cb from the queue of its endpoint along with its unsent request */
+static void
+abandon_request(oc_client_cb_t *cb)
+{
+  oc_request_window_t *w = find_window(cb->endpoint);
+  if (w) {
+    oc_client_cb_t **p = &w->queue_head, *prev = NULL;
+    while (*p && *p != cb) {
+      prev = *p;
+      p = &(*p)->queue_next;
+    }
+    if (*p) {
+      *p = cb->queue_next;
+      if (w->queue_tail == cb) {
+        w->queue_tail = prev;
+      }
+    }
+    free_window_if_idle(w);
+  }
+  cb->queue_next = NULL;
+  cb->queued = false;
+  coap_clear_transaction(coap_get_transaction_by_mid(cb->mid));
+}
+
+static oc_event_callback_retval_t
+non_request_lost(void *data)
+{
+  oc_client_release_request((oc_client_cb_t *)data);
+  return OC_EVENT_DONE;
+}
+
+#ifdef OC_TCP
+static oc_event_callback_retval_t
+request_too_large(void *data)
+{
+  oc_client_complete_request((oc_client_cb_t *)data,
+                             OC_STATUS_REQUEST_ENTITY_TOO_LARGE);
+  return OC_EVENT_DONE;
+}
+
+/* Completed from the event loop, as whoever is sending the request may still
+ * be using cb
+ */
+void
+oc_client_request_too_large(oc_client_cb_t *cb)
+{
+  oc_ri_remove_timed_event_callback(cb, &request_too_large);
+  oc_ri_add_timed_event_callback_ticks(cb, &request_too_large, 0);
+}
+#endif /* OC_TCP */
+
+static void
+start_request(oc_request_window_t *w, oc_client_cb_t *client_cb,
+              coap_transaction_t *transaction)
+{
+  if (w) {
+    w->in_flight++;
+    client_cb->in_flight = true;
+    /* A NON request is never acknowledged, so its slot is given up once a
+     * response is overdue rather than held for the NON_LIFETIME.
+     */
+#ifdef OC_TCP
+    if (client_cb->qos == LOW_QOS && !(client_cb->endpoint->flags & TCP)) {
+#else  /* OC_TCP */
+    if (client_cb->qos == LOW_QOS) {
+#endif /* !OC_TCP */
+      oc_ri_add_timed_event_callback_ticks(
+        client_cb, &non_request_lost, 2 * coap_rtt_timeout(client_cb->endpoint));
+    }
+  }
+
+  coap_send_transaction(transaction);
+
+  if (client_cb->observe_seq == -1) {
+    if (client_cb->qos == LOW_QOS)
+      oc_set_delayed_callback(client_cb, &oc_ri_remove_client_cb,
+                              OC_NON_LIFETIME);
+    else
+      oc_set_delayed_callback(client_cb, &oc_ri_remove_client_cb,
+                              OC_EXCHANGE_LIFETIME);
+  }
+}
+
+static oc_event_callback_retval_t
+send_queued_requests(void *data)
+{
+  oc_request_window_t *w = (oc_request_window_t *)data;
+  while (w->queue_head && w->in_flight < request_window(&w->endpoint)) {
+    oc_client_cb_t *cb = dequeue_request(w);
+    coap_transaction_t *t = coap_get_transaction_by_mid(cb->mid);
+    if (t) {
+      start_request(w, cb, t);
+    }
+  }
+  free_window_if_idle(w);
+  return OC_EVENT_DONE;
+}
+
+void
+oc_client_release_request(oc_client_cb_t *cb)
+{
+#ifdef OC_TCP
+  oc_ri_remove_timed_event_callback(cb, &request_too_large);
+#endif /* OC_TCP */
+  if (cb->queued) {
+    abandon_request(cb);
+    return;
+  }
+  if (!cb->in_flight) {
+    return;
+  }
+  cb->in_flight = false;
+  oc_ri_remove_timed_event_callback(cb, &non_request_lost);
+  oc_request_window_t *w = find_window(cb->endpoint);
+  if (!w) {
+    return;
+  }
+  w->in_flight--;
+  /* Sending is deferred to the event loop as this runs while the transaction
+   * and client callback lists are being walked.
+   */
+  if (w->queue_head) {
+    oc_ri_remove_timed_event_callback(w, &send_queued_requests);
+    oc_ri_add_timed_event_callback_ticks(w, &send_queued_requests, 0);
+  } else {
+    free_window_if_idle(w);
+  }
+}
+
 static bool
-dispatch_coap_request(void)
+dispatch_coap_request(oc_client_request_t *req)
 {
+  coap_packet_t *const request = req->packet;
+  coap_transaction_t *const transaction = req->transaction;
+  oc_client_cb_t *const client_cb = req->client_cb;
   int payload_size = oc_rep_finalize();
 
   if ((client_cb->method == OC_PUT || client_cb->method == OC_POST) &&
       payload_size > 0) {
 
 #ifdef OC_BLOCK_WISE
-    request_buffer->payload_size = payload_size;
+    req->request_buffer->payload_size = payload_size;
     uint32_t block_size;
+    uint32_t block_len = (uint32_t)OC_BLOCK_SIZE;
+    uint16_t block1_size = (uint16_t)OC_BLOCK_SIZE;
 #ifdef OC_TCP
-    if (!(transaction->message->endpoint.flags & TCP) &&
-        payload_size > OC_BLOCK_SIZE) {
-#else /* OC_TCP */
-    if (payload_size > OC_BLOCK_SIZE) {
-#endif /* !OC_TCP */
+    uint8_t bert = 0;
+    if (transaction->message->endpoint.flags & TCP) {
+      block_len = oc_blockwise_tcp_block_size(req->request_buffer, false, false,
+                                              &block1_size, &bert);
+    }
+#endif /* OC_TCP */
+    if ((uint32_t)payload_size > block_len) {
       const void *payload = oc_blockwise_dispatch_block(
-        request_buffer, 0, (uint32_t)OC_BLOCK_SIZE, &block_size);
+        req->request_buffer, 0, block_len, &block_size);
       if (payload) {
         coap_set_payload(request, payload, block_size);
-        coap_set_header_block1(request, 0, 1, (uint16_t)block_size);
+#ifdef OC_TCP
+        if (bert) {
+          coap_set_header_block1_bert(request, 0, 1);
+        } else
+#endif /* OC_TCP */
+        {
+          coap_set_header_block1(request, 0, 1, block1_size);
+        }
         coap_set_header_size1(request, payload_size);
         request->type = COAP_TYPE_CON;
         client_cb->qos = HIGH_QOS;
       }
     } else {
-      coap_set_payload(request, request_buffer->buffer, payload_size);
-      request_buffer->ref_count = 0;
+      coap_set_payload(request, req->request_buffer->buffer, payload_size);
+      req->request_buffer->ref_count = 0;
     }
 #else  /* OC_BLOCK_WISE */
     coap_set_payload(request, transaction->message->data + COAP_MAX_HEADER_SIZE,
@@ -83,60 +364,63 @@ dispatch_coap_request(void)
   transaction->message->length =
     coap_serialize_message(request, transaction->message->data);
 
-  coap_send_transaction(transaction);
+  oc_request_window_t *w =
+    counts_against_nstart(client_cb) ? get_window(client_cb->endpoint) : NULL;
+  if (!w || (!w->queue_head &&
+             w->in_flight < request_window(client_cb->endpoint))) {
+    start_request(w, client_cb, transaction);
+  } else {
+    queue_request(w, client_cb, transaction);
+  }
 
 #ifdef OC_BLOCK_WISE
-  if (request_buffer && request_buffer->ref_count == 0) {
-    oc_blockwise_free_request_buffer(request_buffer);
+  if (req->request_buffer && req->request_buffer->ref_count == 0) {
+    oc_blockwise_free_request_buffer(req->request_buffer);
   }
-  request_buffer = NULL;
+  req->request_buffer = NULL;
 #endif /* OC_BLOCK_WISE */
 
-  if (client_cb->observe_seq == -1) {
-    if (client_cb->qos == LOW_QOS)
-      oc_set_delayed_callback(client_cb, &oc_ri_remove_client_cb,
-                              OC_NON_LIFETIME);
-    else
-      oc_set_delayed_callback(client_cb, &oc_ri_remove_client_cb,
-                              OC_EXCHANGE_LIFETIME);
-  }
-
-  transaction = 0;
-  client_cb = 0;
+  req->transaction = NULL;
+  req->client_cb = NULL;
 
   return true;
 }
 
 static bool
-prepare_coap_request(oc_client_cb_t *cb)
+prepare_coap_request(oc_client_request_t *req, oc_client_cb_t *cb)
 {
+  coap_packet_t *const request = req->packet;
   coap_message_type_t type = COAP_TYPE_NON;
 
   if (cb->qos == HIGH_QOS) {
     type = COAP_TYPE_CON;
   }
 
-  transaction = coap_new_transaction(cb->mid, cb->endpoint);
+#ifdef OC_BLOCK_WISE
+  req->request_buffer = NULL;
+#endif /* OC_BLOCK_WISE */
+  req->transaction = coap_new_transaction(cb->mid, cb->endpoint);
 
-  if (!transaction) {
+  if (!req->transaction) {
     return false;
   }
 
 #ifndef OC_BLOCK_WISE
-  oc_rep_new(transaction->message->data + COAP_MAX_HEADER_SIZE, OC_BLOCK_SIZE);
+  oc_rep_new(req->transaction->message->data + COAP_MAX_HEADER_SIZE,
+             OC_BLOCK_SIZE);
 #else  /* !OC_BLOCK_WISE */
   if (cb->method == OC_PUT || cb->method == OC_POST) {
-    request_buffer = oc_blockwise_alloc_request_buffer(
+    req->request_buffer = oc_blockwise_alloc_request_buffer(
       oc_string(cb->uri) + 1, oc_string_len(cb->uri) - 1, cb->endpoint,
       cb->method, OC_BLOCKWISE_CLIENT);
-    if (!request_buffer) {
+    if (!req->request_buffer) {
       OC_ERR("request_buffer is NULL");
       return false;
     }
-    oc_rep_new(request_buffer->buffer, OC_MAX_APP_DATA_SIZE);
+    oc_rep_new(req->request_buffer->buffer, OC_MAX_APP_DATA_SIZE);
 
-    request_buffer->mid = cb->mid;
-    request_buffer->client_cb = cb;
+    oc_blockwise_set_request_buffer_mid(req->request_buffer, cb->mid);
+    req->request_buffer->client_cb = cb;
   }
 #endif /* OC_BLOCK_WISE */
 
@@ -170,7 +454,7 @@ prepare_coap_request(oc_client_cb_t *cb)
     coap_set_header_uri_query(request, oc_string(cb->query));
   }
 
-  client_cb = cb;
+  req->client_cb = cb;
 
   return true;
 }
@@ -200,12 +484,13 @@ oc_do_delete(const char *uri, oc_endpoint_t *endpoint, const char *query,
   if (!cb)
     return false;
 
+  oc_client_request_t req;
   bool status = false;
 
-  status = prepare_coap_request(cb);
+  status = prepare_coap_request(&req, cb);
 
   if (status)
-    status = dispatch_coap_request();
+    status = dispatch_coap_request(&req);
 
   return status;
 }
@@ -223,12 +508,13 @@ oc_do_get(const char *uri, oc_endpoint_t *endpoint, const char *query,
   if (!cb)
     return false;
 
+  oc_client_request_t req;
   bool status = false;
 
-  status = prepare_coap_request(cb);
+  status = prepare_coap_request(&req, cb);
 
   if (status)
-    status = dispatch_coap_request();
+    status = dispatch_coap_request(&req);
 
   return status;
 }
@@ -246,7 +532,7 @@ oc_init_put(const char *uri, oc_endpoint_t *endpoint, const char *query,
   if (!cb)
     return false;
 
-  return prepare_coap_request(cb);
+  return prepare_coap_request(&pending_request, cb);
 }
 #endif /*.ST_OC_CLIENT_OPT */
 
@@ -263,19 +549,19 @@ oc_init_post(const char *uri, oc_endpoint_t *endpoint, const char *query,
     return false;
   }
 
-  return prepare_coap_request(cb);
+  return prepare_coap_request(&pending_request, cb);
 }
 
 bool
 oc_do_put(void)
 {
-  return dispatch_coap_request();
+  return dispatch_coap_request(&pending_request);
 }
 
 bool
 oc_do_post(void)
 {
-  return dispatch_coap_request();
+  return dispatch_coap_request(&pending_request);
 }
 
 #ifndef ST_OC_CLIENT_OPT
@@ -293,12 +579,13 @@ oc_do_observe(const char *uri, oc_endpoint_t *endpoint, const char *query,
 
   cb->observe_seq = 0;
 
+  oc_client_request_t req;
   bool status = false;
 
-  status = prepare_coap_request(cb);
+  status = prepare_coap_request(&req, cb);
 
   if (status)
-    status = dispatch_coap_request();
+    status = dispatch_coap_request(&req);
 
   return status;
 }
@@ -311,15 +598,16 @@ oc_stop_observe(const char *uri, oc_endpoint_t *endpoint)
   if (!cb)
     return false;
 
-  cb->mid = coap_get_mid();
+  oc_ri_set_client_cb_mid(cb, coap_get_mid());
   cb->observe_seq = 1;
 
+  oc_client_request_t req;
   bool status = false;
 
-  status = prepare_coap_request(cb);
+  status = prepare_coap_request(&req, cb);
 
   if (status)
-    status = dispatch_coap_request();
+    status = dispatch_coap_request(&req);
 
   return status;
 }
@@ -342,14 +630,15 @@ oc_do_ipv4_discovery(const oc_client_cb_t *ipv6_cb,
   if (!cb)
     return false;
 
-  cb->mid = ipv6_cb->mid;
-  memcpy(cb->token, ipv6_cb->token, cb->token_len);
+  oc_ri_set_client_cb_mid(cb, ipv6_cb->mid);
+  oc_ri_set_client_cb_token(cb, ipv6_cb->token, ipv6_cb->token_len);
 
   cb->discovery = true;
-  status = prepare_coap_request(cb);
+  oc_client_request_t req;
+  status = prepare_coap_request(&req, cb);
 
   if (status)
-    status = dispatch_coap_request();
+    status = dispatch_coap_request(&req);
 
   return status;
 }
@@ -371,15 +660,16 @@ oc_do_ipv4_multicast(oc_client_cb_t *ipv6_cb, oc_response_handler_t handler,
     return false;
   }
 
-  cb->mid = ipv6_cb->mid;
-  memcpy(cb->token, ipv6_cb->token, cb->token_len);
+  oc_ri_set_client_cb_mid(cb, ipv6_cb->mid);
+  oc_ri_set_client_cb_token(cb, ipv6_cb->token, ipv6_cb->token_len);
 
   cb->multicast = true;
 
-  bool status = prepare_coap_request(cb);
+  oc_client_request_t req;
+  bool status = prepare_coap_request(&req, cb);
 
   if (status)
-    status = dispatch_coap_request();
+    status = dispatch_coap_request(&req);
 
   return status;
 }
@@ -416,10 +706,11 @@ oc_do_ip_multicast(const char *uri, const char *query,
 
   cb->multicast = true;
 
-  bool status = prepare_coap_request(cb);
+  oc_client_request_t req;
+  bool status = prepare_coap_request(&req, cb);
 
   if (status)
-    status = dispatch_coap_request();
+    status = dispatch_coap_request(&req);
 
 #ifdef OC_IPV4
   if (status)
@@ -456,12 +747,13 @@ dispatch_ip_discovery(const char *rt, oc_discovery_handler_t handler,
 
   cb->discovery = true;
 
+  oc_client_request_t req;
   bool status = false;
 
-  status = prepare_coap_request(cb);
+  status = prepare_coap_request(&req, cb);
 
   if (status)
-    status = dispatch_coap_request();
+    status = dispatch_coap_request(&req);
 
 exit:
   if (oc_string_len(uri_query) > 0) {
@@ -515,4 +807,72 @@ oc_close_session(oc_endpoint_t *endpoint)
   }
 }
 #endif /*.ST_OC_CLIENT_OPT */
-#endif /* OC_CLIENT */
\ No newline at end of file
+
+#ifdef OC_TCP
+static oc_event_callback_retval_t ping_timed_out(void *data);
+#endif /* OC_TCP */
+
+/* Completes a request with a code the stack chose rather than the peer, and
+ * frees it
+ */
+void
+oc_client_complete_request(oc_client_cb_t *cb, oc_status_t code)
+{
+  oc_ri_remove_timed_event_callback(cb, &oc_ri_remove_client_cb);
+#ifdef OC_TCP
+  oc_ri_remove_timed_event_callback(cb, &ping_timed_out);
+#endif /* OC_TCP */
+  cb->failing = false;
+  oc_client_response_t response;
+  memset(&response, 0, sizeof(oc_client_response_t));
+  response.endpoint = cb->endpoint;
+  response.client_cb = cb;
+  response.user_data = cb->user_data;
+  response.code = code;
+  cb->handler.response(&response);
+  oc_ri_remove_client_cb(cb);
+}
+
+#ifdef OC_TCP
+static oc_event_callback_retval_t
+ping_timed_out(void *data)
+{
+  oc_client_complete_request((oc_client_cb_t *)data, OC_PING_TIMEOUT);
+  return OC_EVENT_DONE;
+}
+
+void
+oc_client_handle_pong(oc_client_cb_t *cb)
+{
+  /* Only Pings are answered by a Pong */
+  if (!cb->ping) {
+    return;
+  }
+  oc_client_complete_request(cb, OC_STATUS_OK);
+}
+
+bool
+oc_send_ping(bool custody, oc_endpoint_t *endpoint, uint16_t timeout_seconds,
+             oc_response_handler_t handler, void *user_data)
+{
+  if (!(endpoint->flags & TCP)) {
+    OC_ERR("Ping signals are only sent over TCP");
+    return false;
+  }
+
+  oc_client_handler_t client_handler;
+  client_handler.response = handler;
+
+  oc_client_cb_t *cb = oc_ri_alloc_client_cb("/ping", endpoint, OC_GET, NULL,
+                                             client_handler, LOW_QOS, user_data);
+  if (!cb)
+    return false;
+  cb->ping = true;
+
+  coap_send_ping_message(endpoint, custody, cb->token, cb->token_len);
+
+  oc_set_delayed_callback(cb, &ping_timed_out, timeout_seconds);
+  return true;
+}
+#endif /* OC_TCP */
+#endif /* OC_CLIENT */
@@ -113,6 +113,7 @@ oc_collection_free(oc_collection_t *collection)
 {
   if (collection != NULL) {
     oc_list_remove(oc_collections, collection);
+    oc_ri_uri_index_remove((oc_resource_t *)collection);
     oc_ri_free_resource_properties((oc_resource_t*)collection);
 
     oc_link_t *link;
@@ -198,19 +199,8 @@ oc_link_add_rel(oc_link_t *link, const char *rel)
 oc_collection_t *
 oc_get_collection_by_uri(const char *uri_path, int uri_path_len, int device)
 {
-  while (uri_path[0] == '/') {
-    uri_path++;
-    uri_path_len--;
-  }
-  oc_collection_t *collection = oc_list_head(oc_collections);
-  while (collection != NULL) {
-    if ((int)oc_string_len(collection->uri) == (uri_path_len + 1) &&
-        strncmp(oc_string(collection->uri) + 1, uri_path, uri_path_len) == 0 &&
-        collection->device == device)
-      break;
-    collection = collection->next;
-  }
-  return collection;
+  return (oc_collection_t *)oc_ri_uri_index_find(uri_path, uri_path_len, device,
+                                                 OC_URI_INDEX_COLLECTION);
 }
 
 #ifndef ST_APP_OPTIMIZATION
@@ -247,7 +237,7 @@ oc_check_if_collection(oc_resource_t *resource)
   while (collection != NULL) {
     if ((oc_collection_t *)resource == collection)
       return true;
-    collection = collection->next;
+    collection = (oc_collection_t *)collection->res.next;
   }
   return false;
 }
@@ -256,6 +246,7 @@ void
 oc_collection_add(oc_collection_t *collection)
 {
   oc_list_add(oc_collections, collection);
+  oc_ri_uri_index_add((oc_resource_t *)collection, OC_URI_INDEX_COLLECTION);
 }
 
 void
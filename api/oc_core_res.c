@@ -473,6 +473,7 @@ oc_core_populate_resource(int core_resource, int device_index, const char *uri,
   r->put_handler.cb = put;
   r->post_handler.cb = post;
   r->delete_handler.cb = delete;
+  oc_ri_uri_index_add_core(core_resource, device_index);
 }
 
 oc_uuid_t *
@@ -163,9 +163,9 @@ process_device_resources(CborEncoder *links, oc_request_t *request,
 
 #if defined(OC_COLLECTIONS)
   oc_collection_t *collection = oc_collection_get_all();
-  for (; collection; collection = collection->next) {
-    if (collection->device != device_index ||
-        !(collection->properties & OC_DISCOVERABLE))
+  for (; collection; collection = (oc_collection_t *)collection->res.next) {
+    if (collection->res.device != device_index ||
+        !(collection->res.properties & OC_DISCOVERABLE))
       continue;
 
     if (filter_resource((oc_resource_t *)collection, request, oc_string(anchor),
@@ -328,9 +328,9 @@ process_oic_1_1_device_object(CborEncoder *device, oc_request_t *request,
 
 #if defined(OC_COLLECTIONS)
   oc_collection_t *collection = oc_collection_get_all();
-  for (; collection; collection = collection->next) {
-    if (collection->device != device_num ||
-        !(collection->properties & OC_DISCOVERABLE))
+  for (; collection; collection = (oc_collection_t *)collection->res.next) {
+    if (collection->res.device != device_num ||
+        !(collection->res.properties & OC_DISCOVERABLE))
       continue;
 
     if (filter_oic_1_1_resource((oc_resource_t *)collection, request,
@@ -536,14 +536,15 @@ oc_ri_process_discovery_payload(uint8_t *payload, int len,
   char rep_objects_alloc[OC_MAX_NUM_REP_OBJECTS];
   oc_rep_t rep_objects_pool[OC_MAX_NUM_REP_OBJECTS];
   memset(rep_objects_alloc, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(char));
-  memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
-                                 rep_objects_alloc, (void *)rep_objects_pool,
-                                 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                 .num = OC_MAX_NUM_REP_OBJECTS,
+                                 .count = rep_objects_alloc,
+                                 .mem = (void *)rep_objects_pool };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
 #endif /* OC_DYNAMIC_ALLOCATION */
   oc_rep_set_pool(&rep_objects);
+  size_t rep_arena = oc_rep_arena_begin();
 
   oc_rep_t *links = 0, *rep, *p;
   int s = oc_parse_rep(payload, len, &p);
@@ -685,6 +686,7 @@ oc_ri_process_discovery_payload(uint8_t *payload, int len,
 
 done:
   oc_free_rep(p);
+  oc_rep_arena_end(rep_arena);
   return ret;
 }
 #endif /* OC_CLIENT */
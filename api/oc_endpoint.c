@@ -18,6 +18,7 @@
 #include "oc_core_res.h"
 #include "port/oc_connectivity.h"
 #include "port/oc_network_events_mutex.h"
+#include "util/oc_hash.h"
 #include "util/oc_memb.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -47,7 +48,9 @@ oc_new_endpoint(void)
 void
 oc_free_endpoint(oc_endpoint_t *endpoint)
 {
+  oc_network_event_handler_mutex_lock();
   oc_memb_free(&oc_endpoints_s, endpoint);
+  oc_network_event_handler_mutex_unlock();
 }
 
 #ifdef OC_IPV4
@@ -483,3 +486,24 @@ oc_endpoint_compare(const oc_endpoint_t *ep1, const oc_endpoint_t *ep2)
   // TODO: Add support for other endpoint types
   return -1;
 }
+
+/* Endpoints that oc_endpoint_compare() finds equal hash alike */
+uint32_t
+oc_endpoint_hash(const oc_endpoint_t *endpoint)
+{
+  uint32_t key = (uint32_t)endpoint->device ^
+                 ((uint32_t)(endpoint->flags & ~MULTICAST) << 16);
+  if (endpoint->flags & IPV6) {
+    key ^= oc_hash_bytes(endpoint->addr.ipv6.address,
+                         sizeof(endpoint->addr.ipv6.address));
+    key ^= endpoint->addr.ipv6.port;
+  }
+#ifdef OC_IPV4
+  else if (endpoint->flags & IPV4) {
+    key ^= oc_hash_bytes(endpoint->addr.ipv4.address,
+                         sizeof(endpoint->addr.ipv4.address));
+    key ^= endpoint->addr.ipv4.port;
+  }
+#endif /* OC_IPV4 */
+  return key;
+}
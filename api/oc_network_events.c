@@ -21,6 +21,133 @@
 #include "port/oc_connectivity.h"
 #include "util/oc_list.h"
 
+#ifdef OC_NETWORK_EVENT_RING_SIZE
+#if (OC_NETWORK_EVENT_RING_SIZE & (OC_NETWORK_EVENT_RING_SIZE - 1)) != 0
+#error "OC_NETWORK_EVENT_RING_SIZE must be a power of two"
+#endif
+
+/* Bounded multi-producer/single-consumer ring handing received messages
+ * from the network threads to the stack. Every cell carries a sequence
+ * number: a producer claims a cell by advancing enqueue_pos and publishes
+ * it by setting the sequence to pos + 1; the event loop consumes it and
+ * hands it back by setting the sequence to pos + OC_NETWORK_EVENT_RING_SIZE.
+ */
+typedef struct
+{
+  size_t seq;
+  oc_message_t *message;
+} network_event_cell_t;
+
+#define RING_MASK (OC_NETWORK_EVENT_RING_SIZE - 1)
+
+static network_event_cell_t ring[OC_NETWORK_EVENT_RING_SIZE];
+static size_t enqueue_pos, dequeue_pos;
+/* Set by the first producer after the event loop last drained the ring, so
+ * that only the empty to non-empty transition wakes up the event loop.
+ */
+static bool events_pending;
+#ifdef OC_NETWORK_MONITOR
+static bool interface_up, interface_down;
+#endif /* OC_NETWORK_MONITOR */
+
+static void
+ring_init(void)
+{
+  size_t i;
+  for (i = 0; i < OC_NETWORK_EVENT_RING_SIZE; i++) {
+    __atomic_store_n(&ring[i].seq, i, __ATOMIC_RELAXED);
+    ring[i].message = NULL;
+  }
+  __atomic_store_n(&enqueue_pos, 0, __ATOMIC_RELAXED);
+  dequeue_pos = 0;
+  __atomic_store_n(&events_pending, false, __ATOMIC_RELEASE);
+}
+
+static bool
+ring_enqueue(oc_message_t *message)
+{
+  network_event_cell_t *cell;
+  size_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+  while (1) {
+    cell = &ring[pos & RING_MASK];
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+  cell->message = message;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static oc_message_t *
+ring_dequeue(void)
+{
+  network_event_cell_t *cell = &ring[dequeue_pos & RING_MASK];
+  size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+  if (seq != dequeue_pos + 1) {
+    return NULL;
+  }
+  oc_message_t *message = cell->message;
+  cell->message = NULL;
+  __atomic_store_n(&cell->seq, dequeue_pos + OC_NETWORK_EVENT_RING_SIZE,
+                   __ATOMIC_RELEASE);
+  dequeue_pos++;
+  return message;
+}
+
+static void
+signal_network_events(void)
+{
+  if (!__atomic_exchange_n(&events_pending, true, __ATOMIC_ACQ_REL)) {
+    oc_process_poll(&(oc_network_events));
+    _oc_signal_event_loop();
+  }
+}
+
+static void
+oc_process_network_event(void)
+{
+  /* Clear the pending flag before draining; a producer that publishes after
+   * this point signals the event loop again.
+   */
+  (void)__atomic_exchange_n(&events_pending, false, __ATOMIC_ACQ_REL);
+  oc_message_t *message = ring_dequeue();
+  while (message != NULL) {
+    oc_recv_message(message);
+    message = ring_dequeue();
+  }
+#ifdef OC_NETWORK_MONITOR
+  if (__atomic_exchange_n(&interface_up, false, __ATOMIC_ACQ_REL)) {
+    oc_process_post(&oc_network_events, oc_events[INTERFACE_UP], NULL);
+  }
+  if (__atomic_exchange_n(&interface_down, false, __ATOMIC_ACQ_REL)) {
+    oc_process_post(&oc_network_events, oc_events[INTERFACE_DOWN], NULL);
+  }
+#endif /* OC_NETWORK_MONITOR */
+}
+
+/* Releases the messages still waiting in the ring when the stack shuts
+ * down. Producers stop enqueueing once the process has exited.
+ */
+static void
+free_network_events(void)
+{
+  oc_message_t *message = ring_dequeue();
+  while (message != NULL) {
+    oc_message_unref(message);
+    message = ring_dequeue();
+  }
+}
+#else  /* OC_NETWORK_EVENT_RING_SIZE */
 OC_LIST(network_events);
 #ifdef OC_NETWORK_MONITOR
 static bool interface_up, interface_down;
@@ -31,10 +158,15 @@ oc_process_network_event(void)
 {
   oc_network_event_handler_mutex_lock();
   oc_message_t *message = (oc_message_t *)oc_list_pop(network_events);
+  oc_network_event_handler_mutex_unlock();
+  /* oc_recv_message() may release the message, which takes the mutex */
   while (message != NULL) {
     oc_recv_message(message);
+    oc_network_event_handler_mutex_lock();
     message = oc_list_pop(network_events);
+    oc_network_event_handler_mutex_unlock();
   }
+  oc_network_event_handler_mutex_lock();
 #ifdef OC_NETWORK_MONITOR
   if (interface_up) {
     oc_process_post(&oc_network_events, oc_events[INTERFACE_UP], NULL);
@@ -48,12 +180,31 @@ oc_process_network_event(void)
   oc_network_event_handler_mutex_unlock();
 }
 
+static void
+free_network_events(void)
+{
+  oc_network_event_handler_mutex_lock();
+  oc_message_t *message = (oc_message_t *)oc_list_pop(network_events);
+  while (message != NULL) {
+    oc_network_event_handler_mutex_unlock();
+    oc_message_unref(message);
+    oc_network_event_handler_mutex_lock();
+    message = (oc_message_t *)oc_list_pop(network_events);
+  }
+  oc_network_event_handler_mutex_unlock();
+}
+#endif /* !OC_NETWORK_EVENT_RING_SIZE */
+
 OC_PROCESS(oc_network_events, "");
 OC_PROCESS_THREAD(oc_network_events, ev, data)
 {
   (void)data;
   OC_PROCESS_POLLHANDLER(oc_process_network_event());
+  OC_PROCESS_EXITHANDLER(free_network_events());
   OC_PROCESS_BEGIN();
+#ifdef OC_NETWORK_EVENT_RING_SIZE
+  ring_init();
+#endif /* OC_NETWORK_EVENT_RING_SIZE */
   while (oc_process_is_running(&(oc_network_events))) {
     OC_PROCESS_YIELD();
 #ifdef OC_NETWORK_MONITOR
@@ -74,12 +225,50 @@ oc_network_event(oc_message_t *message)
     oc_message_unref(message);
     return;
   }
+#ifdef OC_NETWORK_EVENT_RING_SIZE
+  if (!ring_enqueue(message)) {
+    OC_WRN("network event ring full; dropping message");
+    oc_message_unref(message);
+  }
+  signal_network_events();
+#else  /* OC_NETWORK_EVENT_RING_SIZE */
   oc_network_event_handler_mutex_lock();
   oc_list_add(network_events, message);
   oc_network_event_handler_mutex_unlock();
 
   oc_process_poll(&(oc_network_events));
   _oc_signal_event_loop();
+#endif /* !OC_NETWORK_EVENT_RING_SIZE */
+}
+
+void
+oc_network_event_batch(oc_message_t **messages, int num_messages)
+{
+  int i;
+  if (!oc_process_is_running(&(oc_network_events))) {
+    for (i = 0; i < num_messages; i++) {
+      oc_message_unref(messages[i]);
+    }
+    return;
+  }
+#ifdef OC_NETWORK_EVENT_RING_SIZE
+  for (i = 0; i < num_messages; i++) {
+    if (!ring_enqueue(messages[i])) {
+      OC_WRN("network event ring full; dropping message");
+      oc_message_unref(messages[i]);
+    }
+  }
+  signal_network_events();
+#else  /* OC_NETWORK_EVENT_RING_SIZE */
+  oc_network_event_handler_mutex_lock();
+  for (i = 0; i < num_messages; i++) {
+    oc_list_add(network_events, messages[i]);
+  }
+  oc_network_event_handler_mutex_unlock();
+
+  oc_process_poll(&(oc_network_events));
+  _oc_signal_event_loop();
+#endif /* !OC_NETWORK_EVENT_RING_SIZE */
 }
 
 #ifdef OC_NETWORK_MONITOR
@@ -90,6 +279,16 @@ oc_network_interface_event(oc_interface_event_t event)
     return;
   }
 
+#ifdef OC_NETWORK_EVENT_RING_SIZE
+  if (event == NETWORK_INTERFACE_DOWN) {
+    __atomic_store_n(&interface_down, true, __ATOMIC_RELEASE);
+  } else if (event == NETWORK_INTERFACE_UP) {
+    __atomic_store_n(&interface_up, true, __ATOMIC_RELEASE);
+  } else {
+    return;
+  }
+  signal_network_events();
+#else  /* OC_NETWORK_EVENT_RING_SIZE */
   oc_network_event_handler_mutex_lock();
   if (event == NETWORK_INTERFACE_DOWN) {
     interface_down = true;
@@ -103,5 +302,6 @@ oc_network_interface_event(oc_interface_event_t event)
 
   oc_process_poll(&(oc_network_events));
   _oc_signal_event_loop();
+#endif /* !OC_NETWORK_EVENT_RING_SIZE */
 }
 #endif /* OC_NETWORK_MONITOR */
@@ -20,10 +20,189 @@
 #include "port/oc_log.h"
 #include "util/oc_memb.h"
 
-static struct oc_memb *rep_objects;
-static uint8_t *g_buf;
-CborEncoder g_encoder, root_map, links_array;
-CborError g_err;
+static OC_REP_THREAD_LOCAL struct oc_memb *rep_objects;
+static OC_REP_THREAD_LOCAL uint8_t *g_buf;
+OC_REP_THREAD_LOCAL CborEncoder g_encoder, root_map, links_array;
+OC_REP_THREAD_LOCAL CborError g_err;
+
+#define OC_REP_BORROWED_NAME (0x01)
+#define OC_REP_BORROWED_VALUE (0x02)
+
+static OC_REP_THREAD_LOCAL bool rep_borrow_strings;
+
+#ifdef OC_REP_ARENA_SIZE
+#define REP_ARENA_ALIGN (sizeof(double))
+
+static OC_REP_THREAD_LOCAL double
+  rep_arena[(OC_REP_ARENA_SIZE + REP_ARENA_ALIGN - 1) / REP_ARENA_ALIGN];
+static OC_REP_THREAD_LOCAL size_t rep_arena_used;
+static OC_REP_THREAD_LOCAL int rep_arena_depth;
+
+size_t
+oc_rep_arena_begin(void)
+{
+  rep_arena_depth++;
+  return rep_arena_used;
+}
+
+void
+oc_rep_arena_end(size_t mark)
+{
+  if (rep_arena_depth > 0) {
+    rep_arena_depth--;
+  }
+  rep_arena_used = mark;
+}
+
+/* Memory is handed out unzeroed; callers initialize what they use. */
+static void *
+rep_arena_alloc(size_t size)
+{
+  if (rep_arena_depth == 0) {
+    return NULL;
+  }
+  size = (size + REP_ARENA_ALIGN - 1) & ~(REP_ARENA_ALIGN - 1);
+  if (size > sizeof(rep_arena) - rep_arena_used) {
+    return NULL;
+  }
+  void *ptr = (uint8_t *)rep_arena + rep_arena_used;
+  rep_arena_used += size;
+  return ptr;
+}
+
+static bool
+in_rep_arena(const void *ptr)
+{
+  return (const uint8_t *)ptr >= (const uint8_t *)rep_arena &&
+         (const uint8_t *)ptr < (const uint8_t *)rep_arena + sizeof(rep_arena);
+}
+
+static bool
+rep_arena_alloc_block(oc_handle_t *block, size_t num_items, size_t item_size)
+{
+  block->ptr = rep_arena_alloc(num_items * item_size);
+  if (!block->ptr) {
+    return false;
+  }
+  block->next = NULL;
+  block->size = (unsigned int)num_items;
+  return true;
+}
+#else  /* OC_REP_ARENA_SIZE */
+size_t
+oc_rep_arena_begin(void)
+{
+  return 0;
+}
+
+void
+oc_rep_arena_end(size_t mark)
+{
+  (void)mark;
+}
+
+#define in_rep_arena(ptr) (false)
+#define rep_arena_alloc_block(block, num_items, item_size) (false)
+#endif /* !OC_REP_ARENA_SIZE */
+
+static void
+rep_alloc_string(oc_string_t *ocstring, size_t size)
+{
+  if (!rep_arena_alloc_block(ocstring, size, sizeof(uint8_t))) {
+    oc_alloc_string(ocstring, size);
+  }
+}
+
+static void
+rep_new_array(oc_array_t *ocarray, size_t size, pool type)
+{
+  size_t item_size = sizeof(uint8_t);
+  if (type == INT_POOL) {
+    item_size = sizeof(int);
+  } else if (type == DOUBLE_POOL) {
+    item_size = sizeof(double);
+  }
+  if (rep_arena_alloc_block(ocarray, size, item_size)) {
+    return;
+  }
+  switch (type) {
+  case INT_POOL:
+    oc_new_int_array(ocarray, size);
+    break;
+  case DOUBLE_POOL:
+    oc_new_double_array(ocarray, size);
+    break;
+  default:
+    oc_new_bool_array(ocarray, size);
+    break;
+  }
+}
+
+static void
+rep_new_string_array(oc_string_array_t *ocstringarray, size_t size)
+{
+  size_t i;
+  if (!rep_arena_alloc_block(ocstringarray, size * STRING_ARRAY_ITEM_MAX_LEN,
+                             sizeof(uint8_t))) {
+    oc_new_string_array(ocstringarray, size);
+    return;
+  }
+  for (i = 0; i < size; i++) {
+    oc_string_array_get_item(*ocstringarray, i)[0] = '\0';
+  }
+}
+
+/* Points ocstring at a definite-length string inside the payload being
+ * parsed, which is NUL-terminated by rep_terminate_borrowed() afterwards.
+ */
+static bool
+rep_borrow_string(const CborValue *value, oc_string_t *ocstring)
+{
+  size_t len;
+  CborValue next = *value;
+  if (!rep_borrow_strings || !cbor_value_is_length_known(value) ||
+      cbor_value_get_string_length(value, &len) != CborNoError ||
+      cbor_value_advance(&next) != CborNoError) {
+    return false;
+  }
+  ocstring->next = NULL;
+  ocstring->ptr = (void *)(cbor_value_get_next_byte(&next) - len);
+  ocstring->size = (unsigned int)len + 1;
+  return true;
+}
+
+/* Slides the string one byte back over the last byte of its CBOR header
+ * and terminates it in the byte that frees up.
+ */
+static void
+rep_terminate_string(oc_string_t *ocstring)
+{
+  char *data = oc_string(*ocstring);
+  size_t len = ocstring->size - 1;
+  memmove(data - 1, data, len);
+  *(data - 1 + len) = '\0';
+  ocstring->ptr = data - 1;
+}
+
+/* Runs once the whole payload has been parsed, as the decoder re-reads
+ * string headers when skipping over nested containers.
+ */
+static void
+rep_terminate_borrowed(oc_rep_t *rep)
+{
+  for (; rep != NULL; rep = rep->next) {
+    if (rep->borrowed & OC_REP_BORROWED_NAME) {
+      rep_terminate_string(&rep->name);
+    }
+    if (rep->borrowed & OC_REP_BORROWED_VALUE) {
+      rep_terminate_string(&rep->value.string);
+    } else if (rep->type == OC_REP_OBJECT) {
+      rep_terminate_borrowed(rep->value.object);
+    } else if (rep->type == OC_REP_OBJECT_ARRAY) {
+      rep_terminate_borrowed(rep->value.object_array);
+    }
+  }
+}
 
 void
 oc_rep_set_pool(struct oc_memb *rep_objects_pool)
@@ -68,7 +247,15 @@ oc_rep_finalize(void)
 static oc_rep_t *
 _alloc_rep(void)
 {
-  oc_rep_t *rep = oc_memb_alloc(rep_objects);
+  oc_rep_t *rep = NULL;
+#ifdef OC_REP_ARENA_SIZE
+  rep = (oc_rep_t *)rep_arena_alloc(sizeof(oc_rep_t));
+  if (rep) {
+    memset(rep, 0, sizeof(oc_rep_t));
+    return rep;
+  }
+#endif /* OC_REP_ARENA_SIZE */
+  rep = oc_memb_alloc(rep_objects);
   if (rep != NULL) {
     rep->name.size = 0;
   }
@@ -81,6 +268,9 @@ _alloc_rep(void)
 static void
 _free_rep(oc_rep_t *rep_value)
 {
+  if (in_rep_arena(rep_value)) {
+    return;
+  }
   oc_memb_free(rep_objects, rep_value);
 }
 
@@ -90,23 +280,30 @@ oc_free_rep(oc_rep_t *rep)
   if (rep == 0)
     return;
   oc_free_rep(rep->next);
+  /* Blocks carved out of the rep arena are released with the arena */
+  bool in_arena = in_rep_arena(oc_string(rep->value.string));
   switch (rep->type) {
   case OC_REP_BYTE_STRING_ARRAY:
   case OC_REP_STRING_ARRAY:
-    oc_free_string_array(&rep->value.array);
+    if (!in_arena)
+      oc_free_string_array(&rep->value.array);
     break;
   case OC_REP_BOOL_ARRAY:
-    oc_free_bool_array(&rep->value.array);
+    if (!in_arena)
+      oc_free_bool_array(&rep->value.array);
     break;
   case OC_REP_DOUBLE_ARRAY:
-    oc_free_double_array(&rep->value.array);
+    if (!in_arena)
+      oc_free_double_array(&rep->value.array);
     break;
   case OC_REP_INT_ARRAY:
-    oc_free_int_array(&rep->value.array);
+    if (!in_arena)
+      oc_free_int_array(&rep->value.array);
     break;
   case OC_REP_BYTE_STRING:
   case OC_REP_STRING:
-    oc_free_string(&rep->value.string);
+    if (!in_arena && !(rep->borrowed & OC_REP_BORROWED_VALUE))
+      oc_free_string(&rep->value.string);
     break;
   case OC_REP_OBJECT:
     oc_free_rep(rep->value.object);
@@ -117,11 +314,92 @@ oc_free_rep(oc_rep_t *rep)
   default:
     break;
   }
-  if (rep->name.size > 0)
+  if (rep->name.size > 0 && !(rep->borrowed & OC_REP_BORROWED_NAME) &&
+      !in_rep_arena(oc_string(rep->name)))
     oc_free_string(&rep->name);
   _free_rep(rep);
 }
 
+#define REP_COPY_ALIGN(size)                                                   \
+  (((size) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+static size_t
+rep_value_bytes(const oc_rep_t *rep)
+{
+  switch (rep->type) {
+  case OC_REP_BYTE_STRING:
+  case OC_REP_STRING:
+  case OC_REP_BYTE_STRING_ARRAY:
+  case OC_REP_STRING_ARRAY:
+    return rep->value.string.size;
+  case OC_REP_INT_ARRAY:
+    return rep->value.array.size * sizeof(int);
+  case OC_REP_DOUBLE_ARRAY:
+    return rep->value.array.size * sizeof(double);
+  case OC_REP_BOOL_ARRAY:
+    return rep->value.array.size * sizeof(bool);
+  default:
+    return 0;
+  }
+}
+
+size_t
+oc_rep_copy_size(const oc_rep_t *rep)
+{
+  size_t size = 0;
+  for (; rep != NULL; rep = rep->next) {
+    size += REP_COPY_ALIGN(sizeof(oc_rep_t)) + REP_COPY_ALIGN(rep->name.size) +
+            REP_COPY_ALIGN(rep_value_bytes(rep));
+    if (rep->type == OC_REP_OBJECT) {
+      size += oc_rep_copy_size(rep->value.object);
+    } else if (rep->type == OC_REP_OBJECT_ARRAY) {
+      size += oc_rep_copy_size(rep->value.object_array);
+    }
+  }
+  return size;
+}
+
+static void
+rep_copy_block(oc_handle_t *block, size_t bytes, uint8_t **buffer)
+{
+  if (bytes == 0) {
+    return;
+  }
+  memcpy(*buffer, block->ptr, bytes);
+  block->next = NULL;
+  block->ptr = *buffer;
+  *buffer += REP_COPY_ALIGN(bytes);
+}
+
+static oc_rep_t *
+rep_copy(const oc_rep_t *rep, uint8_t **buffer)
+{
+  oc_rep_t *head = NULL, **tail = &head;
+  for (; rep != NULL; rep = rep->next) {
+    oc_rep_t *copy = (oc_rep_t *)*buffer;
+    *buffer += REP_COPY_ALIGN(sizeof(oc_rep_t));
+    *copy = *rep;
+    copy->next = NULL;
+    rep_copy_block(&copy->name, copy->name.size, buffer);
+    rep_copy_block(&copy->value.string, rep_value_bytes(rep), buffer);
+    if (rep->type == OC_REP_OBJECT) {
+      copy->value.object = rep_copy(rep->value.object, buffer);
+    } else if (rep->type == OC_REP_OBJECT_ARRAY) {
+      copy->value.object_array = rep_copy(rep->value.object_array, buffer);
+    }
+    *tail = copy;
+    tail = &copy->next;
+  }
+  return head;
+}
+
+oc_rep_t *
+oc_rep_copy(const oc_rep_t *rep, void *buffer)
+{
+  uint8_t *next = (uint8_t *)buffer;
+  return rep_copy(rep, &next);
+}
+
 /*
   An Object is a collection of key-value pairs.
   A value_object value points to the first key-value pair,
@@ -148,13 +426,18 @@ oc_parse_rep_value(CborValue *value, oc_rep_t **rep, CborError *err)
   }
   oc_rep_t *cur = *rep, **prev = 0;
   cur->next = 0;
+  cur->borrowed = 0;
   cur->value.object_array = 0;
   /* key */
-  *err |= cbor_value_calculate_string_length(value, &len);
-  len++;
-  oc_alloc_string(&cur->name, len);
-  *err |= cbor_value_copy_text_string(value, (char *)oc_string(cur->name), &len,
-                                      NULL);
+  if (rep_borrow_string(value, &cur->name)) {
+    cur->borrowed |= OC_REP_BORROWED_NAME;
+  } else {
+    *err |= cbor_value_calculate_string_length(value, &len);
+    len++;
+    rep_alloc_string(&cur->name, len);
+    *err |= cbor_value_copy_text_string(value, (char *)oc_string(cur->name),
+                                        &len, NULL);
+  }
   if (*err != CborNoError)
     return;
   *err |= cbor_value_advance(value);
@@ -173,20 +456,28 @@ oc_parse_rep_value(CborValue *value, oc_rep_t **rep, CborError *err)
     cur->type = OC_REP_DOUBLE;
     break;
   case CborByteStringType:
+    cur->type = OC_REP_BYTE_STRING;
+    if (rep_borrow_string(value, &cur->value.string)) {
+      cur->borrowed |= OC_REP_BORROWED_VALUE;
+      break;
+    }
     *err |= cbor_value_calculate_string_length(value, &len);
     len++;
-    oc_alloc_string(&cur->value.string, len);
+    rep_alloc_string(&cur->value.string, len);
     *err |= cbor_value_copy_byte_string(
       value, oc_cast(cur->value.string, uint8_t), &len, NULL);
-    cur->type = OC_REP_BYTE_STRING;
     break;
   case CborTextStringType:
+    cur->type = OC_REP_STRING;
+    if (rep_borrow_string(value, &cur->value.string)) {
+      cur->borrowed |= OC_REP_BORROWED_VALUE;
+      break;
+    }
     *err |= cbor_value_calculate_string_length(value, &len);
     len++;
-    oc_alloc_string(&cur->value.string, len);
+    rep_alloc_string(&cur->value.string, len);
     *err |= cbor_value_copy_text_string(value, oc_string(cur->value.string),
                                         &len, NULL);
-    cur->type = OC_REP_STRING;
     break;
   case CborMapType: {
     oc_rep_t **obj = &cur->value.object;
@@ -219,14 +510,14 @@ oc_parse_rep_value(CborValue *value, oc_rep_t **rep, CborError *err)
       switch (array.type) {
       case CborIntegerType:
         if (k == 0) {
-          oc_new_int_array(&cur->value.array, len);
+          rep_new_array(&cur->value.array, len, INT_POOL);
           cur->type = OC_REP_INT | OC_REP_ARRAY;
         }
         *err |= cbor_value_get_int(&array, oc_int_array(cur->value.array) + k);
         break;
       case CborDoubleType:
         if (k == 0) {
-          oc_new_double_array(&cur->value.array, len);
+          rep_new_array(&cur->value.array, len, DOUBLE_POOL);
           cur->type = OC_REP_DOUBLE | OC_REP_ARRAY;
         }
         *err |=
@@ -234,7 +525,7 @@ oc_parse_rep_value(CborValue *value, oc_rep_t **rep, CborError *err)
         break;
       case CborBooleanType:
         if (k == 0) {
-          oc_new_bool_array(&cur->value.array, len);
+          rep_new_array(&cur->value.array, len, BYTE_POOL);
           cur->type = OC_REP_BOOL | OC_REP_ARRAY;
         }
         *err |=
@@ -242,7 +533,7 @@ oc_parse_rep_value(CborValue *value, oc_rep_t **rep, CborError *err)
         break;
       case CborByteStringType:
         if (k == 0) {
-          oc_new_string_array(&cur->value.array, len);
+          rep_new_string_array(&cur->value.array, len);
           cur->type = OC_REP_BYTE_STRING | OC_REP_ARRAY;
         }
         *err |= cbor_value_calculate_string_length(&array, &len);
@@ -256,7 +547,7 @@ oc_parse_rep_value(CborValue *value, oc_rep_t **rep, CborError *err)
         break;
       case CborTextStringType:
         if (k == 0) {
-          oc_new_string_array(&cur->value.array, len);
+          rep_new_string_array(&cur->value.array, len);
           cur->type = OC_REP_STRING | OC_REP_ARRAY;
         }
         *err |= cbor_value_calculate_string_length(&array, &len);
@@ -312,8 +603,8 @@ oc_parse_rep_value(CborValue *value, oc_rep_t **rep, CborError *err)
   }
 }
 
-int
-oc_parse_rep(const uint8_t *in_payload, int payload_size, oc_rep_t **out_rep)
+static int
+parse_rep(const uint8_t *in_payload, int payload_size, oc_rep_t **out_rep)
 {
   CborParser parser;
   CborValue root_value, cur_value, map;
@@ -359,6 +650,73 @@ oc_parse_rep(const uint8_t *in_payload, int payload_size, oc_rep_t **out_rep)
   return err;
 }
 
+int
+oc_parse_rep(const uint8_t *in_payload, int payload_size, oc_rep_t **out_rep)
+{
+  return parse_rep(in_payload, payload_size, out_rep);
+}
+
+int
+oc_parse_rep_borrowed(uint8_t *in_payload, int payload_size,
+                      oc_rep_t **out_rep)
+{
+  *out_rep = 0;
+  rep_borrow_strings = true;
+  int err = parse_rep(in_payload, payload_size, out_rep);
+  rep_borrow_strings = false;
+  rep_terminate_borrowed(*out_rep);
+  return err;
+}
+
+bool
+oc_rep_find_number(const uint8_t *payload, int payload_size, const char *key,
+                   double *value)
+{
+  CborParser parser;
+  CborValue root_value, cur_value, next;
+  size_t key_len = strlen(key), len;
+  if (cbor_parser_init(payload, payload_size, 0, &parser, &root_value) !=
+        CborNoError ||
+      !cbor_value_is_map(&root_value) ||
+      cbor_value_enter_container(&root_value, &cur_value) != CborNoError) {
+    return false;
+  }
+  while (!cbor_value_at_end(&cur_value)) {
+    /* Names are compared in place, as rep_borrow_string() points at them */
+    bool match = cbor_value_get_type(&cur_value) == CborTextStringType &&
+                 cbor_value_is_length_known(&cur_value) &&
+                 cbor_value_get_string_length(&cur_value, &len) ==
+                   CborNoError &&
+                 len == key_len;
+    next = cur_value;
+    if (cbor_value_advance(&next) != CborNoError ||
+        cbor_value_at_end(&next)) {
+      return false;
+    }
+    if (match &&
+        memcmp(cbor_value_get_next_byte(&next) - len, key, len) == 0) {
+      int64_t integer;
+      switch (cbor_value_get_type(&next)) {
+      case CborIntegerType:
+        if (cbor_value_get_int64(&next, &integer) != CborNoError) {
+          return false;
+        }
+        *value = (double)integer;
+        return true;
+      case CborDoubleType:
+        return cbor_value_get_double(&next, value) == CborNoError;
+      default:
+        return false;
+      }
+    }
+    cur_value = next;
+    if (cbor_value_advance(&cur_value) != CborNoError) {
+      return false;
+    }
+  }
+  return false;
+}
+
 static bool
 oc_rep_get_value(oc_rep_t *rep, oc_rep_value_type_t type, const char *key,
                  void **value, int *size)
@@ -516,3 +874,17 @@ oc_rep_get_object_array(oc_rep_t *rep, const char *key, oc_rep_t **value)
 {
   return oc_rep_get_value(rep, OC_REP_OBJECT_ARRAY, key, (void **)value, NULL);
 }
+
+bool
+oc_rep_dup_string(oc_rep_t *rep, const char *key, oc_string_t *value)
+{
+  char *str = NULL;
+  int size = 0;
+  if (!value)
+    return false;
+  if (!oc_rep_get_value(rep, OC_REP_STRING, key, (void **)&str, &size) &&
+      !oc_rep_get_value(rep, OC_REP_BYTE_STRING, key, (void **)&str, &size))
+    return false;
+  oc_new_string(value, str, size);
+  return true;
+}
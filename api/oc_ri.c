@@ -19,13 +19,17 @@
 #include <string.h>
 
 #include "util/oc_etimer.h"
+#include "util/oc_hash.h"
 #include "util/oc_list.h"
+#include "util/oc_mem.h"
 #include "util/oc_memb.h"
 #include "util/oc_process.h"
 
+#include "messaging/coap/coap_signal.h"
 #include "messaging/coap/constants.h"
 #include "messaging/coap/engine.h"
 #include "messaging/coap/oc_coap.h"
+#include "messaging/coap/rtt.h"
 
 #include "port/oc_random.h"
 
@@ -41,6 +45,10 @@
 #include "oc_ri.h"
 #include "oc_uuid.h"
 
+#ifdef OC_WORKER_THREADS
+#include "oc_worker.h"
+#endif /* OC_WORKER_THREADS */
+
 #ifdef OC_BLOCK_WISE
 #include "oc_blockwise.h"
 #endif /* OC_BLOCK_WISE */
@@ -64,6 +72,9 @@ OC_MEMB(app_resources_s, oc_resource_t, OC_MAX_APP_RESOURCES);
 #include "oc_client_state.h"
 OC_LIST(client_cbs);
 OC_MEMB(client_cbs_s, oc_client_cb_t, OC_MAX_NUM_CONCURRENT_REQUESTS + 1);
+/* Indexes of client_cbs for matching responses by MID and by token */
+OC_HASH(client_cbs_by_mid, 16);
+OC_HASH(client_cbs_by_token, 16);
 #endif /* OC_CLIENT */
 
 OC_LIST(timed_callbacks);
@@ -226,9 +237,15 @@ start_processes(void)
 #ifdef OC_TCP
   oc_process_start(&oc_session_events, NULL);
 #endif /* OC_TCP */
+#if defined(OC_SERVER) && defined(OC_WORKER_THREADS)
+  oc_process_start(&oc_worker_events, NULL);
+#endif /* OC_SERVER && OC_WORKER_THREADS */
 }
 
 static void stop_processes(void) {
+#if defined(OC_SERVER) && defined(OC_WORKER_THREADS)
+  oc_process_exit(&oc_worker_events);
+#endif /* OC_SERVER && OC_WORKER_THREADS */
 #ifdef OC_TCP
   oc_process_exit(&oc_session_events);
 #endif /* OC_TCP */
@@ -244,29 +261,255 @@ static void stop_processes(void) {
   oc_process_exit(&message_buffer_handler);
 }
 
-#ifdef OC_SERVER
-oc_resource_t *
-oc_ri_get_app_resource_by_uri(const char *uri, int uri_len, int device)
+/* Open addressing hash table over the URIs of core, application and
+ * collection resources, keyed by URI path and device. Core resources are
+ * held by index as their array moves when devices are added, and the
+ * platform resource is shared by all devices.
+ */
+typedef struct
 {
-  int skip = 0;
-  if (uri[0] != '/')
-    skip = 1;
-  oc_resource_t *res = oc_ri_get_app_resources();
-  while (res != NULL) {
-    if ((int)oc_string_len(res->uri) == (uri_len + skip) &&
-        strncmp(uri, oc_string(res->uri) + skip, uri_len) == 0 &&
-        res->device == device)
-      return res;
-    res = res->next;
+  oc_resource_t *resource;
+  uint32_t hash;
+  int device;
+  int8_t core;
+  uint8_t kind;
+} uri_index_entry_t;
+
+#ifdef OC_DYNAMIC_ALLOCATION
+#define URI_INDEX_MIN_SIZE (32)
+
+static uri_index_entry_t *uri_index;
+static size_t uri_index_size;
+#else /* OC_DYNAMIC_ALLOCATION */
+#if defined(OC_SERVER) && defined(OC_COLLECTIONS)
+#define URI_INDEX_MAX_COLLECTIONS (OC_MAX_NUM_COLLECTIONS)
+#else /* OC_SERVER && OC_COLLECTIONS */
+#define URI_INDEX_MAX_COLLECTIONS (0)
+#endif /* !OC_SERVER || !OC_COLLECTIONS */
+#define URI_INDEX_SIZE                                                         \
+  (2 * (OC_NUM_CORE_RESOURCES_PER_DEVICE * OC_MAX_NUM_DEVICES +                \
+        OC_MAX_APP_RESOURCES + URI_INDEX_MAX_COLLECTIONS) +                    \
+   1)
+
+static uri_index_entry_t uri_index[URI_INDEX_SIZE];
+static const size_t uri_index_size = URI_INDEX_SIZE;
+#endif /* !OC_DYNAMIC_ALLOCATION */
+static size_t uri_index_count;
+
+static void
+uri_index_strip(const char **uri, int *uri_len)
+{
+  while (*uri_len > 0 && (*uri)[0] == '/') {
+    (*uri)++;
+    (*uri_len)--;
   }
+}
 
-#ifdef OC_COLLECTIONS
-  if (!res) {
-    res = (oc_resource_t *)oc_get_collection_by_uri(uri, uri_len, device);
+static uint32_t
+uri_index_hash(const char *uri, int uri_len, int device)
+{
+  uint32_t hash = 2166136261u;
+  int i;
+  uri_index_strip(&uri, &uri_len);
+  for (i = 0; i < uri_len; i++) {
+    hash = (hash ^ (uint8_t)uri[i]) * 16777619u;
   }
-#endif /* OC_COLLECTIONS */
+  return (hash ^ (uint32_t)(device + 1)) * 16777619u;
+}
+
+static oc_resource_t *
+uri_index_resource(const uri_index_entry_t *entry)
+{
+  if (entry->kind == OC_URI_INDEX_CORE) {
+    return oc_core_get_resource_by_index(entry->core,
+                                         entry->device < 0 ? 0 : entry->device);
+  }
+  return entry->resource;
+}
+
+static void
+uri_index_insert(const uri_index_entry_t *entry)
+{
+  size_t i = entry->hash % uri_index_size;
+  while (uri_index[i].kind != 0) {
+    i = (i + 1) % uri_index_size;
+  }
+  uri_index[i] = *entry;
+  uri_index_count++;
+}
+
+/* Backward shift deletion, which keeps probe sequences free of holes */
+static void
+uri_index_delete_at(size_t i)
+{
+  size_t j = i, k;
+  while (1) {
+    uri_index[i].kind = 0;
+    do {
+      j = (j + 1) % uri_index_size;
+      if (uri_index[j].kind == 0) {
+        uri_index_count--;
+        return;
+      }
+      k = uri_index[j].hash % uri_index_size;
+    } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+    uri_index[i] = uri_index[j];
+    i = j;
+  }
+}
+
+/* Keeps the load factor at or below one half */
+static bool
+uri_index_reserve(void)
+{
+  if (2 * (uri_index_count + 1) <= uri_index_size) {
+    return true;
+  }
+#ifdef OC_DYNAMIC_ALLOCATION
+  uri_index_entry_t *old_index = uri_index;
+  size_t old_size = uri_index_size, i;
+  size_t new_size = old_size ? 2 * old_size : URI_INDEX_MIN_SIZE;
+  uri_index_entry_t *new_index =
+    (uri_index_entry_t *)oc_mem_calloc(new_size, sizeof(uri_index_entry_t));
+  if (!new_index) {
+    return false;
+  }
+  uri_index = new_index;
+  uri_index_size = new_size;
+  uri_index_count = 0;
+  for (i = 0; i < old_size; i++) {
+    if (old_index[i].kind != 0) {
+      uri_index_insert(&old_index[i]);
+    }
+  }
+  if (old_index) {
+    oc_mem_free(old_index);
+  }
+  return true;
+#else  /* OC_DYNAMIC_ALLOCATION */
+  return uri_index_count + 1 < uri_index_size;
+#endif /* !OC_DYNAMIC_ALLOCATION */
+}
+
+static void
+uri_index_reset(void)
+{
+#ifdef OC_DYNAMIC_ALLOCATION
+  if (uri_index) {
+    oc_mem_free(uri_index);
+  }
+  uri_index = NULL;
+  uri_index_size = 0;
+#else  /* OC_DYNAMIC_ALLOCATION */
+  memset(uri_index, 0, sizeof(uri_index));
+#endif /* !OC_DYNAMIC_ALLOCATION */
+  uri_index_count = 0;
+}
+
+static void
+uri_index_add(uri_index_entry_t *entry, oc_resource_t *resource)
+{
+  if (!uri_index_reserve()) {
+    OC_WRN("insufficient memory to index resource URI");
+    return;
+  }
+  entry->hash = uri_index_hash(oc_string(resource->uri),
+                               (int)oc_string_len(resource->uri), entry->device);
+  uri_index_insert(entry);
+}
 
-  return res;
+void
+oc_ri_uri_index_add(oc_resource_t *resource, oc_uri_index_kind_t kind)
+{
+  uri_index_entry_t entry;
+  if (!resource || oc_string_len(resource->uri) == 0) {
+    return;
+  }
+  entry.resource = resource;
+  entry.device = resource->device;
+  entry.core = -1;
+  entry.kind = (uint8_t)kind;
+  uri_index_add(&entry, resource);
+}
+
+void
+oc_ri_uri_index_add_core(int core_resource, int device)
+{
+  uri_index_entry_t entry;
+  oc_resource_t *resource =
+    oc_core_get_resource_by_index(core_resource, device);
+  if (!resource || oc_string_len(resource->uri) == 0) {
+    return;
+  }
+  entry.resource = NULL;
+  entry.device = (core_resource == OCF_P) ? -1 : device;
+  entry.core = (int8_t)core_resource;
+  entry.kind = OC_URI_INDEX_CORE;
+  uri_index_add(&entry, resource);
+}
+
+void
+oc_ri_uri_index_remove(oc_resource_t *resource)
+{
+  size_t i;
+  if (!resource || uri_index_size == 0) {
+    return;
+  }
+  i = uri_index_hash(oc_string(resource->uri),
+                     (int)oc_string_len(resource->uri), resource->device) %
+      uri_index_size;
+  while (uri_index[i].kind != 0) {
+    if (uri_index[i].resource == resource) {
+      uri_index_delete_at(i);
+      return;
+    }
+    i = (i + 1) % uri_index_size;
+  }
+}
+
+static oc_resource_t *
+uri_index_probe(const char *uri, int uri_len, int device, int kinds)
+{
+  uint32_t hash = uri_index_hash(uri, uri_len, device);
+  size_t i = hash % uri_index_size;
+  for (; uri_index[i].kind != 0; i = (i + 1) % uri_index_size) {
+    const uri_index_entry_t *entry = &uri_index[i];
+    if (entry->hash != hash || entry->device != device ||
+        !(entry->kind & kinds)) {
+      continue;
+    }
+    oc_resource_t *resource = uri_index_resource(entry);
+    const char *res_uri = oc_string(resource->uri);
+    int res_uri_len = (int)oc_string_len(resource->uri);
+    uri_index_strip(&res_uri, &res_uri_len);
+    if (res_uri_len == uri_len && memcmp(res_uri, uri, uri_len) == 0) {
+      return resource;
+    }
+  }
+  return NULL;
+}
+
+oc_resource_t *
+oc_ri_uri_index_find(const char *uri, int uri_len, int device, int kinds)
+{
+  oc_resource_t *resource;
+  if (uri_index_size == 0) {
+    return NULL;
+  }
+  uri_index_strip(&uri, &uri_len);
+  resource = uri_index_probe(uri, uri_len, device, kinds);
+  if (!resource && (kinds & OC_URI_INDEX_CORE)) {
+    resource = uri_index_probe(uri, uri_len, -1, kinds);
+  }
+  return resource;
+}
+
+#ifdef OC_SERVER
+oc_resource_t *
+oc_ri_get_app_resource_by_uri(const char *uri, int uri_len, int device)
+{
+  return oc_ri_uri_index_find(uri, uri_len, device,
+                              OC_URI_INDEX_APP | OC_URI_INDEX_COLLECTION);
 }
 
 static void
@@ -286,6 +529,7 @@ oc_ri_init(void)
   oc_random_init();
   oc_clock_init();
   set_mpro_status_codes();
+  uri_index_reset();
 
 #ifdef OC_SERVER
   oc_list_init(app_resources);
@@ -294,6 +538,8 @@ oc_ri_init(void)
 
 #ifdef OC_CLIENT
   oc_list_init(client_cbs);
+  oc_hash_init(&client_cbs_by_mid);
+  oc_hash_init(&client_cbs_by_token);
 #endif
 
   oc_list_init(timed_callbacks);
@@ -315,7 +561,12 @@ oc_ri_delete_resource(oc_resource_t *resource)
   if (!resource)
     return false;
 
+#ifdef OC_WORKER_THREADS
+  oc_worker_cancel_jobs(resource);
+#endif /* OC_WORKER_THREADS */
   oc_list_remove(app_resources, resource);
+  oc_ri_uri_index_remove(resource);
+  coap_remove_observers_by_resource(resource);
   oc_ri_free_resource_properties(resource);
   oc_memb_free(&app_resources_s, resource);
   return true;
@@ -339,6 +590,7 @@ oc_ri_add_resource(oc_resource_t *resource)
 
   if (valid) {
     oc_list_add(app_resources, resource);
+    oc_ri_uri_index_add(resource, OC_URI_INDEX_APP);
   }
 
   return valid;
@@ -358,7 +610,27 @@ oc_ri_free_resource_properties(oc_resource_t *resource)
     if (oc_string_array_get_allocated_size(resource->types) > 0) {
       oc_free_string_array(&(resource->types));
     }
+    if (oc_string_len(resource->observe_step_property) > 0) {
+      oc_free_string(&(resource->observe_step_property));
+    }
+  }
+}
+
+static void
+free_event_callback(oc_list_t list, oc_event_callback_t *event_cb)
+{
+  oc_list_remove(list, event_cb);
+  /* An expired timer has its event queued or being dispatched, which
+   * then frees the callback.
+   */
+  if (oc_etimer_expired(&event_cb->timer)) {
+    event_cb->callback = NULL;
+    return;
   }
+  OC_PROCESS_CONTEXT_BEGIN(&timed_callback_events);
+  oc_etimer_stop(&event_cb->timer);
+  OC_PROCESS_CONTEXT_END(&timed_callback_events);
+  oc_memb_free(&event_callbacks_s, event_cb);
 }
 
 void
@@ -369,11 +641,7 @@ oc_ri_remove_timed_event_callback(void *cb_data, oc_trigger_t event_callback)
 
   while (event_cb != NULL) {
     if (event_cb->data == cb_data && event_cb->callback == event_callback) {
-      OC_PROCESS_CONTEXT_BEGIN(&timed_callback_events);
-      oc_etimer_stop(&event_cb->timer);
-      OC_PROCESS_CONTEXT_END(&timed_callback_events);
-      oc_list_remove(timed_callbacks, event_cb);
-      oc_memb_free(&event_callbacks_s, event_cb);
+      free_event_callback(timed_callbacks, event_cb);
       break;
     }
     event_cb = event_cb->next;
@@ -400,41 +668,6 @@ oc_ri_add_timed_event_callback_ticks(void *cb_data, oc_trigger_t event_callback,
   }
 }
 
-static void
-poll_event_callback_timers(oc_list_t list, struct oc_memb *cb_pool)
-{
-  oc_event_callback_t *event_cb = (oc_event_callback_t *)oc_list_head(list),
-                      *next;
-
-  while (event_cb != NULL) {
-    next = event_cb->next;
-
-    if (oc_etimer_expired(&event_cb->timer)) {
-      if (event_cb->callback(event_cb->data) == OC_EVENT_DONE) {
-        oc_list_remove(list, event_cb);
-        oc_memb_free(cb_pool, event_cb);
-        event_cb = oc_list_head(list);
-        continue;
-      } else {
-        OC_PROCESS_CONTEXT_BEGIN(&timed_callback_events);
-        oc_etimer_restart(&event_cb->timer);
-        OC_PROCESS_CONTEXT_END(&timed_callback_events);
-      }
-    }
-
-    event_cb = next;
-  }
-}
-
-static void
-check_event_callbacks(void)
-{
-#ifdef OC_SERVER
-  poll_event_callback_timers(observe_callbacks, &event_callbacks_s);
-#endif /* OC_SERVER */
-  poll_event_callback_timers(timed_callbacks, &event_callbacks_s);
-}
-
 #ifdef OC_SERVER
 static oc_event_callback_retval_t
 oc_observe_notification_delayed(void *data)
@@ -486,9 +719,7 @@ remove_periodic_observe_callback(oc_resource_t *resource)
   oc_event_callback_t *event_cb = get_periodic_observe_callback(resource);
 
   if (event_cb) {
-    oc_etimer_stop(&event_cb->timer);
-    oc_list_remove(observe_callbacks, event_cb);
-    oc_memb_free(&event_callbacks_s, event_cb);
+    free_event_callback(observe_callbacks, event_cb);
   }
 }
 
@@ -519,26 +750,49 @@ add_periodic_observe_callback(oc_resource_t *resource)
 #endif /*.ST_OC_PERIODIC_OPT */
 #endif /* OC_SERVER */
 
+static void
+dispatch_event_callback(struct oc_etimer *timer)
+{
+  oc_event_callback_t *event_cb =
+    (oc_event_callback_t *)((uint8_t *)timer -
+                            offsetof(oc_event_callback_t, timer));
+  oc_list_t list = timed_callbacks;
+
+  if (event_cb->callback == NULL) {
+    oc_memb_free(&event_callbacks_s, event_cb);
+    return;
+  }
+#if defined(OC_SERVER) && !defined(ST_OC_PERIODIC_OPT)
+  if (event_cb->callback == periodic_observe_handler) {
+    list = observe_callbacks;
+  }
+#endif /* OC_SERVER && !ST_OC_PERIODIC_OPT */
+
+  oc_event_callback_retval_t ret = event_cb->callback(event_cb->data);
+  if (event_cb->callback == NULL) {
+    /* Removed by the callback itself */
+    oc_memb_free(&event_callbacks_s, event_cb);
+  } else if (ret == OC_EVENT_DONE) {
+    oc_list_remove(list, event_cb);
+    oc_memb_free(&event_callbacks_s, event_cb);
+  } else {
+    OC_PROCESS_CONTEXT_BEGIN(&timed_callback_events);
+    oc_etimer_restart(&event_cb->timer);
+    OC_PROCESS_CONTEXT_END(&timed_callback_events);
+  }
+}
+
 static void
 free_all_event_timers(void)
 {
+  oc_event_callback_t *event_cb;
 #ifdef OC_SERVER
-  oc_event_callback_t *obs_cb =
-    (oc_event_callback_t *)oc_list_pop(observe_callbacks);
-  while (obs_cb != NULL) {
-    oc_etimer_stop(&obs_cb->timer);
-    oc_list_remove(observe_callbacks, obs_cb);
-    oc_memb_free(&event_callbacks_s, obs_cb);
-    obs_cb = oc_list_pop(observe_callbacks);
+  while ((event_cb = oc_list_head(observe_callbacks)) != NULL) {
+    free_event_callback(observe_callbacks, event_cb);
   }
 #endif /* OC_SERVER */
-  oc_event_callback_t *event_cb =
-    (oc_event_callback_t *)oc_list_pop(timed_callbacks);
-  while (event_cb != NULL) {
-    oc_etimer_stop(&event_cb->timer);
-    oc_list_remove(timed_callbacks, event_cb);
-    oc_memb_free(&event_callbacks_s, event_cb);
-    event_cb = oc_list_pop(timed_callbacks);
+  while ((event_cb = oc_list_head(timed_callbacks)) != NULL) {
+    free_event_callback(timed_callbacks, event_cb);
   }
 }
 
@@ -596,16 +850,19 @@ does_interface_support_method(oc_interface_mask_t interface, oc_method_t method)
 
 #ifdef OC_BLOCK_WISE
 bool
-oc_ri_invoke_coap_entity_handler(void *request, void *response,
+oc_ri_invoke_coap_entity_handler(coap_receive_ctx_t *ctx,
                                  oc_blockwise_state_t **request_state,
                                  oc_blockwise_state_t **response_state,
                                  uint16_t block2_size, oc_endpoint_t *endpoint)
 #else  /* OC_BLOCK_WISE */
 bool
-oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
+oc_ri_invoke_coap_entity_handler(coap_receive_ctx_t *ctx, uint8_t *buffer,
                                  oc_endpoint_t *endpoint)
 #endif /* !OC_BLOCK_WISE */
 {
+  void *request = ctx->message;
+  void *response = ctx->response;
+
   /* Flags that capture status along various stages of processing
    *  the request.
    */
@@ -628,6 +885,10 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
   bool resource_is_collection = false;
 #endif /* OC_COLLECTIONS && OC_SERVER */
 
+#if defined(OC_SERVER) && defined(OC_WORKER_THREADS)
+  oc_worker_job_t *worker_job = NULL;
+#endif /* OC_SERVER && OC_WORKER_THREADS */
+
 #ifdef OC_SECURITY
   bool authorized = true;
 #endif /* OC_SECURITY */
@@ -706,15 +967,17 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
 #ifndef OC_DYNAMIC_ALLOCATION
   char rep_objects_alloc[OC_MAX_NUM_REP_OBJECTS];
   oc_rep_t rep_objects_pool[OC_MAX_NUM_REP_OBJECTS];
+  /* Blocks are zeroed by oc_memb_alloc() as they are handed out */
   memset(rep_objects_alloc, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(char));
-  memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
-                                 rep_objects_alloc, (void *)rep_objects_pool,
-                                 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                 .num = OC_MAX_NUM_REP_OBJECTS,
+                                 .count = rep_objects_alloc,
+                                 .mem = (void *)rep_objects_pool };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
 #endif /* OC_DYNAMIC_ALLOCATION */
   oc_rep_set_pool(&rep_objects);
+  size_t rep_arena = oc_rep_arena_begin();
 
   if (payload_len > 0) {
     /* Attempt to parse request payload using tinyCBOR via oc_rep helper
@@ -722,9 +985,11 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
      * which will reflect the schema of the payload.
      * Any failures while parsing the payload is viewed as an erroneous
      * request and results in a 4.00 response being sent.
+     * Strings in the tree borrow from the payload, which therefore has to
+     * stay around until the tree is freed below.
      */
-    int parse_error =
-      oc_parse_rep(payload, payload_len, &request_obj.request_payload);
+    int parse_error = oc_parse_rep_borrowed(
+      (uint8_t *)payload, payload_len, &request_obj.request_payload);
     if (parse_error != 0) {
       OC_WRN("ocri: error parsing request payload; tinyCBOR error code:  %d",
              parse_error);
@@ -732,16 +997,9 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
         entity_too_large = true;
       bad_request = true;
     }
-
-#if defined(OC_BLOCK_WISE)
-    /* Free request_state cause it isn't used any more
-     */
-    oc_blockwise_free_request_buffer(*request_state);
-    *request_state = NULL;
-#endif
   }
 
-  oc_resource_t *resource, *cur_resource = NULL;
+  oc_resource_t *cur_resource = NULL;
 
   /* If there were no errors thus far, attempt to locate the specific
    * resource object that will handle the request using the request uri.
@@ -749,16 +1007,8 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
   /* Check against list of declared core resources.
    */
   if (!bad_request) {
-    int i;
-    for (i = 0; i < OC_NUM_CORE_RESOURCES_PER_DEVICE; i++) {
-      resource = oc_core_get_resource_by_index(i, endpoint->device);
-      if ((int)oc_string_len(resource->uri) == (uri_path_len + 1) &&
-          strncmp((const char *)oc_string(resource->uri) + 1, uri_path,
-                  uri_path_len) == 0) {
-        request_obj.resource = cur_resource = resource;
-        break;
-      }
-    }
+    request_obj.resource = cur_resource = oc_ri_uri_index_find(
+      uri_path, uri_path_len, endpoint->device, OC_URI_INDEX_CORE);
   }
 
 #ifdef OC_SERVER
@@ -859,6 +1109,14 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
       } else
 #endif
 #endif  /* OC_COLLECTIONS && OC_SERVER */
+#if defined(OC_SERVER) && defined(OC_WORKER_THREADS)
+        if ((worker_job = oc_worker_prepare(&request_obj, method,
+                                            interface)) != NULL) {
+        /* The handler runs on a worker once the request has been
+         * accepted as a separate response below.
+         */
+      } else
+#endif /* OC_SERVER && OC_WORKER_THREADS */
         /* If cur_resource is a non-collection resource, invoke
          * its handler for the requested method. If it has not
          * implemented that method, then return a 4.05 response.
@@ -886,7 +1144,14 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
      * payload structure (and return its memory to the pool).
      */
     oc_free_rep(request_obj.request_payload);
+#if defined(OC_BLOCK_WISE)
+    /* Free request_state cause it isn't used any more
+     */
+    oc_blockwise_free_request_buffer(*request_state);
+    *request_state = NULL;
+#endif
   }
+  oc_rep_arena_end(rep_arena);
 
   if (forbidden) {
     OC_WRN("ocri: Forbidden request");
@@ -1017,6 +1282,13 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
                              observe) == 1)
 #endif /* !OC_BLOCK_WISE */
       response_obj.separate_response->active = 1;
+#ifdef OC_WORKER_THREADS
+    if (worker_job) {
+      oc_worker_submit(worker_job);
+    }
+#endif /* OC_WORKER_THREADS */
+    /* Any reply to this request is sent by the separate response path */
+    ctx->status_code = CLEAR_TRANSACTION;
   } else
 #endif /* OC_SERVER */
     if (response_buffer.code == OC_IGNORE) {
@@ -1024,7 +1296,7 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
      * below a response code of IGNORE, which results in the messaging
      * layer freeing the CoAP transaction associated with the request.
      */
-    coap_status_code = CLEAR_TRANSACTION;
+    ctx->status_code = CLEAR_TRANSACTION;
   } else {
 #ifdef OC_SERVER
     /* If the recently handled request was a PUT/POST, it conceivably
@@ -1068,10 +1340,13 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
 static void
 free_client_cb(oc_client_cb_t *cb)
 {
+  oc_client_release_request(cb);
 #ifdef OC_BLOCK_WISE
   oc_blockwise_scrub_buffers_for_client_cb(cb);
 #endif /* OC_BLOCK_WISE */
   oc_list_remove(client_cbs, cb);
+  oc_hash_remove(&client_cbs_by_mid, &cb->mid_link);
+  oc_hash_remove(&client_cbs_by_token, &cb->token_link);
   oc_free_string(&cb->uri);
   if (oc_string_len(cb->query)) {
     oc_free_string(&cb->query);
@@ -1089,12 +1364,7 @@ oc_ri_remove_client_cb(void *data)
 bool
 oc_ri_remove_client_cb_by_mid(uint16_t mid)
 {
-  oc_client_cb_t *cb = (oc_client_cb_t *)oc_list_head(client_cbs);
-  while (cb != NULL) {
-    if (cb->mid == mid)
-      break;
-    cb = cb->next;
-  }
+  oc_client_cb_t *cb = oc_ri_find_client_cb_by_mid(mid);
   if (cb) {
     oc_ri_remove_timed_event_callback(cb, &oc_ri_remove_client_cb);
     free_client_cb(cb);
@@ -1103,30 +1373,69 @@ oc_ri_remove_client_cb_by_mid(uint16_t mid)
   return false;
 }
 
-#ifndef ST_APP_OPTIMIZATION
+/* Completes every request to endpoint with code. Handlers may make or cancel
+ * requests, so the ones to fail are marked first and the list is walked
+ * afresh after each handler returns.
+ */
+void
+oc_ri_fail_client_cbs(const oc_endpoint_t *endpoint, oc_status_t code)
+{
+  oc_client_cb_t *cb = (oc_client_cb_t *)oc_list_head(client_cbs);
+  while (cb != NULL) {
+    cb->failing = !cb->discovery && !cb->multicast &&
+                  oc_endpoint_compare(cb->endpoint, endpoint) == 0;
+    cb = cb->next;
+  }
+  cb = (oc_client_cb_t *)oc_list_head(client_cbs);
+  while (cb != NULL) {
+    if (cb->failing) {
+      oc_client_complete_request(cb, code);
+      cb = (oc_client_cb_t *)oc_list_head(client_cbs);
+    } else {
+      cb = cb->next;
+    }
+  }
+}
+
 oc_client_cb_t *
 oc_ri_find_client_cb_by_mid(uint16_t mid)
 {
-  oc_client_cb_t *cb = oc_list_head(client_cbs);
-  while (cb) {
-    if (cb->mid == mid)
-      break;
-    cb = cb->next;
+  oc_hash_link_t *link = oc_hash_lookup(&client_cbs_by_mid, mid);
+  if (link) {
+    return oc_hash_entry(link, oc_client_cb_t, mid_link);
   }
-  return cb;
+  return NULL;
 }
-#endif /*.ST_APP_OPTIMIZATION */
 
 oc_client_cb_t *
 oc_ri_find_client_cb_by_token(uint8_t *token, uint8_t token_len)
 {
-  oc_client_cb_t *cb = oc_list_head(client_cbs);
-  while (cb != NULL) {
+  oc_hash_link_t *link = oc_hash_lookup(&client_cbs_by_token,
+                                        oc_hash_bytes(token, token_len));
+  while (link) {
+    oc_client_cb_t *cb = oc_hash_entry(link, oc_client_cb_t, token_link);
     if (cb->token_len == token_len && memcmp(cb->token, token, token_len) == 0)
-      break;
-    cb = cb->next;
+      return cb;
+    link = oc_hash_next(link);
   }
-  return cb;
+  return NULL;
+}
+
+void
+oc_ri_set_client_cb_mid(oc_client_cb_t *cb, uint16_t mid)
+{
+  cb->mid = mid;
+  oc_hash_rekey(&client_cbs_by_mid, &cb->mid_link, mid);
+}
+
+void
+oc_ri_set_client_cb_token(oc_client_cb_t *cb, const uint8_t *token,
+                          uint8_t token_len)
+{
+  memcpy(cb->token, token, token_len);
+  cb->token_len = token_len;
+  oc_hash_rekey(&client_cbs_by_token, &cb->token_link,
+                oc_hash_bytes(cb->token, cb->token_len));
 }
 
 #ifdef OC_BLOCK_WISE
@@ -1182,13 +1491,14 @@ oc_ri_invoke_client_cb(void *response, oc_client_cb_t *cb,
 #ifndef OC_DYNAMIC_ALLOCATION
   char rep_objects_alloc[OC_MAX_NUM_REP_OBJECTS];
   oc_rep_t rep_objects_pool[OC_MAX_NUM_REP_OBJECTS];
+  /* Blocks are zeroed by oc_memb_alloc() as they are handed out */
   memset(rep_objects_alloc, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(char));
-  memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
-                                 rep_objects_alloc, (void *)rep_objects_pool,
-                                 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                 .num = OC_MAX_NUM_REP_OBJECTS,
+                                 .count = rep_objects_alloc,
+                                 .mem = (void *)rep_objects_pool };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
 #endif /* OC_DYNAMIC_ALLOCATION */
   oc_rep_set_pool(&rep_objects);
 
@@ -1219,13 +1529,16 @@ oc_ri_invoke_client_cb(void *response, oc_client_cb_t *cb,
       }
 #endif /*.ST_APP_OPTIMIZATION */
     } else {
-      int err = oc_parse_rep(payload, payload_len, &client_response.payload);
+      size_t rep_arena = oc_rep_arena_begin();
+      int err =
+        oc_parse_rep_borrowed(payload, payload_len, &client_response.payload);
       if (err == 0) {
         oc_response_handler_t handler =
           (oc_response_handler_t)cb->handler.response;
         handler(&client_response);
       }
       oc_free_rep(client_response.payload);
+      oc_rep_arena_end(rep_arena);
     }
   } else {
     if (pkt->type == COAP_TYPE_ACK && pkt->code == 0) {
@@ -1253,6 +1566,9 @@ oc_ri_invoke_client_cb(void *response, oc_client_cb_t *cb,
 #endif /* OC_BLOCK_WISE */
   } else {
     cb->observe_seq = client_response.observe_option;
+    if (!separate) {
+      oc_client_release_request(cb);
+    }
   }
 
   return true;
@@ -1286,6 +1602,8 @@ free_all_client_cbs(void)
     free_client_cb(cb);
     cb = oc_list_pop(client_cbs);
   }
+  oc_hash_init(&client_cbs_by_mid);
+  oc_hash_init(&client_cbs_by_token);
 }
 
 oc_client_cb_t *
@@ -1322,6 +1640,9 @@ oc_ri_alloc_client_cb(const char *uri, oc_endpoint_t *endpoint,
     oc_new_string(&cb->query, query, strlen(query));
   }
   oc_list_add(client_cbs, cb);
+  oc_hash_add(&client_cbs_by_mid, &cb->mid_link, cb->mid);
+  oc_hash_add(&client_cbs_by_token, &cb->token_link,
+              oc_hash_bytes(cb->token, cb->token_len));
   return cb;
 }
 #endif /* OC_CLIENT */
@@ -1333,6 +1654,10 @@ oc_ri_shutdown(void)
   coap_free_all_observers();
 #endif /* OC_SERVER */
   coap_free_all_transactions();
+  coap_free_all_rtt_estimators();
+#ifdef OC_TCP
+  coap_free_all_signal_peers();
+#endif /* OC_TCP */
   free_all_event_timers();
 #ifdef OC_CLIENT
   free_all_client_cbs();
@@ -1340,6 +1665,7 @@ oc_ri_shutdown(void)
 #ifdef OC_BLOCK_WISE
   oc_blockwise_scrub_buffers();
 #endif /* OC_BLOCK_WISE */
+  oc_buffer_shutdown();
 
   while (oc_main_poll() != 0)
     ;
@@ -1354,24 +1680,25 @@ oc_ri_shutdown(void)
 #ifdef OC_COLLECTIONS
   oc_collection_t *collection = oc_collection_get_all(), *next;
   while (collection != NULL) {
-    next = collection->next;
+    next = (oc_collection_t *)collection->res.next;
     oc_collection_free(collection);
     collection = next;
   }
 #endif /* OC_COLLECTIONS */
 #endif /* OC_SERVER */
 
+  uri_index_reset();
+
   oc_random_destroy();
 }
 
 OC_PROCESS_THREAD(timed_callback_events, ev, data)
 {
-  (void)data;
   OC_PROCESS_BEGIN();
   while (1) {
     OC_PROCESS_YIELD();
     if (ev == OC_PROCESS_EVENT_TIMER) {
-      check_event_callbacks();
+      dispatch_event_callback((struct oc_etimer *)data);
     }
   }
   OC_PROCESS_END();
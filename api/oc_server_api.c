@@ -180,6 +180,7 @@ oc_new_resource(const char *name, const char *uri, uint8_t num_resource_types,
     resource->default_interface = OC_IF_BASELINE;
     resource->observe_period_seconds = 0;
     resource->num_observers = 0;
+    resource->observers = NULL;
     oc_populate_resource_object(resource, name, uri, num_resource_types,
                                 device);
   }
@@ -193,8 +194,8 @@ oc_new_collection(const char *name, const char *uri, uint8_t num_resource_types,
 {
   oc_collection_t *collection = oc_collection_alloc();
   if (collection) {
-    collection->interfaces = OC_IF_BASELINE | OC_IF_LL | OC_IF_B;
-    collection->default_interface = OC_IF_LL;
+    collection->res.interfaces = OC_IF_BASELINE | OC_IF_LL | OC_IF_B;
+    collection->res.default_interface = OC_IF_LL;
     oc_populate_resource_object((oc_resource_t *)collection, name, uri,
                                 num_resource_types, device);
   }
@@ -273,6 +274,25 @@ oc_resource_set_periodic_observable(oc_resource_t *resource, uint16_t seconds)
   resource->observe_period_seconds = seconds;
 }
 
+void
+oc_resource_set_observe_step_property(oc_resource_t *resource,
+                                      const char *property)
+{
+  if (oc_string_len(resource->observe_step_property) > 0) {
+    oc_free_string(&resource->observe_step_property);
+  }
+  oc_new_string(&resource->observe_step_property, property, strlen(property));
+}
+
+#ifdef OC_WORKER_THREADS
+void
+oc_resource_set_worker_handlers(oc_resource_t *resource, bool concurrent)
+{
+  resource->worker_mode =
+    concurrent ? OC_WORKER_CONCURRENT : OC_WORKER_SERIALIZED;
+}
+#endif /* OC_WORKER_THREADS */
+
 void
 oc_resource_set_request_handler(oc_resource_t *resource, oc_method_t method,
                                 oc_request_callback_t callback, void *user_data)
@@ -350,18 +370,29 @@ oc_send_separate_response(oc_separate_response_t *handle,
   response_buffer.buffer = handle->buffer;
   response_buffer.response_length = (uint16_t)response_length();
   response_buffer.code = oc_status_code(response_code);
+  oc_send_separate_response_buffer(handle, &response_buffer);
+}
 
+void
+oc_send_separate_response_buffer(oc_separate_response_t *handle,
+                                 oc_response_buffer_t *response_buffer)
+{
   coap_separate_t *cur = oc_list_head(handle->requests), *next = NULL;
   coap_packet_t response[1];
 
   while (cur != NULL) {
     next = cur->next;
+    if (response_buffer->code == OC_IGNORE) {
+      coap_separate_clear(handle, cur);
+      cur = next;
+      continue;
+    }
     if (cur->observe > 0) {
       coap_transaction_t *t =
         coap_new_transaction(coap_get_mid(), &cur->endpoint);
       if (t) {
         coap_separate_resume(response, cur,
-                             (uint8_t)oc_status_code(response_code), t->mid);
+                             (uint8_t)response_buffer->code, t->mid);
         if (cur->endpoint.version == OIC_VER_1_1_0) {
           coap_set_header_content_format(response, APPLICATION_CBOR);
         } else {
@@ -372,9 +403,9 @@ oc_send_separate_response(oc_separate_response_t *handle,
         oc_blockwise_state_t *response_state = NULL;
 #ifdef OC_TCP
         if (!(cur->endpoint.flags & TCP) &&
-            response_buffer.response_length > cur->block2_size) {
+            response_buffer->response_length > cur->block2_size) {
 #else /* OC_TCP */
-        if (response_buffer.response_length > cur->block2_size) {
+        if (response_buffer->response_length > cur->block2_size) {
 #endif /* !OC_TCP */
           response_state = oc_blockwise_find_response_buffer(
             oc_string(cur->uri), oc_string_len(cur->uri), &cur->endpoint,
@@ -389,9 +420,9 @@ oc_send_separate_response(oc_separate_response_t *handle,
             goto next_separate_request;
           }
 
-          memcpy(response_state->buffer, response_buffer.buffer,
-                 response_buffer.response_length);
-          response_state->payload_size = response_buffer.response_length;
+          memcpy(response_state->buffer, response_buffer->buffer,
+                 response_buffer->response_length);
+          response_state->payload_size = response_buffer->response_length;
 
           uint32_t payload_size = 0;
           const void *payload = oc_blockwise_dispatch_block(
@@ -406,11 +437,11 @@ oc_send_separate_response(oc_separate_response_t *handle,
           }
         } else
 #endif /* OC_BLOCK_WISE */
-          if (response_buffer.response_length > 0) {
+          if (response_buffer->response_length > 0) {
           coap_set_payload(response, handle->buffer,
-                           response_buffer.response_length);
+                           response_buffer->response_length);
         }
-        coap_set_status_code(response, response_buffer.code);
+        coap_set_status_code(response, response_buffer->code);
         t->message->length = coap_serialize_message(response, t->message->data);
         coap_send_transaction(t);
       }
@@ -418,7 +449,7 @@ oc_send_separate_response(oc_separate_response_t *handle,
       oc_resource_t *resource = oc_ri_get_app_resource_by_uri(
         oc_string(cur->uri), oc_string_len(cur->uri), cur->endpoint.device);
       if (resource) {
-        coap_notify_observers(resource, &response_buffer, &cur->endpoint);
+        coap_notify_observers(resource, response_buffer, &cur->endpoint);
       }
     }
 #ifdef OC_BLOCK_WISE
@@ -27,49 +27,112 @@
 #if defined(OC_SERVER)
 #include "messaging/coap/observe.h"
 #endif /* OC_SERVER */
+#ifdef OC_TCP
+#include "messaging/coap/coap_signal.h"
+#endif /* OC_TCP */
 
 #define SESSION_STATE_FREE_DELAY_SECS (3)
 
 #ifdef OC_TCP
 OC_LIST(session_start_events);
 OC_LIST(session_end_events);
+/* Connects that failed, losing whatever was sent to the session meanwhile */
+OC_LIST(session_connect_failed_events);
+/* Ended sessions, only accessed by the stack */
+OC_LIST(session_free_events);
 
 static oc_event_callback_retval_t
 free_session_state_delayed(void *data)
 {
   (void)data;
-  oc_network_event_handler_mutex_lock();
   oc_endpoint_t *session_event =
-    (oc_endpoint_t *)oc_list_pop(session_end_events);
+    (oc_endpoint_t *)oc_list_pop(session_free_events);
   while (session_event != NULL) {
     oc_handle_session(session_event, OC_SESSION_DISCONNECTED);
     oc_free_endpoint(session_event);
-    session_event = oc_list_pop(session_end_events);
+    session_event = (oc_endpoint_t *)oc_list_pop(session_free_events);
   }
-  oc_network_event_handler_mutex_unlock();
   return OC_EVENT_DONE;
 }
 
+/* Signaling state belongs to the connection and is dropped as soon as it
+ * ends, so that a new connection to the same endpoint starts afresh; the
+ * rest of the session state is freed SESSION_STATE_FREE_DELAY_SECS later.
+ * Returns true if any session ended.
+ */
+static bool
+take_session_end_events(void)
+{
+  bool end_events = false;
+  oc_network_event_handler_mutex_lock();
+  oc_endpoint_t *session_event =
+    (oc_endpoint_t *)oc_list_pop(session_end_events);
+  oc_network_event_handler_mutex_unlock();
+  while (session_event != NULL) {
+    coap_signal_session_end(session_event);
+    oc_list_add(session_free_events, session_event);
+    end_events = true;
+    oc_network_event_handler_mutex_lock();
+    session_event = (oc_endpoint_t *)oc_list_pop(session_end_events);
+    oc_network_event_handler_mutex_unlock();
+  }
+  return end_events;
+}
+
+/* Requests sent to a session that never connected are answered with
+ * OC_SEND_FAILED rather than left to time out, and its signaling state is
+ * dropped as for an ended session.
+ */
 static void
-oc_process_session_event(void)
+take_session_connect_failed_events(bool fail_requests)
 {
   oc_network_event_handler_mutex_lock();
+  oc_endpoint_t *session_event =
+    (oc_endpoint_t *)oc_list_pop(session_connect_failed_events);
+  oc_network_event_handler_mutex_unlock();
+  while (session_event != NULL) {
+    coap_signal_session_end(session_event);
+#ifdef OC_CLIENT
+    if (fail_requests) {
+      oc_ri_fail_client_cbs(session_event, OC_SEND_FAILED);
+    }
+#else  /* OC_CLIENT */
+    (void)fail_requests;
+#endif /* !OC_CLIENT */
+    oc_free_endpoint(session_event);
+    oc_network_event_handler_mutex_lock();
+    session_event = (oc_endpoint_t *)oc_list_pop(session_connect_failed_events);
+    oc_network_event_handler_mutex_unlock();
+  }
+}
+
+static void
+oc_process_session_event(void)
+{
+  /* A session to an endpoint only starts once the previous one to it has
+   * ended, so end events are taken first.
+   */
+  bool end_events = take_session_end_events();
+  take_session_connect_failed_events(true);
 
+  oc_network_event_handler_mutex_lock();
   oc_endpoint_t *session_event =
     (oc_endpoint_t *)oc_list_pop(session_start_events);
+  oc_network_event_handler_mutex_unlock();
 
+  /* Session handlers may release messages, so they run without the mutex */
   while (session_event != NULL) {
     oc_handle_session(session_event, OC_SESSION_CONNECTED);
     oc_free_endpoint(session_event);
+    oc_network_event_handler_mutex_lock();
     session_event = oc_list_pop(session_start_events);
+    oc_network_event_handler_mutex_unlock();
   }
 
-  if (oc_list_length(session_end_events) > 0) {
+  if (end_events) {
     oc_set_delayed_callback(NULL, &free_session_state_delayed,
                             SESSION_STATE_FREE_DELAY_SECS);
   }
-
-  oc_network_event_handler_mutex_unlock();
 }
 
 OC_PROCESS(oc_session_events, "");
@@ -80,6 +143,8 @@ OC_PROCESS_THREAD(oc_session_events, ev, data) {
   while (oc_process_is_running(&(oc_session_events))) {
     OC_PROCESS_YIELD();
   }
+  take_session_end_events();
+  take_session_connect_failed_events(false);
   free_session_state_delayed(NULL);
   OC_PROCESS_END();
 }
@@ -121,6 +186,25 @@ oc_session_end_event(oc_endpoint_t *endpoint)
   oc_process_poll(&(oc_session_events));
   _oc_signal_event_loop();
 }
+
+void
+oc_session_connect_failed_event(oc_endpoint_t *endpoint)
+{
+  if (!oc_process_is_running(&(oc_session_events))) {
+    return;
+  }
+
+  oc_endpoint_t *ep = oc_new_endpoint();
+  memcpy(ep, endpoint, sizeof(oc_endpoint_t));
+  ep->next = NULL;
+
+  oc_network_event_handler_mutex_lock();
+  oc_list_add(session_connect_failed_events, ep);
+  oc_network_event_handler_mutex_unlock();
+
+  oc_process_poll(&(oc_session_events));
+  _oc_signal_event_loop();
+}
 #endif /* OC_TCP */
 
 void
@@ -138,6 +222,11 @@ oc_handle_session(oc_endpoint_t *endpoint, oc_session_state_t state)
     }
 #endif /* OC_SECURITY */
   }
+#ifdef OC_TCP
+  else if (endpoint->flags & TCP) {
+    coap_signal_session_start(endpoint);
+  }
+#endif /* OC_TCP */
 #ifdef OC_SESSION_EVENTS
   handle_session_event_callback(endpoint, state);
 #endif /* OC_SESSION_EVENTS */
@@ -0,0 +1,367 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#if defined(OC_SERVER) && defined(OC_WORKER_THREADS)
+
+#ifndef OC_DYNAMIC_ALLOCATION
+#error "OC_WORKER_THREADS requires OC_DYNAMIC_ALLOCATION"
+#endif /* !OC_DYNAMIC_ALLOCATION */
+#ifdef ST_APP_OPTIMIZATION
+#error "OC_WORKER_THREADS requires separate responses"
+#endif /* ST_APP_OPTIMIZATION */
+
+#include "oc_worker.h"
+#include "config.h"
+#include "messaging/coap/oc_coap.h"
+#include "messaging/coap/separate.h"
+#include "oc_api.h"
+#include "oc_signal_event_loop.h"
+#include "port/oc_log.h"
+#include "port/oc_worker_threads.h"
+#include "util/oc_list.h"
+#include "util/oc_mem.h"
+#include <string.h>
+
+#ifdef OC_BLOCK_WISE
+#define WORKER_RESPONSE_SIZE (OC_MAX_APP_DATA_SIZE)
+#else  /* OC_BLOCK_WISE */
+#define WORKER_RESPONSE_SIZE (OC_BLOCK_SIZE)
+#endif /* !OC_BLOCK_WISE */
+
+#define WORKER_ALIGN(size)                                                     \
+  (((size) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+struct oc_worker_job_s
+{
+  struct oc_worker_job_s *next;
+  oc_resource_t *resource;
+  oc_request_handler_t handler;
+  oc_method_t method;
+  oc_interface_mask_t interface;
+  uint8_t mode;
+  oc_endpoint_t origin;
+  const char *query;
+  int query_len;
+  oc_rep_t *request_payload;
+  oc_separate_response_t separate;
+  oc_response_buffer_t response_buffer;
+};
+
+/* All three lists are guarded by the worker threads lock */
+OC_LIST(pending_jobs);
+OC_LIST(running_jobs);
+OC_LIST(done_jobs);
+
+static bool workers_running;
+
+static bool
+resource_is_busy(oc_resource_t *resource)
+{
+  oc_worker_job_t *job = (oc_worker_job_t *)oc_list_head(running_jobs);
+  while (job != NULL && job->resource != resource) {
+    job = job->next;
+  }
+  return job != NULL;
+}
+
+/* Returns the oldest pending job that may start now. Jobs of a serialized
+ * resource wait while another job of the same resource is running.
+ */
+static oc_worker_job_t *
+next_job(void)
+{
+  oc_worker_job_t *job = (oc_worker_job_t *)oc_list_head(pending_jobs);
+  while (job != NULL) {
+    if (job->mode == OC_WORKER_CONCURRENT || !resource_is_busy(job->resource)) {
+      oc_list_remove(pending_jobs, job);
+      return job;
+    }
+    job = job->next;
+  }
+  return NULL;
+}
+
+static void
+run_job(oc_worker_job_t *job)
+{
+  oc_response_t response;
+  response.separate_response = NULL;
+  response.response_buffer = &job->response_buffer;
+
+  oc_request_t request;
+  request.origin = &job->origin;
+  request.resource = job->resource;
+  request.query = job->query;
+  request.query_len = job->query_len;
+  request.request_payload = job->request_payload;
+  request.response = &response;
+
+  job->response_buffer.buffer = job->separate.buffer;
+  job->response_buffer.buffer_size = (uint16_t)WORKER_RESPONSE_SIZE;
+  job->response_buffer.response_length = 0;
+  job->response_buffer.code = 0;
+
+  oc_rep_new(job->separate.buffer, WORKER_RESPONSE_SIZE);
+  job->handler.cb(&request, job->interface, job->handler.user_data);
+
+  if (response.separate_response != NULL) {
+    OC_ERR("oc_worker: handler on a worker may not defer its response");
+    job->response_buffer.response_length = 0;
+    job->response_buffer.code =
+      oc_status_code(OC_STATUS_INTERNAL_SERVER_ERROR);
+  } else if (job->response_buffer.code == 0) {
+    OC_ERR("oc_worker: handler returned without a response");
+    job->response_buffer.code =
+      oc_status_code(OC_STATUS_INTERNAL_SERVER_ERROR);
+  }
+}
+
+static void
+worker_run(void)
+{
+  oc_worker_threads_lock();
+  while (workers_running) {
+    oc_worker_job_t *job = next_job();
+    if (!job) {
+      oc_worker_threads_wait();
+      continue;
+    }
+    oc_list_add(running_jobs, job);
+    oc_worker_threads_unlock();
+
+    run_job(job);
+
+    oc_worker_threads_lock();
+    oc_list_remove(running_jobs, job);
+    oc_list_add(done_jobs, job);
+    /* Wakes oc_worker_cancel_jobs() waiting for this resource to go idle */
+    oc_worker_threads_broadcast();
+    oc_worker_threads_unlock();
+
+    oc_process_poll(&(oc_worker_events));
+    _oc_signal_event_loop();
+
+    oc_worker_threads_lock();
+  }
+  oc_worker_threads_unlock();
+}
+
+static bool
+resource_exists(oc_resource_t *resource)
+{
+  oc_resource_t *cur = oc_ri_get_app_resources();
+  while (cur != NULL && cur != resource) {
+    cur = cur->next;
+  }
+  return cur != NULL;
+}
+
+static void
+free_job(oc_worker_job_t *job)
+{
+  if (job->separate.active) {
+    job->response_buffer.code = OC_IGNORE;
+    oc_send_separate_response_buffer(&job->separate, &job->response_buffer);
+  } else {
+    oc_mem_free(job->separate.buffer);
+  }
+  oc_mem_free(job);
+}
+
+static void
+send_done_jobs(void)
+{
+  oc_worker_threads_lock();
+  oc_worker_job_t *job = (oc_worker_job_t *)oc_list_pop(done_jobs);
+  oc_worker_threads_unlock();
+
+  while (job != NULL) {
+    oc_send_separate_response_buffer(&job->separate, &job->response_buffer);
+    /* As for inline handlers, a successful update notifies observers */
+    if (job->resource && (job->method == OC_PUT || job->method == OC_POST) &&
+        job->response_buffer.code != OC_IGNORE &&
+        job->response_buffer.code < oc_status_code(OC_STATUS_BAD_REQUEST) &&
+        resource_exists(job->resource)) {
+      oc_notify_observers(job->resource);
+    }
+    oc_mem_free(job);
+
+    oc_worker_threads_lock();
+    job = (oc_worker_job_t *)oc_list_pop(done_jobs);
+    oc_worker_threads_unlock();
+  }
+}
+
+static void
+stop_workers(void)
+{
+  oc_worker_threads_lock();
+  workers_running = false;
+  oc_worker_threads_broadcast();
+  oc_worker_threads_unlock();
+  oc_worker_threads_join();
+
+  oc_worker_job_t *job;
+  while ((job = (oc_worker_job_t *)oc_list_pop(pending_jobs)) != NULL) {
+    free_job(job);
+  }
+  while ((job = (oc_worker_job_t *)oc_list_pop(done_jobs)) != NULL) {
+    free_job(job);
+  }
+}
+
+OC_PROCESS(oc_worker_events, "");
+OC_PROCESS_THREAD(oc_worker_events, ev, data)
+{
+  (void)data;
+  OC_PROCESS_POLLHANDLER(send_done_jobs());
+  OC_PROCESS_EXITHANDLER(stop_workers());
+  OC_PROCESS_BEGIN();
+  workers_running = true;
+  if (!oc_worker_threads_start(OC_WORKER_POOL_SIZE, worker_run)) {
+    OC_ERR("oc_worker: running all handlers on the event loop");
+    stop_workers();
+  }
+  while (oc_process_is_running(&(oc_worker_events))) {
+    OC_PROCESS_YIELD();
+  }
+  OC_PROCESS_END();
+}
+
+static oc_request_handler_t *
+find_handler(oc_resource_t *resource, oc_method_t method)
+{
+  switch (method) {
+  case OC_GET:
+    return &resource->get_handler;
+  case OC_POST:
+    return &resource->post_handler;
+  case OC_PUT:
+    return &resource->put_handler;
+  case OC_DELETE:
+    return &resource->delete_handler;
+  default:
+    return NULL;
+  }
+}
+
+oc_worker_job_t *
+oc_worker_prepare(oc_request_t *request, oc_method_t method,
+                  oc_interface_mask_t interface)
+{
+  oc_resource_t *resource = request->resource;
+  if (!workers_running || resource->worker_mode == OC_WORKER_NONE) {
+    return NULL;
+  }
+  oc_request_handler_t *handler = find_handler(resource, method);
+  if (!handler || !handler->cb) {
+    return NULL;
+  }
+
+  /* The job, the copied payload and the query share one allocation */
+  size_t job_size = WORKER_ALIGN(sizeof(oc_worker_job_t));
+  size_t payload_size = oc_rep_copy_size(request->request_payload);
+  oc_worker_job_t *job = (oc_worker_job_t *)oc_mem_calloc(
+    1, job_size + payload_size + request->query_len + 1);
+  if (!job) {
+    OC_WRN("oc_worker: insufficient memory, handling request inline");
+    return NULL;
+  }
+  uint8_t *extra = (uint8_t *)job + job_size;
+
+  job->resource = resource;
+  job->handler = *handler;
+  job->method = method;
+  job->interface = interface;
+  job->mode = resource->worker_mode;
+  memcpy(&job->origin, request->origin, sizeof(oc_endpoint_t));
+  job->origin.next = NULL;
+  job->request_payload = oc_rep_copy(request->request_payload, extra);
+  if (request->query_len > 0) {
+    memcpy(extra + payload_size, request->query, request->query_len);
+    job->query = (const char *)extra + payload_size;
+    job->query_len = request->query_len;
+  }
+
+  oc_indicate_separate_response(request, &job->separate);
+  return job;
+}
+
+void
+oc_worker_cancel_jobs(oc_resource_t *resource)
+{
+  oc_worker_job_t *cancelled = NULL, *job, *next;
+
+  oc_worker_threads_lock();
+  job = (oc_worker_job_t *)oc_list_head(pending_jobs);
+  while (job != NULL) {
+    next = job->next;
+    if (job->resource == resource) {
+      oc_list_remove(pending_jobs, job);
+      job->next = cancelled;
+      cancelled = job;
+    }
+    job = next;
+  }
+  /* A running handler still dereferences the resource */
+  while (resource_is_busy(resource)) {
+    oc_worker_threads_wait();
+  }
+  job = (oc_worker_job_t *)oc_list_head(done_jobs);
+  while (job != NULL) {
+    if (job->resource == resource) {
+      job->resource = NULL;
+    }
+    job = job->next;
+  }
+  oc_worker_threads_unlock();
+
+  while (cancelled != NULL) {
+    next = cancelled->next;
+    OC_DBG("oc_worker: cancelling a job of a deleted resource");
+    cancelled->response_buffer.response_length = 0;
+    cancelled->response_buffer.code = oc_status_code(OC_STATUS_NOT_FOUND);
+    oc_send_separate_response_buffer(&cancelled->separate,
+                                     &cancelled->response_buffer);
+    oc_mem_free(cancelled);
+    cancelled = next;
+  }
+}
+
+void
+oc_worker_submit(oc_worker_job_t *job)
+{
+  if (!job->separate.active) {
+    free_job(job);
+    return;
+  }
+  if (!job->separate.buffer) {
+    OC_WRN("oc_worker: insufficient memory for the response");
+    job->response_buffer.response_length = 0;
+    job->response_buffer.code = oc_status_code(OC_STATUS_SERVICE_UNAVAILABLE);
+    oc_send_separate_response_buffer(&job->separate, &job->response_buffer);
+    oc_mem_free(job);
+    return;
+  }
+
+  oc_worker_threads_lock();
+  oc_list_add(pending_jobs, job);
+  oc_worker_threads_signal();
+  oc_worker_threads_unlock();
+}
+#endif /* OC_SERVER && OC_WORKER_THREADS */
@@ -0,0 +1,118 @@
+/******************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+extern "C" {
+    #include "oc_buffer.h"
+    #include "port/oc_network_events_mutex.h"
+    #include "util/oc_etimer.h"
+    #include "util/oc_process.h"
+}
+
+#ifdef OC_MESSAGE_CACHE_SIZE
+
+#define NUM_THREADS (4)
+#define NUM_ROUNDS (2000)
+
+class TestMessageCache: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            oc_network_event_handler_mutex_init();
+            oc_process_init();
+            /* Owns the cache timer, which must not outlive the test */
+            oc_process_start(&oc_etimer_process, NULL);
+            oc_process_start(&message_buffer_handler, NULL);
+        }
+
+        virtual void TearDown()
+        {
+            oc_process_exit(&message_buffer_handler);
+            oc_process_exit(&oc_etimer_process);
+            oc_network_event_handler_mutex_destroy();
+        }
+};
+
+TEST_F(TestMessageCache, ReleasedMessageIsReused_P)
+{
+    oc_message_t *message = oc_allocate_message();
+    ASSERT_TRUE(message != NULL);
+    uint8_t *data = message->data;
+    message->length = 10;
+    message->endpoint.flags = IPV6;
+    oc_message_unref(message);
+
+    oc_message_t *reused = oc_allocate_message();
+    ASSERT_EQ(message, reused);
+    EXPECT_EQ(data, reused->data);
+    EXPECT_EQ(1, reused->ref_count);
+    EXPECT_EQ(0u, reused->length);
+    EXPECT_EQ(0, reused->endpoint.flags);
+    oc_message_unref(reused);
+}
+
+static void
+cycle_messages(std::atomic<int> *failures)
+{
+    oc_message_t *messages[4];
+    for (int i = 0; i < NUM_ROUNDS; i++) {
+        int n = oc_allocate_messages(messages, 4);
+        if (n != 4) {
+            (*failures)++;
+        }
+        for (int j = 0; j < n; j++) {
+            if (messages[j]->ref_count != 1) {
+                (*failures)++;
+            }
+            oc_message_unref(messages[j]);
+        }
+    }
+}
+
+TEST_F(TestMessageCache, ConcurrentReleaseWhileCacheIsChecked_P)
+{
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NUM_THREADS; i++) {
+        threads.push_back(std::thread(cycle_messages, &failures));
+    }
+
+    /* Every event the buffer handler receives makes it check the cache
+     * while the other threads fill and drain it.
+     */
+    for (int i = 0; i < NUM_ROUNDS; i++) {
+        oc_process_post(&message_buffer_handler, OC_PROCESS_EVENT_CONTINUE,
+                        NULL);
+        while (oc_process_run()) {
+        }
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(0, failures);
+}
+
+#endif /* OC_MESSAGE_CACHE_SIZE */
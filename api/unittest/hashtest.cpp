@@ -0,0 +1,86 @@
+/******************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include "gtest/gtest.h"
+
+extern "C" {
+    #include "util/oc_hash.h"
+}
+
+#define NUM_ENTRIES (1000)
+
+typedef struct {
+    int id;
+    oc_hash_link_t link;
+} test_entry_t;
+
+OC_HASH(test_index, 8);
+
+static test_entry_t entries[NUM_ENTRIES];
+
+TEST(TestHash, LookupFindsEveryEntry_P)
+{
+    oc_hash_init(&test_index);
+    for (int i = 0; i < NUM_ENTRIES; i++) {
+        entries[i].id = i;
+        oc_hash_add(&test_index, &entries[i].link, (uint32_t)i);
+    }
+    for (int i = 0; i < NUM_ENTRIES; i++) {
+        oc_hash_link_t *link = oc_hash_lookup(&test_index, (uint32_t)i);
+        ASSERT_NE(nullptr, link);
+        EXPECT_EQ(i, oc_hash_entry(link, test_entry_t, link)->id);
+        EXPECT_EQ(nullptr, oc_hash_next(link));
+    }
+    EXPECT_EQ(nullptr, oc_hash_lookup(&test_index, NUM_ENTRIES));
+    oc_hash_init(&test_index);
+}
+
+TEST(TestHash, EqualKeysKeepInsertionOrder_P)
+{
+    oc_hash_init(&test_index);
+    for (int i = 0; i < 4; i++) {
+        entries[i].id = i;
+        oc_hash_add(&test_index, &entries[i].link, 42);
+    }
+    oc_hash_remove(&test_index, &entries[0].link);
+    oc_hash_rekey(&test_index, &entries[1].link, 42);
+    int expected[] = { 2, 3, 1 };
+    oc_hash_link_t *link = oc_hash_lookup(&test_index, 42);
+    for (int i = 0; i < 3; i++) {
+        ASSERT_NE(nullptr, link);
+        EXPECT_EQ(expected[i], oc_hash_entry(link, test_entry_t, link)->id);
+        link = oc_hash_next(link);
+    }
+    EXPECT_EQ(nullptr, link);
+    oc_hash_init(&test_index);
+}
+
+TEST(TestHash, RemoveUnindexedEntryIsIgnored_N)
+{
+    oc_hash_init(&test_index);
+    oc_hash_add(&test_index, &entries[0].link, 7);
+    entries[1].link.key = 7;
+    entries[1].link.next = NULL;
+    oc_hash_remove(&test_index, &entries[1].link);
+    EXPECT_EQ(&entries[0].link, oc_hash_lookup(&test_index, 7));
+    oc_hash_remove(&test_index, &entries[0].link);
+    EXPECT_EQ(nullptr, oc_hash_lookup(&test_index, 7));
+    oc_hash_init(&test_index);
+}
@@ -0,0 +1,237 @@
+/******************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include "gtest/gtest.h"
+
+extern "C" {
+    #include "util/oc_memb.h"
+}
+
+#define SMALL_POOL_SIZE (16)
+#define LARGE_POOL_SIZE (4096)
+
+typedef struct {
+    int value;
+    char data[28];
+} test_block_t;
+
+OC_MEMB(small_pool, test_block_t, SMALL_POOL_SIZE);
+OC_MEMB(large_pool, test_block_t, LARGE_POOL_SIZE);
+OC_MEMB(tiny_pool, char, SMALL_POOL_SIZE);
+#ifdef OC_DYNAMIC_ALLOCATION
+OC_MEMB_FIXED(fixed_pool, test_block_t, SMALL_POOL_SIZE);
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+static int last_num_free = -1;
+
+static void
+buffers_avail(int num_free)
+{
+    last_num_free = num_free;
+}
+
+TEST(TestMemb, AllocUntilExhausted_P)
+{
+    void *blocks[SMALL_POOL_SIZE];
+    oc_memb_init(&small_pool);
+    for (int i = 0; i < SMALL_POOL_SIZE; i++) {
+        blocks[i] = oc_memb_alloc(&small_pool);
+        ASSERT_NE(nullptr, blocks[i]);
+#ifndef OC_DYNAMIC_ALLOCATION
+        EXPECT_EQ(SMALL_POOL_SIZE - i - 1, oc_memb_numfree(&small_pool));
+#endif /* !OC_DYNAMIC_ALLOCATION */
+    }
+#ifndef OC_DYNAMIC_ALLOCATION
+    EXPECT_EQ(nullptr, oc_memb_alloc(&small_pool));
+#endif /* !OC_DYNAMIC_ALLOCATION */
+    for (int i = 0; i < SMALL_POOL_SIZE; i++) {
+        oc_memb_free(&small_pool, blocks[i]);
+    }
+#ifndef OC_DYNAMIC_ALLOCATION
+    EXPECT_EQ(SMALL_POOL_SIZE, oc_memb_numfree(&small_pool));
+#endif /* !OC_DYNAMIC_ALLOCATION */
+}
+
+TEST(TestMemb, FreedBlockIsReused_P)
+{
+    oc_memb_init(&small_pool);
+    test_block_t *a = (test_block_t *)oc_memb_alloc(&small_pool);
+    test_block_t *b = (test_block_t *)oc_memb_alloc(&small_pool);
+    ASSERT_NE(nullptr, a);
+    ASSERT_NE(nullptr, b);
+    a->value = 42;
+    oc_memb_free(&small_pool, a);
+    test_block_t *c = (test_block_t *)oc_memb_alloc(&small_pool);
+    ASSERT_NE(nullptr, c);
+#ifndef OC_DYNAMIC_ALLOCATION
+    EXPECT_EQ(a, c);
+#endif /* !OC_DYNAMIC_ALLOCATION */
+    EXPECT_EQ(0, c->value);
+    oc_memb_free(&small_pool, b);
+    oc_memb_free(&small_pool, c);
+#ifndef OC_DYNAMIC_ALLOCATION
+    EXPECT_EQ(SMALL_POOL_SIZE, oc_memb_numfree(&small_pool));
+#endif /* !OC_DYNAMIC_ALLOCATION */
+}
+
+TEST(TestMemb, DoubleFreeIsIgnored_N)
+{
+#ifndef OC_DYNAMIC_ALLOCATION
+    oc_memb_init(&small_pool);
+    void *a = oc_memb_alloc(&small_pool);
+    ASSERT_NE(nullptr, a);
+    oc_memb_free(&small_pool, a);
+    oc_memb_free(&small_pool, a);
+    EXPECT_EQ(SMALL_POOL_SIZE, oc_memb_numfree(&small_pool));
+    void *b = oc_memb_alloc(&small_pool);
+    void *c = oc_memb_alloc(&small_pool);
+    EXPECT_NE(b, c);
+    oc_memb_free(&small_pool, b);
+    oc_memb_free(&small_pool, c);
+#endif /* !OC_DYNAMIC_ALLOCATION */
+}
+
+TEST(TestMemb, BuffersAvailCallback_P)
+{
+#ifndef OC_DYNAMIC_ALLOCATION
+    oc_memb_init(&small_pool);
+    oc_memb_set_buffers_avail_cb(&small_pool, buffers_avail);
+    void *a = oc_memb_alloc(&small_pool);
+    void *b = oc_memb_alloc(&small_pool);
+    oc_memb_free(&small_pool, a);
+    EXPECT_EQ(SMALL_POOL_SIZE - 1, last_num_free);
+    oc_memb_free(&small_pool, b);
+    EXPECT_EQ(SMALL_POOL_SIZE, last_num_free);
+    oc_memb_set_buffers_avail_cb(&small_pool, NULL);
+#endif /* !OC_DYNAMIC_ALLOCATION */
+}
+
+TEST(TestMemb, AllocatedBlockIsZeroed_P)
+{
+    oc_memb_init(&small_pool);
+    test_block_t *a = (test_block_t *)oc_memb_alloc(&small_pool);
+    ASSERT_NE(nullptr, a);
+    memset(a, 0xA5, sizeof(test_block_t));
+    oc_memb_free(&small_pool, a);
+    test_block_t *b = (test_block_t *)oc_memb_alloc(&small_pool);
+    ASSERT_NE(nullptr, b);
+    /* The free list link stored in a freed block must not leak out */
+    const char *bytes = (const char *)b;
+    for (size_t i = 0; i < sizeof(test_block_t); i++) {
+        EXPECT_EQ(0, bytes[i]);
+    }
+    oc_memb_free(&small_pool, b);
+}
+
+#ifndef OC_DYNAMIC_ALLOCATION
+TEST(TestMemb, FreshBlocksAreHandedOutInOrder_P)
+{
+    test_block_t *blocks[SMALL_POOL_SIZE];
+    oc_memb_init(&small_pool);
+    for (int i = 0; i < SMALL_POOL_SIZE; i++) {
+        blocks[i] = (test_block_t *)oc_memb_alloc(&small_pool);
+        ASSERT_NE(nullptr, blocks[i]);
+        EXPECT_EQ(blocks[0] + i, blocks[i]);
+    }
+    for (int i = 0; i < SMALL_POOL_SIZE; i++) {
+        oc_memb_free(&small_pool, blocks[i]);
+    }
+}
+
+TEST(TestMemb, FreedBlocksAreReusedLastFirst_P)
+{
+    oc_memb_init(&small_pool);
+    void *a = oc_memb_alloc(&small_pool);
+    void *b = oc_memb_alloc(&small_pool);
+    void *c = oc_memb_alloc(&small_pool);
+    oc_memb_free(&small_pool, a);
+    oc_memb_free(&small_pool, c);
+    /* Freed blocks come back most recently freed first, before any block
+     * that was never handed out
+     */
+    EXPECT_EQ(c, oc_memb_alloc(&small_pool));
+    EXPECT_EQ(a, oc_memb_alloc(&small_pool));
+    void *d = oc_memb_alloc(&small_pool);
+    EXPECT_EQ((test_block_t *)b + 2, d);
+    oc_memb_free(&small_pool, a);
+    oc_memb_free(&small_pool, b);
+    oc_memb_free(&small_pool, c);
+    oc_memb_free(&small_pool, d);
+    EXPECT_EQ(SMALL_POOL_SIZE, oc_memb_numfree(&small_pool));
+}
+
+TEST(TestMemb, FullLargePoolReusesFreedBlock_P)
+{
+    static void *blocks[LARGE_POOL_SIZE];
+    oc_memb_init(&large_pool);
+    for (int i = 0; i < LARGE_POOL_SIZE; i++) {
+        blocks[i] = oc_memb_alloc(&large_pool);
+        ASSERT_NE(nullptr, blocks[i]);
+    }
+    EXPECT_EQ(nullptr, oc_memb_alloc(&large_pool));
+    oc_memb_free(&large_pool, blocks[LARGE_POOL_SIZE - 10]);
+    EXPECT_EQ(1, oc_memb_numfree(&large_pool));
+    EXPECT_EQ(blocks[LARGE_POOL_SIZE - 10], oc_memb_alloc(&large_pool));
+    EXPECT_EQ(nullptr, oc_memb_alloc(&large_pool));
+    for (int i = 0; i < LARGE_POOL_SIZE; i++) {
+        oc_memb_free(&large_pool, blocks[i]);
+    }
+    EXPECT_EQ(LARGE_POOL_SIZE, oc_memb_numfree(&large_pool));
+}
+
+TEST(TestMemb, BlocksSmallerThanLinkAreReused_P)
+{
+    char *blocks[SMALL_POOL_SIZE];
+    oc_memb_init(&tiny_pool);
+    for (int i = 0; i < SMALL_POOL_SIZE; i++) {
+        blocks[i] = (char *)oc_memb_alloc(&tiny_pool);
+        ASSERT_NE(nullptr, blocks[i]);
+        *blocks[i] = 'x';
+    }
+    EXPECT_EQ(nullptr, oc_memb_alloc(&tiny_pool));
+    oc_memb_free(&tiny_pool, blocks[5]);
+    char *c = (char *)oc_memb_alloc(&tiny_pool);
+    EXPECT_EQ(blocks[5], c);
+    EXPECT_EQ(0, *c);
+    for (int i = 0; i < SMALL_POOL_SIZE; i++) {
+        oc_memb_free(&tiny_pool, blocks[i]);
+    }
+    EXPECT_EQ(SMALL_POOL_SIZE, oc_memb_numfree(&tiny_pool));
+}
+#else  /* !OC_DYNAMIC_ALLOCATION */
+TEST(TestMemb, FixedPoolCapsLiveBlocks_P)
+{
+    void *blocks[SMALL_POOL_SIZE];
+    oc_memb_init(&fixed_pool);
+    for (int i = 0; i < SMALL_POOL_SIZE; i++) {
+        blocks[i] = oc_memb_alloc(&fixed_pool);
+        ASSERT_NE(nullptr, blocks[i]);
+    }
+    EXPECT_EQ(0, oc_memb_numfree(&fixed_pool));
+    EXPECT_EQ(nullptr, oc_memb_alloc(&fixed_pool));
+    oc_memb_free(&fixed_pool, blocks[0]);
+    blocks[0] = oc_memb_alloc(&fixed_pool);
+    EXPECT_NE(nullptr, blocks[0]);
+    for (int i = 0; i < SMALL_POOL_SIZE; i++) {
+        oc_memb_free(&fixed_pool, blocks[i]);
+    }
+    EXPECT_EQ(SMALL_POOL_SIZE, oc_memb_numfree(&fixed_pool));
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
@@ -0,0 +1,122 @@
+/******************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+extern "C" {
+    #include "oc_buffer.h"
+    #include "oc_network_events.h"
+    #include "port/oc_network_events_mutex.h"
+    #include "util/oc_process.h"
+}
+
+#ifdef OC_NETWORK_EVENT_RING_SIZE
+
+#define NUM_PRODUCERS (4)
+#define MESSAGES_PER_PRODUCER (OC_NETWORK_EVENT_RING_SIZE)
+#define NUM_MESSAGES (NUM_PRODUCERS * MESSAGES_PER_PRODUCER)
+
+OC_MEMB(test_messages, oc_message_t, NUM_MESSAGES);
+
+static std::atomic<int> messages_freed(0);
+
+static void
+messages_freed_handler(int num_free)
+{
+    (void)num_free;
+    messages_freed++;
+}
+
+class TestNetworkEvents: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            messages_freed = 0;
+            oc_network_event_handler_mutex_init();
+            oc_memb_init(&test_messages);
+            oc_memb_set_buffers_avail_cb(&test_messages,
+                                         messages_freed_handler);
+            oc_process_init();
+            oc_process_start(&oc_network_events, NULL);
+        }
+
+        virtual void TearDown()
+        {
+            if (oc_process_is_running(&oc_network_events)) {
+                oc_process_exit(&oc_network_events);
+            }
+            oc_memb_set_buffers_avail_cb(&test_messages, NULL);
+            oc_network_event_handler_mutex_destroy();
+        }
+};
+
+static void
+produce_messages(std::atomic<int> *allocated)
+{
+    for (int i = 0; i < MESSAGES_PER_PRODUCER; i++) {
+        oc_message_t *message =
+            oc_allocate_message_from_pool(&test_messages);
+        if (!message) {
+            continue;
+        }
+        (*allocated)++;
+        oc_network_event(message);
+    }
+}
+
+TEST_F(TestNetworkEvents, ConcurrentProducersFillRing_P)
+{
+    std::atomic<int> allocated(0);
+    std::vector<std::thread> producers;
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        producers.push_back(std::thread(produce_messages, &allocated));
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    ASSERT_EQ(NUM_MESSAGES, allocated);
+
+    /* The event loop has not run, so the ring holds exactly as many
+     * messages as it has slots and every other message was released.
+     */
+    EXPECT_EQ(NUM_MESSAGES - OC_NETWORK_EVENT_RING_SIZE, messages_freed);
+
+    /* Shutting down releases each queued message exactly once */
+    oc_process_exit(&oc_network_events);
+    EXPECT_EQ(NUM_MESSAGES, messages_freed);
+}
+
+TEST_F(TestNetworkEvents, EventsAfterShutdownAreReleased_P)
+{
+    oc_message_t *messages[2];
+    messages[0] = oc_allocate_message_from_pool(&test_messages);
+    messages[1] = oc_allocate_message_from_pool(&test_messages);
+    ASSERT_TRUE(messages[0] != NULL && messages[1] != NULL);
+
+    oc_process_exit(&oc_network_events);
+    oc_network_event_batch(messages, 2);
+    EXPECT_EQ(2, messages_freed);
+}
+
+#endif /* OC_NETWORK_EVENT_RING_SIZE */
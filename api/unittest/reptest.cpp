@@ -20,6 +20,7 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 #include "gtest/gtest.h"
 extern "C" {
     #include "oc_rep.h"
@@ -30,3 +31,155 @@ TEST(TestRep, OCRepFinalizeTest_P)
     int repSize = oc_rep_finalize();
     EXPECT_NE(repSize, -1);
 }
+
+static int
+encode_test_payload(uint8_t *buf, int size)
+{
+    int values[3] = { 1, 2, 3 };
+    oc_rep_new(buf, size);
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, power, 42);
+    oc_rep_set_text_string(root, name, "lamp");
+    oc_rep_set_int_array(root, levels, values, 3);
+    oc_rep_end_root_object();
+    return oc_rep_finalize();
+}
+
+TEST(TestRep, OCRepArenaParseTest_P)
+{
+    uint8_t buf[128];
+    int len = encode_test_payload(buf, sizeof(buf));
+    ASSERT_GT(len, 0);
+
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
+    oc_rep_set_pool(&rep_objects);
+    size_t rep_arena = oc_rep_arena_begin();
+    oc_rep_t *rep = NULL;
+    ASSERT_EQ(0, oc_parse_rep(buf, len, &rep));
+
+    int power = 0, *levels = NULL, levels_size = 0, name_size = 0;
+    char *name = NULL;
+    EXPECT_TRUE(oc_rep_get_int(rep, "power", &power));
+    EXPECT_EQ(42, power);
+    EXPECT_TRUE(oc_rep_get_string(rep, "name", &name, &name_size));
+    EXPECT_STREQ("lamp", name);
+    EXPECT_TRUE(oc_rep_get_int_array(rep, "levels", &levels, &levels_size));
+    ASSERT_EQ(3, levels_size);
+    EXPECT_EQ(3, levels[2]);
+    oc_free_rep(rep);
+    oc_rep_arena_end(rep_arena);
+
+    /* The arena is reused from the start by the next scope */
+    rep_arena = oc_rep_arena_begin();
+    oc_rep_t *rep2 = NULL;
+    ASSERT_EQ(0, oc_parse_rep(buf, len, &rep2));
+#ifdef OC_REP_ARENA_SIZE
+    EXPECT_EQ(rep, rep2);
+#endif /* OC_REP_ARENA_SIZE */
+    oc_free_rep(rep2);
+    oc_rep_arena_end(rep_arena);
+}
+
+TEST(TestRep, OCRepBorrowedParseTest_P)
+{
+    uint8_t buf[128], blob[4] = { 0xde, 0xad, 0x00, 0xef };
+    oc_rep_new(buf, sizeof(buf));
+    oc_rep_start_root_object();
+    oc_rep_set_text_string(root, name, "lamp");
+    oc_rep_set_object(root, cfg);
+    oc_rep_set_text_string(cfg, id, "");
+    oc_rep_set_byte_string(cfg, blob, blob, sizeof(blob));
+    oc_rep_close_object(root, cfg);
+    oc_rep_set_int(root, power, 42);
+    oc_rep_end_root_object();
+    int len = oc_rep_finalize();
+    ASSERT_GT(len, 0);
+
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
+    oc_rep_set_pool(&rep_objects);
+    oc_rep_t *rep = NULL, *cfg = NULL;
+    ASSERT_EQ(0, oc_parse_rep_borrowed(buf, len, &rep));
+
+    char *str = NULL;
+    int size = 0, power = 0;
+    EXPECT_TRUE(oc_rep_get_string(rep, "name", &str, &size));
+    EXPECT_STREQ("lamp", str);
+    EXPECT_EQ(4, size);
+    EXPECT_TRUE(str > (char *)buf && str < (char *)buf + len);
+    ASSERT_TRUE(oc_rep_get_object(rep, "cfg", &cfg));
+    EXPECT_TRUE(oc_rep_get_string(cfg, "id", &str, &size));
+    EXPECT_STREQ("", str);
+    EXPECT_TRUE(oc_rep_get_byte_string(cfg, "blob", &str, &size));
+    ASSERT_EQ((int)sizeof(blob), size);
+    EXPECT_EQ(0, memcmp(blob, str, sizeof(blob)));
+    EXPECT_TRUE(oc_rep_get_int(rep, "power", &power));
+    EXPECT_EQ(42, power);
+
+    oc_string_t copy;
+    ASSERT_TRUE(oc_rep_dup_string(rep, "name", &copy));
+    oc_free_rep(rep);
+    memset(buf, 0, sizeof(buf));
+    EXPECT_STREQ("lamp", oc_string(copy));
+    oc_free_string(&copy);
+}
+
+TEST(TestRep, OCRepCopyTest_P)
+{
+    uint8_t buf[128];
+    int len = encode_test_payload(buf, sizeof(buf));
+    ASSERT_GT(len, 0);
+
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
+    oc_rep_set_pool(&rep_objects);
+    oc_rep_t *rep = NULL;
+    ASSERT_EQ(0, oc_parse_rep_borrowed(buf, len, &rep));
+
+    size_t size = oc_rep_copy_size(rep);
+    ASSERT_GT(size, 0u);
+    void *block = malloc(size);
+    ASSERT_NE(nullptr, block);
+    oc_rep_t *copy = oc_rep_copy(rep, block);
+    EXPECT_EQ(block, (void *)copy);
+    oc_free_rep(rep);
+    memset(buf, 0, sizeof(buf));
+
+    int power = 0, *levels = NULL, levels_size = 0, name_size = 0;
+    char *name = NULL;
+    EXPECT_TRUE(oc_rep_get_int(copy, "power", &power));
+    EXPECT_EQ(42, power);
+    EXPECT_TRUE(oc_rep_get_string(copy, "name", &name, &name_size));
+    EXPECT_STREQ("lamp", name);
+    EXPECT_TRUE(oc_rep_get_int_array(copy, "levels", &levels, &levels_size));
+    ASSERT_EQ(3, levels_size);
+    EXPECT_EQ(3, levels[2]);
+    EXPECT_TRUE((char *)name > (char *)block &&
+                (char *)name < (char *)block + size);
+    free(block);
+
+    EXPECT_EQ(0u, oc_rep_copy_size(NULL));
+    EXPECT_EQ(nullptr, oc_rep_copy(NULL, buf));
+}
+
+TEST(TestRep, OCRepFindNumberTest_P)
+{
+    uint8_t buf[128];
+    int len = encode_test_payload(buf, sizeof(buf));
+    ASSERT_GT(len, 0);
+
+    double value = 0;
+    EXPECT_TRUE(oc_rep_find_number(buf, len, "power", &value));
+    EXPECT_EQ(42.0, value);
+    EXPECT_FALSE(oc_rep_find_number(buf, len, "name", &value));
+    EXPECT_FALSE(oc_rep_find_number(buf, len, "levels", &value));
+    EXPECT_FALSE(oc_rep_find_number(buf, len, "pow", &value));
+
+    oc_rep_new(buf, sizeof(buf));
+    oc_rep_start_root_object();
+    oc_rep_set_text_string(root, name, "sensor");
+    oc_rep_set_double(root, temperature, 21.5);
+    oc_rep_end_root_object();
+    len = oc_rep_finalize();
+    ASSERT_GT(len, 0);
+    EXPECT_TRUE(oc_rep_find_number(buf, len, "temperature", &value));
+    EXPECT_EQ(21.5, value);
+}
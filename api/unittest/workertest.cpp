@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "messaging/coap/coap.h"
+#include "oc_api.h"
+#include "oc_endpoint.h"
+}
+
+#ifdef OC_WORKER_THREADS
+
+static oc_resource_t *work_res;
+static std::atomic<int> handled;
+static std::atomic<bool> started;
+static std::atomic<bool> release;
+static std::thread::id main_thread;
+static std::thread::id handler_thread;
+
+static void
+work_handler(oc_request_t *request, oc_interface_mask_t interface,
+             void *user_data)
+{
+    (void)interface;
+    (void)user_data;
+    handler_thread = std::this_thread::get_id();
+    started = true;
+    while (!release) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    /* The resource stays valid for as long as the handler runs */
+    EXPECT_EQ(work_res, request->resource);
+    handled++;
+    oc_send_response(request, OC_STATUS_OK);
+}
+
+static int
+app_init(void)
+{
+    int ret = oc_init_platform("Samsung", NULL, NULL);
+    ret |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                         "ocf.res.1.0.0", NULL, NULL);
+    return ret;
+}
+
+static void
+register_resources(void)
+{
+    work_res = oc_new_resource(NULL, "/work", 1, 0);
+    oc_resource_bind_resource_type(work_res, "oic.r.test");
+    oc_resource_bind_resource_interface(work_res, OC_IF_RW);
+    oc_resource_set_default_interface(work_res, OC_IF_RW);
+    oc_resource_set_request_handler(work_res, OC_GET, work_handler, NULL);
+    oc_resource_set_worker_handlers(work_res, false);
+    oc_add_resource(work_res);
+}
+
+static void
+signal_event_loop(void)
+{
+}
+
+class TestWorker: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            static const oc_handler_t handler = {
+                .init = app_init,
+                .signal_event_loop = signal_event_loop,
+                .register_resources = register_resources
+            };
+            handled = 0;
+            started = false;
+            release = false;
+            main_thread = std::this_thread::get_id();
+            ASSERT_EQ(0, oc_main_init(&handler));
+
+            sock = socket(AF_INET6, SOCK_DGRAM, 0);
+            ASSERT_LE(0, sock);
+            struct timeval tv = { 0, 10000 };
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            memset(&server, 0, sizeof(server));
+            server.sin6_family = AF_INET6;
+            server.sin6_addr = in6addr_loopback;
+            oc_endpoint_t *ep = oc_connectivity_get_endpoints(0);
+            while (ep) {
+                if ((ep->flags & IPV6) &&
+                    !(ep->flags & (SECURED | MULTICAST | TCP))) {
+                    server.sin6_port = htons(ep->addr.ipv6.port);
+                    break;
+                }
+                ep = ep->next;
+            }
+            ASSERT_NE(0, server.sin6_port);
+        }
+
+        virtual void TearDown()
+        {
+            release = true;
+            close(sock);
+            oc_main_shutdown();
+        }
+
+        /* NON GET /work with a one byte token */
+        void send_get(uint16_t mid)
+        {
+            uint8_t request[] = {
+                (uint8_t)(0x41 | (COAP_TYPE_NON << 4)), 0x01,
+                (uint8_t)(mid >> 8), (uint8_t)mid, (uint8_t)mid,
+                0xB4, 'w', 'o', 'r', 'k'
+            };
+            ASSERT_EQ((ssize_t)sizeof(request),
+                      sendto(sock, request, sizeof(request), 0,
+                             (struct sockaddr *)&server, sizeof(server)));
+        }
+
+        /* Runs the stack until a response arrives or about a second
+         * passes; returns 0 on timeout, else the response code
+         */
+        uint8_t receive_code(void)
+        {
+            uint8_t buf[1024];
+            for (int i = 0; i < 100; i++) {
+                oc_main_poll();
+                ssize_t len = recv(sock, buf, sizeof(buf), 0);
+                if (len >= 4) {
+                    return buf[1];
+                }
+            }
+            return 0;
+        }
+
+        void poll_until_started(void)
+        {
+            for (int i = 0; i < 1000 && !started; i++) {
+                oc_main_poll();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            ASSERT_TRUE(started);
+        }
+
+        int sock;
+        struct sockaddr_in6 server;
+};
+
+TEST_F(TestWorker, HandlerRunsOnWorker_P)
+{
+    release = true;
+    send_get(0x100);
+    EXPECT_EQ(CONTENT_2_05, receive_code());
+    EXPECT_EQ(1, handled);
+    EXPECT_NE(main_thread, handler_thread);
+}
+
+TEST_F(TestWorker, DeleteWaitsForRunningJob_P)
+{
+    send_get(0x200);
+    poll_until_started();
+
+    std::thread releaser([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        release = true;
+    });
+    EXPECT_TRUE(oc_delete_resource(work_res));
+    /* The running handler finished before the resource was freed */
+    EXPECT_EQ(1, handled);
+    releaser.join();
+
+    /* Its response is still delivered */
+    EXPECT_EQ(CONTENT_2_05, receive_code());
+}
+
+TEST_F(TestWorker, DeleteAnswersPendingJobs_N)
+{
+    send_get(0x300);
+    poll_until_started();
+    /* Serialized: the second request waits behind the running one */
+    send_get(0x301);
+    for (int i = 0; i < 20; i++) {
+        oc_main_poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::thread releaser([] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        release = true;
+    });
+    EXPECT_TRUE(oc_delete_resource(work_res));
+    releaser.join();
+
+    std::vector<uint8_t> codes;
+    for (uint8_t code; codes.size() < 2 && (code = receive_code()) != 0;) {
+        codes.push_back(code);
+    }
+    ASSERT_EQ(2u, codes.size());
+    EXPECT_EQ(1, handled);
+    EXPECT_NE(codes.end(),
+              std::find(codes.begin(), codes.end(), CONTENT_2_05));
+    EXPECT_NE(codes.end(),
+              std::find(codes.begin(), codes.end(), NOT_FOUND_4_04));
+}
+
+#endif /* OC_WORKER_THREADS */
@@ -243,10 +243,34 @@ void oc_resource_set_discoverable(oc_resource_t *resource, bool state);
 void oc_resource_set_observable(oc_resource_t *resource, bool state);
 void oc_resource_set_periodic_observable(oc_resource_t *resource,
                                          uint16_t seconds);
+/**
+  @brief Names the numeric property of a resource that observers may put
+    step (st) and threshold (gt, lt) conditions on when registering, in
+    addition to the pmin and pmax notification periods.
+  @param resource Observable resource.
+  @param property Name of a top-level integer or double property of its
+    default representation.
+*/
+void oc_resource_set_observe_step_property(oc_resource_t *resource,
+                                           const char *property);
 void oc_resource_set_request_handler(oc_resource_t *resource,
                                      oc_method_t method,
                                      oc_request_callback_t callback,
                                      void *user_data);
+#ifdef OC_WORKER_THREADS
+/**
+  @brief Runs the request handlers of a resource on the worker thread pool
+    instead of the event loop. The response is sent as a separate response
+    once the handler returns.
+  @param resource Resource whose handlers may block.
+  @param concurrent If false, at most one request to this resource is handled
+    at a time; if true, requests are handled in parallel.
+  @note Handlers running on a worker must only use the request and response
+    APIs (oc_rep_*, oc_get_query_value(), oc_send_response(),
+    oc_ignore_request()); the rest of the stack is not thread-safe.
+*/
+void oc_resource_set_worker_handlers(oc_resource_t *resource, bool concurrent);
+#endif /* OC_WORKER_THREADS */
 bool oc_add_resource(oc_resource_t *resource);
 bool oc_delete_resource(oc_resource_t *resource);
 
@@ -355,8 +379,39 @@ void oc_free_server_endpoints(oc_endpoint_t *endpoint);
 
 void oc_close_session(oc_endpoint_t *endpoint);
 
+#ifdef OC_TCP
+/**
+  @brief  Check that a TCP session is alive with a CoAP Ping signal.
+          The stack sends no Ping of its own unless oc_set_tcp_keepalive()
+          was called.
+  @param  custody          Ask the peer to keep the session open for longer.
+  @param  endpoint         Endpoint of the session. Must not be NULL.
+  @param  timeout_seconds  Time to wait for the Pong.
+  @param  handler          Called with OC_STATUS_OK once the Pong arrives, or
+                           with OC_PING_TIMEOUT. Must not be NULL.
+  @param  user_data        Callback parameter for user defined value.
+  @return Returns true if the Ping was sent.
+*/
+bool oc_send_ping(bool custody, oc_endpoint_t *endpoint,
+                  uint16_t timeout_seconds, oc_response_handler_t handler,
+                  void *user_data);
+#endif /* OC_TCP */
+
 /** Common operations */
 
+#ifdef OC_TCP
+/**
+  @brief  Keep TCP sessions alive with CoAP Ping signals. Nothing is sent
+          automatically by default.
+  @param  interval_seconds  Time between the Pings sent on each connected
+                            session; a session whose peer did not answer
+                            the previous Ping with a Pong is closed. 0 stops
+                            sending Pings.
+  @see    oc_send_ping
+*/
+void oc_set_tcp_keepalive(uint16_t interval_seconds);
+#endif /* OC_TCP */
+
 void oc_set_delayed_callback(void *cb_data, oc_trigger_t callback,
                              uint16_t seconds);
 void oc_remove_delayed_callback(void *cb_data, oc_trigger_t callback);
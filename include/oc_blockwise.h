@@ -22,6 +22,7 @@
 #include "oc_helpers.h"
 #include "oc_ri.h"
 #include "port/oc_connectivity.h"
+#include "util/oc_hash.h"
 
 typedef enum {
   OC_BLOCKWISE_CLIENT = 0,
@@ -46,6 +47,7 @@ typedef struct oc_blockwise_state_s
   oc_string_t uri_query;
 #ifdef OC_CLIENT
   uint16_t mid;
+  oc_hash_link_t mid_link;
   void *client_cb;
 #endif /* OC_CLIENT */
 } oc_blockwise_state_t;
@@ -69,6 +71,12 @@ oc_blockwise_state_t *oc_blockwise_find_request_buffer_by_mid(uint16_t mid);
 
 oc_blockwise_state_t *oc_blockwise_find_response_buffer_by_mid(uint16_t mid);
 
+void oc_blockwise_set_request_buffer_mid(oc_blockwise_state_t *buffer,
+                                         uint16_t mid);
+
+void oc_blockwise_set_response_buffer_mid(oc_blockwise_state_t *buffer,
+                                          uint16_t mid);
+
 oc_blockwise_state_t *oc_blockwise_find_request_buffer_by_client_cb(
   oc_endpoint_t *endpoint, void *client_cb);
 
@@ -100,6 +108,20 @@ const void *oc_blockwise_dispatch_block(oc_blockwise_state_t *buffer,
                                         uint32_t requested_block_size,
                                         uint32_t *payload_size);
 
+#ifdef OC_TCP
+/* Returns how many bytes of the payload in buffer go into each message to
+ * its TCP peer. A payload that fits the peer's messages goes out whole
+ * unless block is set, i.e. the peer asked for a block-wise transfer. It is
+ * otherwise split into BERT blocks if the peer takes them and either bert
+ * is set or no block size was asked for, or else into blocks of at most
+ * *block_size bytes that fit the peer's messages. *block_size and *use_bert
+ * are updated to describe the blocks.
+ */
+uint32_t oc_blockwise_tcp_block_size(oc_blockwise_state_t *buffer, bool block,
+                                     bool bert, uint16_t *block_size,
+                                     uint8_t *use_bert);
+#endif /* OC_TCP */
+
 bool oc_blockwise_handle_block(oc_blockwise_state_t *buffer,
                                uint32_t incoming_block_offset,
                                const uint8_t *incoming_block,
@@ -24,6 +24,11 @@
 
 OC_PROCESS_NAME(message_buffer_handler);
 oc_message_t *oc_allocate_message(void);
+/* Takes up to num_messages incoming messages at once and returns how many
+ * were taken. Network threads receiving several packets per wakeup use it to
+ * contend for the buffer pool once per batch.
+ */
+int oc_allocate_messages(oc_message_t **messages, int num_messages);
 void oc_set_buffers_avail_cb(oc_memb_buffers_avail_callback_t cb);
 
 oc_message_t *oc_allocate_message_from_pool(struct oc_memb *pool);
@@ -36,4 +41,9 @@ void oc_message_unref(oc_message_t *message);
 void oc_recv_message(oc_message_t *message);
 void oc_send_message(oc_message_t *message);
 
+/* Releases buffers kept for reuse and stops their idle timer, so that the
+ * stack can drain its pending timers on shutdown.
+ */
+void oc_buffer_shutdown(void);
+
 #endif /* OC_BUFFER_H */
@@ -20,6 +20,7 @@
 #include "messaging/coap/constants.h"
 #include "oc_endpoint.h"
 #include "oc_ri.h"
+#include "util/oc_hash.h"
 #include <stdbool.h>
 #ifdef OC_BLOCK_WISE
 #include "oc_blockwise.h"
@@ -72,6 +73,13 @@ typedef struct oc_client_cb_s
   bool discovery;
   bool multicast;
   bool stop_multicast_receive;
+  bool in_flight;
+  bool queued;
+  bool ping;
+  bool failing; /* see oc_ri_fail_client_cbs() */
+  struct oc_client_cb_s *queue_next; /* waiting for the same endpoint */
+  oc_hash_link_t mid_link;
+  oc_hash_link_t token_link;
 } oc_client_cb_t;
 
 #ifdef OC_BLOCK_WISE
@@ -96,8 +104,27 @@ oc_client_cb_t *oc_ri_find_client_cb_by_token(uint8_t *token,
 
 oc_client_cb_t *oc_ri_find_client_cb_by_mid(uint16_t mid);
 
+void oc_ri_set_client_cb_mid(oc_client_cb_t *cb, uint16_t mid);
+
+void oc_ri_set_client_cb_token(oc_client_cb_t *cb, const uint8_t *token,
+                               uint8_t token_len);
+
 bool oc_ri_remove_client_cb_by_mid(uint16_t mid);
 
+int oc_client_num_requests_in_flight(const oc_endpoint_t *endpoint);
+
+void oc_client_release_request(oc_client_cb_t *cb);
+
+void oc_client_complete_request(oc_client_cb_t *cb, oc_status_t code);
+
+void oc_ri_fail_client_cbs(const oc_endpoint_t *endpoint, oc_status_t code);
+
+#ifdef OC_TCP
+void oc_client_handle_pong(oc_client_cb_t *cb);
+
+void oc_client_request_too_large(oc_client_cb_t *cb);
+#endif /* OC_TCP */
+
 oc_discovery_flags_t oc_ri_process_discovery_payload(
   uint8_t *payload, int len, oc_discovery_handler_t handler,
   oc_endpoint_t *endpoint, void *user_data);
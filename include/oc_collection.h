@@ -28,20 +28,12 @@ struct oc_link_s
   oc_string_array_t rel;
 };
 
+/* A collection is an oc_resource_t with links; the resource comes first so
+ * that a collection can be used wherever a resource is expected.
+ */
 struct oc_collection_s
 {
-  struct oc_collection_s *next;
-  int device;
-  oc_string_t name;
-  oc_string_t uri;
-  oc_string_array_t types;
-  oc_interface_mask_t interfaces;
-  oc_interface_mask_t default_interface;
-  oc_resource_properties_t properties;
-  oc_request_handler_t get_handler;
-  oc_request_handler_t put_handler;
-  oc_request_handler_t post_handler;
-  oc_request_handler_t delete_handler;
+  oc_resource_t res;
   OC_LIST_STRUCT(links);
 };
 
@@ -47,6 +47,19 @@ typedef struct oc_message_s oc_message_t;
 
 void oc_network_event(oc_message_t *message);
 
+/**
+  @brief Queues a batch of received messages to the stack. With
+    OC_NETWORK_EVENT_RING_SIZE, each message is enqueued on the lock-free
+    network event ring without taking the network event handler mutex, and
+    messages that find the ring full are dropped. The event loop is then
+    woken at most once for the whole batch, and not at all if it has not
+    drained earlier messages yet. Otherwise, the batch is added to the
+    network event list under a single acquisition of the mutex.
+  @param messages  array of received messages.
+  @param num_messages  number of messages in the array.
+*/
+void oc_network_event_batch(oc_message_t **messages, int num_messages);
+
 void oc_network_interface_event(oc_interface_event_t event);
 
 #endif /* OC_NETWORK_EVENTS_H */
@@ -19,6 +19,7 @@
 #ifndef OC_NETWORK_HELPERS_H
 #define OC_NETWORK_HELPERS_H
 
+#include "oc_endpoint.h"
 #include "oc_network_events.h"
 #include "oc_session_events.h"
 
@@ -54,4 +55,30 @@ int oc_add_session_event_callback(session_event_handler_t cb);
 */
 int oc_remove_session_event_callback(session_event_handler_t cb);
 
+/**
+  @brief Round-trip time statistics of a remote endpoint, from which the
+   retransmission timeout of confirmable messages to it is derived. Strong
+   samples come from exchanges without retransmissions, weak ones from
+   exchanges with one or two. Times are in milliseconds.
+*/
+typedef struct oc_rtt_stats_s
+{
+  uint32_t rto_ms;
+  uint32_t srtt_strong_ms;
+  uint32_t rttvar_strong_ms;
+  uint32_t srtt_weak_ms;
+  uint32_t rttvar_weak_ms;
+  uint32_t strong_samples;
+  uint32_t weak_samples;
+  uint32_t retransmissions;
+} oc_rtt_stats_t;
+
+/**
+  @brief Get the round-trip time statistics kept for a remote endpoint.
+  @param endpoint  The remote endpoint.
+  @param stats  The statistics returned.
+  @return true if statistics are kept for the endpoint, false otherwise.
+*/
+bool oc_get_rtt_stats(oc_endpoint_t *endpoint, oc_rtt_stats_t *stats);
+
 #endif /* OC_NETWORK_HELPERS_H */
@@ -29,8 +29,15 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-extern CborEncoder g_encoder, root_map, links_array;
-extern int g_err;
+#ifdef OC_WORKER_THREADS
+/* Resource handlers on worker threads encode with their own encoder */
+#define OC_REP_THREAD_LOCAL __thread
+#else /* OC_WORKER_THREADS */
+#define OC_REP_THREAD_LOCAL
+#endif /* !OC_WORKER_THREADS */
+
+extern OC_REP_THREAD_LOCAL CborEncoder g_encoder, root_map, links_array;
+extern OC_REP_THREAD_LOCAL int g_err;
 
 /**
   @brief A function to initialize payload CBOR buffer.
@@ -348,6 +355,7 @@ typedef enum {
 typedef struct oc_rep_s
 {
   oc_rep_value_type_t type;           /*!< OC Representation value type @see oc_rep_value_type_t */
+  uint8_t borrowed;                   /*!< Strings pointing into the parsed payload */
   struct oc_rep_s *next;              /*!< Link List pointer next */
   oc_string_t name;                   /*!< key */
   union oc_rep_value
@@ -364,6 +372,23 @@ typedef struct oc_rep_s
 
 void oc_rep_set_pool(struct oc_memb *rep_objects_pool);
 
+/**
+  @brief Starts a scope in which oc_parse_rep() carves nodes, names, strings
+    and arrays out of a bump-pointer arena of OC_REP_ARENA_SIZE bytes. Once
+    the arena is full, parsing falls back to the rep pool and oc_mmem.
+    Scopes may nest. Without OC_REP_ARENA_SIZE this does nothing.
+  @return Mark to pass to oc_rep_arena_end().
+*/
+size_t oc_rep_arena_begin(void);
+
+/**
+  @brief Ends a scope started with oc_rep_arena_begin(), releasing in O(1)
+    everything parsed into the arena since then. Trees parsed in the scope
+    must have been released with oc_free_rep() beforehand.
+  @param[in] mark The value returned by the matching oc_rep_arena_begin().
+*/
+void oc_rep_arena_end(size_t mark);
+
 /**
   @brief A function parse a CBOR payload and store in OC Representation.
   @param[in] payload The CBOR payload data.
@@ -377,12 +402,55 @@ void oc_rep_set_pool(struct oc_memb *rep_objects_pool);
 int oc_parse_rep(const uint8_t *payload, int payload_size,
                  oc_rep_t **value_list);
 
+/**
+  @brief A function to parse a CBOR payload without copying its strings.
+    Names and definite-length text and byte string values point directly
+    into the payload, which is NUL-terminated in place and so must be
+    writable and outlive the returned representation. Use
+    oc_rep_dup_string() to retain a value beyond that.
+  @param[in] payload The CBOR payload data. It is modified by the parse.
+  @param[in] payload_size The CBOR payload data size.
+  @param[out] value_list The output value list returned.
+  @return int Result of parsing operation, as for oc_parse_rep().
+*/
+int oc_parse_rep_borrowed(uint8_t *payload, int payload_size,
+                          oc_rep_t **value_list);
+
+/**
+  @brief Reads a top-level integer or double property of a CBOR payload
+    without building a representation.
+  @param[in] payload The CBOR payload data.
+  @param[in] payload_size The CBOR payload data size.
+  @param[in] key The name of the property.
+  @param[out] value The value of the property.
+  @return bool True if the payload is an object holding a number under key.
+*/
+bool oc_rep_find_number(const uint8_t *payload, int payload_size,
+                        const char *key, double *value);
+
 /**
   @brief A function to free the OC Representation.
   @param[in] rep The OC Representation needs to be freed.
 */
 void oc_free_rep(oc_rep_t *rep);
 
+/**
+  @brief Returns the number of bytes oc_rep_copy() needs to copy a tree.
+  @param[in] rep The OC Representation to be copied.
+*/
+size_t oc_rep_copy_size(const oc_rep_t *rep);
+
+/**
+  @brief Copies a tree with all its names, strings and arrays into a single
+    buffer of oc_rep_copy_size() bytes, aligned for a double. The copy does
+    not depend on the payload, pools or arena of the original and is
+    released by releasing the buffer; it must not be passed to oc_free_rep().
+  @param[in] rep The OC Representation to be copied.
+  @param[out] buffer The buffer receiving the copy.
+  @return oc_rep_t* The copy, which starts at buffer, or NULL for no tree.
+*/
+oc_rep_t *oc_rep_copy(const oc_rep_t *rep, void *buffer);
+
 /**
   @brief A function to get the int value from OC Representation.
   @param[in] rep The OC Representation where data is stored.
@@ -534,4 +602,17 @@ bool oc_rep_get_object(oc_rep_t *rep, const char *key, oc_rep_t **value);
 */
 bool oc_rep_get_object_array(oc_rep_t *rep, const char *key, oc_rep_t **value);
 
+/**
+  @brief A function to copy a string or byte string value out of an OC
+    Representation, so that it outlives the payload it was parsed from.
+  @param[in] rep The OC Representation where data is stored.
+  @param[in] key The string which is used to store the value.
+  @param[out] value The new string, to be released with oc_free_string().
+  @return bool Result of copy operation.
+  @retval true if copy is successful.
+  @retval false if any input parameter is NULL,
+                or the rep doesn't have the key.
+*/
+bool oc_rep_dup_string(oc_rep_t *rep, const char *key, oc_string_t *value);
+
 #endif /* OC_REP_H */
@@ -54,7 +54,9 @@ typedef enum {
   OC_STATUS_GATEWAY_TIMEOUT,
   OC_STATUS_PROXYING_NOT_SUPPORTED,
   __NUM_OC_STATUS_CODES__,
-  OC_IGNORE
+  OC_IGNORE,
+  OC_PING_TIMEOUT,
+  OC_SEND_FAILED /* the request could not be handed to the transport */
 } oc_status_t;
 
 typedef struct oc_separate_response_s oc_separate_response_t;
@@ -109,6 +111,14 @@ typedef struct
 typedef void (*oc_request_callback_t)(oc_request_t *, oc_interface_mask_t,
                                       void *);
 
+#ifdef OC_WORKER_THREADS
+typedef enum {
+  OC_WORKER_NONE = 0,
+  OC_WORKER_SERIALIZED,
+  OC_WORKER_CONCURRENT
+} oc_worker_mode_t;
+#endif /* OC_WORKER_THREADS */
+
 typedef struct oc_request_handler_s
 {
   oc_request_callback_t cb;
@@ -131,6 +141,13 @@ struct oc_resource_s
   oc_request_handler_t delete_handler;
   uint16_t observe_period_seconds;
   uint8_t num_observers;
+  struct coap_observer *observers;
+  /* Numeric property compared against the st, gt and lt conditions of
+   * observers */
+  oc_string_t observe_step_property;
+#ifdef OC_WORKER_THREADS
+  uint8_t worker_mode;
+#endif /* OC_WORKER_THREADS */
 };
 
 typedef struct oc_link_s oc_link_t;
@@ -177,11 +194,30 @@ oc_resource_t *oc_ri_get_app_resource_by_uri(const char *uri, int uri_len,
 
 oc_resource_t *oc_ri_get_app_resources(void);
 
+/* Kinds of resources held in the URI index used to dispatch requests */
+typedef enum {
+  OC_URI_INDEX_CORE = 1 << 0,
+  OC_URI_INDEX_APP = 1 << 1,
+  OC_URI_INDEX_COLLECTION = 1 << 2
+} oc_uri_index_kind_t;
+
+void oc_ri_uri_index_add(oc_resource_t *resource, oc_uri_index_kind_t kind);
+void oc_ri_uri_index_add_core(int core_resource, int device);
+void oc_ri_uri_index_remove(oc_resource_t *resource);
+oc_resource_t *oc_ri_uri_index_find(const char *uri, int uri_len, int device,
+                                    int kinds);
+
 #ifdef OC_SERVER
 oc_resource_t *oc_ri_alloc_resource(void);
 bool oc_ri_add_resource(oc_resource_t *resource);
 bool oc_ri_delete_resource(oc_resource_t *resource);
 
+/* Sends an already encoded response to every request waiting on a separate
+ * response handle, or drops them all if its code is OC_IGNORE.
+ */
+void oc_send_separate_response_buffer(oc_separate_response_t *handle,
+                                      oc_response_buffer_t *response_buffer);
+
 #ifdef OC_MAX_NUM_COLLECTIONS
 #define OC_COLLECTIONS
 #endif /* OC_MAX_NUM_COLLECTIONS */
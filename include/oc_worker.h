@@ -0,0 +1,60 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifndef OC_WORKER_H
+#define OC_WORKER_H
+
+#include "oc_ri.h"
+#include "util/oc_process.h"
+
+/**
+ * Requests to resources marked with oc_resource_set_worker_handlers() are
+ * handed to a pool of worker threads so that a slow handler does not stall
+ * the event loop. The request is accepted as a separate response on the
+ * event loop, the handler runs on a worker against copies of the request
+ * data, and the encoded response is sent back from the event loop.
+ */
+
+typedef struct oc_worker_job_s oc_worker_job_t;
+
+OC_PROCESS_NAME(oc_worker_events);
+
+/**
+  @brief Takes over a request whose resource runs its handlers on workers.
+    Copies everything the handler needs out of the request and marks it as
+    answered with a separate response.
+  @return The job to submit once the separate response has been accepted,
+    or NULL if the handler must run inline.
+*/
+oc_worker_job_t *oc_worker_prepare(oc_request_t *request, oc_method_t method,
+                                   oc_interface_mask_t interface);
+
+/**
+  @brief Queues a prepared job, or drops it if its separate response could
+    not be accepted.
+*/
+void oc_worker_submit(oc_worker_job_t *job);
+
+/**
+  @brief Answers the queued jobs of a resource that is about to be deleted
+    with 4.04 and waits for its running jobs to finish, so that no worker
+    touches the resource once it is freed. Call on the event loop.
+*/
+void oc_worker_cancel_jobs(oc_resource_t *resource);
+
+#endif /* OC_WORKER_H */
@@ -49,6 +49,8 @@
 #include <string.h>
 
 #include "coap.h"
+#include "coap_signal.h"
+#include "engine.h"
 #include "transactions.h"
 
 #ifdef OC_SECURITY
@@ -60,7 +62,6 @@
 /*---------------------------------------------------------------------------*/
 static uint16_t current_mid = 0;
 
-coap_status_t coap_status_code = COAP_NO_ERROR;
 /*---------------------------------------------------------------------------*/
 /*- Local helper functions --------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -348,6 +349,127 @@ static size_t coap_serialize_options(void *packet, uint8_t *option_array)
   return (option - option_array);
 }
 /*---------------------------------------------------------------------------*/
+#ifdef OC_TCP
+/* Signaling options are numbered per signal code, so they get their own
+ * serializer and parser.
+ */
+static size_t
+serialize_empty_signal_option(unsigned int number, unsigned int current_number,
+                              uint8_t *option)
+{
+  return coap_set_option_header(number - current_number, 0, option);
+}
+
+static size_t
+coap_serialize_signal_options(void *packet, uint8_t *option_array)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+  uint8_t *option = option_array;
+  unsigned int current_number = 0;
+
+  switch (coap_pkt->code) {
+  case CSM_7_01:
+    COAP_SERIALIZE_INT_OPTION(COAP_SIGNAL_OPTION_MAX_MSG_SIZE, max_msg_size,
+                              "Max-Message-Size");
+    if (IS_OPTION(coap_pkt, COAP_SIGNAL_OPTION_BLOCKWISE_TRANSFER)) {
+      OC_DBG("Block-Wise-Transfer");
+      option += serialize_empty_signal_option(
+        COAP_SIGNAL_OPTION_BLOCKWISE_TRANSFER, current_number, option);
+      current_number = COAP_SIGNAL_OPTION_BLOCKWISE_TRANSFER;
+    }
+    break;
+  case PING_7_02:
+  case PONG_7_03:
+    if (IS_OPTION(coap_pkt, COAP_SIGNAL_OPTION_CUSTODY)) {
+      OC_DBG("Custody");
+      option += serialize_empty_signal_option(COAP_SIGNAL_OPTION_CUSTODY,
+                                              current_number, option);
+      current_number = COAP_SIGNAL_OPTION_CUSTODY;
+    }
+    break;
+  case RELEASE_7_04:
+    COAP_SERIALIZE_INT_OPTION(COAP_SIGNAL_OPTION_HOLD_OFF, hold_off,
+                              "Hold-Off");
+    break;
+  case ABORT_7_05:
+    COAP_SERIALIZE_INT_OPTION(COAP_SIGNAL_OPTION_BAD_CSM_OPTION,
+                              bad_csm_option, "Bad-CSM-Option");
+    break;
+  default:
+    break;
+  }
+
+  return (option - option_array);
+}
+/*---------------------------------------------------------------------------*/
+static coap_status_t
+coap_parse_signal_option(void *packet, unsigned int option_number,
+                         uint8_t *current_option, size_t option_length)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  OC_DBG("SIGNAL OPTION %u (len %zu):", option_number, option_length);
+  switch (coap_pkt->code) {
+  case CSM_7_01:
+    if (option_number == COAP_SIGNAL_OPTION_MAX_MSG_SIZE) {
+      coap_pkt->max_msg_size =
+        coap_parse_int_option(current_option, option_length);
+      SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_MAX_MSG_SIZE);
+      OC_DBG("  Max-Message-Size [%lu]",
+             (unsigned long)coap_pkt->max_msg_size);
+      return COAP_NO_ERROR;
+    }
+    if (option_number == COAP_SIGNAL_OPTION_BLOCKWISE_TRANSFER) {
+      SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_BLOCKWISE_TRANSFER);
+      OC_DBG("  Block-Wise-Transfer");
+      return COAP_NO_ERROR;
+    }
+    break;
+  case PING_7_02:
+  case PONG_7_03:
+    if (option_number == COAP_SIGNAL_OPTION_CUSTODY) {
+      SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_CUSTODY);
+      OC_DBG("  Custody");
+      return COAP_NO_ERROR;
+    }
+    break;
+  case RELEASE_7_04:
+    if (option_number == COAP_SIGNAL_OPTION_ALT_ADDR) {
+      /* Reconnecting elsewhere is left to the application */
+      OC_DBG("  Alternative-Address [%.*s]", (int)option_length,
+             (char *)current_option);
+      return COAP_NO_ERROR;
+    }
+    if (option_number == COAP_SIGNAL_OPTION_HOLD_OFF) {
+      coap_pkt->hold_off = coap_parse_int_option(current_option, option_length);
+      SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_HOLD_OFF);
+      OC_DBG("  Hold-Off [%lu]", (unsigned long)coap_pkt->hold_off);
+      return COAP_NO_ERROR;
+    }
+    break;
+  case ABORT_7_05:
+    if (option_number == COAP_SIGNAL_OPTION_BAD_CSM_OPTION) {
+      coap_pkt->bad_csm_option =
+        (uint16_t)coap_parse_int_option(current_option, option_length);
+      SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_BAD_CSM_OPTION);
+      OC_DBG("  Bad-CSM-Option [%u]", coap_pkt->bad_csm_option);
+      return COAP_NO_ERROR;
+    }
+    break;
+  default:
+    break;
+  }
+  OC_DBG("  unknown (%u)", option_number);
+  if (option_number & 1) {
+    OC_WRN("Unsupported critical signaling option");
+    /* Reported back in an Abort when it came with a CSM */
+    coap_pkt->bad_csm_option = (uint16_t)option_number;
+    return BAD_OPTION_4_02;
+  }
+  return COAP_NO_ERROR;
+}
+#endif /* OC_TCP */
+/*---------------------------------------------------------------------------*/
 static coap_status_t coap_parse_token_option(void *packet,
                                                uint8_t *data,
                                                uint32_t data_len,
@@ -412,6 +534,18 @@ static coap_status_t coap_parse_token_option(void *packet,
 
     option_number += option_delta;
 
+#ifdef OC_TCP
+    if (coap_check_signal_message(coap_pkt)) {
+      coap_status_t ret = coap_parse_signal_option(
+        coap_pkt, option_number, current_option, option_length);
+      if (ret != COAP_NO_ERROR) {
+        return ret;
+      }
+      current_option += option_length;
+      continue;
+    }
+#endif /* OC_TCP */
+
     if (option_number <= COAP_OPTION_SIZE1) {
       OC_DBG("OPTION %u (delta %u, len %zu):", option_number, option_delta,
              option_length);
@@ -544,6 +678,15 @@ static coap_status_t coap_parse_token_option(void *packet,
       coap_pkt->block2_size = 16 << (coap_pkt->block2_num & 0x07);
       coap_pkt->block2_offset = (coap_pkt->block2_num & ~0x0000000F)
                                 << (coap_pkt->block2_num & 0x07);
+#ifdef OC_TCP
+      if (coap_pkt->transport_type == COAP_TRANSPORT_TCP &&
+          (coap_pkt->block2_num & 0x07) == COAP_BERT_SZX) {
+        coap_pkt->block2_bert = 1;
+        coap_pkt->block2_size = COAP_BERT_BLOCK_SIZE;
+        coap_pkt->block2_offset =
+          (coap_pkt->block2_num >> 4) * COAP_BERT_BLOCK_SIZE;
+      }
+#endif /* OC_TCP */
       coap_pkt->block2_num >>= 4;
       OC_DBG("  Block2 [%lu%s (%u B/blk)]", (unsigned long)coap_pkt->block2_num,
              coap_pkt->block2_more ? "+" : "", coap_pkt->block2_size);
@@ -555,6 +698,15 @@ static coap_status_t coap_parse_token_option(void *packet,
       coap_pkt->block1_size = 16 << (coap_pkt->block1_num & 0x07);
       coap_pkt->block1_offset = (coap_pkt->block1_num & ~0x0000000F)
                                 << (coap_pkt->block1_num & 0x07);
+#ifdef OC_TCP
+      if (coap_pkt->transport_type == COAP_TRANSPORT_TCP &&
+          (coap_pkt->block1_num & 0x07) == COAP_BERT_SZX) {
+        coap_pkt->block1_bert = 1;
+        coap_pkt->block1_size = COAP_BERT_BLOCK_SIZE;
+        coap_pkt->block1_offset =
+          (coap_pkt->block1_num >> 4) * COAP_BERT_BLOCK_SIZE;
+      }
+#endif /* OC_TCP */
       coap_pkt->block1_num >>= 4;
       OC_DBG("  Block1 [%lu%s (%u B/blk)]", (unsigned long)coap_pkt->block1_num,
              coap_pkt->block1_more ? "+" : "", coap_pkt->block1_size);
@@ -727,6 +879,17 @@ coap_tcp_init_message(void *packet, uint8_t code)
   coap_pkt->code = code;
   coap_pkt->mid = 0;
 }
+/*---------------------------------------------------------------------------*/
+int
+coap_check_signal_message(void *packet)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  return (coap_pkt->transport_type == COAP_TRANSPORT_TCP &&
+          coap_pkt->code >> 5 == 7)
+           ? 1
+           : 0;
+}
 #endif /* OC_TCP */
 /*---------------------------------------------------------------------------*/
 size_t
@@ -743,7 +906,15 @@ coap_serialize_message(void *packet, uint8_t *buffer)
   coap_pkt->version = 1;
 
   /* coap header option serialize first to know total length about options */
-  size_t option_length = coap_serialize_options(packet, option_array);
+  size_t option_length;
+#ifdef OC_TCP
+  if (coap_check_signal_message(coap_pkt)) {
+    option_length = coap_serialize_signal_options(packet, option_array);
+  } else
+#endif /* OC_TCP */
+  {
+    option_length = coap_serialize_options(packet, option_array);
+  }
 
 #ifdef OC_TCP
   if (coap_pkt->transport_type == COAP_TRANSPORT_TCP) {
@@ -828,6 +999,17 @@ coap_send_message(oc_message_t *message)
 {
   OC_DBG("-sending OCF message (%u)-", (unsigned int)message->length);
 
+#ifdef OC_TCP
+  if (message->endpoint.flags & TCP) {
+    coap_signal_prepare_send(&message->endpoint);
+    if (message->length > coap_signal_max_message_size(&message->endpoint)) {
+      coap_tcp_message_too_large(message);
+      message->ref_count--;
+      return;
+    }
+  }
+#endif /* OC_TCP */
+
   oc_send_message(message);
 }
 /*---------------------------------------------------------------------------*/
@@ -1323,6 +1505,7 @@ coap_set_header_block2(void *packet, uint32_t num, uint8_t more, uint16_t size)
   }
   coap_pkt->block2_num = num;
   coap_pkt->block2_more = more ? 1 : 0;
+  coap_pkt->block2_bert = 0;
   coap_pkt->block2_size = size;
 
   SET_OPTION(coap_pkt, COAP_OPTION_BLOCK2);
@@ -1369,12 +1552,133 @@ coap_set_header_block1(void *packet, uint32_t num, uint8_t more, uint16_t size)
   }
   coap_pkt->block1_num = num;
   coap_pkt->block1_more = more;
+  coap_pkt->block1_bert = 0;
   coap_pkt->block1_size = size;
 
   SET_OPTION(coap_pkt, COAP_OPTION_BLOCK1);
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+#ifdef OC_TCP
+int
+coap_set_header_block2_bert(void *packet, uint32_t num, uint8_t more)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  if (!coap_set_header_block2(packet, num, more, COAP_BERT_BLOCK_SIZE)) {
+    return 0;
+  }
+  coap_pkt->block2_bert = 1;
+  return 1;
+}
+int
+coap_set_header_block1_bert(void *packet, uint32_t num, uint8_t more)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  if (!coap_set_header_block1(packet, num, more, COAP_BERT_BLOCK_SIZE)) {
+    return 0;
+  }
+  coap_pkt->block1_bert = 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_get_header_max_msg_size(void *packet, uint32_t *size)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  if (!IS_OPTION(coap_pkt, COAP_SIGNAL_OPTION_MAX_MSG_SIZE)) {
+    return 0;
+  }
+  *size = coap_pkt->max_msg_size;
+  return 1;
+}
+int
+coap_set_header_max_msg_size(void *packet, uint32_t size)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  coap_pkt->max_msg_size = size;
+  SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_MAX_MSG_SIZE);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_get_header_blockwise_transfer(void *packet)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  return IS_OPTION(coap_pkt, COAP_SIGNAL_OPTION_BLOCKWISE_TRANSFER) ? 1 : 0;
+}
+int
+coap_set_header_blockwise_transfer(void *packet)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_BLOCKWISE_TRANSFER);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_get_header_custody(void *packet)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  return IS_OPTION(coap_pkt, COAP_SIGNAL_OPTION_CUSTODY) ? 1 : 0;
+}
+int
+coap_set_header_custody(void *packet)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_CUSTODY);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_get_header_hold_off(void *packet, uint32_t *seconds)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  if (!IS_OPTION(coap_pkt, COAP_SIGNAL_OPTION_HOLD_OFF)) {
+    return 0;
+  }
+  *seconds = coap_pkt->hold_off;
+  return 1;
+}
+int
+coap_set_header_hold_off(void *packet, uint32_t seconds)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  coap_pkt->hold_off = seconds;
+  SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_HOLD_OFF);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+coap_get_header_bad_csm_option(void *packet, uint16_t *option)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  if (!IS_OPTION(coap_pkt, COAP_SIGNAL_OPTION_BAD_CSM_OPTION)) {
+    return 0;
+  }
+  *option = coap_pkt->bad_csm_option;
+  return 1;
+}
+int
+coap_set_header_bad_csm_option(void *packet, uint16_t option)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  coap_pkt->bad_csm_option = option;
+  SET_OPTION(coap_pkt, COAP_SIGNAL_OPTION_BAD_CSM_OPTION);
+  return 1;
+}
+#endif /* OC_TCP */
+/*---------------------------------------------------------------------------*/
 int
 coap_get_header_size2(void *packet, uint32_t *size)
 {
@@ -81,6 +81,9 @@ enum
   ((packet)->options[opt / OPTION_MAP_SIZE] |= 1 << (opt % OPTION_MAP_SIZE))
 #define IS_OPTION(packet, opt)                                                 \
   ((packet)->options[opt / OPTION_MAP_SIZE] & (1 << (opt % OPTION_MAP_SIZE)))
+#define UNSET_OPTION(packet, opt)                                              \
+  ((packet)->options[opt / OPTION_MAP_SIZE] &=                                 \
+   ~(1 << (opt % OPTION_MAP_SIZE)))
 
 /* enum value for coap transport type  */
 typedef enum {
@@ -88,6 +91,13 @@ typedef enum {
   COAP_TRANSPORT_TCP
 } coap_transport_type_t;
 
+/* Over TCP, a block option with SZX 7 is a BERT block: the block number
+ * counts 1 KB units and the payload carries one or more whole 1 KB blocks,
+ * except for the last block of a body.
+ */
+#define COAP_BERT_SZX (7)
+#define COAP_BERT_BLOCK_SIZE (1024)
+
 /* parsed message struct */
 typedef struct
 {
@@ -129,10 +139,12 @@ typedef struct
   uint8_t if_match[COAP_ETAG_LEN];
   uint32_t block2_num;
   uint8_t block2_more;
+  uint8_t block2_bert;
   uint16_t block2_size;
   uint32_t block2_offset;
   uint32_t block1_num;
   uint8_t block1_more;
+  uint8_t block1_bert;
   uint16_t block1_size;
   uint32_t block1_offset;
   uint32_t size2;
@@ -140,6 +152,11 @@ typedef struct
   size_t uri_query_len;
   const char *uri_query;
   uint8_t if_none_match;
+#ifdef OC_TCP
+  uint32_t max_msg_size;
+  uint32_t hold_off;
+  uint16_t bad_csm_option;
+#endif /* OC_TCP */
 
   uint32_t payload_len;
   uint8_t *payload;
@@ -181,17 +198,17 @@ typedef struct
     if (coap_pkt->field##_more) {                                              \
       block |= 0x8;                                                            \
     }                                                                          \
-    block |= 0xF & coap_log_2(coap_pkt->field##_size / 16);                    \
+    if (coap_pkt->field##_bert) {                                              \
+      block |= COAP_BERT_SZX;                                                  \
+    } else {                                                                   \
+      block |= 0xF & coap_log_2(coap_pkt->field##_size / 16);                  \
+    }                                                                          \
     OC_DBG(text " encoded: 0x%lX", (unsigned long)block);                      \
     option +=                                                                  \
       coap_serialize_int_option(number, current_number, option, block);        \
     current_number = number;                                                   \
   }
 
-/* to store error code and human-readable payload */
-extern coap_status_t coap_status_code;
-extern char *coap_error_message;
-
 void coap_init_connection(void);
 uint16_t coap_get_mid(void);
 
@@ -293,8 +310,29 @@ int coap_get_payload(void *packet, const uint8_t **payload);
 int coap_set_payload(void *packet, const void *payload, size_t length);
 
 #ifdef OC_TCP
+int coap_set_header_block2_bert(void *packet, uint32_t num, uint8_t more);
+int coap_set_header_block1_bert(void *packet, uint32_t num, uint8_t more);
+
+int coap_get_header_max_msg_size(void *packet, uint32_t *size);
+int coap_set_header_max_msg_size(void *packet, uint32_t size);
+
+int coap_get_header_blockwise_transfer(void *packet);
+int coap_set_header_blockwise_transfer(void *packet);
+
+int coap_get_header_custody(void *packet);
+int coap_set_header_custody(void *packet);
+
+int coap_get_header_hold_off(void *packet, uint32_t *seconds);
+int coap_set_header_hold_off(void *packet, uint32_t seconds);
+
+int coap_get_header_bad_csm_option(void *packet, uint16_t *option);
+int coap_set_header_bad_csm_option(void *packet, uint16_t option);
+
 void coap_tcp_init_message(void *packet, uint8_t code);
 
+/* Returns 1 for signaling messages (code class 7) */
+int coap_check_signal_message(void *packet);
+
 size_t coap_tcp_get_packet_size(const uint8_t *data);
 
 coap_status_t coap_tcp_parse_message(void *packet, uint8_t *data, uint32_t data_len);
@@ -0,0 +1,397 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "coap_signal.h"
+#include "oc_api.h"
+#include "oc_buffer.h"
+#ifdef OC_CLIENT
+#include "oc_client_state.h"
+#endif /* OC_CLIENT */
+#include "oc_ri.h"
+#include "port/oc_connectivity.h"
+#ifdef OC_SECURITY
+#include "security/oc_tls.h"
+#endif /* OC_SECURITY */
+#include "util/oc_hash.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef OC_TCP
+typedef struct coap_signal_peer
+{
+  struct coap_signal_peer *next; /* for LIST */
+  oc_hash_link_t endpoint_link;
+  oc_endpoint_t endpoint;
+  uint32_t max_msg_size; /* 0 until the peer's CSM arrives */
+  bool blockwise_transfer;
+  bool connected;
+  bool csm_sent;
+  bool keepalive_pending; /* a keepalive Ping is yet to be answered */
+} coap_signal_peer_t;
+
+OC_MEMB(signal_peers_s, coap_signal_peer_t, OC_MAX_TCP_PEERS);
+OC_LIST(signal_peers);
+OC_HASH(signal_peers_by_endpoint, 16);
+
+static uint16_t keepalive_interval; /* seconds between Pings, 0 if off */
+
+static coap_signal_peer_t *
+find_peer(const oc_endpoint_t *endpoint)
+{
+  oc_hash_link_t *link =
+    oc_hash_lookup(&signal_peers_by_endpoint, oc_endpoint_hash(endpoint));
+  while (link) {
+    coap_signal_peer_t *peer =
+      oc_hash_entry(link, coap_signal_peer_t, endpoint_link);
+    if (oc_endpoint_compare(&peer->endpoint, endpoint) == 0) {
+      return peer;
+    }
+    link = oc_hash_next(link);
+  }
+  return NULL;
+}
+
+static coap_signal_peer_t *
+get_peer(const oc_endpoint_t *endpoint)
+{
+  coap_signal_peer_t *peer = find_peer(endpoint);
+  if (peer) {
+    return peer;
+  }
+  peer = (coap_signal_peer_t *)oc_memb_alloc(&signal_peers_s);
+  if (!peer) {
+    OC_WRN("insufficient memory to track signaling of TCP peer");
+    return NULL;
+  }
+  memcpy(&peer->endpoint, endpoint, sizeof(oc_endpoint_t));
+  peer->endpoint.next = NULL;
+  peer->max_msg_size = 0;
+  peer->blockwise_transfer = false;
+  peer->connected = false;
+  peer->csm_sent = false;
+  peer->keepalive_pending = false;
+  oc_list_add(signal_peers, peer);
+  oc_hash_add(&signal_peers_by_endpoint, &peer->endpoint_link,
+              oc_endpoint_hash(endpoint));
+  return peer;
+}
+
+static oc_event_callback_retval_t send_keepalive(void *data);
+
+static void
+free_peer(coap_signal_peer_t *peer)
+{
+  oc_ri_remove_timed_event_callback(peer, &send_keepalive);
+  oc_hash_remove(&signal_peers_by_endpoint, &peer->endpoint_link);
+  oc_list_remove(signal_peers, peer);
+  oc_memb_free(&signal_peers_s, peer);
+}
+
+/* Sent straight to the buffer handler, so that it does not recurse through
+ * coap_signal_prepare_send(). With close_session the session is ended once
+ * the message has been handed to the transport.
+ */
+static void
+send_signal(coap_packet_t *packet, const oc_endpoint_t *endpoint,
+            bool close_session)
+{
+  oc_message_t *message = oc_internal_allocate_outgoing_message();
+  if (!message) {
+    OC_WRN("could not allocate signaling message");
+    return;
+  }
+  memcpy(&message->endpoint, endpoint, sizeof(oc_endpoint_t));
+  message->endpoint.next = NULL;
+  message->close_session = close_session;
+  message->length = coap_serialize_message(packet, message->data);
+  if (message->length > 0) {
+    oc_send_message(message);
+  }
+  if (message->ref_count == 0) {
+    oc_message_unref(message);
+  }
+}
+
+void
+coap_send_csm_message(const oc_endpoint_t *endpoint)
+{
+  coap_packet_t csm[1];
+  coap_tcp_init_message(csm, CSM_7_01);
+  coap_set_header_max_msg_size(csm, (uint32_t)OC_PDU_SIZE);
+#ifdef OC_BLOCK_WISE
+  coap_set_header_blockwise_transfer(csm);
+#endif /* OC_BLOCK_WISE */
+  OC_DBG("sending CSM");
+  send_signal(csm, endpoint, false);
+
+  coap_signal_peer_t *peer = find_peer(endpoint);
+  if (peer) {
+    peer->csm_sent = true;
+  }
+}
+
+void
+coap_send_ping_message(const oc_endpoint_t *endpoint, bool custody,
+                       const uint8_t *token, uint8_t token_len)
+{
+  coap_packet_t ping[1];
+  coap_tcp_init_message(ping, PING_7_02);
+  if (token_len > 0) {
+    coap_set_token(ping, token, token_len);
+  }
+  if (custody) {
+    coap_set_header_custody(ping);
+  }
+  OC_DBG("sending PING");
+  coap_signal_prepare_send(endpoint);
+  send_signal(ping, endpoint, false);
+}
+
+static void
+send_pong_message(coap_packet_t *ping, const oc_endpoint_t *endpoint)
+{
+  coap_packet_t pong[1];
+  coap_tcp_init_message(pong, PONG_7_03);
+  coap_set_token(pong, ping->token, ping->token_len);
+  /* The Pong goes out right away, so custody can always be granted */
+  if (coap_get_header_custody(ping)) {
+    coap_set_header_custody(pong);
+  }
+  OC_DBG("sending PONG");
+  coap_signal_prepare_send(endpoint);
+  send_signal(pong, endpoint, false);
+}
+
+static void
+end_session(const oc_endpoint_t *endpoint)
+{
+  oc_endpoint_t ep;
+  memcpy(&ep, endpoint, sizeof(oc_endpoint_t));
+  ep.next = NULL;
+#ifdef OC_SECURITY
+  if (ep.flags & SECURED) {
+    oc_tls_close_connection(&ep);
+    return;
+  }
+#endif /* OC_SECURITY */
+  oc_connectivity_end_session(&ep);
+}
+
+void
+coap_send_abort_message(const oc_endpoint_t *endpoint, uint16_t bad_option)
+{
+  coap_packet_t abort_msg[1];
+  coap_tcp_init_message(abort_msg, ABORT_7_05);
+  if (bad_option) {
+    coap_set_header_bad_csm_option(abort_msg, bad_option);
+  }
+  OC_DBG("sending ABORT");
+  /* RFC 8323 5.6: the sender of an Abort closes the connection */
+  send_signal(abort_msg, endpoint, true);
+#ifdef OC_SECURITY
+  /* The TLS layer sends on its own, so its connection is closed here */
+  if (endpoint->flags & SECURED) {
+    end_session(endpoint);
+  }
+#endif /* OC_SECURITY */
+}
+
+void
+coap_signal_prepare_send(const oc_endpoint_t *endpoint)
+{
+  coap_signal_peer_t *peer = get_peer(endpoint);
+  if (peer && !peer->csm_sent) {
+    coap_send_csm_message(endpoint);
+  }
+}
+
+coap_status_t
+coap_signal_handler(void *packet, const oc_endpoint_t *endpoint)
+{
+  coap_packet_t *const pkt = (coap_packet_t *)packet;
+
+  switch (pkt->code) {
+  case CSM_7_01: {
+    coap_signal_peer_t *peer = get_peer(endpoint);
+    if (!peer) {
+      break;
+    }
+    uint32_t max_msg_size = 0;
+    if (coap_get_header_max_msg_size(pkt, &max_msg_size)) {
+      peer->max_msg_size = max_msg_size;
+    }
+    if (coap_get_header_blockwise_transfer(pkt)) {
+      peer->blockwise_transfer = true;
+    }
+    OC_DBG("received CSM: Max-Message-Size %u, Block-Wise-Transfer %d",
+           (unsigned int)peer->max_msg_size, peer->blockwise_transfer);
+  } break;
+  case PING_7_02:
+    send_pong_message(pkt, endpoint);
+    break;
+  case PONG_7_03: {
+    coap_signal_peer_t *peer = find_peer(endpoint);
+    if (peer) {
+      peer->keepalive_pending = false;
+    }
+#ifdef OC_CLIENT
+    oc_client_cb_t *cb =
+      oc_ri_find_client_cb_by_token(pkt->token, pkt->token_len);
+    if (cb) {
+      oc_client_handle_pong(cb);
+    }
+#endif /* OC_CLIENT */
+  } break;
+  case RELEASE_7_04: {
+    uint32_t hold_off = 0;
+    if (coap_get_header_hold_off(pkt, &hold_off)) {
+      OC_DBG("peer asked to hold off reconnecting for %u seconds",
+             (unsigned int)hold_off);
+    }
+    OC_DBG("received RELEASE, closing the session");
+    end_session(endpoint);
+  } break;
+  case ABORT_7_05: {
+    uint16_t bad_option = 0;
+    if (coap_get_header_bad_csm_option(pkt, &bad_option)) {
+      OC_WRN("peer aborted the session over CSM option %u", bad_option);
+    } else {
+      OC_WRN("peer aborted the session");
+    }
+    end_session(endpoint);
+  } break;
+  default:
+    OC_DBG("ignoring signaling message 7.%02u", pkt->code & 0x1F);
+    break;
+  }
+  return COAP_NO_ERROR;
+}
+
+uint32_t
+coap_signal_max_message_size(const oc_endpoint_t *endpoint)
+{
+  uint32_t max_msg_size = (uint32_t)OC_PDU_SIZE;
+  coap_signal_peer_t *peer = find_peer(endpoint);
+  if (peer && peer->max_msg_size > 0) {
+    max_msg_size = MIN(max_msg_size, peer->max_msg_size);
+  }
+  return max_msg_size;
+}
+
+uint32_t
+coap_signal_max_payload_size(const oc_endpoint_t *endpoint)
+{
+  uint32_t max_msg_size = coap_signal_max_message_size(endpoint);
+  if (max_msg_size <= COAP_MAX_HEADER_SIZE) {
+    return 0;
+  }
+  return max_msg_size - COAP_MAX_HEADER_SIZE;
+}
+
+uint32_t
+coap_signal_bert_payload_size(const oc_endpoint_t *endpoint)
+{
+#ifdef OC_BLOCK_WISE
+  coap_signal_peer_t *peer = find_peer(endpoint);
+  if (!peer || !peer->blockwise_transfer) {
+    return 0;
+  }
+  uint32_t max_payload_size = coap_signal_max_payload_size(endpoint);
+  return max_payload_size - max_payload_size % COAP_BERT_BLOCK_SIZE;
+#else  /* OC_BLOCK_WISE */
+  (void)endpoint;
+  return 0;
+#endif /* !OC_BLOCK_WISE */
+}
+
+/* Pings the peer, unless it never answered the last Ping */
+static oc_event_callback_retval_t
+send_keepalive(void *data)
+{
+  coap_signal_peer_t *peer = (coap_signal_peer_t *)data;
+  if (peer->keepalive_pending) {
+    OC_WRN("peer did not answer the keepalive Ping, closing the session");
+    end_session(&peer->endpoint);
+    return OC_EVENT_DONE;
+  }
+  peer->keepalive_pending = true;
+  coap_send_ping_message(&peer->endpoint, false, NULL, 0);
+  return OC_EVENT_CONTINUE;
+}
+
+static void
+start_keepalive(coap_signal_peer_t *peer)
+{
+  oc_ri_remove_timed_event_callback(peer, &send_keepalive);
+  peer->keepalive_pending = false;
+  if (keepalive_interval > 0) {
+    oc_ri_add_timed_event_callback_seconds(peer, &send_keepalive,
+                                           keepalive_interval);
+  }
+}
+
+void
+oc_set_tcp_keepalive(uint16_t interval_seconds)
+{
+  keepalive_interval = interval_seconds;
+  coap_signal_peer_t *peer = (coap_signal_peer_t *)oc_list_head(signal_peers);
+  while (peer) {
+    if (peer->connected) {
+      start_keepalive(peer);
+    }
+    peer = peer->next;
+  }
+}
+
+void
+coap_signal_session_start(const oc_endpoint_t *endpoint)
+{
+  coap_signal_peer_t *peer = get_peer(endpoint);
+  if (!peer) {
+    return;
+  }
+  peer->connected = true;
+  if (!peer->csm_sent) {
+    coap_send_csm_message(endpoint);
+  }
+  start_keepalive(peer);
+}
+
+void
+coap_signal_session_end(const oc_endpoint_t *endpoint)
+{
+  coap_signal_peer_t *peer = find_peer(endpoint);
+  if (peer) {
+    free_peer(peer);
+  }
+}
+
+void
+coap_free_all_signal_peers(void)
+{
+  coap_signal_peer_t *peer = (coap_signal_peer_t *)oc_list_head(signal_peers);
+  while (peer) {
+    coap_signal_peer_t *next = peer->next;
+    free_peer(peer);
+    peer = next;
+  }
+  oc_hash_init(&signal_peers_by_endpoint);
+}
+#endif /* OC_TCP */
@@ -0,0 +1,70 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+/**
+ * Signaling messages of CoAP over TCP (RFC 8323).
+ *
+ * Each side of a connection announces its Capabilities and Settings
+ * Message (CSM) before anything else. Until a session is reported as
+ * connected every outgoing message is preceded by a CSM, as a connection
+ * attempt may fail and be retried; afterwards it is sent once. The settings
+ * of the peer are kept until its session ends.
+ *
+ * Peers that never send a CSM are assumed to take whole messages of up to
+ * our own PDU size, as before signaling was supported. BERT is only used
+ * with peers whose CSM carries the Block-Wise-Transfer option, and no
+ * message larger than the peer's Max-Message-Size is sent: a request is
+ * failed with OC_STATUS_REQUEST_ENTITY_TOO_LARGE instead, and a response is
+ * replaced by a 4.13.
+ *
+ * Pings are answered with a Pong right away; Pongs complete the client
+ * callback of the oc_send_ping() that carried the same token. A Release or
+ * Abort from the peer ends its session, and so does sending an Abort.
+ *
+ * No Ping is sent on our own unless oc_set_tcp_keepalive() sets an
+ * interval. Each connected session is then pinged that often, and closed
+ * if the previous Ping was not answered.
+ */
+
+#ifndef COAP_SIGNAL_H
+#define COAP_SIGNAL_H
+
+#include "coap.h"
+#include "oc_endpoint.h"
+#include <stdbool.h>
+
+#ifdef OC_TCP
+void coap_send_csm_message(const oc_endpoint_t *endpoint);
+void coap_send_ping_message(const oc_endpoint_t *endpoint, bool custody,
+                            const uint8_t *token, uint8_t token_len);
+void coap_send_abort_message(const oc_endpoint_t *endpoint,
+                             uint16_t bad_option);
+void coap_signal_prepare_send(const oc_endpoint_t *endpoint);
+coap_status_t coap_signal_handler(void *packet,
+                                  const oc_endpoint_t *endpoint);
+
+uint32_t coap_signal_max_message_size(const oc_endpoint_t *endpoint);
+uint32_t coap_signal_max_payload_size(const oc_endpoint_t *endpoint);
+uint32_t coap_signal_bert_payload_size(const oc_endpoint_t *endpoint);
+
+void coap_signal_session_start(const oc_endpoint_t *endpoint);
+void coap_signal_session_end(const oc_endpoint_t *endpoint);
+void coap_free_all_signal_peers(void);
+#endif /* OC_TCP */
+
+#endif /* COAP_SIGNAL_H */
@@ -84,4 +84,23 @@
  * check client. */
 #define COAP_OBSERVE_REFRESH_INTERVAL 5
 
+/* Number of remote endpoints whose round-trip times are tracked to adapt
+ * retransmission timeouts. Once all are in use, further endpoints keep the
+ * default timeout until an estimator has been idle long enough to be reused.
+ */
+#ifndef COAP_MAX_RTT_ESTIMATORS
+#define COAP_MAX_RTT_ESTIMATORS (8)
+#endif /* COAP_MAX_RTT_ESTIMATORS */
+
+/* Number of requests a client keeps outstanding to one endpoint (NSTART).
+ * Further requests to it are queued and sent as earlier ones complete. CoAP
+ * over TCP has no retransmissions to pace, so sessions get a deeper pipeline.
+ */
+#ifndef COAP_NSTART
+#define COAP_NSTART (1)
+#endif /* COAP_NSTART */
+#ifndef COAP_TCP_NSTART
+#define COAP_TCP_NSTART (8)
+#endif /* COAP_TCP_NSTART */
+
 #endif /* CONF_H */
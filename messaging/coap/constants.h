@@ -148,6 +148,27 @@ typedef enum {
   EMPTY_ACK_RESPONSE
 } coap_status_t;
 
+#ifdef OC_TCP
+/* CoAP signaling codes (RFC 8323), class 7 */
+typedef enum {
+  CSM_7_01 = 225,     /* Capabilities and Settings Message */
+  PING_7_02 = 226,    /* PING */
+  PONG_7_03 = 227,    /* PONG */
+  RELEASE_7_04 = 228, /* RELEASE */
+  ABORT_7_05 = 229    /* ABORT */
+} coap_signal_code_t;
+
+/* CoAP signaling option numbers; their meaning depends on the signal code */
+typedef enum {
+  COAP_SIGNAL_OPTION_MAX_MSG_SIZE = 2,       /* CSM, 0-4 B */
+  COAP_SIGNAL_OPTION_BLOCKWISE_TRANSFER = 4, /* CSM, 0 B */
+  COAP_SIGNAL_OPTION_CUSTODY = 2,            /* Ping, Pong, 0 B */
+  COAP_SIGNAL_OPTION_ALT_ADDR = 2,           /* Release, 1-255 B */
+  COAP_SIGNAL_OPTION_HOLD_OFF = 4,           /* Release, 0-3 B */
+  COAP_SIGNAL_OPTION_BAD_CSM_OPTION = 2      /* Abort, 0-2 B */
+} coap_signal_option_t;
+#endif /* OC_TCP */
+
 /* CoAP header option numbers */
 typedef enum {
   COAP_OPTION_IF_MATCH = 1,                    /* 0-8 B */
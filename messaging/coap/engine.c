@@ -46,6 +46,8 @@
  */
 
 #include "engine.h"
+#include "coap_signal.h"
+#include "rtt.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -62,37 +64,303 @@
 #include "oc_client_state.h"
 #endif /* OC_CLIENT */
 
+#ifdef OC_DYNAMIC_ALLOCATION
+#include "util/oc_mem.h"
+#endif /* OC_DYNAMIC_ALLOCATION */
+
 OC_PROCESS(coap_engine, "CoAP Engine");
 
 #ifdef OC_BLOCK_WISE
 extern bool oc_ri_invoke_coap_entity_handler(
-  void *request, void *response, oc_blockwise_state_t **request_state,
+  coap_receive_ctx_t *ctx, oc_blockwise_state_t **request_state,
   oc_blockwise_state_t **response_state, uint16_t block2_size,
   oc_endpoint_t *endpoint);
 #else /* OC_BLOCK_WISE */
-extern bool oc_ri_invoke_coap_entity_handler(void *request, void *response,
+extern bool oc_ri_invoke_coap_entity_handler(coap_receive_ctx_t *ctx,
                                              uint8_t *buffer,
                                              oc_endpoint_t *endpoint);
 #endif /* !OC_BLOCK_WISE */
 
+#ifndef OC_REQUEST_HISTORY_SIZE
 #define OC_REQUEST_HISTORY_SIZE (250)
-static uint16_t history[OC_REQUEST_HISTORY_SIZE];
-static uint8_t history_dev[OC_REQUEST_HISTORY_SIZE];
-static uint8_t idx;
+#endif /* !OC_REQUEST_HISTORY_SIZE */
+#ifdef OC_DYNAMIC_ALLOCATION
+#ifndef OC_REQUEST_HISTORY_RESPONSES
+#define OC_REQUEST_HISTORY_RESPONSES (16)
+#endif /* !OC_REQUEST_HISTORY_RESPONSES */
+#endif /* OC_DYNAMIC_ALLOCATION */
+#define HISTORY_NONE (0xFFFF)
 
-static bool
-check_if_duplicate(uint16_t mid, uint8_t device)
+/* Recently seen UDP requests, keyed by sender endpoint and message ID and
+ * hashed into chains of indices. Entries are kept in arrival order in a
+ * ring, so the oldest one is always evicted first, and expire after
+ * EXCHANGE_LIFETIME. Under dynamic allocation the encoded piggybacked
+ * responses to the last OC_REQUEST_HISTORY_RESPONSES confirmable requests
+ * are kept as well, so that duplicates are answered without invoking the
+ * handler again. Confirmable duplicates with no stored response get an
+ * empty ACK.
+ */
+typedef struct
+{
+  oc_endpoint_t endpoint;
+  oc_clock_time_t expires;
+#ifdef OC_DYNAMIC_ALLOCATION
+  uint16_t response;
+#endif /* OC_DYNAMIC_ALLOCATION */
+  uint16_t mid;
+  uint16_t next;
+} coap_history_t;
+
+static coap_history_t history[OC_REQUEST_HISTORY_SIZE];
+static uint16_t history_buckets[OC_REQUEST_HISTORY_SIZE];
+static uint16_t history_head, history_count;
+
+#ifdef OC_DYNAMIC_ALLOCATION
+/* Slots are reused round-robin; a slot stays with its history entry until
+ * either is recycled.
+ */
+typedef struct
+{
+  uint8_t *data;
+  size_t length;
+  uint16_t owner;
+} coap_history_response_t;
+
+static coap_history_response_t history_responses[OC_REQUEST_HISTORY_RESPONSES];
+static uint16_t history_next_response;
+
+static void
+history_free_response(coap_history_t *h)
+{
+  if (h->response == HISTORY_NONE) {
+    return;
+  }
+  coap_history_response_t *r = &history_responses[h->response];
+  oc_mem_free(r->data);
+  r->data = NULL;
+  r->length = 0;
+  r->owner = HISTORY_NONE;
+  h->response = HISTORY_NONE;
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+static uint16_t
+history_hash(const oc_endpoint_t *endpoint, uint16_t mid)
+{
+  const uint8_t *addr = NULL;
+  size_t addr_len = 0, i;
+  uint16_t port = 0;
+  uint32_t hash = 2166136261u;
+
+  if (endpoint->flags & IPV6) {
+    addr = endpoint->addr.ipv6.address;
+    addr_len = sizeof(endpoint->addr.ipv6.address);
+    port = endpoint->addr.ipv6.port;
+  }
+#ifdef OC_IPV4
+  else if (endpoint->flags & IPV4) {
+    addr = endpoint->addr.ipv4.address;
+    addr_len = sizeof(endpoint->addr.ipv4.address);
+    port = endpoint->addr.ipv4.port;
+  }
+#endif /* OC_IPV4 */
+  for (i = 0; i < addr_len; i++) {
+    hash = (hash ^ addr[i]) * 16777619u;
+  }
+  hash = (hash ^ port) * 16777619u;
+  hash = (hash ^ mid) * 16777619u;
+  hash = (hash ^ (uint32_t)endpoint->device) * 16777619u;
+  return (uint16_t)(hash % OC_REQUEST_HISTORY_SIZE);
+}
+
+static void
+history_init(void)
 {
   size_t i;
   for (i = 0; i < OC_REQUEST_HISTORY_SIZE; i++) {
-    if (history[i] == mid && history_dev[i] == device) {
-      OC_DBG("dropping duplicate request");
-      return true;
+    history_buckets[i] = HISTORY_NONE;
+  }
+  history_head = history_count = 0;
+#ifdef OC_DYNAMIC_ALLOCATION
+  for (i = 0; i < OC_REQUEST_HISTORY_RESPONSES; i++) {
+    history_responses[i].owner = HISTORY_NONE;
+  }
+  history_next_response = 0;
+#endif /* OC_DYNAMIC_ALLOCATION */
+}
+
+static void
+history_evict_oldest(void)
+{
+  coap_history_t *h = &history[history_head];
+  uint16_t *link = &history_buckets[history_hash(&h->endpoint, h->mid)];
+
+  while (*link != HISTORY_NONE && *link != history_head) {
+    link = &history[*link].next;
+  }
+  if (*link == history_head) {
+    *link = h->next;
+  }
+#ifdef OC_DYNAMIC_ALLOCATION
+  history_free_response(h);
+#endif /* OC_DYNAMIC_ALLOCATION */
+  history_head = (history_head + 1) % OC_REQUEST_HISTORY_SIZE;
+  history_count--;
+}
+
+static void
+history_expire(oc_clock_time_t now)
+{
+  while (history_count > 0 &&
+         (oc_clock_time_t)(now - history[history_head].expires) <
+           ((oc_clock_time_t)~(oc_clock_time_t)0 >> 1)) {
+    history_evict_oldest();
+  }
+}
+
+static void
+history_free_all(void)
+{
+  while (history_count > 0) {
+    history_evict_oldest();
+  }
+}
+
+static coap_history_t *
+check_if_duplicate(oc_endpoint_t *endpoint, uint16_t mid)
+{
+  uint16_t i;
+
+  history_expire(oc_clock_time());
+  for (i = history_buckets[history_hash(endpoint, mid)]; i != HISTORY_NONE;
+       i = history[i].next) {
+    if (history[i].mid == mid &&
+        oc_endpoint_compare(&history[i].endpoint, endpoint) == 0) {
+      return &history[i];
     }
   }
-  return false;
+  return NULL;
 }
 
+static coap_history_t *
+history_add(oc_endpoint_t *endpoint, uint16_t mid)
+{
+  uint16_t i, bucket = history_hash(endpoint, mid);
+  coap_history_t *h;
+
+  if (history_count == OC_REQUEST_HISTORY_SIZE) {
+    history_evict_oldest();
+  }
+  i = (history_head + history_count) % OC_REQUEST_HISTORY_SIZE;
+  h = &history[i];
+  memcpy(&h->endpoint, endpoint, sizeof(oc_endpoint_t));
+  h->expires = oc_clock_time() + OC_EXCHANGE_LIFETIME * OC_CLOCK_SECOND;
+  h->mid = mid;
+#ifdef OC_DYNAMIC_ALLOCATION
+  h->response = HISTORY_NONE;
+#endif /* OC_DYNAMIC_ALLOCATION */
+  h->next = history_buckets[bucket];
+  history_buckets[bucket] = i;
+  history_count++;
+  return h;
+}
+
+#ifdef OC_DYNAMIC_ALLOCATION
+/* Keeps a copy of only the encoded bytes of the response */
+static void
+history_set_response(coap_history_t *h, oc_message_t *response)
+{
+  uint16_t slot = history_next_response;
+  coap_history_response_t *r = &history_responses[slot];
+
+  history_free_response(h);
+  if (r->owner != HISTORY_NONE) {
+    history_free_response(&history[r->owner]);
+  }
+  r->data = (uint8_t *)oc_mem_malloc(response->length);
+  if (!r->data) {
+    return;
+  }
+  memcpy(r->data, response->data, response->length);
+  r->length = response->length;
+  r->owner = (uint16_t)(h - history);
+  h->response = slot;
+  history_next_response = (slot + 1) % OC_REQUEST_HISTORY_RESPONSES;
+}
+
+/* Returns false when there is no response to replay */
+static bool
+history_replay_response(coap_history_t *h)
+{
+  if (h->response == HISTORY_NONE) {
+    return false;
+  }
+  coap_history_response_t *r = &history_responses[h->response];
+  oc_message_t *message = oc_internal_allocate_outgoing_message();
+  if (!message) {
+    return true;
+  }
+  OC_DBG("replaying response to duplicate request");
+  memcpy(&message->endpoint, &h->endpoint, sizeof(oc_endpoint_t));
+  memcpy(message->data, r->data, r->length);
+  message->length = r->length;
+  coap_send_message(message);
+  if (message->ref_count == 0) {
+    oc_message_unref(message);
+  }
+  return true;
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+#ifdef OC_BLOCK_WISE
+static void
+set_header_block1(void *packet, uint32_t num, uint8_t more, uint16_t size,
+                  uint8_t bert)
+{
+#ifdef OC_TCP
+  if (bert) {
+    coap_set_header_block1_bert(packet, num, more);
+    return;
+  }
+#else  /* OC_TCP */
+  (void)bert;
+#endif /* !OC_TCP */
+  coap_set_header_block1(packet, num, more, size);
+}
+
+static void
+set_header_block2(void *packet, uint32_t num, uint8_t more, uint16_t size,
+                  uint8_t bert)
+{
+#ifdef OC_TCP
+  if (bert) {
+    coap_set_header_block2_bert(packet, num, more);
+    return;
+  }
+#else  /* OC_TCP */
+  (void)bert;
+#endif /* !OC_TCP */
+  coap_set_header_block2(packet, num, more, size);
+}
+
+#ifdef OC_CLIENT
+static void
+init_block_request(void *packet, oc_endpoint_t *endpoint, uint8_t method,
+                   uint16_t mid)
+{
+#ifdef OC_TCP
+  if (endpoint->flags & TCP) {
+    coap_tcp_init_message(packet, method);
+    return;
+  }
+#else  /* OC_TCP */
+  (void)endpoint;
+#endif /* !OC_TCP */
+  coap_udp_init_message(packet, COAP_TYPE_CON, method, mid);
+}
+#endif /* OC_CLIENT */
+#endif /* OC_BLOCK_WISE */
+
 void
 coap_send_empty_ack(uint16_t mid, oc_endpoint_t *endpoint)
 {
@@ -112,21 +380,19 @@ coap_send_empty_ack(uint16_t mid, oc_endpoint_t *endpoint)
 /*- Internal API ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
 int
-coap_receive(oc_message_t *msg)
+coap_receive(coap_receive_ctx_t *ctx, oc_message_t *msg)
 {
-  coap_status_code = COAP_NO_ERROR;
+  ctx->status_code = COAP_NO_ERROR;
 
   OC_DBG("CoAP Engine: received datalen=%u from",
          (unsigned int)msg->length);
   OC_LOGipaddr(msg->endpoint);
   OC_LOGbytes(msg->data, msg->length);
 
-  /* static declaration reduces stack peaks and program code size */
-  static coap_packet_t
-    message[1]; /* this way the packet can be treated as pointer as usual */
-  static coap_packet_t response[1];
-  static coap_transaction_t *transaction;
-  transaction = NULL;
+  coap_packet_t *const message = ctx->message;
+  coap_packet_t *const response = ctx->response;
+  coap_transaction_t *transaction = NULL;
+  coap_history_t *history_entry = NULL;
 
   /* block options */
   uint32_t block1_num = 0, block1_offset = 0, block2_num = 0, block2_offset = 0;
@@ -141,16 +407,24 @@ coap_receive(oc_message_t *msg)
 
 #ifdef OC_TCP
   if (msg->endpoint.flags & TCP) {
-    coap_status_code =
+    ctx->status_code =
       coap_tcp_parse_message(message, msg->data, (uint32_t)msg->length);
   } else
 #endif /* OC_TCP */
   {
-    coap_status_code =
+    ctx->status_code =
       coap_udp_parse_message(message, msg->data, (uint16_t)msg->length);
   }
 
-  if (coap_status_code == COAP_NO_ERROR) {
+#ifdef OC_TCP
+  /* A CSM with an unsupported critical option is answered with an Abort */
+  if (ctx->status_code == BAD_OPTION_4_02 && (msg->endpoint.flags & TCP) &&
+      message->code == CSM_7_01) {
+    coap_send_abort_message(&msg->endpoint, message->bad_csm_option);
+  }
+#endif /* OC_TCP */
+
+  if (ctx->status_code == COAP_NO_ERROR) {
 
 #ifdef OC_DEBUG
     OC_DBG("  Parsed: CoAP version: %u, token: 0x%02X%02X, mid: %u",
@@ -174,6 +448,13 @@ coap_receive(oc_message_t *msg)
     }
 #endif
 
+#ifdef OC_TCP
+    if (coap_check_signal_message(message)) {
+      ctx->status_code = coap_signal_handler(message, &msg->endpoint);
+      goto send_message;
+    }
+#endif /* OC_TCP */
+
     /* extract block options */
     if (coap_get_header_block1(message, &block1_num, &block1_more, &block1_size,
                                &block1_offset))
@@ -183,8 +464,13 @@ coap_receive(oc_message_t *msg)
       block2 = true;
 
 #ifdef OC_BLOCK_WISE
-    block1_size = MIN(block1_size, (uint16_t)OC_BLOCK_SIZE);
-    block2_size = MIN(block2_size, (uint16_t)OC_BLOCK_SIZE);
+    /* BERT blocks are not bounded by the block size of the link */
+    if (!message->block1_bert) {
+      block1_size = MIN(block1_size, (uint16_t)OC_BLOCK_SIZE);
+    }
+    if (!message->block2_bert) {
+      block2_size = MIN(block2_size, (uint16_t)OC_BLOCK_SIZE);
+    }
 #endif /* OC_BLOCK_WISE */
 
 #ifdef OC_TCP
@@ -192,8 +478,15 @@ coap_receive(oc_message_t *msg)
 #endif /* OC_TCP */
     {
       transaction = coap_get_transaction_by_mid(message->mid);
-      if (transaction)
+      if (transaction) {
+        if (message->type == COAP_TYPE_ACK ||
+            message->type == COAP_TYPE_RST) {
+          coap_rtt_measure(&transaction->message->endpoint,
+                           transaction->sent_time,
+                           transaction->retrans_counter);
+        }
         coap_clear_transaction(transaction);
+      }
       transaction = NULL;
     }
 
@@ -226,15 +519,27 @@ coap_receive(oc_message_t *msg)
       } else
 #endif /* OC_TCP */
       {
+        history_entry = check_if_duplicate(&msg->endpoint, message->mid);
+        if (history_entry) {
+          if (message->type != COAP_TYPE_CON) {
+            OC_DBG("dropping duplicate request");
+            return 0;
+          }
+#ifdef OC_DYNAMIC_ALLOCATION
+          if (history_replay_response(history_entry)) {
+            return 0;
+          }
+#endif /* OC_DYNAMIC_ALLOCATION */
+          /* The handler must not run twice for one request */
+          OC_DBG("acknowledging duplicate request with nothing to replay");
+          coap_send_empty_ack(message->mid, &msg->endpoint);
+          return 0;
+        } else {
+          history_entry = history_add(&msg->endpoint, message->mid);
+        }
         if (message->type == COAP_TYPE_CON) {
           coap_udp_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, message->mid);
         } else {
-          if (check_if_duplicate(message->mid, (uint8_t)msg->endpoint.device)) {
-            return 0;
-          }
-          history[idx] = message->mid;
-          history_dev[idx] = (uint8_t)msg->endpoint.device;
-          idx = (idx + 1) % OC_REQUEST_HISTORY_SIZE;
           coap_udp_init_message(response, COAP_TYPE_NON, CONTENT_2_05,
                             coap_get_mid());
         }
@@ -270,23 +575,33 @@ coap_receive(oc_message_t *msg)
             }
           }
 
+          uint32_t block1_len = MIN(incoming_block_len, block1_size);
+          if (message->block1_bert) {
+            /* Only the last BERT block may be shorter than a multiple of
+             * the block size */
+            if (block1_more && incoming_block_len % block1_size != 0) {
+              OC_ERR("BERT block is not a multiple of the block size");
+              goto init_reset_message;
+            }
+            block1_len = incoming_block_len;
+          }
+
           if (request_buffer) {
             OC_DBG("processing incoming block");
-            if (oc_blockwise_handle_block(
-                  request_buffer, block1_offset, incoming_block,
-                  MIN((uint16_t)incoming_block_len, block1_size))) {
+            if (oc_blockwise_handle_block(request_buffer, block1_offset,
+                                          incoming_block, block1_len)) {
               if (block1_more) {
                 OC_DBG(
                   "more blocks expected; issuing request for the next block");
                 response->code = CONTINUE_2_31;
-                coap_set_header_block1(response, block1_num, block1_more,
-                                       block1_size);
+                set_header_block1(response, block1_num, block1_more,
+                                  block1_size, message->block1_bert);
                 request_buffer->ref_count = 1;
                 goto send_message;
               } else {
                 OC_DBG("received all blocks for payload");
-                coap_set_header_block1(response, block1_num, block1_more,
-                                       block1_size);
+                set_header_block1(response, block1_num, block1_more,
+                                  block1_size, message->block1_bert);
                 request_buffer->payload_size =
                   request_buffer->next_block_offset;
                 request_buffer->ref_count = 0;
@@ -309,9 +624,17 @@ coap_receive(oc_message_t *msg)
             message->uri_query_len, OC_BLOCKWISE_SERVER);
           if (response_buffer) {
             OC_DBG("continuing ongoing block-wise transfer");
-            uint32_t payload_size = 0;
+            uint32_t payload_size = 0, block2_len = block2_size;
+            uint8_t block2_bert = 0;
+#ifdef OC_TCP
+            if (msg->endpoint.flags & TCP) {
+              block2_len = oc_blockwise_tcp_block_size(
+                response_buffer, true, message->block2_bert, &block2_size,
+                &block2_bert);
+            }
+#endif /* OC_TCP */
             const void *payload = oc_blockwise_dispatch_block(
-              response_buffer, block2_offset, block2_size, &payload_size);
+              response_buffer, block2_offset, block2_len, &payload_size);
             if (payload) {
               OC_DBG("dispatching next block");
               uint8_t more = (response_buffer->next_block_offset <
@@ -319,7 +642,8 @@ coap_receive(oc_message_t *msg)
                                ? 1
                                : 0;
               coap_set_payload(response, payload, payload_size);
-              coap_set_header_block2(response, block2_num, more, block2_size);
+              set_header_block2(response, block2_offset / block2_size, more,
+                                block2_size, block2_bert);
               oc_blockwise_response_state_t *response_state =
                 (oc_blockwise_response_state_t *)response_buffer;
               coap_set_header_etag(response, response_state->etag,
@@ -405,48 +729,42 @@ coap_receive(oc_message_t *msg)
 #endif /* !OC_BLOCK_WISE */
 #ifdef OC_BLOCK_WISE
       request_handler:
-        if (oc_ri_invoke_coap_entity_handler(message, response, &request_buffer,
+        if (oc_ri_invoke_coap_entity_handler(ctx, &request_buffer,
                                              &response_buffer, block2_size,
                                              &msg->endpoint)) {
 #else /* OC_BLOCK_WISE */
-        if (oc_ri_invoke_coap_entity_handler(message, response,
+        if (oc_ri_invoke_coap_entity_handler(ctx,
                                              transaction->message->data +
                                                COAP_MAX_HEADER_SIZE,
                                              &msg->endpoint)) {
 #endif /* !OC_BLOCK_WISE */
 #ifdef OC_BLOCK_WISE
-          uint32_t payload_size = 0;
+          uint32_t payload_size = 0, block2_len = block2_size;
+          uint8_t block2_bert = 0;
 #ifdef OC_TCP
           if (msg->endpoint.flags & TCP) {
-            const void *payload = oc_blockwise_dispatch_block(
-              response_buffer, 0, response_buffer->payload_size + 1, &payload_size);
-            if (payload && response_buffer->payload_size > 0) {
-              coap_set_payload(response, payload, payload_size);
-            }
-            response_buffer->ref_count = 0;
-          } else {
-#endif /* OC_TCP */
-            const void *payload = oc_blockwise_dispatch_block(
-              response_buffer, 0, block2_size, &payload_size);
-            if (payload) {
-              coap_set_payload(response, payload, payload_size);
-            }
-            if (block2 || response_buffer->payload_size > block2_size) {
-              coap_set_header_block2(
-                response, 0,
-                (response_buffer->payload_size > block2_size) ? 1 : 0,
-                block2_size);
-              coap_set_header_size2(response, response_buffer->payload_size);
-              oc_blockwise_response_state_t *response_state =
-                (oc_blockwise_response_state_t *)response_buffer;
-              coap_set_header_etag(response, response_state->etag,
-                                   COAP_ETAG_LEN);
-            } else {
-              response_buffer->ref_count = 0;
-            }
-#ifdef OC_TCP
+            block2_len = oc_blockwise_tcp_block_size(
+              response_buffer, block2, message->block2_bert, &block2_size,
+              &block2_bert);
           }
 #endif /* OC_TCP */
+          const void *payload = oc_blockwise_dispatch_block(
+            response_buffer, 0, block2_len, &payload_size);
+          if (payload) {
+            coap_set_payload(response, payload, payload_size);
+          }
+          if (block2 || response_buffer->payload_size > block2_len) {
+            set_header_block2(
+              response, 0, (response_buffer->payload_size > block2_len) ? 1 : 0,
+              block2_size, block2_bert);
+            coap_set_header_size2(response, response_buffer->payload_size);
+            oc_blockwise_response_state_t *response_state =
+              (oc_blockwise_response_state_t *)response_buffer;
+            coap_set_header_etag(response, response_state->etag,
+                                 COAP_ETAG_LEN);
+          } else {
+            response_buffer->ref_count = 0;
+          }
 #endif /* OC_BLOCK_WISE */
         }
 #ifdef OC_BLOCK_WISE
@@ -498,11 +816,24 @@ coap_receive(oc_message_t *msg)
         client_cb = (oc_client_cb_t *)request_buffer->client_cb;
         uint32_t payload_size = 0;
         const void *payload = 0;
+        uint8_t block1_bert = 0;
 
         if (block1) {
-          payload = oc_blockwise_dispatch_block(request_buffer,
-                                                block1_offset + block1_size,
-                                                block1_size, &payload_size);
+          uint32_t block1_len = block1_size;
+#ifdef OC_TCP
+          if (message->block1_bert) {
+            /* The next BERT block starts after the last one that was sent,
+             * and may span several blocks again */
+            block1_offset = request_buffer->next_block_offset;
+            block1_len = oc_blockwise_tcp_block_size(
+              request_buffer, true, true, &block1_size, &block1_bert);
+          } else
+#endif /* OC_TCP */
+          {
+            block1_offset += block1_size;
+          }
+          payload = oc_blockwise_dispatch_block(request_buffer, block1_offset,
+                                                block1_len, &payload_size);
         } else {
           OC_DBG("initiating block-wise transfer with block1 option");
           uint32_t peer_mtu = 0;
@@ -519,8 +850,8 @@ coap_receive(oc_message_t *msg)
           OC_DBG("dispatching next block");
           transaction = coap_new_transaction(response_mid, &msg->endpoint);
           if (transaction) {
-            coap_udp_init_message(response, COAP_TYPE_CON, client_cb->method,
-                              response_mid);
+            init_block_request(response, &msg->endpoint, client_cb->method,
+                               response_mid);
             uint8_t more =
               (request_buffer->next_block_offset < request_buffer->payload_size)
                 ? 1
@@ -529,8 +860,8 @@ coap_receive(oc_message_t *msg)
                                      oc_string_len(client_cb->uri));
             coap_set_payload(response, payload, payload_size);
             if (block1) {
-              coap_set_header_block1(response, block1_num + 1, more,
-                                     block1_size);
+              set_header_block1(response, block1_offset / block1_size, more,
+                                block1_size, block1_bert);
             } else {
               coap_set_header_block1(response, 0, more, block1_size);
               coap_set_header_size1(response, request_buffer->payload_size);
@@ -538,7 +869,8 @@ coap_receive(oc_message_t *msg)
             if (oc_string_len(client_cb->query) > 0) {
               coap_set_header_uri_query(response, oc_string(client_cb->query));
             }
-            request_buffer->mid = response_mid;
+            oc_blockwise_set_request_buffer_mid(request_buffer,
+                                                response_mid);
             goto send_message;
           }
         } else {
@@ -589,10 +921,20 @@ coap_receive(oc_message_t *msg)
             OC_DBG("issuing request for next block");
             transaction = coap_new_transaction(response_mid, &msg->endpoint);
             if (transaction) {
-              coap_udp_init_message(response, COAP_TYPE_CON, client_cb->method,
-                                response_mid);
-              response_buffer->mid = response_mid;
-              coap_set_header_block2(response, block2_num + 1, 0, block2_size);
+              init_block_request(response, &msg->endpoint, client_cb->method,
+                                 response_mid);
+              oc_blockwise_set_response_buffer_mid(response_buffer,
+                                                   response_mid);
+              if (message->block2_bert) {
+                /* A BERT block may have carried several blocks */
+                set_header_block2(
+                  response,
+                  response_buffer->next_block_offset / block2_size, 0,
+                  block2_size, 1);
+              } else {
+                coap_set_header_block2(response, block2_num + 1, 0,
+                                       block2_size);
+              }
               coap_set_header_uri_path(response, oc_string(client_cb->uri),
                                        oc_string_len(client_cb->uri));
               if (oc_string_len(client_cb->query) > 0) {
@@ -644,7 +986,7 @@ free_blockwise_buffers:
 #endif /* OC_BLOCK_WISE */
 
 send_message:
-  if (coap_status_code == COAP_NO_ERROR) {
+  if (ctx->status_code == COAP_NO_ERROR) {
     if (transaction) {
       if (response->type != COAP_TYPE_RST && message->token_len) {
         if (message->code >= COAP_GET && message->code <= COAP_DELETE) {
@@ -672,12 +1014,18 @@ send_message:
       transaction->message->length =
         coap_serialize_message(response, transaction->message->data);
       if (transaction->message->length) {
+#ifdef OC_DYNAMIC_ALLOCATION
+        if (history_entry && response->type == COAP_TYPE_ACK &&
+            response->code != 0) {
+          history_set_response(history_entry, transaction->message);
+        }
+#endif /* OC_DYNAMIC_ALLOCATION */
         coap_send_transaction(transaction);
       } else {
         coap_clear_transaction(transaction);
       }
     }
-  } else if (coap_status_code == CLEAR_TRANSACTION) {
+  } else if (ctx->status_code == CLEAR_TRANSACTION) {
     coap_clear_transaction(transaction);
   }
 
@@ -685,7 +1033,7 @@ send_message:
   oc_blockwise_scrub_buffers();
 #endif /* OC_BLOCK_WISE */
 
-  return coap_status_code;
+  return ctx->status_code;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -694,10 +1042,86 @@ coap_init_engine(void)
   coap_register_as_transaction_handler();
 }
 /*---------------------------------------------------------------------------*/
+#ifdef OC_TCP
+#ifdef OC_CLIENT
+/* Returns the client callback of the request or Ping in packet, if any */
+static oc_client_cb_t *
+find_tcp_request(coap_packet_t *packet)
+{
+  if (packet->code < CREATED_2_01 || packet->code == PING_7_02) {
+    return oc_ri_find_client_cb_by_token(packet->token, packet->token_len);
+  }
+  return NULL;
+}
+#endif /* OC_CLIENT */
+
+void
+coap_tcp_send_failed(oc_message_t *message)
+{
+  coap_packet_t packet[1];
+  if (coap_tcp_parse_message(packet, message->data,
+                             (uint32_t)message->length) != COAP_NO_ERROR) {
+    return;
+  }
+#ifdef OC_CLIENT
+  oc_client_cb_t *cb = find_tcp_request(packet);
+  if (cb) {
+    OC_ERR("could not send TCP request; failing it");
+    oc_client_complete_request(cb, OC_SEND_FAILED);
+    return;
+  }
+#endif /* OC_CLIENT */
+  OC_WRN("could not send TCP message with code %d", packet->code);
+}
+
+void
+coap_tcp_message_too_large(oc_message_t *message)
+{
+  OC_ERR("message of %u bytes exceeds the Max-Message-Size of the peer",
+         (unsigned int)message->length);
+  coap_packet_t packet[1];
+  if (coap_tcp_parse_message(packet, message->data,
+                             (uint32_t)message->length) != COAP_NO_ERROR) {
+    return;
+  }
+#ifdef OC_CLIENT
+  oc_client_cb_t *cb = find_tcp_request(packet);
+  if (cb) {
+    oc_client_request_too_large(cb);
+    return;
+  }
+#endif /* OC_CLIENT */
+#ifdef OC_SERVER
+  /* A response is replaced, so that the client is not left waiting */
+  if (packet->code >= CREATED_2_01 && !coap_check_signal_message(packet) &&
+      packet->code != REQUEST_ENTITY_TOO_LARGE_4_13) {
+    coap_packet_t response[1];
+    coap_tcp_init_message(response, REQUEST_ENTITY_TOO_LARGE_4_13);
+    coap_set_token(response, packet->token, packet->token_len);
+    oc_message_t *reply = oc_internal_allocate_outgoing_message();
+    if (reply) {
+      memcpy(&reply->endpoint, &message->endpoint, sizeof(oc_endpoint_t));
+      reply->length = coap_serialize_message(response, reply->data);
+      coap_send_message(reply);
+      if (reply->ref_count == 0) {
+        oc_message_unref(reply);
+      }
+    }
+  }
+#endif /* OC_SERVER */
+}
+#endif /* OC_TCP */
+/*---------------------------------------------------------------------------*/
+/* Context of the engine process; kept off the stack to reduce its peak */
+static coap_receive_ctx_t engine_ctx;
+
 OC_PROCESS_THREAD(coap_engine, ev, data)
 {
+  OC_PROCESS_EXITHANDLER(history_free_all());
   OC_PROCESS_BEGIN();
 
+  history_init();
+
   coap_register_as_transaction_handler();
   coap_init_connection();
 
@@ -705,7 +1129,7 @@ OC_PROCESS_THREAD(coap_engine, ev, data)
     OC_PROCESS_YIELD();
 
     if (ev == oc_events[INBOUND_RI_EVENT]) {
-      coap_receive(data);
+      coap_receive(&engine_ctx, data);
 
       oc_message_unref(data);
     } else if (ev == OC_PROCESS_EVENT_TIMER) {
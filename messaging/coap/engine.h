@@ -55,8 +55,31 @@
 
 OC_PROCESS_NAME(coap_engine);
 
+/* State of one coap_receive() call. Callers that process messages
+ * concurrently must each use their own context.
+ */
+typedef struct coap_receive_ctx
+{
+  coap_packet_t message[1];
+  coap_packet_t response[1];
+  coap_status_t status_code;
+} coap_receive_ctx_t;
+
 void coap_init_engine(void);
 /*---------------------------------------------------------------------------*/
-int coap_receive(oc_message_t *message);
+int coap_receive(coap_receive_ctx_t *ctx, oc_message_t *message);
+
+#ifdef OC_TCP
+/* Reports a message the transport refused to take. TCP has no
+ * retransmissions, so a request in it is failed with OC_SEND_FAILED.
+ */
+void coap_tcp_send_failed(oc_message_t *message);
+
+/* Reports a message larger than the peer's Max-Message-Size. A request in
+ * it is failed with OC_STATUS_REQUEST_ENTITY_TOO_LARGE, and a response is
+ * replaced by a 4.13 with the same token.
+ */
+void coap_tcp_message_too_large(oc_message_t *message);
+#endif /* OC_TCP */
 
 #endif /* ENGINE_H */
@@ -74,41 +74,274 @@ int32_t observe_counter = 3;
 /*---------------------------------------------------------------------------*/
 OC_LIST(observers_list);
 OC_MEMB(observers_memb, coap_observer_t, COAP_MAX_OBSERVERS);
+/* Each observer is also linked into its resource's list of observers and
+ * into this index of observers by endpoint, so notifications and removals
+ * only visit the observers they concern.
+ */
+OC_HASH(observers_by_endpoint, 16);
 
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
+static coap_observer_t *
+first_endpoint_observer(oc_endpoint_t *endpoint)
+{
+  oc_hash_link_t *link =
+    oc_hash_lookup(&observers_by_endpoint, oc_endpoint_hash(endpoint));
+  return link ? oc_hash_entry(link, coap_observer_t, endpoint_link) : NULL;
+}
+
+static coap_observer_t *
+next_endpoint_observer(coap_observer_t *obs)
+{
+  oc_hash_link_t *link = oc_hash_next(&obs->endpoint_link);
+  return link ? oc_hash_entry(link, coap_observer_t, endpoint_link) : NULL;
+}
+
+static void
+link_observer(coap_observer_t *o)
+{
+  oc_resource_t *resource = o->resource;
+  o->resource_next = resource->observers;
+  if (o->resource_next) {
+    o->resource_next->resource_prev = &o->resource_next;
+  }
+  o->resource_prev = &resource->observers;
+  resource->observers = o;
+  resource->num_observers++;
+  oc_hash_add(&observers_by_endpoint, &o->endpoint_link,
+              oc_endpoint_hash(&o->endpoint));
+  oc_list_add(observers_list, o);
+}
+
+static void
+unlink_observer(coap_observer_t *o)
+{
+  *o->resource_prev = o->resource_next;
+  if (o->resource_next) {
+    o->resource_next->resource_prev = o->resource_prev;
+  }
+  o->resource->num_observers--;
+  oc_hash_remove(&observers_by_endpoint, &o->endpoint_link);
+  oc_list_remove(observers_list, o);
+}
+
 static int
 coap_remove_observer_handle_by_uri(oc_endpoint_t *endpoint, const char *uri,
                                    int uri_len)
 {
   int removed = 0;
-  coap_observer_t *obs = (coap_observer_t *)oc_list_head(observers_list), *next;
+  coap_observer_t *obs = first_endpoint_observer(endpoint);
 
   while (obs) {
-    next = obs->next;
     if (((oc_endpoint_compare(&obs->endpoint, endpoint) == 0)) &&
         (obs->url == uri || memcmp(obs->url, uri, uri_len) == 0)) {
-      obs->resource->num_observers--;
-      oc_list_remove(observers_list, obs);
+      /* A pending notification must not clear the freed observer later */
+      if (obs->notification) {
+        obs->notification->observer = NULL;
+      }
+      unlink_observer(obs);
       oc_memb_free(&observers_memb, obs);
       removed++;
       break;
     }
-    obs = next;
+    obs = next_endpoint_observer(obs);
   }
   return removed;
 }
 /*---------------------------------------------------------------------------*/
+/*- Notification conditions -------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
+#define OBSERVE_STEP (1 << 0)
+#define OBSERVE_GT (1 << 1)
+#define OBSERVE_LT (1 << 2)
+
+typedef enum {
+  NOTIFY_SKIP = 0,
+  NOTIFY_IF_CHANGED,
+  NOTIFY_NOW
+} notification_gate_t;
+
+static oc_event_callback_retval_t observe_conditions_due(void *data);
+
+/* Parses a decimal number such as "5", "-3" or "0.25" */
+static bool
+parse_number(const char *str, int len, double *value)
+{
+  double result = 0, scale = 0;
+  bool digits = false;
+  int i = (len > 0 && str[0] == '-') ? 1 : 0;
+  for (; i < len; i++) {
+    if (str[i] >= '0' && str[i] <= '9') {
+      if (scale > 0) {
+        result += (str[i] - '0') * scale;
+        scale /= 10;
+      } else {
+        result = result * 10 + (str[i] - '0');
+      }
+      digits = true;
+    } else if (str[i] == '.' && scale == 0) {
+      scale = 0.1;
+    } else {
+      return false;
+    }
+  }
+  if (!digits) {
+    return false;
+  }
+  *value = (len > 0 && str[0] == '-') ? -result : result;
+  return true;
+}
+
+static bool
+get_query_number(const char *query, int query_len, const char *key,
+                 double *value)
+{
+  char *str = NULL;
+  int len = oc_ri_get_query_value(query, query_len, key, &str);
+  if (len < 0) {
+    return false;
+  }
+  if (!parse_number(str, len, value)) {
+    OC_WRN("Ignoring invalid observe condition %s", key);
+    return false;
+  }
+  return true;
+}
+
+static uint16_t
+query_period(double seconds)
+{
+  if (seconds <= 0) {
+    return 0;
+  }
+  return seconds > UINT16_MAX ? UINT16_MAX : (uint16_t)seconds;
+}
+
+static void
+set_observe_conditions(coap_observer_t *o, const char *query, int query_len)
+{
+  double number;
+  if (get_query_number(query, query_len, "pmin", &number)) {
+    o->pmin = query_period(number);
+  }
+  if (get_query_number(query, query_len, "pmax", &number)) {
+    o->pmax = query_period(number);
+  }
+  if (o->pmax && o->pmax < o->pmin) {
+    OC_WRN("Ignoring pmax below pmin");
+    o->pmax = 0;
+  }
+  if (get_query_number(query, query_len, "st", &number) && number > 0) {
+    o->step = number;
+    o->conditions |= OBSERVE_STEP;
+  }
+  if (get_query_number(query, query_len, "gt", &number)) {
+    o->gt = number;
+    o->conditions |= OBSERVE_GT;
+  }
+  if (get_query_number(query, query_len, "lt", &number)) {
+    o->lt = number;
+    o->conditions |= OBSERVE_LT;
+  }
+  o->last_notify = oc_clock_time();
+}
+
+/* Decides whether an observer may be notified now as far as its periods
+ * are concerned. A change inside pmin is left pending; a timer pass only
+ * serves pending changes and expired pmax periods.
+ */
+static notification_gate_t
+notification_gate(coap_observer_t *obs, oc_clock_time_t now, bool timer_pass)
+{
+  if (!obs->pmin && !obs->pmax && !obs->conditions) {
+    return timer_pass ? NOTIFY_SKIP : NOTIFY_NOW;
+  }
+  oc_clock_time_t elapsed = now - obs->last_notify;
+  if (obs->pmax && elapsed >= (oc_clock_time_t)obs->pmax * OC_CLOCK_SECOND) {
+    return NOTIFY_NOW;
+  }
+  if (timer_pass && !obs->pending) {
+    return NOTIFY_SKIP;
+  }
+  if (elapsed < (oc_clock_time_t)obs->pmin * OC_CLOCK_SECOND) {
+    obs->pending = 1;
+    return NOTIFY_SKIP;
+  }
+  return NOTIFY_IF_CHANGED;
+}
+
+static bool
+value_condition_met(coap_observer_t *obs, double value)
+{
+  if (!obs->conditions || !obs->has_last_value) {
+    return true;
+  }
+  double last = obs->last_value;
+  if (obs->conditions & OBSERVE_STEP) {
+    double delta = value > last ? value - last : last - value;
+    if (delta >= obs->step) {
+      return true;
+    }
+  }
+  if ((obs->conditions & OBSERVE_GT) && (last > obs->gt) != (value > obs->gt)) {
+    return true;
+  }
+  if ((obs->conditions & OBSERVE_LT) && (last < obs->lt) != (value < obs->lt)) {
+    return true;
+  }
+  return false;
+}
+
+static bool
+observers_due(oc_resource_t *resource, oc_clock_time_t now, bool timer_pass)
+{
+  bool due = false;
+  coap_observer_t *obs;
+  for (obs = resource->observers; obs; obs = obs->resource_next) {
+    if (notification_gate(obs, now, timer_pass) != NOTIFY_SKIP) {
+      due = true;
+    }
+  }
+  return due;
+}
+
+/* Arms one timer per resource for the earliest pending change or pmax */
+static void
+schedule_conditions(oc_resource_t *resource, oc_clock_time_t now)
+{
+  oc_clock_time_t due = 0, next;
+  bool scheduled = false;
+  coap_observer_t *obs;
+  for (obs = resource->observers; obs; obs = obs->resource_next) {
+    if (obs->pending) {
+      next = obs->last_notify + (oc_clock_time_t)obs->pmin * OC_CLOCK_SECOND;
+    } else if (obs->pmax) {
+      next = obs->last_notify + (oc_clock_time_t)obs->pmax * OC_CLOCK_SECOND;
+    } else {
+      continue;
+    }
+    if (!scheduled || next < due) {
+      due = next;
+      scheduled = true;
+    }
+  }
+  if (scheduled) {
+    oc_ri_remove_timed_event_callback(resource, observe_conditions_due);
+    oc_ri_add_timed_event_callback_ticks(
+      resource, observe_conditions_due, due > now ? due - now : 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
 static int
 #ifdef OC_BLOCK_WISE
 add_observer(oc_resource_t *resource, uint16_t block2_size,
              oc_endpoint_t *endpoint, const uint8_t *token, size_t token_len,
-             const char *uri, int uri_len)
+             const char *uri, int uri_len, const char *query, int query_len)
 #else  /* OC_BLOCK_WISE */
 add_observer(oc_resource_t *resource, oc_endpoint_t *endpoint,
              const uint8_t *token, size_t token_len, const char *uri,
-             int uri_len)
+             int uri_len, const char *query, int query_len)
 #endif /* !OC_BLOCK_WISE */
 {
   /* Remove existing observe relationship, if any. */
@@ -130,12 +363,12 @@ add_observer(oc_resource_t *resource, oc_endpoint_t *endpoint,
     o->token_len = (uint8_t)token_len;
     memcpy(o->token, token, token_len);
     o->last_mid = 0;
+    o->notification = NULL;
     o->obs_counter = observe_counter;
     o->resource = resource;
 #ifdef OC_BLOCK_WISE
     o->block2_size = block2_size;
 #endif /* OC_BLOCK_WISE */
-    resource->num_observers++;
 #ifdef OC_DYNAMIC_ALLOCATION
     OC_DBG("Adding observer (%u) for /%s [0x%02X%02X]",
            oc_list_length(observers_list) + 1, o->url, o->token[0],
@@ -145,7 +378,9 @@ add_observer(oc_resource_t *resource, oc_endpoint_t *endpoint,
            oc_list_length(observers_list) + 1, COAP_MAX_OBSERVERS, o->url,
            o->token[0], o->token[1]);
 #endif /* !OC_DYNAMIC_ALLOCATION */
-    oc_list_add(observers_list, o);
+    set_observe_conditions(o, query, query_len);
+    link_observer(o);
+    schedule_conditions(resource, o->last_notify);
     return dup;
   }
   OC_WRN("insufficient memory to add new observer");
@@ -169,7 +404,10 @@ coap_remove_observer(coap_observer_t *o)
   }
 #endif /* OC_BLOCK_WISE */
 
-  oc_list_remove(observers_list, o);
+  if (o->notification) {
+    o->notification->observer = NULL;
+  }
+  unlink_observer(o);
   oc_memb_free(&observers_memb, o);
 }
 void
@@ -182,21 +420,21 @@ coap_free_all_observers(void)
     coap_remove_observer(obs);
     obs = next;
   }
+  oc_hash_init(&observers_by_endpoint);
 }
 /*---------------------------------------------------------------------------*/
 int
 coap_remove_observer_by_client(oc_endpoint_t *endpoint)
 {
   int removed = 0;
-  coap_observer_t *obs = (coap_observer_t *)oc_list_head(observers_list), *next;
+  coap_observer_t *obs = first_endpoint_observer(endpoint), *next;
 
   OC_DBG("Unregistering observers for client at: ");
   OC_LOGipaddr(*endpoint);
 
   while (obs) {
-    next = obs->next;
+    next = next_endpoint_observer(obs);
     if (oc_endpoint_compare(&obs->endpoint, endpoint) == 0) {
-      obs->resource->num_observers--;
       coap_remove_observer(obs);
       removed++;
     }
@@ -211,19 +449,18 @@ coap_remove_observer_by_token(oc_endpoint_t *endpoint, uint8_t *token,
                               size_t token_len)
 {
   int removed = 0;
-  coap_observer_t *obs = (coap_observer_t *)oc_list_head(observers_list);
+  coap_observer_t *obs = first_endpoint_observer(endpoint);
   OC_DBG("Unregistering observers for request token 0x%02X%02X", token[0],
          token[1]);
   while (obs) {
     if (oc_endpoint_compare(&obs->endpoint, endpoint) == 0 &&
         obs->token_len == token_len &&
         memcmp(obs->token, token, token_len) == 0) {
-      obs->resource->num_observers--;
       coap_remove_observer(obs);
       removed++;
       break;
     }
-    obs = obs->next;
+    obs = next_endpoint_observer(obs);
   }
   OC_DBG("Removed %d observers", removed);
   return removed;
@@ -236,11 +473,10 @@ coap_remove_observer_by_mid(oc_endpoint_t *endpoint, uint16_t mid)
   coap_observer_t *obs = NULL;
   OC_DBG("Unregistering observers for request MID %u", mid);
 
-  for (obs = (coap_observer_t *)oc_list_head(observers_list); obs != NULL;
-       obs = obs->next) {
+  for (obs = first_endpoint_observer(endpoint); obs != NULL;
+       obs = next_endpoint_observer(obs)) {
     if (oc_endpoint_compare(&obs->endpoint, endpoint) == 0 &&
         obs->last_mid == mid) {
-      obs->resource->num_observers--;
       coap_remove_observer(obs);
       removed++;
       break;
@@ -250,13 +486,133 @@ coap_remove_observer_by_mid(oc_endpoint_t *endpoint, uint16_t mid)
   return removed;
 }
 
+/*---------------------------------------------------------------------------*/
+int
+coap_remove_observers_by_resource(oc_resource_t *resource)
+{
+  int removed = 0;
+  oc_ri_remove_timed_event_callback(resource, observe_conditions_due);
+  while (resource->observers) {
+    coap_remove_observer(resource->observers);
+    removed++;
+  }
+  return removed;
+}
+
 /*---------------------------------------------------------------------------*/
 /*- Notification ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
-int
-coap_notify_observers(oc_resource_t *resource,
-                      oc_response_buffer_t *response_buf,
-                      oc_endpoint_t *endpoint)
+/* Gets the transaction for a notification. Following RFC 7641 4.5.2, a
+ * newer notification takes the place of an unacknowledged confirmable one
+ * to the same observer: it goes out at once with a new MID, but keeps the
+ * retransmission counter and timeout of the one it replaces, so each
+ * observer holds at most one confirmable notification. That one is
+ * returned in *replaced, to be passed to coap_replace_transaction() instead
+ * of sending the new transaction.
+ */
+static coap_transaction_t *
+notification_transaction(coap_observer_t *obs, coap_packet_t *notification,
+                         coap_transaction_t **replaced)
+{
+  *replaced = obs->notification;
+  if (*replaced) {
+    OC_DBG("coap_notify_observers: replacing unacknowledged notification %u",
+           (*replaced)->mid);
+    notification->type = COAP_TYPE_CON;
+  }
+  coap_transaction_t *t = coap_new_transaction(coap_get_mid(), &obs->endpoint);
+  if (!t) {
+    *replaced = NULL;
+    return NULL;
+  }
+  obs->last_mid = t->mid;
+  notification->mid = t->mid;
+#ifdef OC_TCP
+  if (!(obs->endpoint.flags & TCP) && notification->type == COAP_TYPE_CON) {
+#else  /* OC_TCP */
+  if (notification->type == COAP_TYPE_CON) {
+#endif /* !OC_TCP */
+    if (*replaced) {
+      (*replaced)->observer = NULL;
+    }
+    obs->notification = t;
+    t->observer = obs;
+  }
+  return t;
+}
+
+/*---------------------------------------------------------------------------*/
+/* The options of a UDP notification that follow Observe. They depend only
+ * on the content format, so a fan-out encodes them once per format and
+ * copies them behind the header, token and Observe option of each
+ * observer.
+ */
+typedef struct
+{
+  uint8_t data[COAP_MAX_HEADER_SIZE];
+  size_t length;
+} notification_options_t;
+
+/* Serializes notification into buffer like coap_serialize_message().
+ * A single UDP notification only has its header, token and Observe option
+ * encoded here; the options after Observe come from options, which holds
+ * one entry per content format, and the payload is copied in behind them.
+ */
+static size_t
+serialize_notification(coap_packet_t *notification,
+                       notification_options_t options[2], uint8_t *buffer)
+{
+#ifdef OC_TCP
+  if (notification->transport_type == COAP_TRANSPORT_TCP) {
+    return coap_serialize_message(notification, buffer);
+  }
+#endif /* OC_TCP */
+  if (IS_OPTION(notification, COAP_OPTION_BLOCK2) ||
+      !IS_OPTION(notification, COAP_OPTION_CONTENT_FORMAT)) {
+    return coap_serialize_message(notification, buffer);
+  }
+
+  notification_options_t *cached =
+    &options[notification->content_format == APPLICATION_CBOR ? 1 : 0];
+  uint8_t full[COAP_MAX_HEADER_SIZE];
+  size_t full_len = 0;
+  uint32_t payload_len = notification->payload_len;
+  notification->payload_len = 0;
+  if (cached->length == 0) {
+    full_len = coap_serialize_message(notification, full);
+  }
+  UNSET_OPTION(notification, COAP_OPTION_CONTENT_FORMAT);
+  size_t length = coap_serialize_message(notification, buffer);
+  SET_OPTION(notification, COAP_OPTION_CONTENT_FORMAT);
+  notification->payload_len = payload_len;
+  if (cached->length == 0) {
+    if (full_len <= length) {
+      return 0;
+    }
+    cached->length = full_len - length;
+    memcpy(cached->data, full + length, cached->length);
+  }
+  if (length == 0 || length + cached->length > COAP_MAX_HEADER_SIZE) {
+    return 0;
+  }
+
+  memcpy(buffer + length, cached->data, cached->length);
+  length += cached->length;
+  if (payload_len) {
+    buffer[length++] = 0xFF;
+    memcpy(buffer + length, notification->payload, payload_len);
+  }
+  return length + payload_len;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Notifies the observers of a resource, or only those at endpoint. Without
+ * an endpoint, the notification conditions of each observer apply; a timer
+ * pass only serves the observers whose conditions are due.
+ */
+static int
+notify_observers(oc_resource_t *resource, oc_response_buffer_t *response_buf,
+                 oc_endpoint_t *endpoint, bool timer_pass)
 {
   if (!resource) {
     OC_WRN("coap_notify_observers: no resource passed; returning");
@@ -270,6 +626,13 @@ coap_notify_observers(oc_resource_t *resource,
   }
   num_observers = resource->num_observers;
 
+  oc_clock_time_t now = oc_clock_time();
+  if (!endpoint && !observers_due(resource, now, timer_pass)) {
+    OC_DBG("coap_notify_observers: no observer due; deferring");
+    schedule_conditions(resource, now);
+    return num_observers;
+  }
+
 #ifdef OC_BLOCK_WISE
   oc_blockwise_state_t *response_state = NULL;
 #endif /* OC_BLOCK_WISE */
@@ -320,14 +683,43 @@ coap_notify_observers(oc_resource_t *resource,
     }
   }
 
-  coap_observer_t *obs = NULL;
-  /* iterate over observers */
-  for (obs = (coap_observer_t *)oc_list_head(observers_list); obs;
-       obs = obs->next) {
-    if ((obs->resource != resource) ||
-        (endpoint && oc_endpoint_compare(&obs->endpoint, endpoint) != 0)) {
+  double value = 0;
+  bool has_value = false;
+  if (!endpoint && response_buf &&
+      oc_string_len(resource->observe_step_property) > 0 &&
+      response_buf->code < BAD_REQUEST_4_00) {
+    has_value = oc_rep_find_number(
+      response_buf->buffer, response_buf->response_length,
+      oc_string(resource->observe_step_property), &value);
+  }
+
+  notification_options_t options[2];
+  options[0].length = options[1].length = 0;
+
+  coap_observer_t *obs = NULL, *next = NULL;
+  /* iterate over the observers of this resource */
+  for (obs = resource->observers; obs; obs = next) {
+    next = obs->resource_next;
+    if (endpoint && oc_endpoint_compare(&obs->endpoint, endpoint) != 0) {
       continue;
     }
+    if (!endpoint) {
+      notification_gate_t gate = notification_gate(obs, now, timer_pass);
+      if (gate == NOTIFY_IF_CHANGED && has_value &&
+          !value_condition_met(obs, value)) {
+        obs->pending = 0;
+        continue;
+      }
+      if (gate == NOTIFY_SKIP) {
+        continue;
+      }
+      obs->last_notify = now;
+      obs->pending = 0;
+      if (has_value) {
+        obs->last_value = value;
+        obs->has_last_value = 1;
+      }
+    }
 
     if (response.separate_response != NULL &&
         response_buf->code == oc_status_code(OC_STATUS_OK)) {
@@ -440,26 +832,50 @@ coap_notify_observers(oc_resource_t *resource,
                                          APPLICATION_VND_OCF_CBOR);
         }
         coap_set_token(notification, obs->token, obs->token_len);
-        transaction = coap_new_transaction(coap_get_mid(), &obs->endpoint);
+        coap_transaction_t *replaced;
+        transaction = notification_transaction(obs, notification, &replaced);
         if (transaction) {
-          obs->last_mid = transaction->mid;
-          notification->mid = transaction->mid;
-          transaction->message->length =
-            coap_serialize_message(notification, transaction->message->data);
+          transaction->message->length = serialize_notification(
+            notification, options, transaction->message->data);
 
-          coap_send_transaction(transaction);
+          if (replaced) {
+            coap_replace_transaction(replaced, transaction);
+          } else {
+            coap_send_transaction(transaction);
+          }
         }
       }
     }
   }
 
 leave_notify_observers:
+  if (!endpoint) {
+    schedule_conditions(resource, now);
+  }
 #ifdef OC_DYNAMIC_ALLOCATION
   if (buffer)
     oc_mem_free(buffer);
 #endif /* OC_DYNAMIC_ALLOCATION */
   return num_observers;
 }
+
+static oc_event_callback_retval_t
+observe_conditions_due(void *data)
+{
+  oc_resource_t *resource = (oc_resource_t *)data;
+  if (resource->num_observers) {
+    notify_observers(resource, NULL, NULL, true);
+  }
+  return OC_EVENT_DONE;
+}
+
+int
+coap_notify_observers(oc_resource_t *resource,
+                      oc_response_buffer_t *response_buf,
+                      oc_endpoint_t *endpoint)
+{
+  return notify_observers(resource, response_buf, endpoint, false);
+}
 /*---------------------------------------------------------------------------*/
 #ifdef OC_BLOCK_WISE
 int
@@ -477,14 +893,17 @@ coap_observe_handler(void *request, void *response, oc_resource_t *resource,
   if (coap_req->code == COAP_GET && coap_res->code < 128) {
     if (IS_OPTION(coap_req, COAP_OPTION_OBSERVE)) {
       if (coap_req->observe == 0) {
+        const char *query = NULL;
+        int query_len = coap_get_header_uri_query(coap_req, &query);
         dup =
 #ifdef OC_BLOCK_WISE
           add_observer(resource, block2_size, endpoint, coap_req->token,
                        coap_req->token_len, coap_req->uri_path,
-                       coap_req->uri_path_len);
+                       coap_req->uri_path_len, query, query_len);
 #else  /* OC_BLOCK_WISE */
           add_observer(resource, endpoint, coap_req->token, coap_req->token_len,
-                       coap_req->uri_path, coap_req->uri_path_len);
+                       coap_req->uri_path, coap_req->uri_path_len, query,
+                       query_len);
 #endif /* !OC_BLOCK_WISE */
       } else if (coap_req->observe == 1) {
         dup = coap_remove_observer_by_token(endpoint, coap_req->token,
@@ -51,6 +51,7 @@
 #include "coap.h"
 #include "oc_ri.h"
 #include "transactions.h"
+#include "util/oc_hash.h"
 #include "util/oc_list.h"
 
 #define COAP_OBSERVER_URL_LEN 20
@@ -59,6 +60,12 @@ typedef struct coap_observer
 {
   struct coap_observer *next; /* for LIST */
 
+  /* Observers of the same resource, headed by resource->observers */
+  struct coap_observer *resource_next;
+  struct coap_observer **resource_prev;
+  /* Observers of the same endpoint */
+  oc_hash_link_t endpoint_link;
+
   oc_resource_t *resource;
 
   char url[COAP_OBSERVER_URL_LEN];
@@ -66,6 +73,8 @@ typedef struct coap_observer
   uint8_t token_len;
   uint8_t token[COAP_TOKEN_LEN];
   uint16_t last_mid;
+  /* Confirmable notification awaiting its ACK, if any */
+  coap_transaction_t *notification;
 
 #ifdef OC_BLOCK_WISE
   uint16_t block2_size;
@@ -73,6 +82,21 @@ typedef struct coap_observer
 
   int32_t obs_counter;
 
+  /* Notification conditions from the pmin, pmax, st, gt and lt query
+   * parameters of the registration. A change inside pmin stays pending and
+   * the then current state is sent once the period has passed.
+   */
+  uint16_t pmin;
+  uint16_t pmax;
+  uint8_t conditions;
+  uint8_t pending;
+  uint8_t has_last_value;
+  double step;
+  double gt;
+  double lt;
+  double last_value;
+  oc_clock_time_t last_notify;
+
   struct oc_etimer retrans_timer;
   uint8_t retrans_counter;
 } coap_observer_t;
@@ -83,6 +107,7 @@ int coap_remove_observer_by_client(oc_endpoint_t *endpoint);
 int coap_remove_observer_by_token(oc_endpoint_t *endpoint, uint8_t *token,
                                   size_t token_len);
 int coap_remove_observer_by_mid(oc_endpoint_t *endpoint, uint16_t mid);
+int coap_remove_observers_by_resource(oc_resource_t *resource);
 void coap_free_all_observers(void);
 
 int coap_notify_observers(oc_resource_t *resource,
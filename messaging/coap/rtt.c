@@ -0,0 +1,236 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "rtt.h"
+#include "oc_network_monitor.h"
+#include "transactions.h"
+#include "util/oc_hash.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
+#include <string.h>
+
+#define RTT_STRONG (0)
+#define RTT_WEAK (1)
+
+#define RTO_MAX ((oc_clock_time_t)60 * OC_CLOCK_SECOND)
+#define BACKOFF_MAX ((oc_clock_time_t)32 * OC_CLOCK_SECOND)
+/* An estimator not updated for this long has aged back to the default RTO
+ * and may be reclaimed for another endpoint */
+#define ESTIMATOR_IDLE_MAX (10 * RTO_MAX)
+
+#define TICKS_TO_MS(ticks) ((uint32_t)((ticks)*1000 / OC_CLOCK_SECOND))
+
+typedef struct coap_rtt_estimator
+{
+  struct coap_rtt_estimator *next; /* for LIST */
+  oc_hash_link_t endpoint_link;
+  oc_endpoint_t endpoint;
+  oc_clock_time_t srtt[2];
+  oc_clock_time_t rttvar[2];
+  oc_clock_time_t rto;
+  oc_clock_time_t updated;
+  uint32_t samples[2];
+  uint32_t retransmissions;
+} coap_rtt_estimator_t;
+
+OC_MEMB_FIXED(estimators_s, coap_rtt_estimator_t, COAP_MAX_RTT_ESTIMATORS);
+OC_LIST(estimators_list);
+OC_HASH(estimators_by_endpoint, 16);
+
+static coap_rtt_estimator_t *
+find_estimator(const oc_endpoint_t *endpoint)
+{
+  oc_hash_link_t *link =
+    oc_hash_lookup(&estimators_by_endpoint, oc_endpoint_hash(endpoint));
+  while (link) {
+    coap_rtt_estimator_t *e =
+      oc_hash_entry(link, coap_rtt_estimator_t, endpoint_link);
+    if (oc_endpoint_compare(&e->endpoint, endpoint) == 0) {
+      return e;
+    }
+    link = oc_hash_next(link);
+  }
+  return NULL;
+}
+
+static void
+free_estimator(coap_rtt_estimator_t *e)
+{
+  oc_hash_remove(&estimators_by_endpoint, &e->endpoint_link);
+  oc_list_remove(estimators_list, e);
+  oc_memb_free(&estimators_s, e);
+}
+
+/* Frees the estimators of endpoints that have been quiet for a long time.
+ * Only runs when the pool is exhausted.
+ */
+static void
+free_idle_estimators(oc_clock_time_t now)
+{
+  coap_rtt_estimator_t *next,
+    *e = (coap_rtt_estimator_t *)oc_list_head(estimators_list);
+  while (e) {
+    next = e->next;
+    if (now - e->updated > ESTIMATOR_IDLE_MAX) {
+      free_estimator(e);
+    }
+    e = next;
+  }
+}
+
+static coap_rtt_estimator_t *
+get_estimator(const oc_endpoint_t *endpoint)
+{
+  coap_rtt_estimator_t *e = find_estimator(endpoint);
+  if (e) {
+    return e;
+  }
+  oc_clock_time_t now = oc_clock_time();
+  e = (coap_rtt_estimator_t *)oc_memb_alloc(&estimators_s);
+  if (!e) {
+    free_idle_estimators(now);
+    e = (coap_rtt_estimator_t *)oc_memb_alloc(&estimators_s);
+    if (!e) {
+      OC_DBG("no free RTT estimator; endpoint keeps the default RTO");
+      return NULL;
+    }
+  }
+  memcpy(&e->endpoint, endpoint, sizeof(oc_endpoint_t));
+  e->endpoint.next = NULL;
+  e->rto = COAP_RESPONSE_TIMEOUT_TICKS;
+  e->updated = now;
+  oc_list_add(estimators_list, e);
+  oc_hash_add(&estimators_by_endpoint, &e->endpoint_link,
+              oc_endpoint_hash(endpoint));
+  return e;
+}
+
+/* Ages an RTO that was not updated for a while towards the default */
+static void
+age_rto(coap_rtt_estimator_t *e, oc_clock_time_t now)
+{
+  oc_clock_time_t idle = now - e->updated;
+  if (e->rto < OC_CLOCK_SECOND && idle > 16 * e->rto) {
+    e->rto *= 2;
+    e->updated = now;
+  } else if (e->rto > 3 * OC_CLOCK_SECOND && idle > 4 * e->rto) {
+    e->rto = OC_CLOCK_SECOND + e->rto / 2;
+    e->updated = now;
+  }
+}
+
+oc_clock_time_t
+coap_rtt_timeout(const oc_endpoint_t *endpoint)
+{
+  coap_rtt_estimator_t *e = find_estimator(endpoint);
+  if (!e) {
+    return COAP_RESPONSE_TIMEOUT_TICKS;
+  }
+  age_rto(e, oc_clock_time());
+  return e->rto;
+}
+
+oc_clock_time_t
+coap_rtt_backoff(const oc_endpoint_t *endpoint, oc_clock_time_t rto,
+                 oc_clock_time_t interval)
+{
+  coap_rtt_estimator_t *e = find_estimator(endpoint);
+  if (e) {
+    e->retransmissions++;
+  }
+  /* Variable backoff factor: short RTOs back off faster, long ones slower */
+  if (rto < OC_CLOCK_SECOND) {
+    interval *= 3;
+  } else if (rto > 3 * OC_CLOCK_SECOND) {
+    interval += interval / 2;
+  } else {
+    interval *= 2;
+  }
+  return interval > BACKOFF_MAX ? BACKOFF_MAX : interval;
+}
+
+void
+coap_rtt_measure(const oc_endpoint_t *endpoint, oc_clock_time_t sent,
+                 uint8_t retransmissions)
+{
+  /* Which transmission an answer belongs to gets too ambiguous */
+  if (retransmissions > 2) {
+    return;
+  }
+  oc_clock_time_t now = oc_clock_time(), rtt = now - sent, rto;
+  int kind = retransmissions ? RTT_WEAK : RTT_STRONG;
+  coap_rtt_estimator_t *e = get_estimator(endpoint);
+  if (!e) {
+    return;
+  }
+
+  if (e->samples[kind] == 0) {
+    e->srtt[kind] = rtt;
+    e->rttvar[kind] = rtt / 2;
+  } else {
+    oc_clock_time_t delta =
+      e->srtt[kind] > rtt ? e->srtt[kind] - rtt : rtt - e->srtt[kind];
+    e->rttvar[kind] = (3 * e->rttvar[kind] + delta) / 4;
+    e->srtt[kind] = (7 * e->srtt[kind] + rtt) / 8;
+  }
+  e->samples[kind]++;
+
+  if (kind == RTT_STRONG) {
+    rto = e->srtt[kind] + 4 * e->rttvar[kind];
+    e->rto = (e->rto + rto) / 2;
+  } else {
+    rto = e->srtt[kind] + e->rttvar[kind];
+    e->rto = (3 * e->rto + rto) / 4;
+  }
+  if (e->rto == 0) {
+    e->rto = 1;
+  } else if (e->rto > RTO_MAX) {
+    e->rto = RTO_MAX;
+  }
+  e->updated = now;
+  OC_DBG("RTT %u ms (%s), RTO now %u ms", TICKS_TO_MS(rtt),
+         kind == RTT_STRONG ? "strong" : "weak", TICKS_TO_MS(e->rto));
+}
+
+void
+coap_free_all_rtt_estimators(void)
+{
+  coap_rtt_estimator_t *e;
+  while ((e = (coap_rtt_estimator_t *)oc_list_head(estimators_list)) != NULL) {
+    free_estimator(e);
+  }
+  oc_hash_init(&estimators_by_endpoint);
+}
+
+bool
+oc_get_rtt_stats(oc_endpoint_t *endpoint, oc_rtt_stats_t *stats)
+{
+  coap_rtt_estimator_t *e = find_estimator(endpoint);
+  if (!e || !stats) {
+    return false;
+  }
+  stats->rto_ms = TICKS_TO_MS(e->rto);
+  stats->srtt_strong_ms = TICKS_TO_MS(e->srtt[RTT_STRONG]);
+  stats->rttvar_strong_ms = TICKS_TO_MS(e->rttvar[RTT_STRONG]);
+  stats->srtt_weak_ms = TICKS_TO_MS(e->srtt[RTT_WEAK]);
+  stats->rttvar_weak_ms = TICKS_TO_MS(e->rttvar[RTT_WEAK]);
+  stats->strong_samples = e->samples[RTT_STRONG];
+  stats->weak_samples = e->samples[RTT_WEAK];
+  stats->retransmissions = e->retransmissions;
+  return true;
+}
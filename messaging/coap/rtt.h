@@ -0,0 +1,46 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+/**
+ * Round-trip time estimation per remote endpoint, after CoCoA
+ * (draft-ietf-core-cocoa).
+ *
+ * Exchanges without retransmissions feed a strong estimator and those with
+ * one or two retransmissions, measured from the first transmission, feed a
+ * weak one. Each keeps a smoothed RTT and variance as in RFC 6298 and pulls
+ * the overall RTO of the endpoint towards its own estimate. Retransmissions
+ * back off by a factor that depends on the initial RTO, and RTOs that are
+ * not refreshed age back towards the default COAP_RESPONSE_TIMEOUT.
+ */
+
+#ifndef RTT_H
+#define RTT_H
+
+#include "conf.h"
+#include "oc_endpoint.h"
+#include "port/oc_clock.h"
+
+oc_clock_time_t coap_rtt_timeout(const oc_endpoint_t *endpoint);
+oc_clock_time_t coap_rtt_backoff(const oc_endpoint_t *endpoint,
+                                 oc_clock_time_t rto,
+                                 oc_clock_time_t interval);
+void coap_rtt_measure(const oc_endpoint_t *endpoint, oc_clock_time_t sent,
+                      uint8_t retransmissions);
+void coap_free_all_rtt_estimators(void);
+
+#endif /* RTT_H */
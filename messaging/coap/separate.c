@@ -86,8 +86,6 @@ coap_separate_accept(void *request, oc_separate_response_t *separate_response,
                      oc_endpoint_t *endpoint, int observe)
 #endif /* !OC_BLOCK_WISE */
 {
-  coap_status_code = CLEAR_TRANSACTION;
-
   if (separate_response->active == 0) {
     OC_LIST_STRUCT_INIT(separate_response, requests);
 #ifdef OC_DYNAMIC_ALLOCATION
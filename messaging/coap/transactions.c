@@ -48,6 +48,7 @@
 #include "transactions.h"
 #include "observe.h"
 #include "oc_buffer.h"
+#include "rtt.h"
 #include "util/oc_list.h"
 #include "util/oc_memb.h"
 #include <string.h>
@@ -67,6 +68,8 @@
 /*---------------------------------------------------------------------------*/
 OC_MEMB(transactions_memb, coap_transaction_t, COAP_MAX_OPEN_TRANSACTIONS);
 OC_LIST(transactions_list);
+/* Index of transactions_list by MID for matching ACKs and responses */
+OC_HASH(transactions_by_mid, 16);
 
 static struct oc_process *transaction_handler_process = NULL;
 
@@ -89,6 +92,9 @@ coap_new_transaction(uint16_t mid, oc_endpoint_t *endpoint)
       OC_DBG("Created new transaction %u: %p", mid, (void *)t);
       t->mid = mid;
       t->retrans_counter = 0;
+#ifdef OC_SERVER
+      t->observer = NULL;
+#endif /* OC_SERVER */
 
       /* save client address */
       memcpy(&t->message->endpoint, endpoint, sizeof(oc_endpoint_t));
@@ -96,6 +102,7 @@ coap_new_transaction(uint16_t mid, oc_endpoint_t *endpoint)
       oc_list_add(
         transactions_list,
         t); /* list itself makes sure same element is not added twice */
+      oc_hash_add(&transactions_by_mid, &t->mid_link, mid);
     } else {
       oc_memb_free(&transactions_memb, t);
       t = NULL;
@@ -117,6 +124,8 @@ coap_send_transaction(coap_transaction_t *t)
   OC_LOGbytes(t->message->data, t->message->length);
   bool confirmable = false;
 
+  t->queued = false;
+
   confirmable =
     (COAP_TYPE_CON == ((COAP_HEADER_TYPE_MASK & t->message->data[0]) >>
                        COAP_HEADER_TYPE_POSITION))
@@ -133,14 +142,16 @@ coap_send_transaction(coap_transaction_t *t)
       OC_DBG("Keeping transaction %u: %p", t->mid, (void *)t);
 
       if (t->retrans_counter == 0) {
+        t->rto = coap_rtt_timeout(&t->message->endpoint);
+        t->sent_time = oc_clock_time();
         t->retrans_timer.timer.interval =
-          COAP_RESPONSE_TIMEOUT_TICKS +
-          (oc_random_value() %
-           (oc_clock_time_t)COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
+          t->rto +
+          (oc_random_value() % COAP_RESPONSE_TIMEOUT_BACKOFF_MASK(t->rto));
         OC_DBG("Initial interval %d", (int)t->retrans_timer.timer.interval);
       } else {
-        t->retrans_timer.timer.interval <<= 1; /* double */
-        OC_DBG("Doubled %d", (int)t->retrans_timer.timer.interval);
+        t->retrans_timer.timer.interval = coap_rtt_backoff(
+          &t->message->endpoint, t->rto, t->retrans_timer.timer.interval);
+        OC_DBG("Backed off %d", (int)t->retrans_timer.timer.interval);
       }
 
       OC_PROCESS_CONTEXT_BEGIN(transaction_handler_process);
@@ -188,28 +199,62 @@ coap_send_transaction(coap_transaction_t *t)
 }
 /*---------------------------------------------------------------------------*/
 void
+coap_replace_transaction(coap_transaction_t *old, coap_transaction_t *t)
+{
+  OC_DBG("Replacing transaction %u with %u: %p", old->mid, t->mid, (void *)t);
+  t->queued = false;
+  t->retrans_counter = old->retrans_counter;
+  t->rto = old->rto;
+  t->sent_time = old->sent_time;
+
+  /* The next retransmission is due when that of old would have been */
+  OC_PROCESS_CONTEXT_BEGIN(transaction_handler_process);
+  oc_etimer_set(&t->retrans_timer, old->retrans_timer.timer.interval);
+  oc_etimer_adjust(&t->retrans_timer,
+                   (int)(oc_etimer_start_time(&old->retrans_timer) -
+                         oc_etimer_start_time(&t->retrans_timer)));
+  OC_PROCESS_CONTEXT_END(transaction_handler_process);
+
+  coap_clear_transaction(old);
+
+  oc_message_add_ref(t->message);
+  coap_send_message(t->message);
+}
+/*---------------------------------------------------------------------------*/
+void
+coap_queue_transaction(coap_transaction_t *t)
+{
+  OC_DBG("Queueing transaction %u: %p", t->mid, (void *)t);
+  t->queued = true;
+}
+/*---------------------------------------------------------------------------*/
+void
 coap_clear_transaction(coap_transaction_t *t)
 {
   if (t) {
     OC_DBG("Freeing transaction %u: %p", t->mid, (void *)t);
 
     oc_etimer_stop(&t->retrans_timer);
+#ifdef OC_SERVER
+    if (t->observer) {
+      t->observer->notification = NULL;
+    }
+#endif /* OC_SERVER */
     oc_message_unref(t->message);
     oc_list_remove(transactions_list, t);
+    oc_hash_remove(&transactions_by_mid, &t->mid_link);
     oc_memb_free(&transactions_memb, t);
   }
 }
 coap_transaction_t *
 coap_get_transaction_by_mid(uint16_t mid)
 {
-  coap_transaction_t *t = NULL;
-
-  for (t = (coap_transaction_t *)oc_list_head(transactions_list); t;
-       t = t->next) {
-    if (t->mid == mid) {
-      OC_DBG("Found transaction for MID %u: %p", t->mid, (void *)t);
-      return t;
-    }
+  oc_hash_link_t *link = oc_hash_lookup(&transactions_by_mid, mid);
+  if (link) {
+    coap_transaction_t *t =
+      oc_hash_entry(link, coap_transaction_t, mid_link);
+    OC_DBG("Found transaction for MID %u: %p", t->mid, (void *)t);
+    return t;
   }
   return NULL;
 }
@@ -222,7 +267,8 @@ coap_check_transactions(void)
                      *next;
   while (t != NULL) {
     next = t->next;
-    if (oc_etimer_expired(&t->retrans_timer)) {
+    /* Queued transactions have not been sent and have no timer running */
+    if (!t->queued && oc_etimer_expired(&t->retrans_timer)) {
       ++(t->retrans_counter);
       OC_DBG("Retransmitting %u (%u)", t->mid, t->retrans_counter);
       coap_send_transaction(t);
@@ -241,4 +287,5 @@ coap_free_all_transactions(void)
     coap_clear_transaction(t);
     t = next;
   }
+  oc_hash_init(&transactions_by_mid);
 }
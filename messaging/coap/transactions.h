@@ -50,19 +50,19 @@
 
 #include "coap.h"
 #include "util/oc_etimer.h"
+#include "util/oc_hash.h"
 
 /*
  * Modulo mask (thus +1) for a random number to get the tick number for the
  * random
- * retransmission time between COAP_RESPONSE_TIMEOUT and
- * COAP_RESPONSE_TIMEOUT*COAP_RESPONSE_RANDOM_FACTOR.
+ * retransmission time between rto and rto*COAP_RESPONSE_RANDOM_FACTOR, where
+ * rto defaults to COAP_RESPONSE_TIMEOUT.
  */
 #define COAP_RESPONSE_TIMEOUT_TICKS (OC_CLOCK_SECOND * COAP_RESPONSE_TIMEOUT)
-#define COAP_RESPONSE_TIMEOUT_BACKOFF_MASK                                     \
-  (long)((OC_CLOCK_SECOND * COAP_RESPONSE_TIMEOUT *                            \
-          ((float)COAP_RESPONSE_RANDOM_FACTOR - 1.0)) +                        \
-         0.5) +                                                                \
-    1
+#define COAP_RESPONSE_TIMEOUT_BACKOFF_MASK(rto)                                \
+  ((oc_clock_time_t)((rto) * ((float)COAP_RESPONSE_RANDOM_FACTOR - 1.0) +      \
+                     0.5) +                                                    \
+   1)
 
 /* container for transactions with message buffer and retransmission info */
 typedef struct coap_transaction
@@ -70,9 +70,16 @@ typedef struct coap_transaction
   struct coap_transaction *next; /* for LIST */
 
   uint16_t mid;
+  oc_hash_link_t mid_link;
   struct oc_etimer retrans_timer;
   uint8_t retrans_counter;
+  oc_clock_time_t sent_time; /* of the first transmission */
+  oc_clock_time_t rto;       /* initial RTO of the peer */
+  bool queued;               /* serialized, waiting for a free NSTART slot */
   oc_message_t *message;
+#ifdef OC_SERVER
+  struct coap_observer *observer; /* whose CON notification this carries */
+#endif /* OC_SERVER */
 
 } coap_transaction_t;
 
@@ -81,6 +88,12 @@ void coap_register_as_transaction_handler(void);
 coap_transaction_t *coap_new_transaction(uint16_t mid, oc_endpoint_t *endpoint);
 
 void coap_send_transaction(coap_transaction_t *t);
+/* Sends t in place of the unacknowledged transaction old, which is freed.
+ * Following RFC 7641 4.5.2, t keeps its own MID but takes over the
+ * retransmission counter and timeout of old.
+ */
+void coap_replace_transaction(coap_transaction_t *old, coap_transaction_t *t);
+void coap_queue_transaction(coap_transaction_t *t);
 void coap_clear_transaction(coap_transaction_t *t);
 coap_transaction_t *coap_get_transaction_by_mid(uint16_t mid);
 
@@ -1,9 +1,20 @@
 #include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 extern "C" {
 #include "coap.h"
+#include "coap_signal.h"
+#include "engine.h"
 #include "oc_api.h"
+#include "oc_blockwise.h"
+#include "oc_buffer.h"
+#include "oc_client_state.h"
 #include "oc_endpoint.h"
 }
 
@@ -45,4 +56,388 @@ TEST_F(TestCoap, CoapSerializeMessageTest_P)
     size_t size = coap_serialize_message(ack, message->data);
 
     EXPECT_TRUE(size) << "Failed to get mid transaction";
+    oc_message_unref(message);
 }
+
+#ifdef OC_TCP
+TEST_F(TestCoap, CoapTcpBertBlockTest_P)
+{
+    uint8_t payload[2 * COAP_BERT_BLOCK_SIZE], buf[sizeof(payload) + 64];
+    memset(payload, 0x5a, sizeof(payload));
+
+    coap_packet_t request[1], parsed[1];
+    coap_tcp_init_message(request, CONTENT_2_05);
+    EXPECT_EQ(1, coap_set_header_block2_bert(request, 3, 1));
+    coap_set_payload(request, payload, sizeof(payload));
+    size_t len = coap_serialize_message(request, buf);
+    ASSERT_GT(len, sizeof(payload));
+
+    ASSERT_EQ(COAP_NO_ERROR, coap_tcp_parse_message(parsed, buf, len));
+    uint32_t num = 0, offset = 0;
+    uint8_t more = 0;
+    uint16_t size = 0;
+    ASSERT_EQ(1, coap_get_header_block2(parsed, &num, &more, &size, &offset));
+    EXPECT_EQ(1, parsed->block2_bert);
+    EXPECT_EQ(3u, num);
+    EXPECT_EQ(1, more);
+    EXPECT_EQ(COAP_BERT_BLOCK_SIZE, size);
+    EXPECT_EQ(3u * COAP_BERT_BLOCK_SIZE, offset);
+    EXPECT_EQ(sizeof(payload), parsed->payload_len);
+}
+
+TEST_F(TestCoap, CoapTcpCsmTest_P)
+{
+    uint8_t buf[32];
+    coap_packet_t csm[1], parsed[1];
+    coap_tcp_init_message(csm, CSM_7_01);
+    coap_set_header_max_msg_size(csm, 4096);
+    coap_set_header_blockwise_transfer(csm);
+    size_t len = coap_serialize_message(csm, buf);
+    ASSERT_GT(len, 0u);
+
+    ASSERT_EQ(COAP_NO_ERROR, coap_tcp_parse_message(parsed, buf, len));
+    EXPECT_EQ(1, coap_check_signal_message(parsed));
+    uint32_t max_msg_size = 0;
+    ASSERT_EQ(1, coap_get_header_max_msg_size(parsed, &max_msg_size));
+    EXPECT_EQ(4096u, max_msg_size);
+    EXPECT_EQ(1, coap_get_header_blockwise_transfer(parsed));
+}
+
+TEST_F(TestCoap, CoapTcpSignalOptionsTest_P)
+{
+    uint8_t buf[32];
+    uint8_t token[] = { 0x01, 0x02, 0x03, 0x04 };
+    coap_packet_t signal[1], parsed[1];
+
+    coap_tcp_init_message(signal, PING_7_02);
+    coap_set_token(signal, token, sizeof(token));
+    coap_set_header_custody(signal);
+    size_t len = coap_serialize_message(signal, buf);
+    ASSERT_EQ(COAP_NO_ERROR, coap_tcp_parse_message(parsed, buf, len));
+    EXPECT_EQ(PING_7_02, parsed->code);
+    ASSERT_EQ(sizeof(token), parsed->token_len);
+    EXPECT_EQ(0, memcmp(token, parsed->token, sizeof(token)));
+    EXPECT_EQ(1, coap_get_header_custody(parsed));
+
+    coap_tcp_init_message(signal, RELEASE_7_04);
+    coap_set_header_hold_off(signal, 30);
+    len = coap_serialize_message(signal, buf);
+    ASSERT_EQ(COAP_NO_ERROR, coap_tcp_parse_message(parsed, buf, len));
+    uint32_t hold_off = 0;
+    ASSERT_EQ(1, coap_get_header_hold_off(parsed, &hold_off));
+    EXPECT_EQ(30u, hold_off);
+
+    coap_tcp_init_message(signal, ABORT_7_05);
+    coap_set_header_bad_csm_option(signal, 3);
+    len = coap_serialize_message(signal, buf);
+    ASSERT_EQ(COAP_NO_ERROR, coap_tcp_parse_message(parsed, buf, len));
+    uint16_t bad_option = 0;
+    ASSERT_EQ(1, coap_get_header_bad_csm_option(parsed, &bad_option));
+    EXPECT_EQ(3, bad_option);
+}
+
+TEST_F(TestCoap, CoapTcpCsmCriticalOptionTest_N)
+{
+    /* CSM carrying the unknown critical option 3 */
+    uint8_t buf[] = { 0x10, 0xe1, 0x30 };
+    coap_packet_t parsed[1];
+    EXPECT_EQ(BAD_OPTION_4_02,
+              coap_tcp_parse_message(parsed, buf, sizeof(buf)));
+    EXPECT_EQ(3, parsed->bad_csm_option);
+}
+
+#ifdef OC_BLOCK_WISE
+#ifdef OC_DYNAMIC_ALLOCATION
+#define BERT_APP_DATA_SIZE (12 * 1024)
+#define BERT_PAYLOAD_SIZE (4 * COAP_BERT_BLOCK_SIZE)
+#else /* OC_DYNAMIC_ALLOCATION */
+#define BERT_APP_DATA_SIZE (OC_MAX_APP_DATA_SIZE)
+#define BERT_PAYLOAD_SIZE (COAP_BERT_BLOCK_SIZE)
+#endif /* !OC_DYNAMIC_ALLOCATION */
+
+static int
+app_init(void)
+{
+    int ret = oc_init_platform("Samsung", NULL, NULL);
+    ret |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                         "ocf.res.1.0.0", NULL, NULL);
+    return ret;
+}
+
+static void
+signal_event_loop(void)
+{
+}
+
+static void
+on_response(oc_client_response_t *data)
+{
+    (void)data;
+}
+
+/* The peer is a loopback TCP listener the test reads frames from */
+class TestCoapBert: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            static const oc_handler_t handler = {
+                .init = app_init,
+                .signal_event_loop = signal_event_loop
+            };
+#ifdef OC_DYNAMIC_ALLOCATION
+            app_data_size = oc_get_max_app_data_size();
+            oc_set_max_app_data_size(BERT_APP_DATA_SIZE);
+#endif /* OC_DYNAMIC_ALLOCATION */
+            ASSERT_EQ(0, oc_main_init(&handler));
+
+            conn = -1;
+            received = 0;
+            listener = socket(AF_INET6, SOCK_STREAM, 0);
+            ASSERT_LE(0, listener);
+            struct sockaddr_in6 addr;
+            socklen_t len = sizeof(addr);
+            memset(&addr, 0, sizeof(addr));
+            addr.sin6_family = AF_INET6;
+            addr.sin6_addr = in6addr_loopback;
+            ASSERT_EQ(0, bind(listener, (struct sockaddr *)&addr,
+                              sizeof(addr)));
+            ASSERT_EQ(0, getsockname(listener, (struct sockaddr *)&addr,
+                                     &len));
+            ASSERT_EQ(0, listen(listener, 1));
+
+            memset(&peer, 0, sizeof(peer));
+            peer.flags = IPV6 | TCP;
+            memcpy(peer.addr.ipv6.address, &in6addr_loopback, 16);
+            peer.addr.ipv6.port = ntohs(addr.sin6_port);
+        }
+
+        virtual void TearDown()
+        {
+            if (conn >= 0) {
+                close(conn);
+            }
+            close(listener);
+            oc_main_shutdown();
+#ifdef OC_DYNAMIC_ALLOCATION
+            oc_set_max_app_data_size(app_data_size);
+#endif /* OC_DYNAMIC_ALLOCATION */
+        }
+
+        /* Hands the stack a CSM from the peer */
+        void receive_csm(uint32_t max_msg_size, bool blockwise)
+        {
+            coap_packet_t csm[1];
+            coap_tcp_init_message(csm, CSM_7_01);
+            if (max_msg_size > 0) {
+                coap_set_header_max_msg_size(csm, max_msg_size);
+            }
+            if (blockwise) {
+                coap_set_header_blockwise_transfer(csm);
+            }
+            ASSERT_EQ(COAP_NO_ERROR, coap_signal_handler(csm, &peer));
+        }
+
+        /* Runs the stack until the peer reads a frame with the given code
+         * into frame; returns its length, or 0 after about a second
+         */
+        size_t receive_frame(uint8_t code)
+        {
+            for (int i = 0; i < 200; i++) {
+                oc_main_poll();
+                struct pollfd pfd = { conn >= 0 ? conn : listener, POLLIN, 0 };
+                if (poll(&pfd, 1, 5) <= 0) {
+                    continue;
+                }
+                if (conn < 0) {
+                    conn = accept(listener, NULL, NULL);
+                    continue;
+                }
+                ssize_t len = recv(conn, data + received,
+                                   sizeof(data) - received, 0);
+                if (len <= 0) {
+                    return 0;
+                }
+                received += (size_t)len;
+                size_t frame_len;
+                while (received > 0 && header_length() <= received &&
+                       (frame_len = coap_tcp_get_packet_size(data)) <=
+                         received) {
+                    coap_packet_t packet[1];
+                    bool found = coap_tcp_parse_message(
+                                   packet, data, (uint32_t)frame_len) ==
+                                   COAP_NO_ERROR && packet->code == code;
+                    if (found) {
+                        memcpy(frame, data, frame_len);
+                    }
+                    received -= frame_len;
+                    memmove(data, data + frame_len, received);
+                    if (found) {
+                        return frame_len;
+                    }
+                }
+            }
+            return 0;
+        }
+
+        /* Bytes ahead of the token of the frame at the start of data */
+        size_t header_length(void)
+        {
+            static const size_t extended[] = { 1, 2, 4 };
+            uint8_t len = data[0] >> 4;
+            return 2 + (len < 13 ? 0 : extended[len - 13]);
+        }
+
+        int listener, conn;
+        oc_endpoint_t peer;
+        uint8_t data[2 * BERT_APP_DATA_SIZE], frame[2 * BERT_APP_DATA_SIZE];
+        size_t received;
+#ifdef OC_DYNAMIC_ALLOCATION
+        long app_data_size;
+#endif /* OC_DYNAMIC_ALLOCATION */
+};
+
+TEST_F(TestCoapBert, LargeResponseIsSentInBertBlocks_P)
+{
+    receive_csm(BERT_PAYLOAD_SIZE + COAP_MAX_HEADER_SIZE, true);
+    oc_blockwise_state_t *buffer = oc_blockwise_alloc_response_buffer(
+      "a", 1, &peer, OC_GET, OC_BLOCKWISE_SERVER);
+    ASSERT_TRUE(buffer != NULL);
+    for (uint32_t i = 0; i < BERT_APP_DATA_SIZE; i++) {
+        buffer->buffer[i] = (uint8_t)i;
+    }
+    buffer->payload_size = BERT_APP_DATA_SIZE;
+    oc_message_t *message = oc_internal_allocate_outgoing_message();
+    ASSERT_TRUE(message != NULL);
+
+    /* As the engine answers the request, and then each request for the
+     * next block
+     */
+    int blocks = 0;
+    bool block = false;
+    uint32_t offset = 0;
+    while (offset < buffer->payload_size) {
+        uint16_t block_size = (uint16_t)OC_BLOCK_SIZE;
+        uint8_t bert = 0;
+        uint32_t len = oc_blockwise_tcp_block_size(buffer, block, block,
+                                                   &block_size, &bert);
+        EXPECT_EQ(1, bert);
+        EXPECT_EQ((uint32_t)BERT_PAYLOAD_SIZE, len);
+        uint32_t payload_size = 0;
+        const void *payload =
+          oc_blockwise_dispatch_block(buffer, offset, len, &payload_size);
+        ASSERT_TRUE(payload != NULL);
+
+        coap_packet_t response[1], parsed[1];
+        coap_tcp_init_message(response, CONTENT_2_05);
+        coap_set_payload(response, payload, payload_size);
+        uint8_t more = buffer->next_block_offset < buffer->payload_size;
+        coap_set_header_block2_bert(response, offset / COAP_BERT_BLOCK_SIZE,
+                                    more);
+        message->length = coap_serialize_message(response, message->data);
+        EXPECT_GE(coap_signal_max_message_size(&peer), message->length);
+
+        ASSERT_EQ(COAP_NO_ERROR, coap_tcp_parse_message(
+                                   parsed, message->data,
+                                   (uint32_t)message->length));
+        uint32_t num = 0, block_offset = 0;
+        uint8_t parsed_more = 0;
+        uint16_t size = 0;
+        ASSERT_EQ(1, coap_get_header_block2(parsed, &num, &parsed_more, &size,
+                                            &block_offset));
+        EXPECT_EQ(offset, block_offset);
+        EXPECT_EQ(more, parsed_more);
+        EXPECT_EQ((uint32_t)BERT_PAYLOAD_SIZE, parsed->payload_len);
+
+        offset = buffer->next_block_offset;
+        block = true;
+        blocks++;
+    }
+    EXPECT_EQ(BERT_APP_DATA_SIZE / BERT_PAYLOAD_SIZE, blocks);
+    oc_message_unref(message);
+    oc_blockwise_free_response_buffer(buffer);
+}
+
+TEST_F(TestCoapBert, PeerWithoutCsmGetsOwnPduSize_P)
+{
+    EXPECT_EQ((uint32_t)OC_PDU_SIZE, coap_signal_max_message_size(&peer));
+    EXPECT_EQ(0u, coap_signal_bert_payload_size(&peer));
+
+    oc_blockwise_state_t *buffer = oc_blockwise_alloc_response_buffer(
+      "a", 1, &peer, OC_GET, OC_BLOCKWISE_SERVER);
+    ASSERT_TRUE(buffer != NULL);
+    buffer->payload_size = BERT_APP_DATA_SIZE;
+
+    /* Anything the application can produce fits in one message */
+    uint16_t block_size = (uint16_t)OC_BLOCK_SIZE;
+    uint8_t bert = 1;
+    EXPECT_EQ((uint32_t)BERT_APP_DATA_SIZE,
+              oc_blockwise_tcp_block_size(buffer, false, false, &block_size,
+                                          &bert));
+    EXPECT_EQ(0, bert);
+
+    /* A smaller peer without BERT gets blocks that fit its messages */
+    receive_csm(COAP_BERT_BLOCK_SIZE / 2 + COAP_MAX_HEADER_SIZE, false);
+    EXPECT_EQ((uint32_t)COAP_BERT_BLOCK_SIZE / 2,
+              oc_blockwise_tcp_block_size(buffer, false, false, &block_size,
+                                          &bert));
+    EXPECT_EQ(0, bert);
+    EXPECT_EQ(COAP_BERT_BLOCK_SIZE / 2, block_size);
+    oc_blockwise_free_response_buffer(buffer);
+}
+
+TEST_F(TestCoapBert, ClientBertBlock1ContinuesAtNextBlockOffset_P)
+{
+    receive_csm(BERT_PAYLOAD_SIZE + COAP_MAX_HEADER_SIZE, true);
+    oc_client_handler_t handler;
+    handler.response = on_response;
+    oc_client_cb_t *cb = oc_ri_alloc_client_cb("/a", &peer, OC_POST, NULL,
+                                               handler, HIGH_QOS, NULL);
+    ASSERT_TRUE(cb != NULL);
+    oc_blockwise_state_t *buffer = oc_blockwise_alloc_request_buffer(
+      "a", 1, &peer, OC_POST, OC_BLOCKWISE_CLIENT);
+    ASSERT_TRUE(buffer != NULL);
+    buffer->client_cb = cb;
+    for (uint32_t i = 0; i < BERT_APP_DATA_SIZE; i++) {
+        buffer->buffer[i] = (uint8_t)i;
+    }
+    buffer->payload_size = BERT_APP_DATA_SIZE;
+
+    /* The first BERT block went out, carrying several blocks */
+    uint32_t payload_size = 0;
+    ASSERT_TRUE(oc_blockwise_dispatch_block(buffer, 0, BERT_PAYLOAD_SIZE,
+                                            &payload_size) != NULL);
+
+    /* and the server asks for the rest */
+    coap_packet_t cont[1];
+    coap_tcp_init_message(cont, CONTINUE_2_31);
+    coap_set_token(cont, cb->token, cb->token_len);
+    coap_set_header_block1_bert(cont, 0, 1);
+    oc_message_t *message = oc_allocate_message();
+    ASSERT_TRUE(message != NULL);
+    memcpy(&message->endpoint, &peer, sizeof(peer));
+    message->length = coap_serialize_message(cont, message->data);
+    static coap_receive_ctx_t ctx;
+    coap_receive(&ctx, message);
+    oc_message_unref(message);
+
+    size_t len = receive_frame(COAP_POST);
+    ASSERT_LT(0u, len);
+    coap_packet_t parsed[1];
+    ASSERT_EQ(COAP_NO_ERROR, coap_tcp_parse_message(parsed, frame,
+                                                    (uint32_t)len));
+    uint32_t num = 0, offset = 0;
+    uint8_t more = 0;
+    uint16_t size = 0;
+    ASSERT_EQ(1, coap_get_header_block1(parsed, &num, &more, &size, &offset));
+    EXPECT_EQ(1, parsed->block1_bert);
+    EXPECT_EQ((uint32_t)BERT_PAYLOAD_SIZE, offset);
+    EXPECT_EQ(2 * BERT_PAYLOAD_SIZE < BERT_APP_DATA_SIZE, more);
+    ASSERT_EQ((uint32_t)BERT_PAYLOAD_SIZE, parsed->payload_len);
+    for (uint32_t i = 0; i < BERT_PAYLOAD_SIZE; i++) {
+        ASSERT_EQ((uint8_t)(offset + i), parsed->payload[i]);
+    }
+    EXPECT_EQ((uint32_t)(2 * BERT_PAYLOAD_SIZE), buffer->next_block_offset);
+}
+#endif /* OC_BLOCK_WISE */
+#endif /* OC_TCP */
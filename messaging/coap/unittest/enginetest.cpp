@@ -1,4 +1,12 @@
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 extern "C" {
@@ -34,5 +42,181 @@ TEST_F(TestEngine, CoapReceiveTest_P)
 {
     coap_init_engine();
     oc_message_t *message = oc_internal_allocate_outgoing_message();
-    coap_receive(message);
+    coap_receive_ctx_t ctx;
+    coap_receive(&ctx, message);
+    oc_message_unref(message);
+}
+
+static int get_requests;
+
+static void
+get_handler(oc_request_t *request, oc_interface_mask_t interface,
+            void *user_data)
+{
+    (void)interface;
+    (void)user_data;
+    get_requests++;
+    oc_send_response(request, OC_STATUS_OK);
+}
+
+static int
+app_init(void)
+{
+    int ret = oc_init_platform("Samsung", NULL, NULL);
+    ret |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                         "ocf.res.1.0.0", NULL, NULL);
+    return ret;
+}
+
+static void
+register_resources(void)
+{
+    oc_resource_t *res = oc_new_resource(NULL, "/dup", 1, 0);
+    oc_resource_bind_resource_type(res, "oic.r.test");
+    oc_resource_bind_resource_interface(res, OC_IF_RW);
+    oc_resource_set_default_interface(res, OC_IF_RW);
+    oc_resource_set_request_handler(res, OC_GET, get_handler, NULL);
+    oc_add_resource(res);
+}
+
+static void
+signal_event_loop(void)
+{
+}
+
+class TestEngineDuplicates: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            static const oc_handler_t handler = {
+                .init = app_init,
+                .signal_event_loop = signal_event_loop,
+                .register_resources = register_resources
+            };
+            get_requests = 0;
+            ASSERT_EQ(0, oc_main_init(&handler));
+
+            sock = socket(AF_INET6, SOCK_DGRAM, 0);
+            ASSERT_LE(0, sock);
+            struct timeval tv = { 0, 10000 };
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            memset(&server, 0, sizeof(server));
+            server.sin6_family = AF_INET6;
+            server.sin6_addr = in6addr_loopback;
+            oc_endpoint_t *ep = oc_connectivity_get_endpoints(0);
+            while (ep) {
+                if ((ep->flags & IPV6) &&
+                    !(ep->flags & (SECURED | MULTICAST | TCP))) {
+                    server.sin6_port = htons(ep->addr.ipv6.port);
+                    break;
+                }
+                ep = ep->next;
+            }
+            ASSERT_NE(0, server.sin6_port);
+        }
+
+        virtual void TearDown()
+        {
+            close(sock);
+            oc_main_shutdown();
+        }
+
+        void send_request(const std::vector<uint8_t> &request)
+        {
+            ASSERT_EQ((ssize_t)request.size(),
+                      sendto(sock, request.data(), request.size(), 0,
+                             (struct sockaddr *)&server, sizeof(server)));
+        }
+
+        /* Runs the stack until a response arrives or about a second
+         * passes; returns an empty vector on timeout
+         */
+        std::vector<uint8_t> receive_response(void)
+        {
+            uint8_t buf[1024];
+            for (int i = 0; i < 100; i++) {
+                oc_main_poll();
+                ssize_t len = recv(sock, buf, sizeof(buf), 0);
+                if (len >= 0) {
+                    return std::vector<uint8_t>(buf, buf + len);
+                }
+            }
+            return std::vector<uint8_t>();
+        }
+
+        int sock;
+        struct sockaddr_in6 server;
+};
+
+/* GET /dup with a two byte token */
+static std::vector<uint8_t>
+make_get(uint8_t type, uint16_t mid)
+{
+    return std::vector<uint8_t>{
+        (uint8_t)(0x42 | (type << 4)), 0x01, (uint8_t)(mid >> 8),
+        (uint8_t)mid, 0xAB, 0xCD, 0xB3, 'd', 'u', 'p'
+    };
+}
+
+TEST_F(TestEngineDuplicates, DuplicateConRequestGetsSameResponse_P)
+{
+    std::vector<uint8_t> request = make_get(COAP_TYPE_CON, 0x1234);
+    send_request(request);
+    std::vector<uint8_t> first = receive_response();
+    ASSERT_LE(4u, first.size());
+    EXPECT_EQ(COAP_TYPE_ACK, (first[0] >> 4) & 0x3);
+    EXPECT_EQ(0x12, first[2]);
+    EXPECT_EQ(0x34, first[3]);
+    EXPECT_EQ(1, get_requests);
+
+    send_request(request);
+    std::vector<uint8_t> second = receive_response();
+#ifdef OC_DYNAMIC_ALLOCATION
+    /* The stored response is replayed without invoking the handler */
+    EXPECT_EQ(first, second);
+#else  /* OC_DYNAMIC_ALLOCATION */
+    /* No response is stored, so the duplicate only gets an empty ACK */
+    EXPECT_EQ(std::vector<uint8_t>({ 0x60, 0x00, 0x12, 0x34 }), second);
+#endif /* !OC_DYNAMIC_ALLOCATION */
+    EXPECT_EQ(1, get_requests);
+}
+
+TEST_F(TestEngineDuplicates, DuplicateConRequestWithNoStoredResponseIsAcked_P)
+{
+    int requests = 1;
+    std::vector<uint8_t> request = make_get(COAP_TYPE_CON, 0x3000);
+    send_request(request);
+    ASSERT_FALSE(receive_response().empty());
+#ifdef OC_DYNAMIC_ALLOCATION
+    /* Recycle every stored response slot */
+    for (uint16_t mid = 0x3001; mid <= 0x3000 + OC_REQUEST_HISTORY_RESPONSES;
+         mid++, requests++) {
+        send_request(make_get(COAP_TYPE_CON, mid));
+        ASSERT_FALSE(receive_response().empty());
+    }
+#endif /* OC_DYNAMIC_ALLOCATION */
+    EXPECT_EQ(requests, get_requests);
+
+    send_request(request);
+    EXPECT_EQ(std::vector<uint8_t>({ 0x60, 0x00, 0x30, 0x00 }),
+              receive_response());
+    EXPECT_EQ(requests, get_requests);
+}
+
+TEST_F(TestEngineDuplicates, DuplicateNonRequestIsDropped_N)
+{
+    std::vector<uint8_t> request = make_get(COAP_TYPE_NON, 0x2000);
+    send_request(request);
+    ASSERT_FALSE(receive_response().empty());
+    EXPECT_EQ(1, get_requests);
+
+    send_request(request);
+    EXPECT_TRUE(receive_response().empty());
+    EXPECT_EQ(1, get_requests);
+
+    /* A new message ID from the same peer is a new request */
+    send_request(make_get(COAP_TYPE_NON, 0x2001));
+    EXPECT_FALSE(receive_response().empty());
+    EXPECT_EQ(2, get_requests);
 }
@@ -0,0 +1,127 @@
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "testcommon.h"
+
+extern "C" {
+#include "coap.h"
+#include "transactions.h"
+#include "oc_client_state.h"
+}
+
+/* Requests go to a plain UDP socket standing in for the server */
+class TestRequestWindow: public TestStack
+{
+    protected:
+        virtual void SetUp()
+        {
+            ASSERT_NO_FATAL_FAILURE(TestStack::SetUp());
+            ASSERT_NO_FATAL_FAILURE(bind_loopback(SOCK_DGRAM, &sock,
+                                                  &server));
+            struct timeval tv = { 0, 10000 };
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        }
+
+        virtual void TearDown()
+        {
+            close(sock);
+            TestStack::TearDown();
+        }
+
+        /* Runs the stack until a request arrives or about 100ms pass;
+         * returns its length, or 0 on timeout
+         */
+        ssize_t receive_request(void)
+        {
+            for (int i = 0; i < 10; i++) {
+                oc_main_poll();
+                ssize_t len = recv(sock, request, sizeof(request), 0);
+                if (len >= 4) {
+                    return len;
+                }
+            }
+            return 0;
+        }
+
+        /* Piggybacks an empty 2.05 on the ACK of the last request */
+        void acknowledge(void)
+        {
+            uint8_t tkl = request[0] & 0x0F;
+            uint8_t ack[4 + 8];
+            ack[0] = (uint8_t)(0x40 | (COAP_TYPE_ACK << 4) | tkl);
+            ack[1] = CONTENT_2_05;
+            ack[2] = request[2];
+            ack[3] = request[3];
+            memcpy(ack + 4, request + 4, tkl);
+            oc_message_t *message = oc_allocate_message();
+            ASSERT_TRUE(message != NULL);
+            memcpy(&message->endpoint, &server, sizeof(server));
+            memcpy(message->data, ack, 4 + tkl);
+            message->length = 4 + tkl;
+            oc_network_event(message);
+            for (int i = 0; i < 5; i++) {
+                oc_main_poll();
+            }
+        }
+
+        uint16_t request_mid(void)
+        {
+            return (uint16_t)((request[2] << 8) | request[3]);
+        }
+
+        int sock;
+        oc_endpoint_t server;
+        uint8_t request[1024];
+};
+
+TEST_F(TestRequestWindow, HoldsRequestsBeyondNSTART_P)
+{
+    ASSERT_TRUE(oc_do_get("/a", &server, NULL, on_response, HIGH_QOS, NULL));
+    ASSERT_TRUE(oc_do_get("/b", &server, NULL, on_response, HIGH_QOS, NULL));
+    ASSERT_TRUE(oc_do_get("/c", &server, NULL, on_response, HIGH_QOS, NULL));
+
+    ASSERT_LT(0, receive_request());
+    EXPECT_EQ(COAP_NSTART, oc_client_num_requests_in_flight(&server));
+    /* The others wait for the first to be answered */
+    EXPECT_EQ(0, receive_request());
+    EXPECT_EQ(COAP_NSTART, oc_client_num_requests_in_flight(&server));
+}
+
+TEST_F(TestRequestWindow, ReleasedSlotSendsNextRequest_P)
+{
+    ASSERT_TRUE(oc_do_get("/a", &server, NULL, on_response, HIGH_QOS, NULL));
+    ASSERT_TRUE(oc_do_get("/b", &server, NULL, on_response, HIGH_QOS, NULL));
+
+    ASSERT_LT(0, receive_request());
+    uint16_t first = request_mid();
+    EXPECT_EQ(0, receive_request());
+
+    acknowledge();
+    EXPECT_EQ(1, responses);
+
+    ASSERT_LT(0, receive_request());
+    EXPECT_NE(first, request_mid());
+    EXPECT_EQ(1, oc_client_num_requests_in_flight(&server));
+
+    acknowledge();
+    EXPECT_EQ(2, responses);
+    EXPECT_EQ(0, oc_client_num_requests_in_flight(&server));
+}
+
+TEST_F(TestRequestWindow, AbandonedQueuedRequestIsNeverSent_N)
+{
+    ASSERT_TRUE(oc_do_get("/a", &server, NULL, on_response, HIGH_QOS, NULL));
+    ASSERT_TRUE(oc_do_get("/b", &server, NULL, on_response, HIGH_QOS, NULL));
+    ASSERT_LT(0, receive_request());
+
+    oc_client_cb_t *queued = oc_ri_get_client_cb("/b", &server, OC_GET);
+    ASSERT_TRUE(queued != NULL);
+    uint16_t mid = queued->mid;
+    EXPECT_TRUE(oc_ri_remove_client_cb_by_mid(mid));
+    EXPECT_EQ(NULL, coap_get_transaction_by_mid(mid));
+
+    acknowledge();
+    EXPECT_EQ(1, responses);
+    EXPECT_EQ(0, receive_request());
+    EXPECT_EQ(0, oc_client_num_requests_in_flight(&server));
+}
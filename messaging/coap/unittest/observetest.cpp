@@ -1,5 +1,6 @@
 
 #include <cstdlib>
+#include <cstring>
 #include "gtest/gtest.h"
 
 extern "C" {
@@ -8,17 +9,38 @@ extern "C" {
 #include "oc_endpoint.h"
 }
 
+static int
+app_init(void)
+{
+    int ret = oc_init_platform("Samsung", NULL, NULL);
+    ret |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                         "ocf.res.1.0.0", NULL, NULL);
+    return ret;
+}
+
+static void
+signal_event_loop(void)
+{
+}
+
+/* Notifications are sent through a running stack, which owns their
+ * retransmission timers and releases their buffers
+ */
 class TestObserve: public testing::Test
 {
     protected:
         virtual void SetUp()
         {
-
+            static const oc_handler_t handler = {
+                .init = app_init,
+                .signal_event_loop = signal_event_loop
+            };
+            ASSERT_EQ(0, oc_main_init(&handler));
         }
 
         virtual void TearDown()
         {
-
+            oc_main_shutdown();
         }
 };
 
@@ -50,3 +72,395 @@ TEST_F(TestObserve, FreeAllObserverTest_P)
     coap_free_all_observers();
 }
 
+
+static int
+observe(oc_resource_t *resource, oc_endpoint_t *endpoint, uint8_t token,
+        const char *query = NULL)
+{
+    coap_packet_t request[1], response[1];
+    coap_udp_init_message(request, COAP_TYPE_CON, COAP_GET, coap_get_mid());
+    coap_udp_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, 0);
+    coap_set_token(request, &token, 1);
+    coap_set_header_uri_path(request, oc_string(resource->uri),
+                             oc_string_len(resource->uri));
+    coap_set_header_observe(request, 0);
+    if (query) {
+        coap_set_header_uri_query(request, query);
+    }
+#ifdef OC_BLOCK_WISE
+    return coap_observe_handler(request, response, resource, 1024, endpoint);
+#else  /* OC_BLOCK_WISE */
+    return coap_observe_handler(request, response, resource, endpoint);
+#endif /* !OC_BLOCK_WISE */
+}
+
+TEST_F(TestObserve, ObserversIndexedByResourceAndClient_P)
+{
+    oc_resource_t resources[2];
+    oc_endpoint_t clients[2];
+    memset(resources, 0, sizeof(resources));
+    memset(clients, 0, sizeof(clients));
+    oc_new_string(&resources[0].uri, "/a", 2);
+    oc_new_string(&resources[1].uri, "/b", 2);
+    for (int i = 0; i < 2; i++) {
+        clients[i].flags = IPV6;
+        clients[i].addr.ipv6.port = 5683 + i;
+        clients[i].addr.ipv6.address[15] = i + 1;
+    }
+
+    EXPECT_EQ(0, observe(&resources[0], &clients[0], 1));
+    EXPECT_EQ(0, observe(&resources[0], &clients[1], 2));
+    EXPECT_EQ(0, observe(&resources[1], &clients[0], 3));
+    EXPECT_EQ(2, resources[0].num_observers);
+    EXPECT_EQ(1, resources[1].num_observers);
+    ASSERT_NE(nullptr, resources[1].observers);
+    EXPECT_EQ(&resources[1], resources[1].observers->resource);
+
+    /* Registering again from the same client replaces the registration */
+    EXPECT_EQ(1, observe(&resources[0], &clients[1], 4));
+    EXPECT_EQ(2, resources[0].num_observers);
+
+    EXPECT_EQ(2, coap_remove_observer_by_client(&clients[0]));
+    EXPECT_EQ(1, resources[0].num_observers);
+    EXPECT_EQ(0, resources[1].num_observers);
+    EXPECT_EQ(nullptr, resources[1].observers);
+
+    EXPECT_EQ(1, coap_remove_observers_by_resource(&resources[0]));
+    EXPECT_EQ(0, resources[0].num_observers);
+    EXPECT_EQ(0, coap_remove_observer_by_client(&clients[1]));
+
+    oc_free_string(&resources[0].uri);
+    oc_free_string(&resources[1].uri);
+}
+
+TEST_F(TestObserve, ReplaceUnacknowledgedNotification_P)
+{
+    oc_resource_t resource;
+    oc_endpoint_t client;
+    memset(&resource, 0, sizeof(resource));
+    memset(&client, 0, sizeof(client));
+    oc_new_string(&resource.uri, "/a", 2);
+    client.flags = IPV6;
+    client.addr.ipv6.port = 5683;
+    client.addr.ipv6.address[15] = 1;
+    EXPECT_EQ(0, observe(&resource, &client, 1));
+    coap_observer_t *obs = resource.observers;
+    ASSERT_NE(nullptr, obs);
+
+    uint8_t payload[4] = { 1, 2, 3, 4 };
+    oc_response_buffer_t response_buffer;
+    response_buffer.buffer = payload;
+    response_buffer.buffer_size = sizeof(payload);
+    response_buffer.response_length = sizeof(payload);
+    response_buffer.code = CONTENT_2_05;
+
+    /* Force a confirmable notification */
+    obs->obs_counter = COAP_OBSERVE_REFRESH_INTERVAL;
+    EXPECT_EQ(1, coap_notify_observers(&resource, &response_buffer, NULL));
+    uint16_t mid = obs->last_mid;
+    coap_transaction_t *transaction = coap_get_transaction_by_mid(mid);
+    ASSERT_NE(nullptr, transaction);
+    EXPECT_EQ(transaction, obs->notification);
+    transaction->retrans_counter = 2;
+    oc_clock_time_t expiration =
+        oc_etimer_expiration_time(&transaction->retrans_timer);
+
+    /* The newer state goes out with a new MID and takes over the
+     * retransmission state of the unacknowledged notification
+     */
+    payload[3] = 5;
+    EXPECT_EQ(1, coap_notify_observers(&resource, &response_buffer, NULL));
+    EXPECT_NE(mid, obs->last_mid);
+    EXPECT_EQ(nullptr, coap_get_transaction_by_mid(mid));
+    transaction = coap_get_transaction_by_mid(obs->last_mid);
+    ASSERT_NE(nullptr, transaction);
+    EXPECT_EQ(transaction, obs->notification);
+    EXPECT_EQ(2, transaction->retrans_counter);
+    EXPECT_EQ(expiration,
+              oc_etimer_expiration_time(&transaction->retrans_timer));
+    EXPECT_EQ(5, transaction->message->data[transaction->message->length - 1]);
+    EXPECT_EQ(COAP_TYPE_CON, (transaction->message->data[0] &
+                              COAP_HEADER_TYPE_MASK) >>
+                               COAP_HEADER_TYPE_POSITION);
+
+    /* An acknowledged notification is no longer replaced */
+    coap_clear_transaction(transaction);
+    EXPECT_EQ(nullptr, obs->notification);
+
+    coap_free_all_transactions();
+    EXPECT_EQ(1, coap_remove_observers_by_resource(&resource));
+    oc_free_string(&resource.uri);
+}
+
+TEST_F(TestObserve, ReRegistrationReleasesPendingNotification_P)
+{
+    oc_resource_t resource;
+    oc_endpoint_t client;
+    memset(&resource, 0, sizeof(resource));
+    memset(&client, 0, sizeof(client));
+    oc_new_string(&resource.uri, "/a", 2);
+    client.flags = IPV6;
+    client.addr.ipv6.port = 5683;
+    client.addr.ipv6.address[15] = 1;
+    EXPECT_EQ(0, observe(&resource, &client, 1));
+    coap_observer_t *obs = resource.observers;
+    ASSERT_NE(nullptr, obs);
+
+    uint8_t payload[4] = { 1, 2, 3, 4 };
+    oc_response_buffer_t response_buffer;
+    response_buffer.buffer = payload;
+    response_buffer.buffer_size = sizeof(payload);
+    response_buffer.response_length = sizeof(payload);
+    response_buffer.code = CONTENT_2_05;
+
+    /* Force a confirmable notification */
+    obs->obs_counter = COAP_OBSERVE_REFRESH_INTERVAL;
+    EXPECT_EQ(1, coap_notify_observers(&resource, &response_buffer, NULL));
+    coap_transaction_t *transaction =
+      coap_get_transaction_by_mid(obs->last_mid);
+    ASSERT_NE(nullptr, transaction);
+    EXPECT_EQ(obs, transaction->observer);
+
+    /* The new registration frees the old observer, which the pending
+     * notification must no longer point at
+     */
+    EXPECT_EQ(1, observe(&resource, &client, 2));
+    EXPECT_EQ(1, resource.num_observers);
+    EXPECT_EQ(nullptr, transaction->observer);
+    coap_clear_transaction(transaction);
+    ASSERT_NE(nullptr, resource.observers);
+    EXPECT_EQ(nullptr, resource.observers->notification);
+
+    coap_free_all_transactions();
+    EXPECT_EQ(1, coap_remove_observers_by_resource(&resource));
+    oc_free_string(&resource.uri);
+}
+
+TEST_F(TestObserve, FanOutMatchesFullSerialization_P)
+{
+    oc_resource_t resource;
+    oc_endpoint_t clients[3];
+    memset(&resource, 0, sizeof(resource));
+    memset(clients, 0, sizeof(clients));
+    oc_new_string(&resource.uri, "/a", 2);
+    /* Observe values of one, two and three bytes, and both content
+     * formats
+     */
+    const int32_t counters[] = { COAP_OBSERVE_REFRESH_INTERVAL,
+                                 COAP_OBSERVE_REFRESH_INTERVAL * 100,
+                                 COAP_OBSERVE_REFRESH_INTERVAL * 20000 };
+    const uint8_t token[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    coap_observer_t *obs[3];
+    for (int i = 0; i < 3; i++) {
+        clients[i].flags = IPV6;
+        clients[i].addr.ipv6.port = 5683;
+        clients[i].addr.ipv6.address[15] = i + 1;
+        clients[i].version = (i == 1) ? OIC_VER_1_1_0 : OCF_VER_1_0_0;
+        EXPECT_EQ(0, observe(&resource, &clients[i], 1));
+    }
+    for (int i = 0; i < 3; i++) {
+        for (obs[i] = resource.observers; obs[i];
+             obs[i] = obs[i]->resource_next) {
+            if (oc_endpoint_compare(&obs[i]->endpoint, &clients[i]) == 0) {
+                break;
+            }
+        }
+        ASSERT_NE(nullptr, obs[i]);
+        /* Each forced to a confirmable notification, which is kept */
+        obs[i]->obs_counter = counters[i];
+        obs[i]->token_len = (uint8_t)(2 + 3 * i);
+        memcpy(obs[i]->token, token, obs[i]->token_len);
+    }
+
+    uint8_t payload[64];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)i;
+    }
+    oc_response_buffer_t response_buffer;
+    response_buffer.buffer = payload;
+    response_buffer.buffer_size = sizeof(payload);
+    response_buffer.response_length = sizeof(payload);
+    response_buffer.code = CONTENT_2_05;
+    EXPECT_EQ(3, coap_notify_observers(&resource, &response_buffer, NULL));
+
+    for (int i = 0; i < 3; i++) {
+        coap_transaction_t *transaction =
+          coap_get_transaction_by_mid(obs[i]->last_mid);
+        ASSERT_NE(nullptr, transaction);
+        coap_packet_t expected[1];
+        uint8_t buffer[OC_PDU_SIZE];
+        coap_udp_init_message(expected, COAP_TYPE_CON, CONTENT_2_05,
+                              obs[i]->last_mid);
+        coap_set_token(expected, obs[i]->token, obs[i]->token_len);
+        coap_set_header_observe(expected, (uint32_t)counters[i]);
+        coap_set_header_content_format(expected, i == 1
+                                                   ? APPLICATION_CBOR
+                                                   : APPLICATION_VND_OCF_CBOR);
+        coap_set_payload(expected, payload, sizeof(payload));
+        size_t length = coap_serialize_message(expected, buffer);
+        ASSERT_EQ(length, transaction->message->length);
+        EXPECT_EQ(0, memcmp(buffer, transaction->message->data, length));
+    }
+
+    coap_free_all_transactions();
+    EXPECT_EQ(3, coap_remove_observers_by_resource(&resource));
+    oc_free_string(&resource.uri);
+}
+
+static oc_resource_t *cond_res;
+static int cond_value;
+static int cond_gets;
+
+/* Encodes {"v": cond_value} for a cond_value below 256 */
+static void
+encode_value(oc_response_buffer_t *response_buffer, int value)
+{
+    uint8_t payload[] = { 0xA1, 0x61, 'v', 0x18, (uint8_t)value };
+    memcpy(response_buffer->buffer, payload, sizeof(payload));
+    response_buffer->response_length = sizeof(payload);
+    response_buffer->code = oc_status_code(OC_STATUS_OK);
+}
+
+static void
+cond_get_handler(oc_request_t *request, oc_interface_mask_t interface,
+                 void *user_data)
+{
+    (void)interface;
+    (void)user_data;
+    cond_gets++;
+    encode_value(request->response->response_buffer, cond_value);
+}
+
+static void
+cond_register_resources(void)
+{
+    cond_res = oc_new_resource(NULL, "/cond", 1, 0);
+    oc_resource_bind_resource_type(cond_res, "oic.r.test");
+    oc_resource_bind_resource_interface(cond_res, OC_IF_RW);
+    oc_resource_set_default_interface(cond_res, OC_IF_RW);
+    oc_resource_set_observable(cond_res, true);
+    oc_resource_set_observe_step_property(cond_res, "v");
+    oc_resource_set_request_handler(cond_res, OC_GET, cond_get_handler, NULL);
+    oc_add_resource(cond_res);
+}
+
+class TestObserveConditions: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            static const oc_handler_t handler = {
+                .init = app_init,
+                .signal_event_loop = signal_event_loop,
+                .register_resources = cond_register_resources
+            };
+            cond_value = 0;
+            cond_gets = 0;
+            ASSERT_EQ(0, oc_main_init(&handler));
+            memset(clients, 0, sizeof(clients));
+            for (int i = 0; i < 2; i++) {
+                clients[i].flags = IPV6;
+                clients[i].addr.ipv6.port = 9;
+                clients[i].addr.ipv6.address[15] = i + 1;
+            }
+        }
+
+        virtual void TearDown()
+        {
+            oc_main_shutdown();
+        }
+
+        coap_observer_t *observer(const char *query)
+        {
+            EXPECT_EQ(0, observe(cond_res, &clients[0], 1, query));
+            return cond_res->observers;
+        }
+
+        /* Reports a change to value; returns whether the observer was
+         * notified of it
+         */
+        bool change(coap_observer_t *obs, int value)
+        {
+            uint8_t buffer[8];
+            oc_response_buffer_t response_buffer;
+            response_buffer.buffer = buffer;
+            response_buffer.buffer_size = sizeof(buffer);
+            encode_value(&response_buffer, value);
+            cond_value = value;
+            int32_t counter = obs->obs_counter;
+            coap_notify_observers(cond_res, &response_buffer, NULL);
+            return obs->obs_counter != counter;
+        }
+
+        oc_endpoint_t clients[2];
+};
+
+TEST_F(TestObserveConditions, StepSuppressesSmallChanges_P)
+{
+    coap_observer_t *obs = observer("st=5");
+    ASSERT_NE(nullptr, obs);
+    EXPECT_TRUE(change(obs, 10));
+    EXPECT_FALSE(change(obs, 12));
+    EXPECT_FALSE(change(obs, 6));
+    /* Measured from the last value sent, not the last change */
+    EXPECT_TRUE(change(obs, 15));
+    EXPECT_TRUE(change(obs, 9));
+}
+
+TEST_F(TestObserveConditions, ThresholdsNotifyOnCrossing_P)
+{
+    coap_observer_t *obs = observer("gt=20&lt=5");
+    ASSERT_NE(nullptr, obs);
+    EXPECT_TRUE(change(obs, 10));
+    EXPECT_FALSE(change(obs, 15));
+    EXPECT_TRUE(change(obs, 25));
+    EXPECT_FALSE(change(obs, 30));
+    EXPECT_TRUE(change(obs, 3));
+    EXPECT_FALSE(change(obs, 4));
+    EXPECT_TRUE(change(obs, 12));
+}
+
+TEST_F(TestObserveConditions, PminDefersChanges_P)
+{
+    coap_observer_t *obs = observer("pmin=10");
+    ASSERT_NE(nullptr, obs);
+    EXPECT_FALSE(change(obs, 10));
+    EXPECT_TRUE(obs->pending);
+
+    /* Once the period has passed, the next change goes out */
+    obs->last_notify -= 10 * OC_CLOCK_SECOND;
+    EXPECT_TRUE(change(obs, 11));
+    EXPECT_FALSE(obs->pending);
+    EXPECT_FALSE(change(obs, 12));
+}
+
+TEST_F(TestObserveConditions, PmaxOverridesConditions_P)
+{
+    coap_observer_t *obs = observer("pmax=10&st=100");
+    ASSERT_NE(nullptr, obs);
+    EXPECT_TRUE(change(obs, 10));
+    EXPECT_FALSE(change(obs, 11));
+
+    obs->last_notify -= 10 * OC_CLOCK_SECOND;
+    EXPECT_TRUE(change(obs, 12));
+}
+
+TEST_F(TestObserveConditions, OverduePendingChangeIsSentAtOnce_P)
+{
+    coap_observer_t *obs = observer("pmin=10");
+    ASSERT_NE(nullptr, obs);
+    EXPECT_FALSE(change(obs, 10));
+    obs->last_notify -= 20 * OC_CLOCK_SECOND;
+    int32_t counter = obs->obs_counter;
+
+    /* Registering another observer reschedules the resource's timer, whose
+     * earliest deadline has already passed
+     */
+    EXPECT_EQ(0, observe(cond_res, &clients[1], 2));
+    for (int i = 0; i < 10 && cond_gets == 0; i++) {
+        oc_main_poll();
+    }
+    EXPECT_EQ(1, cond_gets);
+    EXPECT_NE(counter, obs->obs_counter);
+    EXPECT_FALSE(obs->pending);
+}
@@ -0,0 +1,127 @@
+/******************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "rtt.h"
+#include "transactions.h"
+#include "oc_network_monitor.h"
+}
+
+#define MS(ms) ((oc_clock_time_t)(ms) * OC_CLOCK_SECOND / 1000)
+
+class TestRtt: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            coap_free_all_rtt_estimators();
+            memset(&peer, 0, sizeof(peer));
+            peer.flags = IPV6;
+            peer.addr.ipv6.port = 5683;
+            peer.addr.ipv6.address[15] = 1;
+        }
+
+        virtual void TearDown()
+        {
+            coap_free_all_rtt_estimators();
+        }
+
+        oc_endpoint_t peer;
+};
+
+TEST_F(TestRtt, UnknownPeerUsesDefaultTimeout_P)
+{
+    oc_rtt_stats_t stats;
+    EXPECT_EQ((oc_clock_time_t)COAP_RESPONSE_TIMEOUT_TICKS,
+              coap_rtt_timeout(&peer));
+    EXPECT_FALSE(oc_get_rtt_stats(&peer, &stats));
+}
+
+TEST_F(TestRtt, StrongSamplesLowerTimeout_P)
+{
+    for (int i = 0; i < 10; i++) {
+        coap_rtt_measure(&peer, oc_clock_time() - MS(100), 0);
+    }
+    oc_clock_time_t rto = coap_rtt_timeout(&peer);
+    EXPECT_LT(rto, MS(500));
+    EXPECT_GE(rto, MS(100));
+
+    oc_rtt_stats_t stats;
+    ASSERT_TRUE(oc_get_rtt_stats(&peer, &stats));
+    EXPECT_EQ(10u, stats.strong_samples);
+    EXPECT_EQ(0u, stats.weak_samples);
+    EXPECT_NEAR(100, stats.srtt_strong_ms, 20);
+}
+
+TEST_F(TestRtt, AmbiguousSamplesAreIgnored_N)
+{
+    coap_rtt_measure(&peer, oc_clock_time() - MS(100), 3);
+    oc_rtt_stats_t stats;
+    EXPECT_FALSE(oc_get_rtt_stats(&peer, &stats));
+
+    coap_rtt_measure(&peer, oc_clock_time() - MS(9000), 1);
+    ASSERT_TRUE(oc_get_rtt_stats(&peer, &stats));
+    EXPECT_EQ(1u, stats.weak_samples);
+    EXPECT_GT(coap_rtt_timeout(&peer), (oc_clock_time_t)MS(3000));
+}
+
+TEST_F(TestRtt, BackoffDependsOnInitialTimeout_P)
+{
+    coap_rtt_measure(&peer, oc_clock_time() - MS(100), 0);
+    EXPECT_EQ(MS(1500), coap_rtt_backoff(&peer, MS(500), MS(500)));
+    EXPECT_EQ(MS(4000), coap_rtt_backoff(&peer, MS(2000), MS(2000)));
+    EXPECT_EQ(MS(6000), coap_rtt_backoff(&peer, MS(4000), MS(4000)));
+    EXPECT_EQ(MS(32000), coap_rtt_backoff(&peer, MS(2000), MS(20000)));
+
+    oc_rtt_stats_t stats;
+    ASSERT_TRUE(oc_get_rtt_stats(&peer, &stats));
+    EXPECT_EQ(4u, stats.retransmissions);
+}
+
+TEST_F(TestRtt, BackoffDoesNotTrackUnknownPeer_N)
+{
+    EXPECT_EQ(MS(4000), coap_rtt_backoff(&peer, MS(2000), MS(2000)));
+    oc_rtt_stats_t stats;
+    EXPECT_FALSE(oc_get_rtt_stats(&peer, &stats));
+}
+
+TEST_F(TestRtt, FullPoolKeepsTrackedPeers_N)
+{
+    oc_endpoint_t peers[COAP_MAX_RTT_ESTIMATORS + 1];
+    for (int i = 0; i <= COAP_MAX_RTT_ESTIMATORS; i++) {
+        peers[i] = peer;
+        peers[i].addr.ipv6.port = 6000 + i;
+        coap_rtt_measure(&peers[i], oc_clock_time() - MS(50), 0);
+    }
+    oc_rtt_stats_t stats;
+    for (int i = 0; i < COAP_MAX_RTT_ESTIMATORS; i++) {
+        EXPECT_TRUE(oc_get_rtt_stats(&peers[i], &stats));
+    }
+    EXPECT_FALSE(oc_get_rtt_stats(&peers[COAP_MAX_RTT_ESTIMATORS], &stats));
+    EXPECT_EQ((oc_clock_time_t)COAP_RESPONSE_TIMEOUT_TICKS,
+              coap_rtt_timeout(&peers[COAP_MAX_RTT_ESTIMATORS]));
+
+    /* A freed estimator is available again */
+    coap_free_all_rtt_estimators();
+    coap_rtt_measure(&peers[COAP_MAX_RTT_ESTIMATORS], oc_clock_time(), 0);
+    EXPECT_TRUE(oc_get_rtt_stats(&peers[COAP_MAX_RTT_ESTIMATORS], &stats));
+}
@@ -0,0 +1,94 @@
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "testcommon.h"
+
+extern "C" {
+#include "coap.h"
+#include "engine.h"
+#include "oc_buffer.h"
+#include "oc_client_state.h"
+}
+
+#ifdef OC_TCP
+
+class TestSendFailure: public TestStack
+{
+    protected:
+        virtual void SetUp()
+        {
+            ASSERT_NO_FATAL_FAILURE(TestStack::SetUp());
+            ASSERT_NO_FATAL_FAILURE(bind_loopback(SOCK_STREAM, &listener,
+                                                  &server));
+        }
+
+        virtual void TearDown()
+        {
+            if (listener >= 0) {
+                close(listener);
+            }
+            TestStack::TearDown();
+        }
+
+        int listener;
+        oc_endpoint_t server;
+};
+
+TEST_F(TestSendFailure, RefusedConnectFailsRequest_N)
+{
+    /* Nothing listens on the port once the socket is closed */
+    close(listener);
+    listener = -1;
+
+    ASSERT_TRUE(oc_do_get("/a", &server, NULL, on_response, HIGH_QOS, NULL));
+    poll_for_response();
+    EXPECT_EQ(1, responses);
+    EXPECT_EQ(OC_SEND_FAILED, last_code);
+    EXPECT_EQ(NULL, oc_ri_get_client_cb("/a", &server, OC_GET));
+}
+
+TEST_F(TestSendFailure, RefusedMessageFailsRequest_N)
+{
+    ASSERT_EQ(0, listen(listener, 1));
+    ASSERT_TRUE(oc_do_get("/a", &server, NULL, on_response, HIGH_QOS, NULL));
+    oc_client_cb_t *cb = oc_ri_get_client_cb("/a", &server, OC_GET);
+    ASSERT_TRUE(cb != NULL);
+
+    /* As handed back by a transport whose send queue is full */
+    coap_packet_t packet[1];
+    coap_tcp_init_message(packet, COAP_GET);
+    coap_set_token(packet, cb->token, cb->token_len);
+    oc_message_t *message = oc_allocate_message();
+    ASSERT_TRUE(message != NULL);
+    memcpy(&message->endpoint, &server, sizeof(server));
+    message->length = coap_serialize_message(packet, message->data);
+    coap_tcp_send_failed(message);
+    oc_message_unref(message);
+
+    EXPECT_EQ(1, responses);
+    EXPECT_EQ(OC_SEND_FAILED, last_code);
+    EXPECT_EQ(NULL, oc_ri_get_client_cb("/a", &server, OC_GET));
+}
+
+TEST_F(TestSendFailure, RefusedResponseLeavesRequestsAlone_P)
+{
+    ASSERT_EQ(0, listen(listener, 1));
+    ASSERT_TRUE(oc_do_get("/a", &server, NULL, on_response, HIGH_QOS, NULL));
+    oc_client_cb_t *cb = oc_ri_get_client_cb("/a", &server, OC_GET);
+    ASSERT_TRUE(cb != NULL);
+
+    coap_packet_t packet[1];
+    coap_tcp_init_message(packet, CONTENT_2_05);
+    coap_set_token(packet, cb->token, cb->token_len);
+    oc_message_t *message = oc_allocate_message();
+    ASSERT_TRUE(message != NULL);
+    memcpy(&message->endpoint, &server, sizeof(server));
+    message->length = coap_serialize_message(packet, message->data);
+    coap_tcp_send_failed(message);
+    oc_message_unref(message);
+
+    EXPECT_EQ(0, responses);
+    EXPECT_EQ(cb, oc_ri_get_client_cb("/a", &server, OC_GET));
+}
+
+#endif /* OC_TCP */
@@ -0,0 +1,252 @@
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "testcommon.h"
+
+extern "C" {
+#include "coap.h"
+#include "coap_signal.h"
+#include "oc_buffer.h"
+#include "oc_client_state.h"
+}
+
+#ifdef OC_TCP
+
+/* The peer is a loopback TCP listener the stack connects to */
+class TestSignal: public TestStack
+{
+    protected:
+        virtual void SetUp()
+        {
+            ASSERT_NO_FATAL_FAILURE(TestStack::SetUp());
+            conn = -1;
+            received = 0;
+            csm_frames = 0;
+            ASSERT_NO_FATAL_FAILURE(bind_loopback(SOCK_STREAM, &listener,
+                                                  &peer));
+            ASSERT_EQ(0, listen(listener, 1));
+        }
+
+        virtual void TearDown()
+        {
+            oc_set_tcp_keepalive(0);
+            if (conn >= 0) {
+                close(conn);
+            }
+            close(listener);
+            TestStack::TearDown();
+        }
+
+        /* Hands the stack a CSM from the peer */
+        void receive_csm(uint32_t max_msg_size)
+        {
+            coap_packet_t csm[1];
+            coap_tcp_init_message(csm, CSM_7_01);
+            coap_set_header_max_msg_size(csm, max_msg_size);
+            ASSERT_EQ(COAP_NO_ERROR, coap_signal_handler(csm, &peer));
+        }
+
+        /* Runs the stack until the peer reads a frame with the given code
+         * into frame, counting the CSMs read on the way; returns its length,
+         * or 0 if none came within ms milliseconds or the stack closed the
+         * connection
+         */
+        size_t receive_frame(uint8_t code, int ms = 1000)
+        {
+            for (int i = 0; i < ms / 5; i++) {
+                size_t frame_len = take_frame(code);
+                if (frame_len > 0) {
+                    return frame_len;
+                }
+                oc_main_poll();
+                struct pollfd pfd = { conn >= 0 ? conn : listener, POLLIN, 0 };
+                if (poll(&pfd, 1, 5) <= 0) {
+                    continue;
+                }
+                if (conn < 0) {
+                    conn = accept(listener, NULL, NULL);
+                    continue;
+                }
+                ssize_t len = recv(conn, data + received,
+                                   sizeof(data) - received, 0);
+                if (len <= 0) {
+                    return 0;
+                }
+                received += (size_t)len;
+            }
+            return take_frame(code);
+        }
+
+        /* Consumes the whole frames read so far up to the first with the
+         * given code, which is copied into frame; returns its length, or 0
+         * if there is none yet
+         */
+        size_t take_frame(uint8_t code)
+        {
+            size_t frame_len;
+            while (received > 0 && header_length() <= received &&
+                   (frame_len = coap_tcp_get_packet_size(data)) <= received) {
+                coap_packet_t packet[1];
+                bool found = coap_tcp_parse_message(
+                               packet, data, (uint32_t)frame_len) ==
+                               COAP_NO_ERROR && packet->code == code;
+                if (packet->code == CSM_7_01) {
+                    csm_frames++;
+                }
+                if (found) {
+                    memcpy(frame, data, frame_len);
+                }
+                received -= frame_len;
+                memmove(data, data + frame_len, received);
+                if (found) {
+                    return frame_len;
+                }
+            }
+            return 0;
+        }
+
+        /* Bytes ahead of the token of the frame at the start of data */
+        size_t header_length(void)
+        {
+            static const size_t extended[] = { 1, 2, 4 };
+            uint8_t len = data[0] >> 4;
+            return 2 + (len < 13 ? 0 : extended[len - 13]);
+        }
+
+        /* Runs the stack until it closes the connection or ms pass */
+        bool wait_for_close(int ms)
+        {
+            for (int i = 0; i < ms / 5; i++) {
+                oc_main_poll();
+                struct pollfd pfd = { conn, POLLIN, 0 };
+                if (poll(&pfd, 1, 5) <= 0) {
+                    continue;
+                }
+                uint8_t buf[64];
+                if (recv(conn, buf, sizeof(buf), 0) <= 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void send_frame(coap_packet_t *packet)
+        {
+            uint8_t buf[64];
+            size_t len = coap_serialize_message(packet, buf);
+            ASSERT_EQ((ssize_t)len, send(conn, buf, len, 0));
+        }
+
+        int listener, conn, csm_frames;
+        oc_endpoint_t peer;
+        uint8_t data[2048], frame[2048];
+        size_t received;
+};
+
+TEST_F(TestSignal, OversizedRequestFailsAsTooLarge_N)
+{
+    receive_csm(32);
+    char query[40];
+    memset(query, 'q', sizeof(query) - 1);
+    query[sizeof(query) - 1] = '\0';
+    ASSERT_TRUE(oc_do_get("/a", &peer, query, on_response, HIGH_QOS, NULL));
+
+    poll_for_response();
+    EXPECT_EQ(1, responses);
+    EXPECT_EQ(OC_STATUS_REQUEST_ENTITY_TOO_LARGE, last_code);
+    EXPECT_EQ(NULL, oc_ri_get_client_cb("/a", &peer, OC_GET));
+    EXPECT_EQ(0, oc_client_num_requests_in_flight(&peer));
+}
+
+TEST_F(TestSignal, OversizedResponseIsReplacedBy413_P)
+{
+    receive_csm(32);
+    uint8_t token[] = { 0x01, 0x02, 0x03, 0x04 };
+    uint8_t payload[64];
+    memset(payload, 0x5a, sizeof(payload));
+    coap_packet_t response[1];
+    coap_tcp_init_message(response, CONTENT_2_05);
+    coap_set_token(response, token, sizeof(token));
+    coap_set_payload(response, payload, sizeof(payload));
+    oc_message_t *message = oc_internal_allocate_outgoing_message();
+    ASSERT_TRUE(message != NULL);
+    memcpy(&message->endpoint, &peer, sizeof(peer));
+    message->length = coap_serialize_message(response, message->data);
+    coap_send_message(message);
+    if (message->ref_count == 0) {
+        oc_message_unref(message);
+    }
+
+    size_t len = receive_frame(REQUEST_ENTITY_TOO_LARGE_4_13);
+    ASSERT_LT(0u, len);
+    coap_packet_t parsed[1];
+    ASSERT_EQ(COAP_NO_ERROR, coap_tcp_parse_message(parsed, frame,
+                                                    (uint32_t)len));
+    ASSERT_EQ(sizeof(token), parsed->token_len);
+    EXPECT_EQ(0, memcmp(token, parsed->token, sizeof(token)));
+}
+
+TEST_F(TestSignal, SentAbortClosesSession_P)
+{
+    ASSERT_TRUE(oc_send_ping(false, &peer, 5, on_response, NULL));
+    ASSERT_LT(0u, receive_frame(PING_7_02));
+
+    /* A CSM with the unknown critical option 3 */
+    const uint8_t csm[] = { 0x10, 0xe1, 0x30 };
+    ASSERT_EQ((ssize_t)sizeof(csm), send(conn, csm, sizeof(csm), 0));
+
+    ASSERT_LT(0u, receive_frame(ABORT_7_05));
+    EXPECT_TRUE(wait_for_close(1000));
+}
+
+TEST_F(TestSignal, KeepaliveClosesSilentSession_P)
+{
+    oc_set_tcp_keepalive(1);
+    ASSERT_TRUE(oc_do_get("/a", &peer, NULL, on_response, HIGH_QOS, NULL));
+    ASSERT_LT(0u, receive_frame(COAP_GET));
+
+    /* An answered Ping keeps the session open */
+    ASSERT_LT(0u, receive_frame(PING_7_02, 2000));
+    coap_packet_t pong[1];
+    coap_tcp_init_message(pong, PONG_7_03);
+    send_frame(pong);
+
+    ASSERT_LT(0u, receive_frame(PING_7_02, 2000));
+    EXPECT_TRUE(wait_for_close(2000));
+}
+
+TEST_F(TestSignal, RequestsQueuedWhileConnectingShareOneCsm_P)
+{
+    ASSERT_TRUE(oc_send_ping(false, &peer, 5, on_response, NULL));
+    ASSERT_TRUE(oc_send_ping(false, &peer, 5, on_response, NULL));
+    ASSERT_LT(0u, receive_frame(PING_7_02));
+    ASSERT_LT(0u, receive_frame(PING_7_02));
+    EXPECT_EQ(1, csm_frames);
+}
+
+TEST_F(TestSignal, FailedConnectsReleaseSignalPeers_P)
+{
+    /* More unreachable endpoints than there are signaling peers in
+     * static builds
+     */
+    for (int i = 0; i < 3; i++) {
+        int sock;
+        oc_endpoint_t refused;
+        ASSERT_NO_FATAL_FAILURE(bind_loopback(SOCK_STREAM, &sock, &refused));
+        close(sock);
+
+        responses = 0;
+        ASSERT_TRUE(oc_do_get("/a", &refused, NULL, on_response, HIGH_QOS,
+                              NULL));
+        poll_for_response();
+        ASSERT_EQ(1, responses);
+        EXPECT_EQ(OC_SEND_FAILED, last_code);
+    }
+
+    ASSERT_TRUE(oc_do_get("/a", &peer, NULL, on_response, HIGH_QOS, NULL));
+    ASSERT_LT(0u, receive_frame(COAP_GET));
+    EXPECT_EQ(1, csm_frames);
+}
+
+#endif /* OC_TCP */
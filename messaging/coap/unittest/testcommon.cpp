@@ -0,0 +1,77 @@
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "testcommon.h"
+
+int responses;
+oc_status_t last_code;
+
+void
+on_response(oc_client_response_t *data)
+{
+    responses++;
+    last_code = data->code;
+}
+
+static int
+app_init(void)
+{
+    int ret = oc_init_platform("Samsung", NULL, NULL);
+    ret |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                         "ocf.res.1.0.0", NULL, NULL);
+    return ret;
+}
+
+static void
+signal_event_loop(void)
+{
+}
+
+void
+TestStack::SetUp()
+{
+    static const oc_handler_t handler = {
+        .init = app_init,
+        .signal_event_loop = signal_event_loop
+    };
+    responses = 0;
+    last_code = OC_STATUS_OK;
+    ASSERT_EQ(0, oc_main_init(&handler));
+}
+
+void
+TestStack::TearDown()
+{
+    oc_main_shutdown();
+}
+
+void
+TestStack::bind_loopback(int type, int *sock, oc_endpoint_t *endpoint)
+{
+    *sock = socket(AF_INET6, type, 0);
+    ASSERT_LE(0, *sock);
+    struct sockaddr_in6 addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    ASSERT_EQ(0, bind(*sock, (struct sockaddr *)&addr, sizeof(addr)));
+    ASSERT_EQ(0, getsockname(*sock, (struct sockaddr *)&addr, &len));
+
+    memset(endpoint, 0, sizeof(*endpoint));
+    endpoint->flags =
+      (enum transport_flags)(type == SOCK_STREAM ? (IPV6 | TCP) : IPV6);
+    memcpy(endpoint->addr.ipv6.address, &in6addr_loopback, 16);
+    endpoint->addr.ipv6.port = ntohs(addr.sin6_port);
+}
+
+void
+TestStack::poll_for_response(void)
+{
+    for (int i = 0; i < 200 && responses == 0; i++) {
+        oc_main_poll();
+        usleep(5000);
+    }
+}
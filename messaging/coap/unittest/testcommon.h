@@ -0,0 +1,37 @@
+#ifndef TESTCOMMON_H
+#define TESTCOMMON_H
+
+#include "gtest/gtest.h"
+
+extern "C" {
+#include "oc_api.h"
+#include "oc_endpoint.h"
+}
+
+/* Responses to the requests made with on_response, and the latest code */
+extern int responses;
+extern oc_status_t last_code;
+
+void on_response(oc_client_response_t *data);
+
+/* Runs the stack with a single device for tests that talk to it through
+ * loopback sockets standing in for its peers
+ */
+class TestStack: public testing::Test
+{
+    protected:
+        virtual void SetUp();
+        virtual void TearDown();
+
+        /* Binds a new loopback socket of the given type to a free port
+         * and points endpoint at it
+         */
+        void bind_loopback(int type, int *sock, oc_endpoint_t *endpoint);
+
+        /* Runs the stack until a response arrives or about a second
+         * passes
+         */
+        void poll_for_response(void);
+};
+
+#endif /* TESTCOMMON_H */
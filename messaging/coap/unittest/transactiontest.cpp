@@ -95,3 +95,16 @@ TEST_F(TestCoapTransaction, FreeAllTransactionTest_P)
 
     coap_free_all_transactions();
 }
+
+TEST_F(TestCoapTransaction, QueuedTransactionIsNotRetransmitted_P)
+{
+    oc_endpoint_t *endpoint = oc_new_endpoint();
+    coap_transaction_t *queued = coap_new_transaction(coap_get_mid(), endpoint);
+    ASSERT_TRUE(NULL != queued);
+
+    /* Queued transactions have never been sent, so are not retransmitted */
+    coap_queue_transaction(queued);
+    coap_check_transactions();
+    EXPECT_EQ(0, queued->retrans_counter);
+    EXPECT_TRUE(queued->queued);
+}
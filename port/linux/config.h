@@ -18,6 +18,34 @@ typedef uint64_t oc_clock_time_t;
 /* Maximum wait time for select function */
 #define SELECT_TIMEOUT_SEC (1)
 
+/* Maximum number of UDP datagrams read with a single recvmmsg() call */
+#define OC_UDP_RECV_BATCH_SIZE (8)
+
+/* Maximum number of unicast messages sent with a single sendmmsg() call */
+#define OC_SEND_BATCH_SIZE (16)
+
+/* Maximum number of messages waiting in the outbound queue */
+#define OC_SEND_QUEUE_LEN (64)
+
+/* Number of slots (a power of two) in the lock-free queue of received
+ * messages handed from the network threads to the event loop
+ */
+#define OC_NETWORK_EVENT_RING_SIZE (64)
+
+/* Size in bytes of the arena that holds parsed oc_rep trees */
+#define OC_REP_ARENA_SIZE (4096)
+
+/* Number of remote endpoints whose round-trip times are tracked */
+#define COAP_MAX_RTT_ESTIMATORS (64)
+
+/* Number of recent requests remembered to detect duplicates */
+#define OC_REQUEST_HISTORY_SIZE (250)
+
+/* Maximum number of threads that run resource handlers with
+ * OC_WORKER_THREADS
+ */
+#define OC_WORKER_POOL_SIZE (4)
+
 /* Add support for passing network up/down events to the app */
 #define OC_NETWORK_MONITOR
 /* Add support for passing TCP/TLS/DTLS session connection events to the app */
@@ -32,6 +60,15 @@ typedef uint64_t oc_clock_time_t;
 #define OC_COLLECTIONS
 #define OC_BLOCK_WISE
 
+/* Maximum number of released message buffers kept for reuse */
+#define OC_MESSAGE_CACHE_SIZE (32)
+
+/* Number of encoded responses kept to answer duplicate requests */
+#define OC_REQUEST_HISTORY_RESPONSES (16)
+
+/* Number of message buffers all TCP sessions receive into */
+#define OC_TCP_RECEIVE_BUFFERS (64)
+
 #else /* OC_DYNAMIC_ALLOCATION */
 /* List of constraints below for a build that does not employ dynamic
    memory allocation
@@ -40,6 +40,9 @@
 #include <string.h>
 #include <sys/select.h>
 #include <sys/un.h>
+#ifdef OC_EPOLL
+#include <sys/epoll.h>
+#endif /* OC_EPOLL */
 #include <unistd.h>
 
 /* Some outdated toolchains do not define IFA_FLAGS.
@@ -60,6 +63,10 @@ static const uint8_t ALL_OCF_NODES_SL[] = {
 };
 #define ALL_COAP_NODES_V4 0xe00001bb
 
+#ifndef OC_UDP_RECV_BATCH_SIZE
+#define OC_UDP_RECV_BATCH_SIZE (8)
+#endif /* !OC_UDP_RECV_BATCH_SIZE */
+
 static pthread_mutex_t mutex;
 struct sockaddr_nl ifchange_nl;
 int ifchange_sock;
@@ -651,45 +658,23 @@ static int process_interface_change_event(void) {
   return ret;
 }
 
+/* Fills in the source address, the receiving interface and the local
+ * address of a received datagram from its IPV6_PKTINFO/IP_PKTINFO ancillary
+ * data.
+ */
 static int
-recv_msg(int sock, uint8_t *recv_buf, int recv_buf_size,
-         oc_endpoint_t *endpoint, bool multicast)
+parse_msg_pktinfo(struct msghdr *msg, oc_endpoint_t *endpoint, bool multicast)
 {
-  struct sockaddr_storage client;
-  struct iovec iovec[1];
-  struct msghdr msg;
-  char msg_control[CMSG_LEN(sizeof(struct sockaddr_storage))];
-
-  iovec[0].iov_base = recv_buf;
-  iovec[0].iov_len = (size_t)recv_buf_size;
-
-  msg.msg_name = &client;
-  msg.msg_namelen = sizeof(client);
-
-  msg.msg_iov = iovec;
-  msg.msg_iovlen = 1;
-
-  msg.msg_control = msg_control;
-  msg.msg_controllen = sizeof(msg_control);
-
-  msg.msg_flags = 0;
-
-  int ret = recvmsg(sock, &msg, 0);
-
-  if (ret < 0 || msg.msg_flags & MSG_TRUNC || msg.msg_flags & MSG_CTRUNC) {
-    OC_ERR("recvmsg returned with an error: %d", errno);
-    return -1;
-  }
-
+  struct sockaddr_storage *client = (struct sockaddr_storage *)msg->msg_name;
   struct cmsghdr *cmsg;
-  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != 0; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != 0; cmsg = CMSG_NXTHDR(msg, cmsg)) {
     if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
-      if (msg.msg_namelen != sizeof(struct sockaddr_in6)) {
+      if (msg->msg_namelen != sizeof(struct sockaddr_in6)) {
         OC_ERR("anciliary data contains invalid source address");
         return -1;
       }
       /* Set source address of packet in endpoint structure */
-      struct sockaddr_in6 *c6 = (struct sockaddr_in6 *)&client;
+      struct sockaddr_in6 *c6 = (struct sockaddr_in6 *)client;
       memcpy(endpoint->addr.ipv6.address, c6->sin6_addr.s6_addr,
              sizeof(c6->sin6_addr.s6_addr));
       endpoint->addr.ipv6.scope = c6->sin6_scope_id;
@@ -715,22 +700,26 @@ recv_msg(int sock, uint8_t *recv_buf, int recv_buf_size,
                * address of a multicast response.
                */
         oc_endpoint_t *dst = oc_connectivity_get_endpoints(endpoint->device);
-        while (dst->interface_index != endpoint->interface_index ||
-               !(dst->flags & IPV6)) {
+        while (dst && (dst->interface_index != endpoint->interface_index ||
+                       !(dst->flags & IPV6))) {
           dst = dst->next;
         }
+        if (!dst) {
+          OC_ERR("multicast datagram on an interface without an endpoint");
+          return -1;
+        }
         memcpy(endpoint->addr_local.ipv6.address, dst->addr.ipv6.address, 16);
       }
       break;
     }
 #ifdef OC_IPV4
     else if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_PKTINFO) {
-      if (msg.msg_namelen != sizeof(struct sockaddr_in)) {
+      if (msg->msg_namelen != sizeof(struct sockaddr_in)) {
         OC_ERR("anciliary data contains invalid source address");
         return -1;
       }
       struct in_pktinfo *pktinfo = (struct in_pktinfo *)CMSG_DATA(cmsg);
-      struct sockaddr_in *c4 = (struct sockaddr_in *)&client;
+      struct sockaddr_in *c4 = (struct sockaddr_in *)client;
       memcpy(endpoint->addr.ipv4.address, &c4->sin_addr.s_addr,
              sizeof(c4->sin_addr.s_addr));
       endpoint->addr.ipv4.port = ntohs(c4->sin_port);
@@ -739,10 +728,14 @@ recv_msg(int sock, uint8_t *recv_buf, int recv_buf_size,
         memcpy(endpoint->addr_local.ipv4.address, &pktinfo->ipi_addr.s_addr, 4);
       } else {
         oc_endpoint_t *dst = oc_connectivity_get_endpoints(endpoint->device);
-        while (dst->interface_index != endpoint->interface_index ||
-               !(dst->flags & IPV4)) {
+        while (dst && (dst->interface_index != endpoint->interface_index ||
+                       !(dst->flags & IPV4))) {
           dst = dst->next;
         }
+        if (!dst) {
+          OC_ERR("multicast datagram on an interface without an endpoint");
+          return -1;
+        }
         memcpy(endpoint->addr_local.ipv4.address, dst->addr.ipv4.address, 4);
       }
       break;
@@ -750,15 +743,332 @@ recv_msg(int sock, uint8_t *recv_buf, int recv_buf_size,
 #endif /* OC_IPV4 */
   }
 
+  return 0;
+}
+
+/* Reads up to max_messages datagrams from sock with a single recvmmsg()
+ * call and hands all of them to the stack at once. Buffers that were not
+ * filled go back to the pool before returning.
+ * Returns the number of datagrams consumed from the socket, 0 if none were
+ * pending, or -1 if the message pool ran out before the socket was drained.
+ */
+static int
+recv_msgs(ip_context_t *dev, int sock, enum transport_flags flags,
+          int max_messages)
+{
+  oc_message_t *messages[OC_UDP_RECV_BATCH_SIZE];
+  struct mmsghdr msgs[OC_UDP_RECV_BATCH_SIZE];
+  struct iovec iovecs[OC_UDP_RECV_BATCH_SIZE];
+  struct sockaddr_storage clients[OC_UDP_RECV_BATCH_SIZE];
+  char msg_control[OC_UDP_RECV_BATCH_SIZE]
+                  [CMSG_LEN(sizeof(struct sockaddr_storage))];
+  bool multicast = (flags & MULTICAST) ? true : false;
+  int i, num_messages, num_received, num_delivered = 0;
+
+  num_messages = oc_allocate_messages(messages, max_messages);
+  for (i = 0; i < num_messages; i++) {
+    oc_message_t *message = messages[i];
+    message->endpoint.device = dev->device;
+
+    iovecs[i].iov_base = message->data;
+    iovecs[i].iov_len = (size_t)OC_PDU_SIZE;
+
+    struct msghdr *msg = &msgs[i].msg_hdr;
+    memset(msg, 0, sizeof(struct msghdr));
+    msg->msg_name = &clients[i];
+    msg->msg_namelen = sizeof(struct sockaddr_storage);
+    msg->msg_iov = &iovecs[i];
+    msg->msg_iovlen = 1;
+    msg->msg_control = msg_control[i];
+    msg->msg_controllen = sizeof(msg_control[i]);
+  }
+
+  if (num_messages == 0) {
+    return -1;
+  }
+
+  num_received = recvmmsg(sock, msgs, (unsigned int)num_messages,
+                          MSG_DONTWAIT, NULL);
+  if (num_received < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      OC_ERR("recvmmsg returned with an error: %d", errno);
+    }
+    num_received = 0;
+  }
+
+  for (i = 0; i < num_received; i++) {
+    oc_message_t *message = messages[i];
+    struct msghdr *msg = &msgs[i].msg_hdr;
+
+    if (msg->msg_flags & MSG_TRUNC || msg->msg_flags & MSG_CTRUNC ||
+        parse_msg_pktinfo(msg, &message->endpoint, multicast) < 0) {
+      OC_ERR("dropping truncated or invalid datagram");
+      oc_message_unref(message);
+      continue;
+    }
+
+    message->length = (size_t)msgs[i].msg_len;
+    message->endpoint.flags = flags;
+
+#ifdef OC_DEBUG
+    PRINT("Incoming message of size %d bytes from ", (int)message->length);
+    PRINTipaddr(message->endpoint);
+    PRINT("\n\n");
+#endif /* OC_DEBUG */
+
+    messages[num_delivered++] = message;
+  }
+
+  for (i = num_received; i < num_messages; i++) {
+    oc_message_unref(messages[i]);
+  }
+
+  if (num_delivered > 0) {
+    oc_network_event_batch(messages, num_delivered);
+  }
+
+  if (num_messages < max_messages && num_received == num_messages) {
+    return -1;
+  }
+
+  return num_received;
+}
+
+static bool
+udp_has_pending_data(int sock)
+{
+  uint8_t dummy;
+  return recv(sock, &dummy, 1, MSG_PEEK | MSG_DONTWAIT) >= 0;
+}
+
+/* Drains the datagrams pending on a readable UDP socket. As the number of
+ * waiting datagrams is not known up front, buffers are taken from the pool
+ * for one datagram at first, and the batch only doubles, up to
+ * OC_UDP_RECV_BATCH_SIZE, while the previous one came back full and more
+ * data is waiting. This keeps a single datagram from tying up a batch worth
+ * of buffers in small static pools.
+ * Returns the number of datagrams received, or -1 if the message pool ran
+ * out before the socket was drained.
+ */
+static int
+receive_udp_socket(ip_context_t *dev, int sock, enum transport_flags flags)
+{
+  int batch = 1, total = 0;
+  while (dev->terminate != 1) {
+    int count = recv_msgs(dev, sock, flags, batch);
+    if (count < 0) {
+      return -1;
+    }
+    total += count;
+    if (count < batch || !udp_has_pending_data(sock)) {
+      break;
+    }
+    batch *= 2;
+    if (batch > OC_UDP_RECV_BATCH_SIZE) {
+      batch = OC_UDP_RECV_BATCH_SIZE;
+    }
+  }
+  return total;
+}
+
+#ifdef OC_EPOLL
+#define OC_MAX_EPOLL_EVENTS (16)
+
+static uint32_t
+get_source_events(const ip_event_source_t *source)
+{
+  /* Sessions also report when a connect completes or send space frees up */
+  if (source->type == IP_EVENT_SOURCE_TCP_SESSION) {
+    return EPOLLIN | EPOLLOUT | EPOLLET;
+  }
+  return EPOLLIN | EPOLLET;
+}
+
+int
+oc_ip_watch_event_source(ip_context_t *dev, ip_event_source_t *source)
+{
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = get_source_events(source);
+  event.data.ptr = source;
+
+  if (epoll_ctl(dev->epoll_fd, EPOLL_CTL_ADD, source->fd, &event) == -1) {
+    OC_ERR("adding fd %d to epoll set %d", source->fd, errno);
+    return -1;
+  }
+
+  return 0;
+}
+
+void
+oc_ip_unwatch_event_source(ip_context_t *dev, ip_event_source_t *source)
+{
+  if (epoll_ctl(dev->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL) == -1) {
+    OC_DBG("removing fd %d from epoll set %d", source->fd, errno);
+  }
+}
+
+/* Sources are edge-triggered, so a source that could not be drained (for
+ * instance because the message pool is exhausted) is re-armed. This reports
+ * it again on the next epoll_wait() if it is still readable.
+ */
+void
+oc_ip_rearm_event_source(ip_context_t *dev, ip_event_source_t *source)
+{
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = get_source_events(source);
+  event.data.ptr = source;
+
+  if (epoll_ctl(dev->epoll_fd, EPOLL_CTL_MOD, source->fd, &event) == -1) {
+    OC_ERR("re-arming fd %d in epoll set %d", source->fd, errno);
+  }
+}
+
+int
+oc_ip_add_event_source(ip_context_t *dev, ip_event_source_type_t type,
+                       int fd, enum transport_flags flags)
+{
+  if (dev->num_sources >= OC_MAX_IP_EVENT_SOURCES) {
+    OC_ERR("no free slot for event source of device %d", dev->device);
+    return -1;
+  }
+
+  ip_event_source_t *source = &dev->sources[dev->num_sources];
+  source->type = type;
+  source->fd = fd;
+  source->flags = flags;
+  source->data = NULL;
+
+  if (oc_ip_watch_event_source(dev, source) < 0) {
+    return -1;
+  }
+
+  dev->num_sources++;
+  return 0;
+}
+
+static int
+add_event_sources(ip_context_t *dev)
+{
+  int ret = 0;
+
+  /* Monitor network interface changes on the platform from only the 0th logical
+   * device
+   */
+  if (dev->device == 0) {
+    ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_IFCHANGE, ifchange_sock,
+                                  0);
+  }
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_SHUTDOWN,
+                                dev->shutdown_pipe[0], 0);
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_UDP, dev->server_sock,
+                                IPV6);
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_UDP, dev->mcast_sock,
+                                IPV6 | MULTICAST);
+#ifdef OC_SECURITY
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_UDP, dev->secure_sock,
+                                IPV6 | SECURED);
+#endif /* OC_SECURITY */
+
+#ifdef OC_IPV4
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_UDP, dev->server4_sock,
+                                IPV4);
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_UDP, dev->mcast4_sock,
+                                IPV4 | MULTICAST);
+#ifdef OC_SECURITY
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_UDP, dev->secure4_sock,
+                                IPV4 | SECURED);
+#endif /* OC_SECURITY */
+#endif /* OC_IPV4 */
+
+#ifdef OC_TCP
+  ret += oc_tcp_add_event_sources(dev);
+#endif /* OC_TCP */
+
   return ret;
 }
 
+static bool
+ifchange_has_pending_data(void)
+{
+  uint8_t dummy;
+  return recv(ifchange_sock, &dummy, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
+
+static void
+receive_udp_messages(ip_context_t *dev, ip_event_source_t *source)
+{
+  if (receive_udp_socket(dev, source->fd, source->flags) < 0) {
+    oc_ip_rearm_event_source(dev, source);
+  }
+}
+
 static void *
 network_event_thread(void *data)
 {
   ip_context_t *dev = (ip_context_t *)data;
+  struct epoll_event events[OC_MAX_EPOLL_EVENTS];
+  int i, n;
 
-  fd_set setfds;
+  while (dev->terminate != 1) {
+    n = epoll_wait(dev->epoll_fd, events, OC_MAX_EPOLL_EVENTS, -1);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      OC_ERR("epoll_wait returned with an error: %d", errno);
+      break;
+    }
+
+    for (i = 0; i < n && dev->terminate != 1; i++) {
+      ip_event_source_t *source = (ip_event_source_t *)events[i].data.ptr;
+
+      switch (source->type) {
+      case IP_EVENT_SOURCE_SHUTDOWN: {
+        char buf;
+        // write to pipe shall not block - so read the byte we wrote
+        if (read(source->fd, &buf, 1) < 0) {
+          // intentionally left blank
+        }
+      } break;
+      case IP_EVENT_SOURCE_IFCHANGE:
+        while (ifchange_has_pending_data()) {
+          if (process_interface_change_event() < 0) {
+            OC_WRN("caught errors while handling a network interface change");
+          }
+        }
+        break;
+      case IP_EVENT_SOURCE_UDP:
+        receive_udp_messages(dev, source);
+        break;
+#ifdef OC_TCP
+      case IP_EVENT_SOURCE_TCP_LISTENER:
+      case IP_EVENT_SOURCE_TCP_SIGNAL:
+      case IP_EVENT_SOURCE_TCP_IDLE_TIMER:
+      case IP_EVENT_SOURCE_TCP_SESSION:
+        oc_tcp_handle_event_source(dev, source);
+        break;
+#endif /* OC_TCP */
+      default:
+        break;
+      }
+    }
+
+#ifdef OC_TCP
+    oc_tcp_reap_sessions(dev);
+#endif /* OC_TCP */
+  }
+  pthread_exit(NULL);
+}
+#else /* OC_EPOLL */
+/* Filled in before the network thread starts, so that sessions the
+ * application opens right after oc_main_init() are not wiped out
+ */
+static void
+add_socks_to_fd_set(ip_context_t *dev)
+{
   FD_ZERO(&dev->rfds);
   /* Monitor network interface changes on the platform from only the 0th logical
    * device
@@ -784,12 +1094,27 @@ network_event_thread(void *data)
 #ifdef OC_TCP
   oc_tcp_add_socks_to_fd_set(dev);
 #endif /* OC_TCP */
+}
+
+static void *
+network_event_thread(void *data)
+{
+  ip_context_t *dev = (ip_context_t *)data;
 
+  fd_set setfds;
   int i, n;
 
   while (dev->terminate != 1) {
     setfds = dev->rfds;
+#ifdef OC_TCP
+    fd_set wsetfds = dev->tcp.wfds;
+    n = select(FD_SETSIZE, &setfds, &wsetfds, NULL, NULL);
+    if (n > 0) {
+      n -= oc_tcp_handle_writable_sessions(dev, &setfds, &wsetfds);
+    }
+#else  /* OC_TCP */
     n = select(FD_SETSIZE, &setfds, NULL, NULL, NULL);
+#endif /* !OC_TCP */
 
     if (FD_ISSET(dev->shutdown_pipe[0], &setfds)) {
       char buf;
@@ -814,145 +1139,84 @@ network_event_thread(void *data)
         }
       }
 
-      oc_message_t *message = oc_allocate_message();
-
-      if (!message) {
-        break;
-      }
-
-      message->endpoint.device = dev->device;
-
       if (FD_ISSET(dev->server_sock, &setfds)) {
-        int count = recv_msg(dev->server_sock, message->data, OC_PDU_SIZE,
-                             &message->endpoint, false);
-        if (count < 0) {
-          oc_message_unref(message);
-          continue;
-        }
-        message->length = (size_t)count;
-        message->endpoint.flags = IPV6;
         FD_CLR(dev->server_sock, &setfds);
-        goto common;
+        if (receive_udp_socket(dev, dev->server_sock, IPV6) < 0) {
+          break;
+        }
+        continue;
       }
 
       if (FD_ISSET(dev->mcast_sock, &setfds)) {
-        int count = recv_msg(dev->mcast_sock, message->data, OC_PDU_SIZE,
-                             &message->endpoint, true);
-        if (count < 0) {
-          oc_message_unref(message);
-          continue;
-        }
-        message->length = (size_t)count;
-        message->endpoint.flags = IPV6 | MULTICAST;
         FD_CLR(dev->mcast_sock, &setfds);
-        goto common;
+        if (receive_udp_socket(dev, dev->mcast_sock, IPV6 | MULTICAST) < 0) {
+          break;
+        }
+        continue;
       }
 
 #ifdef OC_IPV4
       if (FD_ISSET(dev->server4_sock, &setfds)) {
-        int count = recv_msg(dev->server4_sock, message->data, OC_PDU_SIZE,
-                             &message->endpoint, false);
-        if (count < 0) {
-          oc_message_unref(message);
-          continue;
-        }
-        message->length = (size_t)count;
-        message->endpoint.flags = IPV4;
         FD_CLR(dev->server4_sock, &setfds);
-        goto common;
+        if (receive_udp_socket(dev, dev->server4_sock, IPV4) < 0) {
+          break;
+        }
+        continue;
       }
 
       if (FD_ISSET(dev->mcast4_sock, &setfds)) {
-        int count = recv_msg(dev->mcast4_sock, message->data, OC_PDU_SIZE,
-                             &message->endpoint, true);
-        if (count < 0) {
-          oc_message_unref(message);
-          continue;
-        }
-        message->length = (size_t)count;
-        message->endpoint.flags = IPV4 | MULTICAST;
         FD_CLR(dev->mcast4_sock, &setfds);
-        goto common;
+        if (receive_udp_socket(dev, dev->mcast4_sock, IPV4 | MULTICAST) < 0) {
+          break;
+        }
+        continue;
       }
 #endif /* OC_IPV4 */
 
 #ifdef OC_SECURITY
       if (FD_ISSET(dev->secure_sock, &setfds)) {
-        int count = recv_msg(dev->secure_sock, message->data, OC_PDU_SIZE,
-                             &message->endpoint, false);
-        if (count < 0) {
-          oc_message_unref(message);
-          continue;
-        }
-        message->length = (size_t)count;
-        message->endpoint.flags = IPV6 | SECURED;
         FD_CLR(dev->secure_sock, &setfds);
-        goto common;
+        if (receive_udp_socket(dev, dev->secure_sock, IPV6 | SECURED) < 0) {
+          break;
+        }
+        continue;
       }
 #ifdef OC_IPV4
       if (FD_ISSET(dev->secure4_sock, &setfds)) {
-        int count = recv_msg(dev->secure4_sock, message->data, OC_PDU_SIZE,
-                             &message->endpoint, false);
-        if (count < 0) {
-          oc_message_unref(message);
-          continue;
-        }
-        message->length = (size_t)count;
-        message->endpoint.flags = IPV4 | SECURED;
         FD_CLR(dev->secure4_sock, &setfds);
-        goto common;
+        if (receive_udp_socket(dev, dev->secure4_sock, IPV4 | SECURED) < 0) {
+          break;
+        }
+        continue;
       }
 #endif /* OC_IPV4 */
 #endif /* OC_SECURITY */
 
 #ifdef OC_TCP
-      tcp_receive_state_t tcp_status = oc_tcp_receive_message(dev,
-                                                              &setfds,
-                                                              message);
-      if (tcp_status == TCP_STATUS_RECEIVE) {
-        goto common;
-      } else {
-        oc_message_unref(message);
-        continue;
-      }
+      /* Received frames are handed to the stack by the TCP adapter */
+      oc_tcp_receive_message(dev, &setfds);
 #endif /* OC_TCP */
-
-    common:
-#ifdef OC_DEBUG
-      PRINT("Incoming message of size %d bytes from ", message->length);
-      PRINTipaddr(message->endpoint);
-      PRINT("\n\n");
-#endif /* OC_DEBUG */
-
-      oc_network_event(message);
     }
   }
   pthread_exit(NULL);
 }
+#endif /* !OC_EPOLL */
 
-int
-send_msg(int sock, struct sockaddr_storage *receiver, oc_message_t *message)
+/* Selects the outgoing interface and the source address of a unicast
+ * datagram through IPV6_PKTINFO/IP_PKTINFO ancillary data.
+ */
+static int
+set_msg_pktinfo(struct msghdr *msg, char *msg_control, oc_message_t *message)
 {
-  char msg_control[CMSG_LEN(sizeof(struct sockaddr_storage))];
-  struct iovec iovec[1];
-  struct msghdr msg;
-
-  memset(&msg, 0, sizeof(struct msghdr));
-  msg.msg_name = (void *)receiver;
-  msg.msg_namelen = sizeof(struct sockaddr_storage);
-
-  msg.msg_iov = iovec;
-  msg.msg_iovlen = 1;
-
   if (message->endpoint.flags & IPV6) {
     struct cmsghdr *cmsg;
     struct in6_pktinfo *pktinfo;
 
-    msg.msg_control = msg_control;
-    msg.msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
-    memset(msg.msg_control, 0, msg.msg_controllen);
+    msg->msg_control = msg_control;
+    msg->msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
+    memset(msg->msg_control, 0, msg->msg_controllen);
 
-    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg = CMSG_FIRSTHDR(msg);
     cmsg->cmsg_level = IPPROTO_IPV6;
     cmsg->cmsg_type = IPV6_PKTINFO;
     cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
@@ -972,11 +1236,11 @@ send_msg(int sock, struct sockaddr_storage *receiver, oc_message_t *message)
     struct cmsghdr *cmsg;
     struct in_pktinfo *pktinfo;
 
-    msg.msg_control = msg_control;
-    msg.msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
-    memset(msg.msg_control, 0, msg.msg_controllen);
+    msg->msg_control = msg_control;
+    msg->msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
+    memset(msg->msg_control, 0, msg->msg_controllen);
 
-    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg = CMSG_FIRSTHDR(msg);
     cmsg->cmsg_level = SOL_IP;
     cmsg->cmsg_type = IP_PKTINFO;
     cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
@@ -995,6 +1259,27 @@ send_msg(int sock, struct sockaddr_storage *receiver, oc_message_t *message)
   }
 #endif /* !OC_IPV4 */
 
+  return 0;
+}
+
+int
+send_msg(int sock, struct sockaddr_storage *receiver, oc_message_t *message)
+{
+  char msg_control[CMSG_LEN(sizeof(struct sockaddr_storage))];
+  struct iovec iovec[1];
+  struct msghdr msg;
+
+  memset(&msg, 0, sizeof(struct msghdr));
+  msg.msg_name = (void *)receiver;
+  msg.msg_namelen = sizeof(struct sockaddr_storage);
+
+  msg.msg_iov = iovec;
+  msg.msg_iovlen = 1;
+
+  if (set_msg_pktinfo(&msg, msg_control, message) < 0) {
+    return -1;
+  }
+
   int bytes_sent = 0, x;
   while (bytes_sent < (int)message->length) {
     iovec[0].iov_base = message->data + bytes_sent;
@@ -1015,20 +1300,13 @@ send_msg(int sock, struct sockaddr_storage *receiver, oc_message_t *message)
   return bytes_sent;
 }
 
-int
-oc_send_buffer(oc_message_t *message)
+static void
+get_receiver(oc_message_t *message, struct sockaddr_storage *receiver)
 {
-#ifdef OC_DEBUG
-  PRINT("Outgoing message of size %d bytes to ", message->length);
-  PRINTipaddr(message->endpoint);
-  PRINT("\n\n");
-#endif /* OC_DEBUG */
-
-  struct sockaddr_storage receiver;
-  memset(&receiver, 0, sizeof(struct sockaddr_storage));
+  memset(receiver, 0, sizeof(struct sockaddr_storage));
 #ifdef OC_IPV4
   if (message->endpoint.flags & IPV4) {
-    struct sockaddr_in *r = (struct sockaddr_in *)&receiver;
+    struct sockaddr_in *r = (struct sockaddr_in *)receiver;
     memcpy(&r->sin_addr.s_addr, message->endpoint.addr.ipv4.address,
            sizeof(r->sin_addr.s_addr));
     r->sin_family = AF_INET;
@@ -1037,22 +1315,20 @@ oc_send_buffer(oc_message_t *message)
 #else
   {
 #endif
-    struct sockaddr_in6 *r = (struct sockaddr_in6 *)&receiver;
+    struct sockaddr_in6 *r = (struct sockaddr_in6 *)receiver;
     memcpy(r->sin6_addr.s6_addr, message->endpoint.addr.ipv6.address,
            sizeof(r->sin6_addr.s6_addr));
     r->sin6_family = AF_INET6;
     r->sin6_port = htons(message->endpoint.addr.ipv6.port);
     r->sin6_scope_id = message->endpoint.addr.ipv6.scope;
   }
-  int send_sock = -1;
-
-  ip_context_t *dev = get_ip_context_for_device(message->endpoint.device);
+}
 
-#ifdef OC_TCP
-  if (message->endpoint.flags & TCP) {
-    return oc_tcp_send_buffer(dev, message, &receiver);
-  }
-#endif /* OC_TCP */
+static int
+get_send_sock(ip_context_t *dev, oc_message_t *message)
+{
+  (void)message;
+  int send_sock = -1;
 
 #ifdef OC_SECURITY
   if (message->endpoint.flags & SECURED) {
@@ -1079,9 +1355,135 @@ oc_send_buffer(oc_message_t *message)
   }
 #endif /* !OC_IPV4 */
 
-  return send_msg(send_sock, &receiver, message);
+  return send_sock;
+}
+
+int
+oc_send_buffer(oc_message_t *message)
+{
+#ifdef OC_DEBUG
+  PRINT("Outgoing message of size %d bytes to ", (int)message->length);
+  PRINTipaddr(message->endpoint);
+  PRINT("\n\n");
+#endif /* OC_DEBUG */
+
+  struct sockaddr_storage receiver;
+  get_receiver(message, &receiver);
+
+  ip_context_t *dev = get_ip_context_for_device(message->endpoint.device);
+
+#ifdef OC_TCP
+  if (message->endpoint.flags & TCP) {
+    return oc_tcp_send_buffer(dev, message, &receiver);
+  }
+#endif /* OC_TCP */
+
+  return send_msg(get_send_sock(dev, message), &receiver, message);
 }
 
+#ifdef OC_SEND_BATCH_SIZE
+/* Returns the number of datagrams from the start of msgs that are done with,
+ * either sent or dropped after a hard error. A smaller count than num_msgs
+ * means the socket would block and the rest should be offered again later.
+ */
+static int
+send_msgs(int sock, struct mmsghdr *msgs, int num_msgs)
+{
+  int num_sent = 0, offset = 0;
+  while (offset < num_msgs) {
+    int ret = sendmmsg(sock, msgs + offset, (unsigned int)(num_msgs - offset), 0);
+    if (ret < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+        OC_WRN("sendmmsg() would block; deferring %d datagrams",
+               num_msgs - offset);
+        break;
+      }
+      /* The datagram at offset could not be sent; skip past it */
+      OC_WRN("sendmmsg() returned errno %d", errno);
+      offset++;
+      continue;
+    }
+    num_sent += ret;
+    offset += ret;
+  }
+  OC_DBG("Sent %d datagrams with sendmmsg()", num_sent);
+  return offset;
+}
+
+int
+oc_send_buffers(oc_message_t **messages, int num_messages)
+{
+  struct mmsghdr msgs[OC_SEND_BATCH_SIZE];
+  struct iovec iovecs[OC_SEND_BATCH_SIZE];
+  struct sockaddr_storage receivers[OC_SEND_BATCH_SIZE];
+  char msg_control[OC_SEND_BATCH_SIZE]
+                  [CMSG_LEN(sizeof(struct sockaddr_storage))];
+  /* Index in messages of the message behind each entry of msgs */
+  int msg_index[OC_SEND_BATCH_SIZE];
+  int i, num_msgs = 0, num_done, send_sock = -1;
+
+  for (i = 0; i < num_messages; i++) {
+    oc_message_t *message = messages[i];
+
+#ifdef OC_TCP
+    if (message->endpoint.flags & TCP) {
+      oc_send_buffer(message);
+      continue;
+    }
+#endif /* OC_TCP */
+
+    ip_context_t *dev = get_ip_context_for_device(message->endpoint.device);
+    if (!dev) {
+      continue;
+    }
+    int sock = get_send_sock(dev, message);
+
+    /* Consecutive datagrams leaving through the same socket share one
+     * sendmmsg() call.
+     */
+    if (num_msgs > 0 && (sock != send_sock || num_msgs == OC_SEND_BATCH_SIZE)) {
+      num_done = send_msgs(send_sock, msgs, num_msgs);
+      if (num_done < num_msgs) {
+        return msg_index[num_done];
+      }
+      num_msgs = 0;
+    }
+    send_sock = sock;
+
+#ifdef OC_DEBUG
+    PRINT("Outgoing message of size %d bytes to ", (int)message->length);
+    PRINTipaddr(message->endpoint);
+    PRINT("\n\n");
+#endif /* OC_DEBUG */
+
+    struct msghdr *msg = &msgs[num_msgs].msg_hdr;
+    memset(msg, 0, sizeof(struct msghdr));
+    get_receiver(message, &receivers[num_msgs]);
+    msg->msg_name = &receivers[num_msgs];
+    msg->msg_namelen = sizeof(struct sockaddr_storage);
+    iovecs[num_msgs].iov_base = message->data;
+    iovecs[num_msgs].iov_len = message->length;
+    msg->msg_iov = &iovecs[num_msgs];
+    msg->msg_iovlen = 1;
+    if (set_msg_pktinfo(msg, msg_control[num_msgs], message) < 0) {
+      continue;
+    }
+    msgs[num_msgs].msg_len = 0;
+    msg_index[num_msgs] = i;
+    num_msgs++;
+  }
+
+  if (num_msgs > 0) {
+    num_done = send_msgs(send_sock, msgs, num_msgs);
+    if (num_done < num_msgs) {
+      return msg_index[num_done];
+    }
+  }
+
+  return num_messages;
+}
+#endif /* OC_SEND_BATCH_SIZE */
+
 #ifdef OC_CLIENT
 void
 oc_send_discovery_request(oc_message_t *message)
@@ -1378,6 +1780,15 @@ int oc_connectivity_init(int device) {
     return -1;
   }
 
+#ifdef OC_EPOLL
+  dev->num_sources = 0;
+  dev->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (dev->epoll_fd < 0) {
+    OC_ERR("creating epoll instance %d", errno);
+    return -1;
+  }
+#endif /* OC_EPOLL */
+
   memset(&dev->mcast, 0, sizeof(struct sockaddr_storage));
   memset(&dev->server, 0, sizeof(struct sockaddr_storage));
 
@@ -1547,6 +1958,15 @@ int oc_connectivity_init(int device) {
     ifchange_initialized = true;
   }
 
+#ifdef OC_EPOLL
+  if (add_event_sources(dev) < 0) {
+    OC_ERR("registering sockets with the network event thread");
+    return -1;
+  }
+#else  /* OC_EPOLL */
+  add_socks_to_fd_set(dev);
+#endif /* !OC_EPOLL */
+
   if (pthread_create(&dev->event_thread, NULL, &network_event_thread, dev) !=
       0) {
     OC_ERR("creating network polling thread");
@@ -1566,6 +1986,8 @@ oc_connectivity_shutdown(int device)
   if (write(dev->shutdown_pipe[1], "\n", 1) < 0) {
       OC_WRN("cannot wakeup network thread");
   }
+  /* The thread may be reading TCP sessions until it sees terminate */
+  pthread_join(dev->event_thread, NULL);
 
   close(dev->server_sock);
   close(dev->mcast_sock);
@@ -1586,11 +2008,13 @@ oc_connectivity_shutdown(int device)
   oc_tcp_connectivity_shutdown(dev);
 #endif /* OC_TCP */
 
-  pthread_join(dev->event_thread, NULL);
-
   close(dev->shutdown_pipe[1]);
   close(dev->shutdown_pipe[0]);
 
+#ifdef OC_EPOLL
+  close(dev->epoll_fd);
+#endif /* OC_EPOLL */
+
   free_endpoints_list(dev);
 
   oc_list_remove(ip_contexts, dev);
@@ -21,9 +21,36 @@
 
 #include "oc_endpoint.h"
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/socket.h>
 
+#ifdef OC_EPOLL
+typedef enum {
+  IP_EVENT_SOURCE_SHUTDOWN = 0,
+  IP_EVENT_SOURCE_IFCHANGE,
+  IP_EVENT_SOURCE_UDP,
+  IP_EVENT_SOURCE_TCP_LISTENER,
+  IP_EVENT_SOURCE_TCP_SIGNAL,
+  IP_EVENT_SOURCE_TCP_IDLE_TIMER,
+  IP_EVENT_SOURCE_TCP_SESSION
+} ip_event_source_type_t;
+
+/* Dispatch record registered with epoll for every descriptor monitored by
+ * the network event thread. The endpoint flags are applied to messages read
+ * from UDP sockets and to sessions accepted on TCP listeners.
+ */
+typedef struct ip_event_source_t
+{
+  ip_event_source_type_t type;
+  int fd;
+  enum transport_flags flags;
+  void *data;
+} ip_event_source_t;
+
+#define OC_MAX_IP_EVENT_SOURCES (12)
+#endif /* OC_EPOLL */
+
 #ifdef OC_TCP
 typedef struct tcp_context_t {
   struct sockaddr_storage server;
@@ -45,7 +72,16 @@ typedef struct tcp_context_t {
 #endif /* OC_SECURITY */
 #endif /* OC_IPV4 */
   int connect_pipe[2];
+  int idle_timer; /* timerfd that reaps idle sessions, or -1 */
   pthread_mutex_t mutex;
+  struct ip_context_t *rx_waiting_next; /* see wait_for_receive_buffer() */
+  bool rx_waiting;
+#ifdef OC_EPOLL
+  bool reap_sessions;
+#else  /* OC_EPOLL */
+  fd_set wfds; /* sessions that are connecting or have data to write */
+  int ready_fd; /* where the scan for ready sessions resumes this wakeup */
+#endif /* !OC_EPOLL */
 } tcp_context_t;
 #endif
 
@@ -82,6 +118,22 @@ typedef struct ip_context_t {
   int device;
   fd_set rfds;
   int shutdown_pipe[2];
+#ifdef OC_EPOLL
+  int epoll_fd;
+  ip_event_source_t sources[OC_MAX_IP_EVENT_SOURCES];
+  int num_sources;
+#endif /* OC_EPOLL */
 } ip_context_t;
 
+#ifdef OC_EPOLL
+int oc_ip_add_event_source(ip_context_t *dev, ip_event_source_type_t type,
+                           int fd, enum transport_flags flags);
+
+int oc_ip_watch_event_source(ip_context_t *dev, ip_event_source_t *source);
+
+void oc_ip_unwatch_event_source(ip_context_t *dev, ip_event_source_t *source);
+
+void oc_ip_rearm_event_source(ip_context_t *dev, ip_event_source_t *source);
+#endif /* OC_EPOLL */
+
 #endif /* IPCONTEXT_H */
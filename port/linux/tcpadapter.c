@@ -24,6 +24,7 @@
 #include "oc_endpoint.h"
 #include "oc_session_events.h"
 #include "port/oc_assert.h"
+#include "util/oc_hash.h"
 #include "util/oc_memb.h"
 #include <arpa/inet.h>
 #include <assert.h>
@@ -31,32 +32,104 @@
 #include <fcntl.h>
 #include <ifaddrs.h>
 #include <net/if.h>
+#include <netinet/tcp.h>
 #include <stdlib.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef OC_TCP
 
+#ifdef OC_DYNAMIC_ALLOCATION
+#define OC_TCP_LISTEN_BACKLOG SOMAXCONN
+#else /* OC_DYNAMIC_ALLOCATION */
 #define OC_TCP_LISTEN_BACKLOG 3
+#endif /* !OC_DYNAMIC_ALLOCATION */
 
 #define TLS_HEADER_SIZE 5
 
-#define DEFAULT_RECEIVE_SIZE                                                   \
-  (COAP_TCP_DEFAULT_HEADER_LEN + COAP_TCP_MAX_EXTENDED_LENGTH_LEN)
-
-#define LIMIT_RETRY_CONNECT 5
-
-#define TCP_CONNECT_TIMEOUT 5
+/* SYN retransmissions before a connect gives up, after about 7 seconds */
+#define TCP_CONNECT_SYN_RETRIES 2
+
+/* Number of message buffers a session may fill with data waiting to be
+ * written. Messages that do not fit are refused rather than blocking.
+ */
+#ifndef OC_TCP_SEND_QUEUE_LEN
+#define OC_TCP_SEND_QUEUE_LEN (2)
+#endif /* OC_TCP_SEND_QUEUE_LEN */
+
+/* Message buffers that sessions receive into, shared by all of them. Each
+ * session reassembles at most one frame at a time; the others carry frames
+ * to the event loop. TCP peers draw on this pool alone, so they cannot use up
+ * the buffers UDP receives into.
+ */
+#ifndef OC_TCP_RECEIVE_BUFFERS
+#define OC_TCP_RECEIVE_BUFFERS (2 * OC_MAX_TCP_PEERS)
+#endif /* OC_TCP_RECEIVE_BUFFERS */
+
+/* Seconds a session may go without exchanging any data before it is closed,
+ * or 0 to keep idle sessions open. A single timer per device checks all of
+ * its sessions every half timeout.
+ */
+#ifndef OC_TCP_SESSION_IDLE_TIMEOUT
+#define OC_TCP_SESSION_IDLE_TIMEOUT (0)
+#endif /* OC_TCP_SESSION_IDLE_TIMEOUT */
 
 typedef struct tcp_session
 {
   struct tcp_session *next;
   ip_context_t *dev;
   oc_endpoint_t endpoint;
+  oc_hash_link_t endpoint_link;
   int sock;
+  time_t last_active; /* monotonic seconds of the last data exchanged */
+  oc_message_t *rx_message; /* frame being reassembled, if any */
+  size_t rx_frame_length;   /* its length, 0 until its header has arrived */
+  bool rx_stalled;          /* waits for a free receive buffer */
+  OC_LIST_STRUCT(tx_queue); /* messages waiting to be written */
+  size_t tx_offset;         /* bytes of the first one already written */
+  bool connecting;
+#ifdef OC_EPOLL
+  ip_event_source_t source;
+  bool closing;
+#endif /* OC_EPOLL */
 } tcp_session_t;
 
+typedef enum {
+  SESSION_RECEIVED = 0, /* bytes were read, more may be waiting */
+  SESSION_DRAINED,      /* the socket has nothing more to read */
+  SESSION_NO_BUFFER,    /* the receive buffer pool is exhausted */
+  SESSION_CLOSED        /* the session has been freed */
+} session_read_status_t;
+
 OC_LIST(session_list);
 OC_MEMB(tcp_session_s, tcp_session_t, OC_MAX_TCP_PEERS);
+OC_MEMB(tcp_send_buffers_s, oc_message_t,
+        OC_MAX_TCP_PEERS * OC_TCP_SEND_QUEUE_LEN);
+OC_MEMB_FIXED(tcp_receive_buffers_s, oc_message_t, OC_TCP_RECEIVE_BUFFERS);
+/* Devices whose sessions wait for a receive buffer. Buffers are freed on
+ * whichever thread drops the last reference, so this has its own lock.
+ */
+static pthread_mutex_t rx_wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ip_context_t *rx_waiting_devs;
+/* Sessions are also indexed by peer endpoint for sends, and in select mode
+ * by socket for the descriptors select() reports, so neither path walks
+ * every session.
+ */
+OC_HASH(sessions_by_endpoint, 16);
+#ifndef OC_EPOLL
+static tcp_session_t *sessions_by_fd[FD_SETSIZE];
+static int session_fd_limit; /* one past the highest session socket seen */
+#endif /* !OC_EPOLL */
+
+static time_t
+session_clock(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec;
+}
 
 static int
 configure_tcp_socket(int sock, struct sockaddr_storage *sock_info)
@@ -138,6 +211,17 @@ get_interface_index(int sock)
   return interface_index;
 }
 
+static int
+set_nonblocking(int sock)
+{
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags < 0) {
+    return -1;
+  }
+  return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+}
+
+#ifndef OC_EPOLL
 void
 oc_tcp_add_socks_to_fd_set(ip_context_t *dev)
 {
@@ -153,36 +237,150 @@ oc_tcp_add_socks_to_fd_set(ip_context_t *dev)
 #endif /* OC_SECURITY */
 #endif /* OC_IPV4 */
   FD_SET(dev->tcp.connect_pipe[0], &dev->rfds);
+  if (dev->tcp.idle_timer >= 0) {
+    FD_SET(dev->tcp.idle_timer, &dev->rfds);
+  }
 }
+#endif /* !OC_EPOLL */
 
 static void
-free_tcp_session(tcp_session_t *session)
+signal_network_thread(ip_context_t *dev)
 {
-  oc_session_end_event(&session->endpoint);
-
-  FD_CLR(session->sock, &session->dev->rfds);
-
   ssize_t len = 0;
   do {
     uint8_t dummy_value = 0xef;
-    len = write(session->dev->tcp.connect_pipe[1], &dummy_value, 1);
+    len = write(dev->tcp.connect_pipe[1], &dummy_value, 1);
   } while (len == -1 && errno == EINTR);
+}
+
+/* Called whenever a receive buffer returns to the pool */
+static void
+receive_buffers_available(int num_free)
+{
+  (void)num_free;
+  pthread_mutex_lock(&rx_wait_mutex);
+  while (rx_waiting_devs) {
+    ip_context_t *dev = rx_waiting_devs;
+    rx_waiting_devs = dev->tcp.rx_waiting_next;
+    dev->tcp.rx_waiting = false;
+    signal_network_thread(dev);
+  }
+  pthread_mutex_unlock(&rx_wait_mutex);
+}
+
+/* Parks a session that found the receive pool empty. Its socket is not
+ * polled again until a buffer is freed, so the network thread sleeps rather
+ * than retrying.
+ */
+static void
+wait_for_receive_buffer(tcp_session_t *session)
+{
+  ip_context_t *dev = session->dev;
+  session->rx_stalled = true;
+#ifndef OC_EPOLL
+  FD_CLR(session->sock, &dev->rfds);
+#endif /* !OC_EPOLL */
+  pthread_mutex_lock(&rx_wait_mutex);
+  if (!dev->tcp.rx_waiting) {
+    dev->tcp.rx_waiting = true;
+    dev->tcp.rx_waiting_next = rx_waiting_devs;
+    rx_waiting_devs = dev;
+  }
+  pthread_mutex_unlock(&rx_wait_mutex);
+  /* A buffer freed before the device was listed would go unnoticed */
+  if (oc_memb_numfree(&tcp_receive_buffers_s) > 0) {
+    receive_buffers_available(0);
+  }
+}
+
+static oc_message_t *
+allocate_receive_buffer(tcp_session_t *session)
+{
+  oc_message_t *message =
+    oc_allocate_message_from_pool(&tcp_receive_buffers_s);
+  if (!message) {
+    OC_WRN("out of TCP receive buffers");
+    wait_for_receive_buffer(session);
+  }
+  return message;
+}
+
+static void
+free_tcp_session(tcp_session_t *session)
+{
+  if (!session->connecting) {
+    oc_session_end_event(&session->endpoint);
+  } else {
+    oc_session_connect_failed_event(&session->endpoint);
+  }
+
+#ifdef OC_EPOLL
+  if (!session->closing) {
+    oc_ip_unwatch_event_source(session->dev, &session->source);
+  }
+#else  /* OC_EPOLL */
+  FD_CLR(session->sock, &session->dev->rfds);
+  FD_CLR(session->sock, &session->dev->tcp.wfds);
+  sessions_by_fd[session->sock] = NULL;
+  if (session->sock + 1 == session_fd_limit) {
+    while (session_fd_limit > 0 && !sessions_by_fd[session_fd_limit - 1]) {
+      session_fd_limit--;
+    }
+  }
+
+  signal_network_thread(session->dev);
+#endif /* !OC_EPOLL */
 
   close(session->sock);
 
+  if (session->rx_message) {
+    oc_message_unref(session->rx_message);
+  }
+
+  oc_message_t *message;
+  while ((message = (oc_message_t *)oc_list_pop(session->tx_queue)) != NULL) {
+    oc_message_unref(message);
+  }
+
+  oc_hash_remove(&sessions_by_endpoint, &session->endpoint_link);
   oc_list_remove(session_list, session);
   oc_memb_free(&tcp_session_s, session);
 
   OC_DBG("freed TCP session");
 }
 
-static int
-add_new_session(int sock, ip_context_t *dev, oc_endpoint_t *endpoint)
+/* Closes a session from the receive path. With epoll the network thread may
+ * still hold a reference to it from its current batch of events, so the
+ * session is only released when it reaps closed sessions.
+ */
+static void
+close_session(tcp_session_t *session)
 {
+#ifdef OC_EPOLL
+  oc_ip_unwatch_event_source(session->dev, &session->source);
+  session->closing = true;
+  session->dev->tcp.reap_sessions = true;
+  signal_network_thread(session->dev);
+#else  /* OC_EPOLL */
+  free_tcp_session(session);
+#endif /* !OC_EPOLL */
+}
+
+static tcp_session_t *
+add_new_session(int sock, ip_context_t *dev, oc_endpoint_t *endpoint,
+                bool connecting)
+{
+#ifndef OC_EPOLL
+  if (sock >= FD_SETSIZE) {
+    OC_ERR("TCP session socket %d is beyond the reach of select()", sock);
+    return NULL;
+  }
+#endif /* !OC_EPOLL */
+
   tcp_session_t *session = oc_memb_alloc(&tcp_session_s);
   if (!session) {
     OC_ERR("could not allocate new TCP session object");
-    return -1;
+    return NULL;
   }
 
   endpoint->interface_index = get_interface_index(sock);
@@ -191,16 +389,42 @@ add_new_session(int sock, ip_context_t *dev, oc_endpoint_t *endpoint)
   memcpy(&session->endpoint, endpoint, sizeof(oc_endpoint_t));
   session->endpoint.next = NULL;
   session->sock = sock;
+  session->last_active = session_clock();
+  session->rx_message = NULL;
+  session->rx_frame_length = 0;
+  session->rx_stalled = false;
+  OC_LIST_STRUCT_INIT(session, tx_queue);
+  session->tx_offset = 0;
+  session->connecting = connecting;
+
+#ifdef OC_EPOLL
+  session->closing = false;
+  session->source.type = IP_EVENT_SOURCE_TCP_SESSION;
+  session->source.fd = sock;
+  session->source.flags = endpoint->flags;
+  session->source.data = session;
+  if (oc_ip_watch_event_source(dev, &session->source) < 0) {
+    oc_memb_free(&tcp_session_s, session);
+    return NULL;
+  }
+#else  /* OC_EPOLL */
+  sessions_by_fd[sock] = session;
+  if (sock >= session_fd_limit) {
+    session_fd_limit = sock + 1;
+  }
+#endif /* !OC_EPOLL */
 
   oc_list_add(session_list, session);
+  oc_hash_add(&sessions_by_endpoint, &session->endpoint_link,
+              oc_endpoint_hash(&session->endpoint));
 
-  if (!(endpoint->flags & SECURED)) {
+  if (!connecting && !(endpoint->flags & SECURED)) {
     oc_session_start_event((oc_endpoint_t *)endpoint);
   }
 
   OC_DBG("recorded new TCP session");
 
-  return 0;
+  return session;
 }
 
 static int
@@ -212,7 +436,9 @@ accept_new_session(ip_context_t *dev, int fd, fd_set *setfds,
 
   int new_socket = accept(fd, (struct sockaddr *)&receive_from, &receive_len);
   if (new_socket < 0) {
-    OC_ERR("failed to accept incoming TCP connection");
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      OC_ERR("failed to accept incoming TCP connection");
+    }
     return -1;
   }
   OC_DBG("accepted incomming TCP connection");
@@ -232,15 +458,19 @@ accept_new_session(ip_context_t *dev, int fd, fd_set *setfds,
 #endif /* !OC_IPV4 */
   }
 
-  FD_CLR(fd, setfds);
+  if (setfds) {
+    FD_CLR(fd, setfds);
+  }
 
-  if (add_new_session(new_socket, dev, endpoint) < 0) {
+  if (!add_new_session(new_socket, dev, endpoint, false)) {
     OC_ERR("could not record new TCP session");
     close(new_socket);
     return -1;
   }
 
+#ifndef OC_EPOLL
   FD_SET(new_socket, &dev->rfds);
+#endif /* !OC_EPOLL */
 
   return 0;
 }
@@ -248,10 +478,20 @@ accept_new_session(ip_context_t *dev, int fd, fd_set *setfds,
 static tcp_session_t *
 find_session_by_endpoint(oc_endpoint_t *endpoint)
 {
-  tcp_session_t *session = oc_list_head(session_list);
-  while (session != NULL &&
-         oc_endpoint_compare(&session->endpoint, endpoint) != 0) {
-    session = session->next;
+  tcp_session_t *session = NULL;
+  oc_hash_link_t *link =
+    oc_hash_lookup(&sessions_by_endpoint, oc_endpoint_hash(endpoint));
+  while (link) {
+    session = oc_hash_entry(link, tcp_session_t, endpoint_link);
+    if (oc_endpoint_compare(&session->endpoint, endpoint) == 0
+#ifdef OC_EPOLL
+        && !session->closing
+#endif /* OC_EPOLL */
+        ) {
+      break;
+    }
+    session = NULL;
+    link = oc_hash_next(link);
   }
 
   if (!session) {
@@ -270,19 +510,39 @@ find_session_by_endpoint(oc_endpoint_t *endpoint)
   return session;
 }
 
+#ifndef OC_EPOLL
+/* Returns the next session of dev whose socket is in fds. The scan picks up
+ * after the last session returned, so one wakeup walks fds only once.
+ */
 static tcp_session_t *
-get_ready_to_read_session(fd_set *setfds)
+get_ready_session(ip_context_t *dev, fd_set *fds)
 {
-  tcp_session_t *session = oc_list_head(session_list);
-  while (session != NULL && !FD_ISSET(session->sock, setfds)) {
-    session = session->next;
+  for (; dev->tcp.ready_fd < session_fd_limit; dev->tcp.ready_fd++) {
+    int fd = dev->tcp.ready_fd;
+    tcp_session_t *session = sessions_by_fd[fd];
+    if (session && session->dev == dev && FD_ISSET(fd, fds)) {
+      dev->tcp.ready_fd++;
+      return session;
+    }
   }
+  return NULL;
+}
+#endif /* !OC_EPOLL */
 
-  if (!session) {
-    OC_ERR("could not find any open ready-to-read session");
-    return NULL;
+/* Number of leading bytes of a frame that carry its length */
+static size_t
+get_header_length(const uint8_t *data, oc_endpoint_t *endpoint)
+{
+  if (endpoint->flags & SECURED) {
+    return TLS_HEADER_SIZE;
   }
-  return session;
+  uint8_t tcp_len =
+    (COAP_TCP_HEADER_LEN_MASK & data[0]) >> COAP_TCP_HEADER_LEN_POSITION;
+  if (tcp_len < COAP_TCP_EXTENDED_LENGTH_1) {
+    return COAP_TCP_DEFAULT_HEADER_LEN;
+  }
+  return COAP_TCP_DEFAULT_HEADER_LEN +
+         (1 << (tcp_len - COAP_TCP_EXTENDED_LENGTH_1));
 }
 
 static size_t
@@ -300,9 +560,192 @@ get_total_length_from_header(oc_message_t *message, oc_endpoint_t *endpoint)
   return total_length;
 }
 
+static size_t
+get_message_capacity(oc_message_t *message)
+{
+#ifdef OC_DYNAMIC_ALLOCATION
+  return message->data_size;
+#else  /* OC_DYNAMIC_ALLOCATION */
+  (void)message;
+  return OC_PDU_SIZE;
+#endif /* !OC_DYNAMIC_ALLOCATION */
+}
+
+/* Moves every frame completed in the session's receive buffer to the frames
+ * list. Bytes past the end of a frame start the next one in a new message.
+ */
+static session_read_status_t
+split_session_frames(tcp_session_t *session, oc_message_t ***frames)
+{
+  oc_message_t *message = session->rx_message;
+  while (message && message->length > 0) {
+    if (session->rx_frame_length == 0) {
+      if (message->length < get_header_length(message->data,
+                                              &session->endpoint)) {
+        break;
+      }
+      session->rx_frame_length =
+        get_total_length_from_header(message, &session->endpoint);
+      if (session->rx_frame_length > get_message_capacity(message)) {
+        OC_ERR("total receive length(%ld) is bigger than max pdu size(%ld)",
+               session->rx_frame_length, get_message_capacity(message));
+        close_session(session);
+        return SESSION_CLOSED;
+      }
+      OC_DBG("tcp packet total length : %ld bytes.", session->rx_frame_length);
+    }
+    if (message->length < session->rx_frame_length) {
+      break;
+    }
+
+    oc_message_t *next = NULL;
+    size_t excess = message->length - session->rx_frame_length;
+    if (excess > 0) {
+      next = allocate_receive_buffer(session);
+      if (!next) {
+        return SESSION_NO_BUFFER;
+      }
+      memcpy(next->data, message->data + session->rx_frame_length, excess);
+      next->length = excess;
+    }
+
+    message->length = session->rx_frame_length;
+    memcpy(&message->endpoint, &session->endpoint, sizeof(oc_endpoint_t));
+    message->next = NULL;
+    **frames = message;
+    *frames = &message->next;
+
+    message = session->rx_message = next;
+    session->rx_frame_length = 0;
+  }
+  return SESSION_RECEIVED;
+}
+
+/* Reads what the session socket has without blocking and appends the frames
+ * it completes to the frames list. A peer that sends a partial frame only
+ * leaves it buffered in the session, so it never holds up other sessions.
+ */
+static session_read_status_t
+receive_session_data(tcp_session_t *session, oc_message_t ***frames)
+{
+  session_read_status_t ret = split_session_frames(session, frames);
+  if (ret != SESSION_RECEIVED) {
+    return ret;
+  }
+
+  if (!session->rx_message) {
+    session->rx_message = allocate_receive_buffer(session);
+    if (!session->rx_message) {
+      return SESSION_NO_BUFFER;
+    }
+    session->rx_frame_length = 0;
+  }
+
+  oc_message_t *message = session->rx_message;
+  ssize_t count =
+    recv(session->sock, message->data + message->length,
+         get_message_capacity(message) - message->length, MSG_DONTWAIT);
+  if (count < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      /* Idle sessions do not hold on to a buffer */
+      if (message->length == 0) {
+        oc_message_unref(message);
+        session->rx_message = NULL;
+      }
+      return SESSION_DRAINED;
+    }
+    OC_ERR("recv error! %d", errno);
+    close_session(session);
+    return SESSION_CLOSED;
+  } else if (count == 0) {
+    OC_DBG("peer closed TCP session\n");
+    close_session(session);
+    return SESSION_CLOSED;
+  }
+
+  OC_DBG("recv(): %d bytes.", (int)count);
+  message->length += (size_t)count;
+  session->last_active = session_clock();
+
+  return split_session_frames(session, frames);
+}
+
+static void
+receive_stalled_sessions(ip_context_t *dev, oc_message_t ***frames)
+{
+  tcp_session_t *session = (tcp_session_t *)oc_list_head(session_list), *next;
+  while (session != NULL) {
+    next = session->next;
+    if (session->dev == dev && session->rx_stalled
+#ifdef OC_EPOLL
+        && !session->closing
+#endif /* OC_EPOLL */
+        ) {
+      session->rx_stalled = false;
+#ifdef OC_EPOLL
+      /* No edge is reported for data that arrived while it waited */
+      while (receive_session_data(session, frames) == SESSION_RECEIVED)
+        ;
+#else  /* OC_EPOLL */
+      FD_SET(session->sock, &dev->rfds);
+      receive_session_data(session, frames);
+#endif /* !OC_EPOLL */
+    }
+    session = next;
+  }
+}
+
+static void
+deliver_frames(oc_message_t *frames)
+{
+  while (frames) {
+    oc_message_t *message = frames;
+    frames = frames->next;
+#ifdef OC_DEBUG
+    PRINT("Incoming message of size %d bytes from ", (int)message->length);
+    PRINTipaddr(message->endpoint);
+    PRINT("\n\n");
+#endif /* OC_DEBUG */
+    oc_network_event(message);
+  }
+}
+
+/* Runs on every expiry of the device's idle timer */
+static void
+close_idle_sessions(ip_context_t *dev)
+{
+  uint64_t expirations;
+  if (read(dev->tcp.idle_timer, &expirations, sizeof(expirations)) < 0) {
+    return;
+  }
+
+  time_t now = session_clock();
+  tcp_session_t *session = (tcp_session_t *)oc_list_head(session_list), *next;
+  while (session != NULL) {
+    next = session->next;
+    if (session->dev == dev &&
+#ifdef OC_EPOLL
+        !session->closing &&
+#endif /* OC_EPOLL */
+        now - session->last_active >= OC_TCP_SESSION_IDLE_TIMEOUT) {
+      OC_DBG("closing idle TCP session");
+      close_session(session);
+    }
+    session = next;
+  }
+}
+
+static int handle_session_writable(tcp_session_t *session);
+
+#ifndef OC_EPOLL
 tcp_receive_state_t
-oc_tcp_receive_message(ip_context_t *dev, fd_set *fds, oc_message_t *message)
+oc_tcp_receive_message(ip_context_t *dev, fd_set *fds)
 {
+  oc_message_t *frames = NULL, **frames_tail = &frames;
+  oc_endpoint_t endpoint;
+  memset(&endpoint, 0, sizeof(oc_endpoint_t));
+  endpoint.device = dev->device;
+
   pthread_mutex_lock(&dev->tcp.mutex);
 
 #define ret_with_code(status)                                                  \
@@ -310,21 +753,18 @@ oc_tcp_receive_message(ip_context_t *dev, fd_set *fds, oc_message_t *message)
   goto oc_tcp_receive_message_done
 
   tcp_receive_state_t ret = TCP_STATUS_ERROR;
-  message->endpoint.device = dev->device;
 
   if (FD_ISSET(dev->tcp.server_sock, fds)) {
-    message->endpoint.flags = IPV6 | TCP;
-    if (accept_new_session(dev, dev->tcp.server_sock, fds, &message->endpoint) <
-        0) {
+    endpoint.flags = IPV6 | TCP;
+    if (accept_new_session(dev, dev->tcp.server_sock, fds, &endpoint) < 0) {
       OC_ERR("accept new session fail");
       ret_with_code(TCP_STATUS_ERROR);
     }
     ret_with_code(TCP_STATUS_ACCEPT);
 #ifdef OC_SECURITY
   } else if (FD_ISSET(dev->tcp.secure_sock, fds)) {
-    message->endpoint.flags = IPV6 | SECURED | TCP;
-    if (accept_new_session(dev, dev->tcp.secure_sock, fds, &message->endpoint) <
-        0) {
+    endpoint.flags = IPV6 | SECURED | TCP;
+    if (accept_new_session(dev, dev->tcp.secure_sock, fds, &endpoint) < 0) {
       OC_ERR("accept new session fail");
       ret_with_code(TCP_STATUS_ERROR);
     }
@@ -332,18 +772,16 @@ oc_tcp_receive_message(ip_context_t *dev, fd_set *fds, oc_message_t *message)
 #endif /* OC_SECURITY */
 #ifdef OC_IPV4
   } else if (FD_ISSET(dev->tcp.server4_sock, fds)) {
-    message->endpoint.flags = IPV4 | TCP;
-    if (accept_new_session(dev, dev->tcp.server4_sock, fds,
-                           &message->endpoint) < 0) {
+    endpoint.flags = IPV4 | TCP;
+    if (accept_new_session(dev, dev->tcp.server4_sock, fds, &endpoint) < 0) {
       OC_ERR("accept new session fail");
       ret_with_code(TCP_STATUS_ERROR);
     }
     ret_with_code(TCP_STATUS_ACCEPT);
 #ifdef OC_SECURITY
   } else if (FD_ISSET(dev->tcp.secure4_sock, fds)) {
-    message->endpoint.flags = IPV4 | SECURED | TCP;
-    if (accept_new_session(dev, dev->tcp.secure4_sock, fds,
-                           &message->endpoint) < 0) {
+    endpoint.flags = IPV4 | SECURED | TCP;
+    if (accept_new_session(dev, dev->tcp.secure4_sock, fds, &endpoint) < 0) {
       OC_ERR("accept new session fail");
       ret_with_code(TCP_STATUS_ERROR);
     }
@@ -351,72 +789,175 @@ oc_tcp_receive_message(ip_context_t *dev, fd_set *fds, oc_message_t *message)
 #endif /* OC_SECURITY */
 #endif /* OC_IPV4 */
   } else if (FD_ISSET(dev->tcp.connect_pipe[0], fds)) {
-    ssize_t len = read(dev->tcp.connect_pipe[0], message->data, OC_PDU_SIZE);
+    uint8_t buf[16];
+    ssize_t len = read(dev->tcp.connect_pipe[0], buf, sizeof(buf));
     if (len < 0) {
       OC_ERR("read error! %d", errno);
       ret_with_code(TCP_STATUS_ERROR);
     }
     FD_CLR(dev->tcp.connect_pipe[0], fds);
+    receive_stalled_sessions(dev, &frames_tail);
+    ret_with_code(TCP_STATUS_NONE);
+  } else if (dev->tcp.idle_timer >= 0 && FD_ISSET(dev->tcp.idle_timer, fds)) {
+    FD_CLR(dev->tcp.idle_timer, fds);
+    close_idle_sessions(dev);
     ret_with_code(TCP_STATUS_NONE);
   }
 
   // find session.
-  tcp_session_t *session = get_ready_to_read_session(fds);
+  tcp_session_t *session = get_ready_session(dev, fds);
   if (!session) {
     OC_DBG("could not find TCP session socket in fd set");
     ret_with_code(TCP_STATUS_NONE);
   }
 
-  // receive message.
-  size_t total_length = 0;
-  size_t want_read = DEFAULT_RECEIVE_SIZE;
-  message->length = 0;
-  do {
-    int count =
-      recv(session->sock, message->data + message->length, want_read, 0);
-    if (count < 0) {
-      OC_ERR("recv error! %d", errno);
-
-      free_tcp_session(session);
-
-      ret_with_code(TCP_STATUS_ERROR);
-    } else if (count == 0) {
-      OC_DBG("peer closed TCP session\n");
+  // receive message. A socket that still has data is reported again by the
+  // next select(), so one read per wakeup keeps sessions taking turns.
+  FD_CLR(session->sock, fds);
+  switch (receive_session_data(session, &frames_tail)) {
+  case SESSION_RECEIVED:
+    ret = TCP_STATUS_RECEIVE;
+    break;
+  case SESSION_CLOSED:
+    ret = TCP_STATUS_ERROR;
+    break;
+  default:
+    ret = TCP_STATUS_NONE;
+    break;
+  }
 
-      free_tcp_session(session);
+oc_tcp_receive_message_done:
+  pthread_mutex_unlock(&dev->tcp.mutex);
+#undef ret_with_code
+  deliver_frames(frames);
+  return ret;
+}
+#else /* !OC_EPOLL */
+int
+oc_tcp_add_event_sources(ip_context_t *dev)
+{
+  int ret = 0;
+
+  /* Listeners and the signal pipe are drained until EAGAIN on every
+   * edge-triggered wakeup, so they must not block.
+   */
+  ret += set_nonblocking(dev->tcp.server_sock);
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_TCP_LISTENER,
+                                dev->tcp.server_sock, IPV6 | TCP);
+#ifdef OC_SECURITY
+  ret += set_nonblocking(dev->tcp.secure_sock);
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_TCP_LISTENER,
+                                dev->tcp.secure_sock, IPV6 | SECURED | TCP);
+#endif /* OC_SECURITY */
 
-      ret_with_code(TCP_STATUS_NONE);
-    }
+#ifdef OC_IPV4
+  ret += set_nonblocking(dev->tcp.server4_sock);
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_TCP_LISTENER,
+                                dev->tcp.server4_sock, IPV4 | TCP);
+#ifdef OC_SECURITY
+  ret += set_nonblocking(dev->tcp.secure4_sock);
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_TCP_LISTENER,
+                                dev->tcp.secure4_sock, IPV4 | SECURED | TCP);
+#endif /* OC_SECURITY */
+#endif /* OC_IPV4 */
 
-    OC_DBG("recv(): %d bytes.", count);
-    message->length += (size_t)count;
-    want_read -= (size_t)count;
+  ret += set_nonblocking(dev->tcp.connect_pipe[0]);
+  ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_TCP_SIGNAL,
+                                dev->tcp.connect_pipe[0], 0);
+  if (dev->tcp.idle_timer >= 0) {
+    ret += oc_ip_add_event_source(dev, IP_EVENT_SOURCE_TCP_IDLE_TIMER,
+                                  dev->tcp.idle_timer, 0);
+  }
 
-    if (total_length == 0) {
-      total_length = get_total_length_from_header(message, &session->endpoint);
-      if (total_length >
-          (unsigned)(OC_MAX_APP_DATA_SIZE + COAP_MAX_HEADER_SIZE)) {
-        OC_ERR("total receive length(%ld) is bigger than max pdu size(%ld)",
-               total_length, (OC_MAX_APP_DATA_SIZE + COAP_MAX_HEADER_SIZE));
-        OC_ERR("It may occur buffer overflow.");
-        ret_with_code(TCP_STATUS_ERROR);
-      }
-      OC_DBG("tcp packet total length : %ld bytes.", total_length);
+  return ret;
+}
 
-      want_read = total_length - (size_t)count;
+static void
+receive_session_messages(ip_context_t *dev, tcp_session_t *session)
+{
+  session_read_status_t ret = SESSION_RECEIVED;
+  /* Edge-triggered, so the socket is read until it would block */
+  while (ret == SESSION_RECEIVED && dev->terminate != 1) {
+    oc_message_t *frames = NULL, **frames_tail = &frames;
+    pthread_mutex_lock(&dev->tcp.mutex);
+    if (session->closing) {
+      ret = SESSION_CLOSED;
+    } else {
+      ret = receive_session_data(session, &frames_tail);
     }
-  } while (total_length > message->length);
+    pthread_mutex_unlock(&dev->tcp.mutex);
 
-  memcpy(&message->endpoint, &session->endpoint, sizeof(oc_endpoint_t));
+    deliver_frames(frames);
+  }
+  /* On SESSION_NO_BUFFER the session is picked up again by
+   * receive_stalled_sessions() once a buffer is freed.
+   */
+}
 
-  FD_CLR(session->sock, fds);
-  ret = TCP_STATUS_RECEIVE;
+void
+oc_tcp_handle_event_source(ip_context_t *dev, ip_event_source_t *source)
+{
+  switch (source->type) {
+  case IP_EVENT_SOURCE_TCP_LISTENER: {
+    int ret = 0;
+    while (ret == 0 && dev->terminate != 1) {
+      oc_endpoint_t endpoint;
+      memset(&endpoint, 0, sizeof(oc_endpoint_t));
+      endpoint.device = dev->device;
+      endpoint.flags = source->flags;
+      pthread_mutex_lock(&dev->tcp.mutex);
+      ret = accept_new_session(dev, source->fd, NULL, &endpoint);
+      pthread_mutex_unlock(&dev->tcp.mutex);
+    }
+  } break;
+  case IP_EVENT_SOURCE_TCP_SIGNAL: {
+    uint8_t buf[16];
+    while (read(source->fd, buf, sizeof(buf)) > 0)
+      ;
+    oc_message_t *frames = NULL, **frames_tail = &frames;
+    pthread_mutex_lock(&dev->tcp.mutex);
+    receive_stalled_sessions(dev, &frames_tail);
+    pthread_mutex_unlock(&dev->tcp.mutex);
+    deliver_frames(frames);
+  } break;
+  case IP_EVENT_SOURCE_TCP_IDLE_TIMER:
+    pthread_mutex_lock(&dev->tcp.mutex);
+    close_idle_sessions(dev);
+    pthread_mutex_unlock(&dev->tcp.mutex);
+    break;
+  case IP_EVENT_SOURCE_TCP_SESSION: {
+    tcp_session_t *session = (tcp_session_t *)source->data;
+    pthread_mutex_lock(&dev->tcp.mutex);
+    if (!session->closing &&
+        (session->connecting || oc_list_head(session->tx_queue))) {
+      handle_session_writable(session);
+    }
+    pthread_mutex_unlock(&dev->tcp.mutex);
+    receive_session_messages(dev, session);
+  } break;
+  default:
+    break;
+  }
+}
 
-oc_tcp_receive_message_done:
+void
+oc_tcp_reap_sessions(ip_context_t *dev)
+{
+  pthread_mutex_lock(&dev->tcp.mutex);
+  if (dev->tcp.reap_sessions) {
+    tcp_session_t *session = (tcp_session_t *)oc_list_head(session_list), *next;
+    while (session != NULL) {
+      next = session->next;
+      if (session->dev == dev && session->closing) {
+        free_tcp_session(session);
+      }
+      session = next;
+    }
+    dev->tcp.reap_sessions = false;
+  }
   pthread_mutex_unlock(&dev->tcp.mutex);
-#undef ret_with_code
-  return ret;
 }
+#endif /* OC_EPOLL */
 
 void
 oc_tcp_end_session(ip_context_t *dev, oc_endpoint_t *endpoint)
@@ -424,182 +965,318 @@ oc_tcp_end_session(ip_context_t *dev, oc_endpoint_t *endpoint)
   pthread_mutex_lock(&dev->tcp.mutex);
   tcp_session_t *session = find_session_by_endpoint(endpoint);
   if (session) {
-    free_tcp_session(session);
+    close_session(session);
   }
   pthread_mutex_unlock(&dev->tcp.mutex);
 }
 
-static int
-get_session_socket(oc_endpoint_t *endpoint)
+#ifndef OC_EPOLL
+/* The network thread only selects for writing on sessions that need it */
+static void
+watch_session_writable(tcp_session_t *session, bool watch)
 {
-  int sock = -1;
-  tcp_session_t *session = find_session_by_endpoint(endpoint);
-  if (!session) {
-    return -1;
+  if (watch) {
+    FD_SET(session->sock, &session->dev->tcp.wfds);
+    signal_network_thread(session->dev);
+  } else {
+    FD_CLR(session->sock, &session->dev->tcp.wfds);
   }
-
-  sock = session->sock;
-  return sock;
 }
+#endif /* !OC_EPOLL */
 
+/* Writes as much of the send queue as the socket takes without blocking.
+ * Returns -1 if the session had to be closed.
+ */
 static int
-connect_nonb(int sockfd, const struct sockaddr *r, int r_len, int nsec)
+flush_session(tcp_session_t *session)
 {
-  int flags, n, error;
-  socklen_t len;
-  fd_set rset, wset;
-  struct timeval tval;
+  struct iovec iov[OC_TCP_SEND_QUEUE_LEN];
+  int iovcnt = 0;
+  oc_message_t *message = (oc_message_t *)oc_list_head(session->tx_queue);
+  size_t offset = session->tx_offset;
+  while (message != NULL && iovcnt < OC_TCP_SEND_QUEUE_LEN) {
+    iov[iovcnt].iov_base = message->data + offset;
+    iov[iovcnt].iov_len = message->length - offset;
+    iovcnt++;
+    offset = 0;
+    message = message->next;
+  }
+  if (iovcnt == 0) {
+    return 0;
+  }
 
-  flags = fcntl(sockfd, F_GETFL, 0);
-  if (flags < 0) {
+  /* sendmsg() is writev() with flags, so a reset peer cannot raise SIGPIPE */
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = (size_t)iovcnt;
+  ssize_t sent = sendmsg(session->sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (sent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return 0;
+    }
+    OC_WRN("sendmsg() returned errno %d", errno);
+    close_session(session);
     return -1;
   }
+  OC_DBG("Sent %d queued bytes", (int)sent);
+  if (sent > 0) {
+    session->last_active = session_clock();
+  }
 
-  error = fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
-  if (error < 0) {
-    return -1;
+  size_t remaining = (size_t)sent;
+  while ((message = (oc_message_t *)oc_list_head(session->tx_queue)) != NULL) {
+    size_t pending = message->length - session->tx_offset;
+    if (remaining < pending) {
+      session->tx_offset += remaining;
+      break;
+    }
+    remaining -= pending;
+    session->tx_offset = 0;
+    oc_list_pop(session->tx_queue);
+    oc_message_unref(message);
   }
 
-  error = 0;
-  if ((n = connect(sockfd, (struct sockaddr *)r, r_len)) < 0) {
-    if (errno != EINPROGRESS)
-      return -1;
+#ifndef OC_EPOLL
+  if (!oc_list_head(session->tx_queue)) {
+    watch_session_writable(session, false);
   }
+#endif /* !OC_EPOLL */
+  return 0;
+}
 
-  /* Do whatever we want while the connect is taking place. */
-  if (n == 0) {
-    goto done; /* connect completed immediately */
+/* Appends data to the send queue, filling up the last buffer first. Returns
+ * false when the queue is at its high-water mark or out of buffers.
+ */
+static bool
+queue_session_data(tcp_session_t *session, const uint8_t *data, size_t len)
+{
+  oc_message_t *tail = (oc_message_t *)oc_list_tail(session->tx_queue);
+  size_t space = 0;
+  int num_buffers = oc_list_length(session->tx_queue);
+  if (tail) {
+    space = get_message_capacity(tail) - tail->length;
+  }
+  if (len > space) {
+    size_t buffer_size = (size_t)OC_PDU_SIZE;
+    size_t needed = (len - space + buffer_size - 1) / buffer_size;
+    if (num_buffers + (int)needed > OC_TCP_SEND_QUEUE_LEN) {
+      return false;
+    }
   }
 
-  FD_ZERO(&rset);
-  FD_SET(sockfd, &rset);
-  wset = rset;
-  tval.tv_sec = nsec;
-  tval.tv_usec = 0;
+  bool was_empty = (num_buffers == 0);
+  while (len > 0) {
+    if (!tail || tail->length == get_message_capacity(tail)) {
+      tail = oc_allocate_message_from_pool(&tcp_send_buffers_s);
+      if (!tail) {
+        return false;
+      }
+      oc_list_add(session->tx_queue, tail);
+    }
+    size_t chunk = get_message_capacity(tail) - tail->length;
+    if (chunk > len) {
+      chunk = len;
+    }
+    memcpy(tail->data + tail->length, data, chunk);
+    tail->length += chunk;
+    data += chunk;
+    len -= chunk;
+  }
 
-  if ((n = select(sockfd + 1, &rset, &wset, NULL, nsec ? &tval : NULL)) == 0) {
-    /* timeout */
-    errno = ETIMEDOUT;
-    return -1;
+#ifndef OC_EPOLL
+  if (was_empty && !session->connecting) {
+    watch_session_writable(session, true);
   }
+#else  /* !OC_EPOLL */
+  (void)was_empty;
+#endif /* OC_EPOLL */
+  return true;
+}
 
-  if (FD_ISSET(sockfd, &rset) || FD_ISSET(sockfd, &wset)) {
-    len = sizeof(error);
-    if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
-      return -1; /* Solaris pending error */
-  } else {
-    OC_DBG("select error: sockfd not set");
-    return -1;
+static int
+send_session_data(tcp_session_t *session, const uint8_t *data, size_t len)
+{
+  size_t sent = 0;
+  if (!session->connecting && !oc_list_head(session->tx_queue)) {
+    ssize_t ret =
+      send(session->sock, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        OC_WRN("send() returned errno %d", errno);
+        close_session(session);
+        return -1;
+      }
+    } else {
+      sent = (size_t)ret;
+      session->last_active = session_clock();
+    }
   }
 
-done:
-  if (error < 0) {
-    close(sockfd); /* just in case */
-    errno = error;
-    return -1;
-  } else {
-    error = fcntl(sockfd, F_SETFL, flags); /* restore file status flags */
-    if (error < 0) {
+  if (sent < len && !queue_session_data(session, data + sent, len - sent)) {
+    if (sent > 0) {
+      /* Part of the message is on the wire, so the stream cannot recover */
+      OC_ERR("could not queue the rest of a TCP message");
+      close_session(session);
       return -1;
     }
+    OC_WRN("TCP send queue is full, refusing message");
+    return -1;
   }
-  return 0;
+
+  OC_DBG("Sent %d bytes, queued %d", (int)sent, (int)(len - sent));
+  return (int)len;
 }
 
+/* Completes a connect started by initiate_new_session() once the socket
+ * turns writable. Returns 1 once connected, 0 while still in progress and -1
+ * if the connect failed and the session was closed.
+ */
 static int
+finish_connect(tcp_session_t *session)
+{
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(session->sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0 ||
+      error != 0) {
+    OC_ERR("could not initiate TCP connection %d", error);
+    close_session(session);
+    return -1;
+  }
+  struct sockaddr_storage peer;
+  len = sizeof(peer);
+  if (getpeername(session->sock, (struct sockaddr *)&peer, &len) < 0) {
+    return 0;
+  }
+
+  OC_DBG("successfully initiated TCP connection");
+  session->connecting = false;
+  session->endpoint.interface_index = get_interface_index(session->sock);
+  if (!(session->endpoint.flags & SECURED)) {
+    oc_session_start_event(&session->endpoint);
+  }
+#ifndef OC_EPOLL
+  if (!oc_list_head(session->tx_queue)) {
+    watch_session_writable(session, false);
+  }
+#endif /* !OC_EPOLL */
+  return 1;
+}
+
+/* Returns -1 if the session was closed */
+static int
+handle_session_writable(tcp_session_t *session)
+{
+  if (session->connecting) {
+    int ret = finish_connect(session);
+    if (ret <= 0) {
+      return ret;
+    }
+  }
+  return flush_session(session);
+}
+
+#ifndef OC_EPOLL
+/* Called once after every select(), before oc_tcp_receive_message() */
+int
+oc_tcp_handle_writable_sessions(ip_context_t *dev, fd_set *rfds, fd_set *wfds)
+{
+  int num_handled = 0, sock;
+  /* A new wakeup, so the scan for readable sessions starts over */
+  dev->tcp.ready_fd = 0;
+  pthread_mutex_lock(&dev->tcp.mutex);
+  for (sock = 0; sock < session_fd_limit; sock++) {
+    tcp_session_t *session = sessions_by_fd[sock];
+    if (!session || session->dev != dev || !FD_ISSET(sock, wfds)) {
+      continue;
+    }
+    FD_CLR(sock, wfds);
+    num_handled++;
+    if (handle_session_writable(session) < 0 && FD_ISSET(sock, rfds)) {
+      /* Freed, so nothing is left to read either */
+      FD_CLR(sock, rfds);
+      num_handled++;
+    }
+  }
+  pthread_mutex_unlock(&dev->tcp.mutex);
+  return num_handled;
+}
+#endif /* !OC_EPOLL */
+
+/* Starts a non-blocking connect. Messages to the session are queued until
+ * the network thread sees it complete.
+ */
+static tcp_session_t *
 initiate_new_session(ip_context_t *dev, oc_endpoint_t *endpoint,
                      const struct sockaddr_storage *receiver)
 {
   int sock = -1;
-  uint8_t retry_cnt = 0;
-
-  while (retry_cnt < LIMIT_RETRY_CONNECT) {
-    if (endpoint->flags & IPV6) {
-      sock = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+  if (endpoint->flags & IPV6) {
+    sock = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
 #ifdef OC_IPV4
-    } else if (endpoint->flags & IPV4) {
-      sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  } else if (endpoint->flags & IPV4) {
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 #endif
-    }
-
-    if (sock < 0) {
-      OC_ERR("could not create socket for new TCP session");
-      return -1;
-    }
+  }
 
-    socklen_t receiver_size = sizeof(*receiver);
-    int ret = 0;
-    if ((ret = connect_nonb(sock, (struct sockaddr *)receiver, receiver_size,
-                            TCP_CONNECT_TIMEOUT)) == 0) {
-      break;
-    }
+  if (sock < 0) {
+    OC_ERR("could not create socket for new TCP session");
+    return NULL;
+  }
 
+  int syn_retries = TCP_CONNECT_SYN_RETRIES;
+  if (set_nonblocking(sock) < 0 ||
+      setsockopt(sock, IPPROTO_TCP, TCP_SYNCNT, &syn_retries,
+                 sizeof(syn_retries)) < 0) {
+    OC_ERR("configuring socket for new TCP session %d", errno);
     close(sock);
-    retry_cnt++;
-    OC_DBG("connect fail with %d. retry(%d)", ret, retry_cnt);
+    return NULL;
   }
 
-  if (retry_cnt >= LIMIT_RETRY_CONNECT) {
-    OC_ERR("could not initiate TCP connection");
-    return -1;
+  if (connect(sock, (struct sockaddr *)receiver, sizeof(*receiver)) < 0 &&
+      errno != EINPROGRESS) {
+    OC_ERR("could not initiate TCP connection %d", errno);
+    close(sock);
+    return NULL;
   }
 
-  OC_DBG("successfully initiated TCP connection");
-
-  if (add_new_session(sock, dev, endpoint) < 0) {
+  tcp_session_t *session = add_new_session(sock, dev, endpoint, true);
+  if (!session) {
     OC_ERR("could not record new TCP session");
     close(sock);
-    return -1;
+    return NULL;
   }
 
+#ifndef OC_EPOLL
   FD_SET(sock, &dev->rfds);
-
-  ssize_t len = 0;
-  do {
-    uint8_t dummy_value = 0xef;
-    len = write(dev->tcp.connect_pipe[1], &dummy_value, 1);
-  } while (len == -1 && errno == EINTR);
+  watch_session_writable(session, true);
 
   OC_DBG("signaled network event thread to monitor the newly added session\n");
+#endif /* !OC_EPOLL */
 
-  return sock;
+  return session;
 }
 
 int
 oc_tcp_send_buffer(ip_context_t *dev, oc_message_t *message,
                    const struct sockaddr_storage *receiver)
 {
+  int ret = -1;
   pthread_mutex_lock(&dev->tcp.mutex);
-  int send_sock = get_session_socket(&message->endpoint);
-
-  size_t bytes_sent = 0;
-  if (send_sock < 0) {
-    if ((send_sock = initiate_new_session(dev, &message->endpoint, receiver)) <
-        0) {
+  tcp_session_t *session = find_session_by_endpoint(&message->endpoint);
+  if (!session) {
+    session = initiate_new_session(dev, &message->endpoint, receiver);
+    if (!session) {
       OC_ERR("could not initiate new TCP session");
       goto oc_tcp_send_buffer_done;
     }
   }
 
-  do {
-    ssize_t send_len = send(send_sock, message->data + bytes_sent,
-                            message->length - bytes_sent, 0);
-    if (send_len < 0) {
-      OC_WRN("send() returned errno %d", errno);
-      goto oc_tcp_send_buffer_done;
-    }
-    bytes_sent += send_len;
-  } while (bytes_sent < message->length);
+  ret = send_session_data(session, message->data, message->length);
 
-  OC_DBG("Sent %d bytes", bytes_sent);
 oc_tcp_send_buffer_done:
   pthread_mutex_unlock(&dev->tcp.mutex);
-
-  if (bytes_sent == 0) {
-    return -1;
-  }
-
-  return bytes_sent;
+  return ret;
 }
 
 #ifdef OC_IPV4
@@ -677,6 +1354,9 @@ oc_tcp_connectivity_init(ip_context_t *dev)
   if (pthread_mutex_init(&dev->tcp.mutex, NULL) != 0) {
     oc_abort("error initializing TCP adapter mutex");
   }
+  dev->tcp.rx_waiting = false;
+  oc_memb_set_buffers_avail_cb(&tcp_receive_buffers_s,
+                               receive_buffers_available);
 
   memset(&dev->tcp.server, 0, sizeof(struct sockaddr_storage));
   struct sockaddr_in6 *l = (struct sockaddr_in6 *)&dev->tcp.server;
@@ -741,6 +1421,29 @@ oc_tcp_connectivity_init(ip_context_t *dev)
     OC_ERR("Could not initialize connection pipe");
   }
 
+  dev->tcp.idle_timer = -1;
+  if (OC_TCP_SESSION_IDLE_TIMEOUT > 0) {
+    struct itimerspec period;
+    memset(&period, 0, sizeof(struct itimerspec));
+    period.it_interval.tv_sec = (OC_TCP_SESSION_IDLE_TIMEOUT + 1) / 2;
+    period.it_value = period.it_interval;
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (timer < 0 || timerfd_settime(timer, 0, &period, NULL) < 0) {
+      OC_ERR("Could not initialize idle TCP session timer %d", errno);
+      if (timer >= 0) {
+        close(timer);
+      }
+    } else {
+      dev->tcp.idle_timer = timer;
+    }
+  }
+
+#ifdef OC_EPOLL
+  dev->tcp.reap_sessions = false;
+#else  /* OC_EPOLL */
+  FD_ZERO(&dev->tcp.wfds);
+#endif /* !OC_EPOLL */
+
   OC_DBG("=======tcp port info.========");
   OC_DBG("  ipv6 port   : %u", dev->tcp.port);
 #ifdef OC_SECURITY
@@ -774,8 +1477,22 @@ oc_tcp_connectivity_shutdown(ip_context_t *dev)
 #endif /* OC_IPV4 */
 #endif /* OC_SECURITY */
 
+  pthread_mutex_lock(&rx_wait_mutex);
+  ip_context_t **waiting = &rx_waiting_devs;
+  while (*waiting && *waiting != dev) {
+    waiting = &(*waiting)->tcp.rx_waiting_next;
+  }
+  if (*waiting) {
+    *waiting = dev->tcp.rx_waiting_next;
+  }
+  dev->tcp.rx_waiting = false;
+  pthread_mutex_unlock(&rx_wait_mutex);
+
   close(dev->tcp.connect_pipe[0]);
   close(dev->tcp.connect_pipe[1]);
+  if (dev->tcp.idle_timer >= 0) {
+    close(dev->tcp.idle_timer);
+  }
 
   tcp_session_t *session = (tcp_session_t *)oc_list_head(session_list), *next;
   while (session != NULL) {
@@ -38,12 +38,22 @@ void oc_tcp_connectivity_shutdown(ip_context_t *dev);
 int oc_tcp_send_buffer(ip_context_t *dev, oc_message_t *message,
                        const struct sockaddr_storage *receiver);
 
+#ifdef OC_EPOLL
+int oc_tcp_add_event_sources(ip_context_t *dev);
+
+void oc_tcp_handle_event_source(ip_context_t *dev, ip_event_source_t *source);
+
+void oc_tcp_reap_sessions(ip_context_t *dev);
+#else /* OC_EPOLL */
 void oc_tcp_add_socks_to_fd_set(ip_context_t *dev);
 
+int oc_tcp_handle_writable_sessions(ip_context_t *dev, fd_set *rfds,
+                                    fd_set *wfds);
+#endif /* !OC_EPOLL */
+
 void oc_tcp_set_session_fds(fd_set *fds);
 
-tcp_receive_state_t oc_tcp_receive_message(ip_context_t *dev, fd_set *fds,
-                                           oc_message_t *message);
+tcp_receive_state_t oc_tcp_receive_message(ip_context_t *dev, fd_set *fds);
 
 void oc_tcp_end_session(ip_context_t *dev, oc_endpoint_t *endpoint);
 
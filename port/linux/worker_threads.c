@@ -0,0 +1,97 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifdef OC_WORKER_THREADS
+
+#include "port/oc_worker_threads.h"
+#include "port/oc_log.h"
+#include "config.h"
+#include <pthread.h>
+
+static pthread_t threads[OC_WORKER_POOL_SIZE];
+static int num_started;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static void (*thread_run)(void);
+
+static void *
+worker_thread(void *data)
+{
+  (void)data;
+  thread_run();
+  return NULL;
+}
+
+bool
+oc_worker_threads_start(int num_threads, void (*run)(void))
+{
+  if (num_threads > OC_WORKER_POOL_SIZE) {
+    num_threads = OC_WORKER_POOL_SIZE;
+  }
+  thread_run = run;
+  for (num_started = 0; num_started < num_threads; num_started++) {
+    if (pthread_create(&threads[num_started], NULL, worker_thread, NULL) !=
+        0) {
+      OC_ERR("could not start worker thread %d", num_started);
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+oc_worker_threads_join(void)
+{
+  int i;
+  for (i = 0; i < num_started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  num_started = 0;
+}
+
+void
+oc_worker_threads_lock(void)
+{
+  pthread_mutex_lock(&mutex);
+}
+
+void
+oc_worker_threads_unlock(void)
+{
+  pthread_mutex_unlock(&mutex);
+}
+
+void
+oc_worker_threads_wait(void)
+{
+  pthread_cond_wait(&cond, &mutex);
+}
+
+void
+oc_worker_threads_signal(void)
+{
+  pthread_cond_signal(&cond);
+}
+
+void
+oc_worker_threads_broadcast(void)
+{
+  pthread_cond_broadcast(&cond);
+}
+
+#endif /* OC_WORKER_THREADS */
@@ -89,16 +89,30 @@ struct oc_message_s
   uint8_t ref_count;
 #ifdef OC_DYNAMIC_ALLOCATION
   uint8_t *data;
+  size_t data_size;
 #else  /* OC_DYNAMIC_ALLOCATION */
   uint8_t data[OC_PDU_SIZE];
 #endif /* OC_DYNAMIC_ALLOCATION */
 #ifdef OC_TCP
   size_t read_offset;
+  bool close_session; /* end the session once the message is sent */
 #endif /* OC_TCP */
 };
 
 int oc_send_buffer(oc_message_t *message);
 
+#ifdef OC_SEND_BATCH_SIZE
+/* Ports that can hand several datagrams to the network in one call define
+ * OC_SEND_BATCH_SIZE in config.h and implement oc_send_buffers(). The stack
+ * then drains its outbound queue in batches of up to OC_SEND_BATCH_SIZE
+ * unicast messages. Returns the number of messages, from the start of the
+ * array, that the port is done with. Messages past that count could not be
+ * sent because the network would block; the stack keeps them queued and
+ * offers them again later.
+ */
+int oc_send_buffers(oc_message_t **messages, int num_messages);
+#endif /* OC_SEND_BATCH_SIZE */
+
 int oc_connectivity_init(int device);
 
 void oc_connectivity_shutdown(int device);
@@ -0,0 +1,52 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifndef OC_WORKER_THREADS_H
+#define OC_WORKER_THREADS_H
+
+#include <stdbool.h>
+
+/**
+  @brief Starts the threads that run resource handlers with
+    OC_WORKER_THREADS, along with the lock and condition they share.
+  @param num_threads Number of threads to start.
+  @param run Function each thread executes until it returns.
+  @return true if all threads were started.
+*/
+bool oc_worker_threads_start(int num_threads, void (*run)(void));
+
+/**
+  @brief Waits for all threads to return from run() and releases them.
+*/
+void oc_worker_threads_join(void);
+
+void oc_worker_threads_lock(void);
+
+void oc_worker_threads_unlock(void);
+
+/**
+  @brief Called with the lock held; releases it until another thread calls
+    oc_worker_threads_signal() or oc_worker_threads_broadcast().
+*/
+void oc_worker_threads_wait(void);
+
+void oc_worker_threads_signal(void);
+
+void oc_worker_threads_broadcast(void);
+
+#endif /* OC_WORKER_THREADS_H */
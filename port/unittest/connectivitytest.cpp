@@ -20,11 +20,24 @@
 
 #include <cstdlib>
 #include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 extern "C" {
     #include "port/oc_connectivity.h"
     #include "oc_network_monitor.h"
+    #include "oc_buffer.h"
+    #include "oc_endpoint.h"
+    #include "oc_network_events.h"
+    #include "util/oc_etimer.h"
+    #include "util/oc_process.h"
 }
 
 static const int device = 0;
@@ -132,3 +145,250 @@ TEST_F(TestConnectivity, handle_session_event_callback)
     handle_session_event_callback(&ep, OC_SESSION_CONNECTED);
     EXPECT_EQ(true, is_callback_received);
 }
+
+static std::atomic<int> buffers_freed(0);
+
+static void
+buffers_avail_handler(int num_free)
+{
+    (void)num_free;
+    buffers_freed++;
+}
+
+static uint16_t
+get_udp_ipv6_port(void)
+{
+    oc_endpoint_t *ep = oc_connectivity_get_endpoints(device);
+    while (ep) {
+        if ((ep->flags & IPV6) &&
+            !(ep->flags & (SECURED | MULTICAST | TCP))) {
+            return ep->addr.ipv6.port;
+        }
+        ep = ep->next;
+    }
+    return 0;
+}
+
+static bool
+wait_for_frees(int expected)
+{
+    for (int i = 0; i < 100 && buffers_freed < expected; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return buffers_freed >= expected;
+}
+
+TEST_F(TestConnectivity, ReceiveTakesOneBufferPerDatagram_P)
+{
+    uint16_t port = get_udp_ipv6_port();
+    ASSERT_NE(0, port);
+
+    buffers_freed = 0;
+    oc_set_buffers_avail_cb(buffers_avail_handler);
+
+    int sock = socket(AF_INET6, SOCK_DGRAM, 0);
+    ASSERT_LE(0, sock);
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    addr.sin6_port = htons(port);
+
+    /* The network event process is not running, so every datagram that
+     * reaches the stack is released right away. A receive that took more
+     * buffers than there were datagrams waiting frees the extra ones too.
+     */
+    const char payload[] = { 0x40, 0x01, 0x00, 0x01 };
+    for (int i = 1; i <= 3; i++) {
+        ASSERT_EQ((ssize_t)sizeof(payload),
+                  sendto(sock, payload, sizeof(payload), 0,
+                         (struct sockaddr *)&addr, sizeof(addr)));
+        ASSERT_TRUE(wait_for_frees(i));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        EXPECT_EQ(i, buffers_freed);
+    }
+
+    close(sock);
+    oc_set_buffers_avail_cb(NULL);
+}
+
+#if defined(OC_SEND_BATCH_SIZE) && defined(OC_DYNAMIC_ALLOCATION)
+TEST_F(TestConnectivity, SendQueueIsBounded_P)
+{
+    int sock = socket(AF_INET6, SOCK_DGRAM, 0);
+    ASSERT_LE(0, sock);
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    ASSERT_EQ(0, bind(sock, (struct sockaddr *)&addr, sizeof(addr)));
+    socklen_t len = sizeof(addr);
+    ASSERT_EQ(0, getsockname(sock, (struct sockaddr *)&addr, &len));
+
+    oc_process_init();
+    /* Drops the buffer handler's timers when it exits */
+    oc_process_start(&oc_etimer_process, NULL);
+    oc_process_start(&message_buffer_handler, NULL);
+
+    int dropped = 0;
+    for (int i = 0; i < OC_SEND_QUEUE_LEN + 2; i++) {
+        oc_message_t *message = oc_internal_allocate_outgoing_message();
+        ASSERT_TRUE(message != NULL);
+        memset(&message->endpoint, 0, sizeof(oc_endpoint_t));
+        message->endpoint.flags = IPV6;
+        memcpy(message->endpoint.addr.ipv6.address, &in6addr_loopback, 16);
+        message->endpoint.addr.ipv6.port = ntohs(addr.sin6_port);
+        message->data[0] = (uint8_t)i;
+        message->length = 1;
+        oc_send_message(message);
+        if (message->ref_count == 0) {
+            dropped++;
+            oc_message_unref(message);
+        }
+    }
+    EXPECT_EQ(2, dropped);
+
+    while (oc_process_run()) {
+    }
+
+    /* Everything that was queued leaves in order */
+    struct timeval tv = { 1, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int received = 0;
+    uint8_t b;
+    while (received < OC_SEND_QUEUE_LEN &&
+           recv(sock, &b, sizeof(b), 0) == 1) {
+        EXPECT_EQ((uint8_t)received, b);
+        received++;
+    }
+    EXPECT_EQ(OC_SEND_QUEUE_LEN, received);
+
+    oc_process_exit(&message_buffer_handler);
+    oc_process_exit(&oc_etimer_process);
+    close(sock);
+}
+#endif /* OC_SEND_BATCH_SIZE && OC_DYNAMIC_ALLOCATION */
+
+#ifdef OC_TCP
+static uint16_t
+get_tcp_ipv6_port(void)
+{
+    oc_endpoint_t *ep = oc_connectivity_get_endpoints(device);
+    while (ep) {
+        if ((ep->flags & IPV6) && (ep->flags & TCP) &&
+            !(ep->flags & SECURED)) {
+            return ep->addr.ipv6.port;
+        }
+        ep = ep->next;
+    }
+    return 0;
+}
+
+static long
+cpu_time_ms(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+TEST_F(TestConnectivity, StalledTcpSessionWaitsForBuffer_P)
+{
+    uint16_t port = get_tcp_ipv6_port();
+    ASSERT_NE(0, port);
+
+    buffers_freed = 0;
+    oc_set_buffers_avail_cb(buffers_avail_handler);
+    oc_process_init();
+    oc_process_start(&oc_network_events, NULL);
+
+    int sock = socket(AF_INET6, SOCK_STREAM, 0);
+    ASSERT_LE(0, sock);
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    addr.sin6_port = htons(port);
+    ASSERT_EQ(0, connect(sock, (struct sockaddr *)&addr, sizeof(addr)));
+
+    /* The event loop never runs, so the frames it was handed hold on to
+     * every TCP receive buffer and the session has to wait for one.
+     */
+    uint8_t frames[2 * 256];
+    for (size_t i = 0; i < sizeof(frames); i += 2) {
+        frames[i] = 0x00;
+        frames[i + 1] = 0x01;
+    }
+    ASSERT_EQ((ssize_t)sizeof(frames), send(sock, frames, sizeof(frames), 0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    /* A frame too large for any buffer makes the session close, but not
+     * while it waits; neither does waiting keep the network thread busy.
+     */
+    const uint8_t oversized[] = { 0xE0, 0xFF, 0xFF, 0x01 };
+    ASSERT_EQ((ssize_t)sizeof(oversized),
+              send(sock, oversized, sizeof(oversized), 0));
+    long cpu = cpu_time_ms();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_GT(100, cpu_time_ms() - cpu);
+    uint8_t b;
+    EXPECT_EQ(-1, recv(sock, &b, sizeof(b), MSG_DONTWAIT));
+
+    /* TCP sessions do not receive into the buffers UDP uses */
+    EXPECT_EQ(0, buffers_freed);
+
+    /* Releasing the held frames lets the session read on */
+    oc_process_exit(&oc_network_events);
+    struct timeval tv = { 1, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    EXPECT_EQ(0, recv(sock, &b, sizeof(b), 0));
+
+    close(sock);
+    oc_set_buffers_avail_cb(NULL);
+}
+
+#ifdef OC_DYNAMIC_ALLOCATION
+#define NUM_CLIENTS (8)
+#else /* OC_DYNAMIC_ALLOCATION */
+#define NUM_CLIENTS (OC_MAX_TCP_PEERS)
+#endif /* !OC_DYNAMIC_ALLOCATION */
+
+TEST_F(TestConnectivity, EveryReadyTcpSessionIsServed_P)
+{
+    uint16_t port = get_tcp_ipv6_port();
+    ASSERT_NE(0, port);
+
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    addr.sin6_port = htons(port);
+    const uint8_t oversized[] = { 0xE0, 0xFF, 0xFF, 0x01 };
+    struct timeval tv = { 1, 0 };
+
+    /* The second round runs after the first round's sessions are gone */
+    for (int round = 0; round < 2; round++) {
+        int socks[NUM_CLIENTS];
+        for (int i = 0; i < NUM_CLIENTS; i++) {
+            socks[i] = socket(AF_INET6, SOCK_STREAM, 0);
+            ASSERT_LE(0, socks[i]);
+            ASSERT_EQ(0, connect(socks[i], (struct sockaddr *)&addr,
+                                 sizeof(addr)));
+            setsockopt(socks[i], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        /* Ready together, and each has to be read to be closed */
+        for (int i = 0; i < NUM_CLIENTS; i++) {
+            ASSERT_EQ((ssize_t)sizeof(oversized),
+                      send(socks[i], oversized, sizeof(oversized), 0));
+        }
+        for (int i = 0; i < NUM_CLIENTS; i++) {
+            uint8_t b;
+            EXPECT_EQ(0, recv(socks[i], &b, sizeof(b), 0));
+            close(socks[i]);
+        }
+    }
+}
+#endif /* OC_TCP */
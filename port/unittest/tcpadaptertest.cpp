@@ -0,0 +1,207 @@
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+    #include "oc_api.h"
+    #include "oc_endpoint.h"
+}
+
+#ifdef OC_TCP
+
+#define LONG_PATH "abcdefghijkl"
+
+static std::vector<std::string> requests;
+
+static void
+get_handler(oc_request_t *request, oc_interface_mask_t interface,
+            void *user_data)
+{
+    (void)interface;
+    (void)user_data;
+    requests.push_back(oc_string(request->resource->uri));
+    oc_send_response(request, OC_STATUS_OK);
+}
+
+static int
+app_init(void)
+{
+    int ret = oc_init_platform("Samsung", NULL, NULL);
+    ret |= oc_add_device("/oic/d", "oic.d.light", "Lamp", "ocf.1.0.0",
+                         "ocf.res.1.0.0", NULL, NULL);
+    return ret;
+}
+
+static void
+add_resource(const char *uri)
+{
+    oc_resource_t *res = oc_new_resource(NULL, uri, 1, 0);
+    oc_resource_bind_resource_type(res, "oic.r.test");
+    oc_resource_bind_resource_interface(res, OC_IF_RW);
+    oc_resource_set_default_interface(res, OC_IF_RW);
+    oc_resource_set_request_handler(res, OC_GET, get_handler, NULL);
+    oc_add_resource(res);
+}
+
+static void
+register_resources(void)
+{
+    add_resource("/a");
+    add_resource("/" LONG_PATH);
+}
+
+static void
+signal_event_loop(void)
+{
+}
+
+/* GET frame for a path of up to 12 characters with a one byte token; paths
+ * of 12 characters take the one byte extended length
+ */
+static std::vector<uint8_t>
+get_frame(const std::string &path, uint8_t token)
+{
+    std::vector<uint8_t> options;
+    options.push_back((uint8_t)(0xB0 | path.size()));
+    options.insert(options.end(), path.begin(), path.end());
+
+    std::vector<uint8_t> frame;
+    if (options.size() < 13) {
+        frame.push_back((uint8_t)((options.size() << 4) | 1));
+    } else {
+        frame.push_back((uint8_t)((13 << 4) | 1));
+        frame.push_back((uint8_t)(options.size() - 13));
+    }
+    frame.push_back(0x01);
+    frame.push_back(token);
+    frame.insert(frame.end(), options.begin(), options.end());
+    return frame;
+}
+
+/* A loopback client of the stack's TCP endpoint */
+class TestTcpFrames: public testing::Test
+{
+    protected:
+        virtual void SetUp()
+        {
+            static const oc_handler_t handler = {
+                .init = app_init,
+                .signal_event_loop = signal_event_loop,
+                .register_resources = register_resources
+            };
+            requests.clear();
+            ASSERT_EQ(0, oc_main_init(&handler));
+
+            struct sockaddr_in6 addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin6_family = AF_INET6;
+            addr.sin6_addr = in6addr_loopback;
+            oc_endpoint_t *ep = oc_connectivity_get_endpoints(0);
+            while (ep) {
+                if ((ep->flags & IPV6) && (ep->flags & TCP) &&
+                    !(ep->flags & SECURED)) {
+                    addr.sin6_port = htons(ep->addr.ipv6.port);
+                    break;
+                }
+                ep = ep->next;
+            }
+            ASSERT_NE(0, addr.sin6_port);
+            sock = socket(AF_INET6, SOCK_STREAM, 0);
+            ASSERT_LE(0, sock);
+            ASSERT_EQ(0, connect(sock, (struct sockaddr *)&addr,
+                                 sizeof(addr)));
+        }
+
+        virtual void TearDown()
+        {
+            close(sock);
+            oc_main_shutdown();
+        }
+
+        void send_bytes(const std::vector<uint8_t> &bytes, size_t from,
+                        size_t to)
+        {
+            ASSERT_EQ((ssize_t)(to - from),
+                      send(sock, bytes.data() + from, to - from, 0));
+        }
+
+        /* Runs the stack until count requests were handled, and then
+         * for another 100ms to let any surplus ones in
+         */
+        void run_stack(size_t count)
+        {
+            for (int i = 0; i < 200 && requests.size() < count; i++) {
+                oc_main_poll();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            for (int i = 0; i < 20; i++) {
+                oc_main_poll();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+
+        int sock;
+};
+
+TEST_F(TestTcpFrames, PartialHeaderWaitsForRestOfFrame_P)
+{
+    std::vector<uint8_t> frame = get_frame(LONG_PATH, 0x01);
+
+    /* Not even the extended length has arrived */
+    send_bytes(frame, 0, 1);
+    run_stack(1);
+    EXPECT_TRUE(requests.empty());
+
+    send_bytes(frame, 1, 3);
+    run_stack(1);
+    EXPECT_TRUE(requests.empty());
+
+    send_bytes(frame, 3, frame.size());
+    run_stack(1);
+    ASSERT_EQ(1u, requests.size());
+    EXPECT_EQ("/" LONG_PATH, requests[0]);
+}
+
+TEST_F(TestTcpFrames, SeveralFramesInOneRead_P)
+{
+    std::vector<uint8_t> bytes = get_frame("a", 0x01);
+    std::vector<uint8_t> frame = get_frame(LONG_PATH, 0x02);
+    bytes.insert(bytes.end(), frame.begin(), frame.end());
+    frame = get_frame("a", 0x03);
+    bytes.insert(bytes.end(), frame.begin(), frame.end());
+
+    send_bytes(bytes, 0, bytes.size());
+    run_stack(3);
+    ASSERT_EQ(3u, requests.size());
+    EXPECT_EQ("/a", requests[0]);
+    EXPECT_EQ("/" LONG_PATH, requests[1]);
+    EXPECT_EQ("/a", requests[2]);
+}
+
+TEST_F(TestTcpFrames, ExcessBytesStartNextFrame_P)
+{
+    std::vector<uint8_t> bytes = get_frame("a", 0x01);
+    size_t first_len = bytes.size();
+    std::vector<uint8_t> frame = get_frame(LONG_PATH, 0x02);
+    bytes.insert(bytes.end(), frame.begin(), frame.end());
+
+    /* The first frame and the header of the second one */
+    send_bytes(bytes, 0, first_len + 4);
+    run_stack(1);
+    ASSERT_EQ(1u, requests.size());
+    EXPECT_EQ("/a", requests[0]);
+
+    send_bytes(bytes, first_len + 4, bytes.size());
+    run_stack(2);
+    ASSERT_EQ(2u, requests.size());
+    EXPECT_EQ("/" LONG_PATH, requests[1]);
+}
+
+#endif /* OC_TCP */
@@ -252,8 +252,9 @@ oc_obt_load_state(void)
 
   ret = oc_storage_read("obt_state", buf, OC_MAX_APP_DATA_SIZE);
   if (ret > 0) {
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
     oc_rep_set_pool(&rep_objects);
+    size_t rep_arena = oc_rep_arena_begin();
     int err = oc_parse_rep(buf, ret, &rep);
     head = rep;
     if (err == 0) {
@@ -272,6 +273,7 @@ oc_obt_load_state(void)
       }
     }
     oc_free_rep(head);
+    oc_rep_arena_end(rep_arena);
   } else {
     id = 1000;
   }
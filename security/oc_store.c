@@ -61,17 +61,19 @@ oc_sec_load_doxm(int device)
     char rep_objects_alloc[OC_MAX_NUM_REP_OBJECTS];
     oc_rep_t rep_objects_pool[OC_MAX_NUM_REP_OBJECTS];
     memset(rep_objects_alloc, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(char));
-    memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
-                                   rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = OC_MAX_NUM_REP_OBJECTS,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
+    size_t rep_arena = oc_rep_arena_begin();
     oc_parse_rep(buf, (uint16_t)ret, &rep);
     oc_sec_decode_doxm(rep, true, device);
     oc_free_rep(rep);
+    oc_rep_arena_end(rep_arena);
   }
 #ifdef OC_DYNAMIC_ALLOCATION
   oc_mem_free(buf);
@@ -107,17 +109,19 @@ oc_sec_load_pstat(int device)
     char rep_objects_alloc[OC_MAX_NUM_REP_OBJECTS];
     oc_rep_t rep_objects_pool[OC_MAX_NUM_REP_OBJECTS];
     memset(rep_objects_alloc, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(char));
-    memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
-                                   rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = OC_MAX_NUM_REP_OBJECTS,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
+    size_t rep_arena = oc_rep_arena_begin();
     oc_parse_rep(buf, (uint16_t)ret, &rep);
     oc_sec_decode_pstat(rep, true, device);
     oc_free_rep(rep);
+    oc_rep_arena_end(rep_arena);
   }
 
 #ifdef OC_DYNAMIC_ALLOCATION
@@ -152,18 +156,20 @@ oc_sec_load_cred(int device)
     char rep_objects_alloc[OC_MAX_NUM_REP_OBJECTS];
     oc_rep_t rep_objects_pool[OC_MAX_NUM_REP_OBJECTS];
     memset(rep_objects_alloc, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(char));
-    memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
-                                   rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = OC_MAX_NUM_REP_OBJECTS,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
+    size_t rep_arena = oc_rep_arena_begin();
     oc_parse_rep(buf, (uint16_t)ret, &rep);
     oc_sec_decode_cred(rep, NULL, true, device);
     oc_sec_load_certs(device);
     oc_free_rep(rep);
+    oc_rep_arena_end(rep_arena);
   }
 #ifdef OC_DYNAMIC_ALLOCATION
   oc_mem_free(buf);
@@ -194,17 +200,19 @@ oc_sec_load_acl(int device)
     char rep_objects_alloc[OC_MAX_NUM_REP_OBJECTS];
     oc_rep_t rep_objects_pool[OC_MAX_NUM_REP_OBJECTS];
     memset(rep_objects_alloc, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(char));
-    memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
-                                   rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = OC_MAX_NUM_REP_OBJECTS,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
+    size_t rep_arena = oc_rep_arena_begin();
     oc_parse_rep(buf, (uint16_t)ret, &rep);
     oc_sec_decode_acl(rep, true, device);
     oc_free_rep(rep);
+    oc_rep_arena_end(rep_arena);
   }
 #ifdef OC_DYNAMIC_ALLOCATION
   oc_mem_free(buf);
@@ -340,14 +348,15 @@ oc_sec_load_unique_ids(int device)
     char rep_objects_alloc[OC_MAX_NUM_REP_OBJECTS];
     oc_rep_t rep_objects_pool[OC_MAX_NUM_REP_OBJECTS];
     memset(rep_objects_alloc, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(char));
-    memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
-                                   rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = OC_MAX_NUM_REP_OBJECTS,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
+    size_t rep_arena = oc_rep_arena_begin();
     int err = oc_parse_rep(buf, ret, &rep);
     oc_rep_t *p = rep;
     if (err == 0) {
@@ -369,6 +378,7 @@ oc_sec_load_unique_ids(int device)
       }
     }
     oc_free_rep(p);
+    oc_rep_arena_end(rep_arena);
   }
 #ifdef OC_DYNAMIC_ALLOCATION
   oc_mem_free(buf);
@@ -288,8 +288,10 @@ TEST(Security, AclPost)
     oc_rep_t rep_objects_pool[150];
     memset(rep_objects_alloc, 0, 150 * sizeof(char));
     memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                   (void *)rep_objects_pool, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = 150,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
   }
@@ -426,8 +428,10 @@ TEST(Security, DoxmDecode)
     oc_rep_t rep_objects_pool[150];
     memset(rep_objects_alloc, 0, 150 * sizeof(char));
     memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                   (void *)rep_objects_pool, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = 150,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
     EXPECT_FALSE(oc_sec_decode_doxm(rep, false, -1));
@@ -451,8 +455,10 @@ TEST(Security, DoxmPost)
     oc_rep_t rep_objects_pool[150];
     memset(rep_objects_alloc, 0, 150 * sizeof(char));
     memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                   (void *)rep_objects_pool, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = 150,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
   }
@@ -604,8 +610,10 @@ TEST(Security, CredDecode3)
   oc_rep_t rep_objects_pool[150];
   memset(rep_objects_alloc, 0, 150 * sizeof(char));
   memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                 (void *)rep_objects_pool, 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                 .num = 150,
+                                 .count = rep_objects_alloc,
+                                 .mem = (void *)rep_objects_pool };
   oc_rep_set_pool(&rep_objects);
   oc_parse_rep(buf, size, &rep);
   oc_sec_cred_t *owner = NULL;
@@ -637,8 +645,10 @@ TEST(Security, CredDecode2)
   oc_rep_t rep_objects_pool[150];
   memset(rep_objects_alloc, 0, 150 * sizeof(char));
   memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                 (void *)rep_objects_pool, 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                 .num = 150,
+                                 .count = rep_objects_alloc,
+                                 .mem = (void *)rep_objects_pool };
   oc_rep_set_pool(&rep_objects);
   oc_parse_rep(buf, size, &rep);
   oc_sec_cred_t *owner = NULL;
@@ -670,8 +680,10 @@ TEST(Security, CredDecode1)
   oc_rep_t rep_objects_pool[150];
   memset(rep_objects_alloc, 0, 150 * sizeof(char));
   memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                 (void *)rep_objects_pool, 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                 .num = 150,
+                                 .count = rep_objects_alloc,
+                                 .mem = (void *)rep_objects_pool };
   oc_rep_set_pool(&rep_objects);
   oc_parse_rep(buf, size, &rep);
   oc_sec_cred_t *owner = NULL;
@@ -703,8 +715,10 @@ TEST(Security, CredDecode)
   oc_rep_t rep_objects_pool[150];
   memset(rep_objects_alloc, 0, 150 * sizeof(char));
   memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                 (void *)rep_objects_pool, 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                 .num = 150,
+                                 .count = rep_objects_alloc,
+                                 .mem = (void *)rep_objects_pool };
   oc_rep_set_pool(&rep_objects);
   oc_parse_rep(buf, size, &rep);
   oc_sec_cred_t *owner = NULL;
@@ -800,8 +814,10 @@ TEST(Security, CredGet)
     oc_rep_t rep_objects_pool[150];
     memset(rep_objects_alloc, 0, 150 * sizeof(char));
     memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                   (void *)rep_objects_pool, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = 150,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
   }
@@ -983,8 +999,10 @@ TEST(Security, PstatDecode)
   oc_rep_t rep_objects_pool[150];
   memset(rep_objects_alloc, 0, 150 * sizeof(char));
   memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-  struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                 (void *)rep_objects_pool, 0 };
+  struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                 .num = 150,
+                                 .count = rep_objects_alloc,
+                                 .mem = (void *)rep_objects_pool };
   oc_rep_set_pool(&rep_objects);
   oc_parse_rep(buf, size, &rep);
   EXPECT_FALSE(oc_sec_decode_pstat(rep, false, dev));
@@ -1008,8 +1026,10 @@ TEST(Security, PstatSecReset)
     oc_rep_t rep_objects_pool[150];
     memset(rep_objects_alloc, 0, 150 * sizeof(char));
     memset(rep_objects_pool, 0, 150 * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 150, rep_objects_alloc,
-                                   (void *)rep_objects_pool, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = 150,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
     oc_rep_set_pool(&rep_objects);
     oc_parse_rep(buf, (uint16_t)ret, &rep);
   }
@@ -160,6 +160,8 @@ bool oc_find_ping_resource(oc_endpoint_t *endpoint,
 
 /**
   @brief Function for send ping message to remote endpoint.
+  Only the Cloud's keep-alive interval needs this request; to check that the
+  TCP session is alive in between, oc_send_ping() sends a CoAP Ping signal.
   @param endpoint The endpoint of the Cloud.
   @param interval The interval value for keep-alive.
   @param handler To refer to the request sent out on behalf of calling this API.
@@ -106,17 +106,19 @@ st_data_mgr_info_load(void)
     char rep_objects_alloc[OC_MAX_NUM_REP_OBJECTS];
     oc_rep_t rep_objects_pool[OC_MAX_NUM_REP_OBJECTS];
     memset(rep_objects_alloc, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(char));
-    memset(rep_objects_pool, 0, OC_MAX_NUM_REP_OBJECTS * sizeof(oc_rep_t));
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), OC_MAX_NUM_REP_OBJECTS,
-                                   rep_objects_alloc, (void *)rep_objects_pool,
-                                   0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t),
+                                   .num = OC_MAX_NUM_REP_OBJECTS,
+                                   .count = rep_objects_alloc,
+                                   .mem = (void *)rep_objects_pool };
 #else  /* !OC_DYNAMIC_ALLOCATION */
-    struct oc_memb rep_objects = { sizeof(oc_rep_t), 0, 0, 0, 0 };
+    struct oc_memb rep_objects = { .size = sizeof(oc_rep_t) };
 #endif /* OC_DYNAMIC_ALLOCATION */
     oc_rep_set_pool(&rep_objects);
+    size_t rep_arena = oc_rep_arena_begin();
     oc_parse_rep(g_device_def, (uint16_t)g_device_def_len, &rep);
     ret = st_decode_device_data_info(rep);
     oc_free_rep(rep);
+    oc_rep_arena_end(rep_arena);
   } else {
     st_print_log("[ST_DATA_MGR] can't read device info\n");
     return -1;
@@ -314,7 +314,8 @@ static oc_event_callback_retval_t
 coap_receive_handler(void *data)
 {
     oc_message_t *message = (oc_message_t *)data;
-    coap_receive(message);
+    coap_receive_ctx_t ctx;
+    coap_receive(&ctx, message);
     oc_message_unref(message);
     return OC_EVENT_DONE;
 }
@@ -37,37 +37,139 @@
 #include "oc_etimer.h"
 #include "oc_process.h"
 
+/* Pending timers are kept in a pairing heap ordered by expiration time,
+   so that the next timer to expire is always at the root. Timers are
+   linked to their first child through child, to their next sibling
+   through next, and to their left sibling (or parent, for a first
+   child) through prev. */
 static struct oc_etimer *timerlist;
 static oc_clock_time_t next_expiration;
 
 OC_PROCESS(oc_etimer_process, "Event timer");
+
+/* Compares expiration times modulo clock wraparound */
+#define TIMER_BEFORE(a, b)                                                     \
+  ((oc_clock_time_t)(oc_etimer_expiration_time(a) -                            \
+                     oc_etimer_expiration_time(b)) >                           \
+   ((oc_clock_time_t)~(oc_clock_time_t)0 >> 1))
 /*---------------------------------------------------------------------------*/
-static void
-update_time(void)
+static struct oc_etimer *
+meld(struct oc_etimer *a, struct oc_etimer *b)
 {
-  oc_clock_time_t tdist;
-  oc_clock_time_t now;
   struct oc_etimer *t;
 
+  if (TIMER_BEFORE(b, a)) {
+    t = a;
+    a = b;
+    b = t;
+  }
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL) {
+    a->child->prev = b;
+  }
+  a->child = b;
+  return a;
+}
+/*---------------------------------------------------------------------------*/
+static struct oc_etimer *
+merge_pairs(struct oc_etimer *first)
+{
+  struct oc_etimer *pairs = NULL, *a, *b, *root = NULL;
+
+  /* Meld siblings pairwise from left to right, stacking up the results */
+  while (first != NULL) {
+    a = first;
+    b = a->next;
+    first = (b != NULL) ? b->next : NULL;
+    a->next = a->prev = NULL;
+    if (b != NULL) {
+      b->next = b->prev = NULL;
+      a = meld(a, b);
+    }
+    a->next = pairs;
+    pairs = a;
+  }
+  /* Then meld the stacked results from right to left */
+  while (pairs != NULL) {
+    a = pairs;
+    pairs = a->next;
+    a->next = NULL;
+    root = (root != NULL) ? meld(root, a) : a;
+  }
+  return root;
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert_timer(struct oc_etimer *t)
+{
+  t->next = t->child = t->prev = NULL;
+  timerlist = (timerlist != NULL) ? meld(timerlist, t) : t;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_timer(struct oc_etimer *t)
+{
+  struct oc_etimer *sub;
+
+  if (t == timerlist) {
+    timerlist = merge_pairs(t->child);
+  } else {
+    if (t->prev->child == t) {
+      t->prev->child = t->next;
+    } else {
+      t->prev->next = t->next;
+    }
+    if (t->next != NULL) {
+      t->next->prev = t->prev;
+    }
+    sub = merge_pairs(t->child);
+    if (sub != NULL) {
+      timerlist = meld(timerlist, sub);
+    }
+  }
+  t->next = t->child = t->prev = NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_time(void)
+{
   if (timerlist == NULL) {
     next_expiration = 0;
   } else {
-    now = oc_clock_time();
-    t = timerlist;
-    /* Must calculate distance to next time into account due to wraps */
-    tdist = t->timer.start + t->timer.interval - now;
-    for (t = t->next; t != NULL; t = t->next) {
-      if (t->timer.start + t->timer.interval - now < tdist) {
-        tdist = t->timer.start + t->timer.interval - now;
-      }
+    next_expiration = oc_etimer_expiration_time(timerlist);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Drops every timer of an exited process, reinserting the others */
+static void
+remove_process_timers(struct oc_process *p)
+{
+  struct oc_etimer *pending = timerlist, *t, *last;
+
+  timerlist = NULL;
+  while (pending != NULL) {
+    t = pending;
+    pending = t->next;
+    if (t->child != NULL) {
+      for (last = t->child; last->next != NULL; last = last->next)
+        ;
+      last->next = pending;
+      pending = t->child;
+    }
+    if (t->p == p) {
+      t->next = t->child = t->prev = NULL;
+      t->p = OC_PROCESS_NONE;
+    } else {
+      insert_timer(t);
     }
-    next_expiration = now + tdist;
   }
+  update_time();
 }
 /*---------------------------------------------------------------------------*/
 OC_PROCESS_THREAD(oc_etimer_process, ev, data)
 {
-  struct oc_etimer *t, *u;
+  struct oc_etimer *t;
 
   OC_PROCESS_BEGIN();
 
@@ -77,53 +179,25 @@ OC_PROCESS_THREAD(oc_etimer_process, ev, data)
     OC_PROCESS_YIELD();
 
     if (ev == OC_PROCESS_EVENT_EXITED) {
-      struct oc_process *p = data;
-
-      while (timerlist != NULL && timerlist->p == p) {
-        timerlist = timerlist->next;
-      }
-
-      if (timerlist != NULL) {
-        t = timerlist;
-        while (t->next != NULL) {
-          if (t->next->p == p) {
-            t->next = t->next->next;
-          } else
-            t = t->next;
-        }
-      }
+      remove_process_timers(data);
       continue;
     } else if (ev != OC_PROCESS_EVENT_POLL) {
       continue;
     }
 
-  again:
-
-    u = NULL;
-
-    for (t = timerlist; t != NULL; t = t->next) {
-      if (oc_timer_expired(&t->timer)) {
-        if (oc_process_post(t->p, OC_PROCESS_EVENT_TIMER, t) ==
-            OC_PROCESS_ERR_OK) {
-
-          /* Reset the process ID of the event timer, to signal that the
-             etimer has expired. This is later checked in the
-             oc_etimer_expired() function. */
-          t->p = OC_PROCESS_NONE;
-          if (u != NULL) {
-            u->next = t->next;
-          } else {
-            timerlist = t->next;
-          }
-          t->next = NULL;
-          update_time();
-          goto again;
-        } else {
-          oc_etimer_request_poll();
-        }
+    while ((t = timerlist) != NULL && oc_timer_expired(&t->timer)) {
+      if (oc_process_post(t->p, OC_PROCESS_EVENT_TIMER, t) !=
+          OC_PROCESS_ERR_OK) {
+        oc_etimer_request_poll();
+        break;
       }
-      u = t;
+      /* Reset the process ID of the event timer, to signal that the
+         etimer has expired. This is later checked in the
+         oc_etimer_expired() function. */
+      remove_timer(t);
+      t->p = OC_PROCESS_NONE;
     }
+    update_time();
   }
 
   OC_PROCESS_END();
@@ -139,25 +213,16 @@ oc_etimer_request_poll(void)
 static void
 add_timer(struct oc_etimer *timer)
 {
-  struct oc_etimer *t;
-
   oc_etimer_request_poll();
 
+  /* A timer still owned by a process is already in the heap; its
+     expiration time may have changed, so it is reinserted. */
   if (timer->p != OC_PROCESS_NONE) {
-    for (t = timerlist; t != NULL; t = t->next) {
-      if (t == timer) {
-        /* Timer already on list, bail out. */
-        timer->p = OC_PROCESS_CURRENT();
-        update_time();
-        return;
-      }
-    }
+    remove_timer(timer);
   }
 
-  /* Timer not on list. */
   timer->p = OC_PROCESS_CURRENT();
-  timer->next = timerlist;
-  timerlist = timer;
+  insert_timer(timer);
 
   update_time();
 }
@@ -195,7 +260,13 @@ oc_etimer_restart(struct oc_etimer *et)
 void
 oc_etimer_adjust(struct oc_etimer *et, int timediff)
 {
-  et->timer.start += timediff;
+  if (et->p != OC_PROCESS_NONE) {
+    remove_timer(et);
+    et->timer.start += timediff;
+    insert_timer(et);
+  } else {
+    et->timer.start += timediff;
+  }
   update_time();
 }
 /*---------------------------------------------------------------------------*/
@@ -232,30 +303,11 @@ oc_etimer_next_expiration_time(void)
 void
 oc_etimer_stop(struct oc_etimer *et)
 {
-  struct oc_etimer *t;
-
-  /* First check if et is the first event timer on the list. */
-  if (et == timerlist) {
-    timerlist = timerlist->next;
+  if (et->p != OC_PROCESS_NONE) {
+    remove_timer(et);
     update_time();
-  } else {
-    /* Else walk through the list and try to find the item before the
-       et timer. */
-    for (t = timerlist; t != NULL && t->next != et; t = t->next)
-      ;
-
-    if (t != NULL) {
-      /* We've found the item before the event timer that we are about
-   to remove. We point the items next pointer to the event after
-   the removed item. */
-      t->next = et->next;
-
-      update_time();
-    }
   }
 
-  /* Remove the next pointer from the item to be removed. */
-  et->next = NULL;
   /* Set the timer as expired */
   et->p = OC_PROCESS_NONE;
 }
@@ -69,6 +69,8 @@ struct oc_etimer
 {
   struct oc_timer timer;
   struct oc_etimer *next;
+  struct oc_etimer *child;
+  struct oc_etimer *prev;
   struct oc_process *p;
 };
 
@@ -0,0 +1,154 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "oc_hash.h"
+#include <string.h>
+
+#ifdef OC_DYNAMIC_ALLOCATION
+#include "oc_mem.h"
+
+#define OC_HASH_MAX_SIZE (0x8000)
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+static uint16_t
+bucket_of(const struct oc_hash *hash, uint32_t key)
+{
+  key ^= key >> 16;
+  return (uint16_t)(key & (hash->size - 1));
+}
+
+static void
+append(oc_hash_link_t **bucket, oc_hash_link_t *link)
+{
+  while (*bucket) {
+    bucket = &(*bucket)->next;
+  }
+  link->next = NULL;
+  *bucket = link;
+}
+
+#ifdef OC_DYNAMIC_ALLOCATION
+static void
+grow(struct oc_hash *hash)
+{
+  uint16_t size = hash->size << 1;
+  oc_hash_link_t **buckets =
+    (oc_hash_link_t **)oc_mem_calloc(size, sizeof(oc_hash_link_t *));
+  if (!buckets) {
+    return;
+  }
+  oc_hash_link_t **old = hash->buckets;
+  uint16_t old_size = hash->size;
+  hash->buckets = buckets;
+  hash->size = size;
+  /* Walking each old chain in order keeps equal keys in insertion order */
+  uint16_t i;
+  for (i = 0; i < old_size; i++) {
+    oc_hash_link_t *link = old[i], *next;
+    while (link) {
+      next = link->next;
+      append(&buckets[bucket_of(hash, link->key)], link);
+      link = next;
+    }
+  }
+  if (old != hash->initial) {
+    oc_mem_free(old);
+  }
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+void
+oc_hash_init(struct oc_hash *hash)
+{
+#ifdef OC_DYNAMIC_ALLOCATION
+  if (hash->buckets != hash->initial) {
+    oc_mem_free(hash->buckets);
+    hash->buckets = hash->initial;
+    hash->size = hash->initial_size;
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+  memset(hash->buckets, 0, hash->size * sizeof(oc_hash_link_t *));
+  hash->count = 0;
+}
+
+void
+oc_hash_add(struct oc_hash *hash, oc_hash_link_t *link, uint32_t key)
+{
+#ifdef OC_DYNAMIC_ALLOCATION
+  if (hash->count >= 2 * hash->size && hash->size < OC_HASH_MAX_SIZE) {
+    grow(hash);
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+  link->key = key;
+  append(&hash->buckets[bucket_of(hash, key)], link);
+  hash->count++;
+}
+
+void
+oc_hash_remove(struct oc_hash *hash, oc_hash_link_t *link)
+{
+  oc_hash_link_t **bucket = &hash->buckets[bucket_of(hash, link->key)];
+  while (*bucket) {
+    if (*bucket == link) {
+      *bucket = link->next;
+      link->next = NULL;
+      hash->count--;
+      return;
+    }
+    bucket = &(*bucket)->next;
+  }
+}
+
+void
+oc_hash_rekey(struct oc_hash *hash, oc_hash_link_t *link, uint32_t key)
+{
+  oc_hash_remove(hash, link);
+  oc_hash_add(hash, link, key);
+}
+
+oc_hash_link_t *
+oc_hash_lookup(struct oc_hash *hash, uint32_t key)
+{
+  oc_hash_link_t *link = hash->buckets[bucket_of(hash, key)];
+  while (link && link->key != key) {
+    link = link->next;
+  }
+  return link;
+}
+
+oc_hash_link_t *
+oc_hash_next(oc_hash_link_t *link)
+{
+  uint32_t key = link->key;
+  link = link->next;
+  while (link && link->key != key) {
+    link = link->next;
+  }
+  return link;
+}
+
+uint32_t
+oc_hash_bytes(const uint8_t *data, size_t len)
+{
+  uint32_t h = 2166136261u;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    h = (h ^ data[i]) * 16777619u;
+  }
+  return h;
+}
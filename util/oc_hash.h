@@ -0,0 +1,70 @@
+/****************************************************************************
+ *
+ * Copyright 2018 Samsung Electronics All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+/**
+ * Intrusive hash index over objects that already live in an oc_list.
+ *
+ * An object embeds one oc_hash_link_t per index it takes part in. The
+ * index only stores the link and a 32-bit key; lookups return the first
+ * link with a matching key and oc_hash_next() walks the remaining ones,
+ * so callers still compare the full key (e.g. token bytes) themselves.
+ * Entries with equal keys are kept in insertion order.
+ *
+ * Indexes are declared with OC_HASH(). The bucket array starts out as a
+ * static array of the given power-of-two size; with dynamic allocation it
+ * is doubled on the heap once the average chain exceeds two entries.
+ */
+
+#ifndef OC_HASH_H
+#define OC_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct oc_hash_link_s
+{
+  struct oc_hash_link_s *next;
+  uint32_t key;
+} oc_hash_link_t;
+
+struct oc_hash
+{
+  oc_hash_link_t **buckets;
+  oc_hash_link_t **initial;
+  uint16_t size;
+  uint16_t initial_size;
+  uint16_t count;
+};
+
+#define OC_HASH(name, size)                                                    \
+  static oc_hash_link_t *name##_buckets[size];                                 \
+  static struct oc_hash name = { name##_buckets, name##_buckets, size, size,   \
+                                 0 }
+
+#define oc_hash_entry(link, type, member)                                      \
+  ((type *)((char *)(link)-offsetof(type, member)))
+
+void oc_hash_init(struct oc_hash *hash);
+void oc_hash_add(struct oc_hash *hash, oc_hash_link_t *link, uint32_t key);
+void oc_hash_remove(struct oc_hash *hash, oc_hash_link_t *link);
+void oc_hash_rekey(struct oc_hash *hash, oc_hash_link_t *link, uint32_t key);
+oc_hash_link_t *oc_hash_lookup(struct oc_hash *hash, uint32_t key);
+oc_hash_link_t *oc_hash_next(oc_hash_link_t *link);
+uint32_t oc_hash_bytes(const uint8_t *data, size_t len);
+
+#endif /* OC_HASH_H */
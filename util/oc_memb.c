@@ -44,16 +44,46 @@
 void
 oc_memb_init(struct oc_memb *m)
 {
+#ifndef OC_DYNAMIC_ALLOCATION
   if (m->num > 0) {
     memset(m->count, 0, m->num);
-#ifndef OC_DYNAMIC_ALLOCATION
     memset(m->mem, 0, (unsigned)m->size * (unsigned)m->num);
-#else  /* !OC_DYNAMIC_ALLOCATION */
-    memset(m->mem, 0, (unsigned)m->num * sizeof(char *));
-#endif /* OC_DYNAMIC_ALLOCATION */
   }
+#endif /* !OC_DYNAMIC_ALLOCATION */
+  m->free_list = NULL;
+  m->next_unused = 0;
+  m->num_used = 0;
 }
 /*---------------------------------------------------------------------------*/
+#ifndef OC_DYNAMIC_ALLOCATION
+/* Returns the index of a free block in constant time. Freed blocks are
+ * reused most recently freed first; blocks that were never handed out
+ * are taken in order. Blocks too small to hold the free list link are
+ * looked up in the count array instead.
+ */
+static int
+get_free_block(struct oc_memb *m)
+{
+  int i;
+  if (m->free_list) {
+    char *block = (char *)m->free_list;
+    memcpy(&m->free_list, block, sizeof(void *));
+    return (int)((block - (char *)m->mem) / m->size);
+  }
+  if (m->next_unused < m->num) {
+    return m->next_unused++;
+  }
+  if (m->size < sizeof(void *)) {
+    for (i = 0; i < m->num; i++) {
+      if (m->count[i] == 0) {
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+#endif /* !OC_DYNAMIC_ALLOCATION */
+/*---------------------------------------------------------------------------*/
 void *
 _oc_memb_alloc(
 #ifdef OC_MEMORY_TRACE
@@ -66,28 +96,26 @@ _oc_memb_alloc(
     return NULL;
   }
 
-  int i = m->num;
   void *ptr = NULL;
   if (m->num > 0) {
-    for (i = 0; i < m->num; i++) {
-      if (m->count[i] == 0) {
-        /* If this block was unused, we increase the reference count to
-     indicate that it now is used and return a pointer to the
-     memory block. */
-        ++(m->count[i]);
-        break;
-      }
-    }
-
-    if (i < m->num) {
 #ifdef OC_DYNAMIC_ALLOCATION
+    /* The pool only caps the number of live blocks */
+    if (m->num_used < m->num) {
       ptr = calloc(1, m->size);
-      void *slot = (void *)((char *)m->mem + (i * sizeof(void *)));
-      memcpy(slot, &ptr, sizeof(void *));
+    }
 #else  /* OC_DYNAMIC_ALLOCATION */
+    int i = get_free_block(m);
+    if (i >= 0) {
+      /* If this block was unused, we increase the reference count to
+         indicate that it now is used and return a pointer to the
+         memory block. */
+      ++(m->count[i]);
       ptr = (void *)((char *)m->mem + (i * m->size));
       memset(ptr, 0, m->size);
+    }
 #endif /* !OC_DYNAMIC_ALLOCATION */
+    if (ptr) {
+      m->num_used++;
     }
   }
 #ifdef OC_DYNAMIC_ALLOCATION
@@ -125,37 +153,32 @@ _oc_memb_free(
   oc_mem_trace_add_pace(func, m->size, MEM_TRACE_FREE, ptr);
 #endif
 
-  int i = m->num;
-  char *ptr2 = NULL;
   if (m->num > 0) {
-    /* Walk through the list of blocks and try to find the block to
-       which the pointer "ptr" points to. */
-    ptr2 = (char *)m->mem;
-    for (i = 0; i < m->num; ++i) {
 #ifdef OC_DYNAMIC_ALLOCATION
-      if (memcmp(ptr2, &ptr, sizeof(void *)) == 0) {
+    if (ptr && m->num_used > 0) {
+      m->num_used--;
+    }
 #else  /* OC_DYNAMIC_ALLOCATION */
-      if (ptr2 == (char *)ptr) {
-#endif /* !OC_DYNAMIC_ALLOCATION */
-        /* We've found to block to which "ptr" points so we decrease the
-           reference count and return the new value of it. */
-        if (m->count[i] > 0) {
-          /* Make sure that we don't deallocate free memory. */
-          --(m->count[i]);
+    /* Find the block to which the pointer "ptr" points from its offset
+       in the pool. */
+    if (oc_memb_inmemb(m, ptr) &&
+        ((char *)ptr - (char *)m->mem) % m->size == 0) {
+      int i = (int)(((char *)ptr - (char *)m->mem) / m->size);
+      if (m->count[i] > 0) {
+        /* Make sure that we don't deallocate free memory. */
+        --(m->count[i]);
+        if (m->count[i] == 0) {
+          if (m->size >= sizeof(void *)) {
+            memcpy(ptr, &m->free_list, sizeof(void *));
+            m->free_list = ptr;
+          }
+          m->num_used--;
         }
-        break;
       }
-#ifdef OC_DYNAMIC_ALLOCATION
-      ptr2 += sizeof(void *);
-#else  /* OC_DYNAMIC_ALLOCATION */
-      ptr2 += m->size;
-#endif /* !OC_DYNAMIC_ALLOCATION */
     }
+#endif /* !OC_DYNAMIC_ALLOCATION */
   }
 #ifdef OC_DYNAMIC_ALLOCATION
-  if (i < m->num) {
-    memset(&ptr2, 0, sizeof(void *));
-  }
   free(ptr);
 #endif /* OC_DYNAMIC_ALLOCATION */
   if (m->buffers_avail_cb) {
@@ -173,16 +196,7 @@ int oc_memb_inmemb(struct oc_memb * m, void *ptr)
 int
 oc_memb_numfree(struct oc_memb *m)
 {
-  int i;
-  int num_free = 0;
-
-  for (i = 0; i < m->num; ++i) {
-    if (m->count[i] == 0) {
-      ++num_free;
-    }
-  }
-
-  return num_free;
+  return m->num - m->num_used;
 }
 /*---------------------------------------------------------------------------*/
 void oc_memb_set_buffers_avail_cb(struct oc_memb * m,
@@ -76,26 +76,27 @@
  *
  * \param structure The name of the struct that the memory block holds
  *
- * \param num The total number of memory chunks in the block.
+ * \param num_blocks The total number of memory chunks in the block.
  *
  */
 #ifdef OC_DYNAMIC_ALLOCATION
 #include <stdlib.h>
-#define OC_MEMB(name, structure, num)                                          \
-  static struct oc_memb name = { sizeof(structure), 0, 0, 0, 0 }
-#define OC_MEMB_FIXED(name, structure, num)                                    \
-  static char CC_CONCAT(name, _memb_count)[num];                               \
-  static void *CC_CONCAT(name, _memb_mem)[num];                                \
-  static struct oc_memb name = { sizeof(structure), num,                       \
-                                 CC_CONCAT(name, _memb_count),                 \
-                                 (void *)CC_CONCAT(name, _memb_mem), 0 }
+#define OC_MEMB(name, structure, num_blocks)                                   \
+  static struct oc_memb name = { .size = sizeof(structure) }
+/* Blocks come from the heap; num_blocks only caps how many may be live */
+#define OC_MEMB_FIXED(name, structure, num_blocks)                             \
+  static struct oc_memb name = { .size = sizeof(structure),                    \
+                                 .num = num_blocks }
 #else /* OC_DYNAMIC_ALLOCATION */
-#define OC_MEMB(name, structure, num)                                          \
-  static char CC_CONCAT(name, _memb_count)[num];                               \
-  static structure CC_CONCAT(name, _memb_mem)[num];                            \
-  static struct oc_memb name = { sizeof(structure), num,                       \
-                                 CC_CONCAT(name, _memb_count),                 \
-                                 (void *)CC_CONCAT(name, _memb_mem), 0 }
+#define OC_MEMB(name, structure, num_blocks)                                   \
+  static char CC_CONCAT(name, _memb_count)[num_blocks];                        \
+  static structure CC_CONCAT(name, _memb_mem)[num_blocks];                     \
+  static struct oc_memb name = { .size = sizeof(structure),                    \
+                                 .num = num_blocks,                            \
+                                 .count = CC_CONCAT(name, _memb_count),        \
+                                 .mem = (void *)CC_CONCAT(name, _memb_mem) }
+#define OC_MEMB_FIXED(name, structure, num_blocks)                             \
+  OC_MEMB(name, structure, num_blocks)
 #endif /* !OC_DYNAMIC_ALLOCATION */
 
 typedef void (*oc_memb_buffers_avail_callback_t)(int);
@@ -107,6 +108,13 @@ struct oc_memb
   char *count;
   void *mem;
   oc_memb_buffers_avail_callback_t buffers_avail_cb;
+  /* Allocator state. A zero-initialized pool is ready for use: blocks below
+   * next_unused have been handed out at least once, and freed blocks are
+   * chained through their first bytes on free_list.
+   */
+  void *free_list;
+  unsigned short next_unused;
+  unsigned short num_used;
 };
 
 /**